@@ -0,0 +1,320 @@
+#ifndef __AXHELM_KERNELS
+#define __AXHELM_KERNELS
+
+#include <omp.h>
+
+// Helmholtz operator kernels, one team per element and one thread per (i,j)
+// column of the Nq x Nq x Nq element. The polynomial order is a template
+// parameter so that the register arrays, the team-local arrays and the
+// inner loops are sized at compile time for every order.
+//
+// With Trilinear == false the seven geometric factors of every node are
+// streamed from the precomputed ggeo array. With Trilinear == true they are
+// recomputed from the 8 vertices of the element (EXYZ), trading the largest
+// memory stream of the operator for arithmetic.
+
+#pragma omp declare target
+// Geometric factors of a trilinear hexahedron at the reference point (r,s,t)
+// with quadrature weight W. The vertices are stored x[0:8], y[8:16],
+// z[16:24] in tensor order v = a + 2*b + 4*c, where a, b and c select the
+// -1 or +1 end of r, s and t.
+inline void trilinearGeometricFactors(const dfloat *xyz,
+                                      const dfloat r, const dfloat s, const dfloat t,
+                                      const dfloat W, dfloat *G)
+{
+  dfloat xr = 0, xs = 0, xt = 0;
+  dfloat yr = 0, ys = 0, yt = 0;
+  dfloat zr = 0, zs = 0, zt = 0;
+  for (int v = 0; v < 8; v++) {
+    const dfloat a = (v & 1) ? 1 : -1;
+    const dfloat b = (v & 2) ? 1 : -1;
+    const dfloat c = (v & 4) ? 1 : -1;
+    const dfloat ra = 1 + a * r, sb = 1 + b * s, tc = 1 + c * t;
+    const dfloat Nr = a * sb * tc, Ns = b * ra * tc, Nt = c * ra * sb;
+    xr += Nr * xyz[v];    xs += Ns * xyz[v];    xt += Nt * xyz[v];
+    yr += Nr * xyz[8+v];  ys += Ns * xyz[8+v];  yt += Nt * xyz[8+v];
+    zr += Nr * xyz[16+v]; zs += Ns * xyz[16+v]; zt += Nt * xyz[16+v];
+  }
+  xr *= 0.125; xs *= 0.125; xt *= 0.125;
+  yr *= 0.125; ys *= 0.125; yt *= 0.125;
+  zr *= 0.125; zs *= 0.125; zt *= 0.125;
+
+  const dfloat J = xr * (ys * zt - zs * yt) - yr * (xs * zt - zs * xt) + zr * (xs * yt - ys * xt);
+  const dfloat invJ = 1 / J;
+
+  const dfloat rx =  (ys * zt - zs * yt) * invJ;
+  const dfloat ry = -(xs * zt - zs * xt) * invJ;
+  const dfloat rz =  (xs * yt - ys * xt) * invJ;
+  const dfloat sx = -(yr * zt - zr * yt) * invJ;
+  const dfloat sy =  (xr * zt - zr * xt) * invJ;
+  const dfloat sz = -(xr * yt - yr * xt) * invJ;
+  const dfloat tx =  (yr * zs - zr * ys) * invJ;
+  const dfloat ty = -(xr * zs - zr * xs) * invJ;
+  const dfloat tz =  (xr * ys - yr * xs) * invJ;
+
+  const dfloat JW = J * W;
+  G[p_G00ID] = JW * (rx * rx + ry * ry + rz * rz);
+  G[p_G01ID] = JW * (rx * sx + ry * sy + rz * sz);
+  G[p_G02ID] = JW * (rx * tx + ry * ty + rz * tz);
+  G[p_G11ID] = JW * (sx * sx + sy * sy + sz * sz);
+  G[p_G12ID] = JW * (sx * tx + sy * ty + sz * tz);
+  G[p_G22ID] = JW * (tx * tx + ty * ty + tz * tz);
+  G[p_GWJID] = JW;
+}
+#pragma omp end declare target
+
+// scalar field
+template <int Nq, bool Trilinear>
+void axhelm1(const int Nelements, const int offset,
+             const dfloat *ggeo, const dfloat *EXYZ,
+             const dfloat *gllz, const dfloat *gllw,
+             const dfloat *DrV, const dfloat *lambda,
+             const dfloat *q, dfloat *Aq_d)
+{
+  constexpr int Nq2 = Nq * Nq;
+  constexpr int Np = Nq * Nq * Nq;
+
+#pragma omp target teams num_teams(Nelements) thread_limit(Nq2)
+  {
+    double s_D[Nq2];
+    double s_q[Nq2];
+    double s_Gqr[Nq2];
+    double s_Gqs[Nq2];
+    double s_xyz[24];
+    double s_z[Nq];
+    double s_w[Nq];
+#pragma omp parallel num_threads(Nq2)
+    {
+      double r_qt, r_Gqt, r_Auk;
+      double r_q[Nq];
+      double r_Aq[Nq];
+      double r_G[p_Nggeo];
+      double r_lam0, r_lam1;
+
+      int e = omp_get_team_num();
+      int j = omp_get_thread_num() / Nq;
+      int i = omp_get_thread_num() % Nq;
+
+      s_D[j*Nq+i] = DrV[j*Nq+i];
+      if (Trilinear) {
+        for (int n = j*Nq+i; n < 24; n += Nq2) s_xyz[n] = EXYZ[e*24+n];
+        if (j == 0) {
+          s_z[i] = gllz[i];
+          s_w[i] = gllw[i];
+        }
+#pragma omp barrier
+      }
+      const int base = i + j * Nq + e * Np;
+      for (int k = 0; k < Nq; ++k) {
+        r_q[k] = q[base + k * Nq2];
+        r_Aq[k] = 0;
+      }
+#pragma unroll
+      for (int k = 0; k < Nq; ++k) {
+        const int id = e * Np + k * Nq2 + j * Nq + i;
+        if (Trilinear) {
+          trilinearGeometricFactors(s_xyz, s_z[i], s_z[j], s_z[k],
+                                    s_w[i] * s_w[j] * s_w[k], r_G);
+        } else {
+          const int gbase = e * p_Nggeo * Np + k * Nq2 + j * Nq + i;
+          for (int g = 0; g < p_Nggeo; g++) r_G[g] = ggeo[gbase + g * Np];
+        }
+        r_lam0 = lambda[id + 0 * offset];
+        r_lam1 = lambda[id + 1 * offset];
+#pragma omp barrier
+        s_q[j*Nq+i] = r_q[k];
+        r_qt = 0;
+#pragma unroll
+        for (int m = 0; m < Nq; ++m) {
+          r_qt += s_D[k*Nq+m] * r_q[m];
+        }
+#pragma omp barrier
+        double qr = 0;
+        double qs = 0;
+#pragma unroll
+        for (int m = 0; m < Nq; ++m) {
+          qr += s_D[i*Nq+m] * s_q[j*Nq+m];
+          qs += s_D[j*Nq+m] * s_q[m*Nq+i];
+        }
+        s_Gqs[j*Nq+i] = r_lam0 * (r_G[p_G01ID] * qr + r_G[p_G11ID] * qs + r_G[p_G12ID] * r_qt);
+        s_Gqr[j*Nq+i] = r_lam0 * (r_G[p_G00ID] * qr + r_G[p_G01ID] * qs + r_G[p_G02ID] * r_qt);
+        r_Gqt = r_lam0 * (r_G[p_G02ID] * qr + r_G[p_G12ID] * qs + r_G[p_G22ID] * r_qt);
+        r_Auk = r_G[p_GWJID] * r_lam1 * r_q[k];
+#pragma omp barrier
+#pragma unroll
+        for (int m = 0; m < Nq; ++m) {
+          r_Auk += s_D[m*Nq+j] * s_Gqs[m*Nq+i];
+          r_Aq[m] += s_D[k*Nq+m] * r_Gqt;
+          r_Auk += s_D[m*Nq+i] * s_Gqr[j*Nq+m];
+        }
+        r_Aq[k] += r_Auk;
+#pragma omp barrier
+      }
+#pragma unroll
+      for (int k = 0; k < Nq; ++k) {
+        const int id = e * Np + k * Nq2 + j * Nq + i;
+        Aq_d[id] = r_Aq[k];
+      }
+    }
+  }
+}
+
+// three-component field
+template <int Nq, bool Trilinear>
+void axhelm3(const int Nelements, const int offset,
+             const dfloat *ggeo, const dfloat *EXYZ,
+             const dfloat *gllz, const dfloat *gllw,
+             const dfloat *DrV, const dfloat *lambda,
+             const dfloat *q, dfloat *Aq_d)
+{
+  constexpr int Nq2 = Nq * Nq;
+  constexpr int Np = Nq * Nq * Nq;
+
+#pragma omp target teams num_teams(Nelements) thread_limit(Nq2)
+  {
+    double s_D[Nq2];
+    double s_U[Nq2];
+    double s_V[Nq2];
+    double s_W[Nq2];
+    double s_GUr[Nq2];
+    double s_GUs[Nq2];
+    double s_GVr[Nq2];
+    double s_GVs[Nq2];
+    double s_GWr[Nq2];
+    double s_GWs[Nq2];
+    double s_xyz[24];
+    double s_z[Nq];
+    double s_w[Nq];
+#pragma omp parallel num_threads(Nq2)
+    {
+      double r_Ut, r_Vt, r_Wt;
+      double r_U[Nq], r_V[Nq], r_W[Nq];
+      double r_AU[Nq], r_AV[Nq], r_AW[Nq];
+      double r_G[p_Nggeo];
+      double r_lam0, r_lam1;
+
+      int e = omp_get_team_num();
+      int j = omp_get_thread_num() / Nq;
+      int i = omp_get_thread_num() % Nq;
+
+      s_D[j*Nq+i] = DrV[j*Nq+i];
+      if (Trilinear) {
+        for (int n = j*Nq+i; n < 24; n += Nq2) s_xyz[n] = EXYZ[e*24+n];
+        if (j == 0) {
+          s_z[i] = gllz[i];
+          s_w[i] = gllw[i];
+        }
+#pragma omp barrier
+      }
+      const int base = i + j * Nq + e * Np;
+      for (int k = 0; k < Nq; k++) {
+        r_U[k] = q[base + k * Nq2 + 0 * offset];
+        r_V[k] = q[base + k * Nq2 + 1 * offset];
+        r_W[k] = q[base + k * Nq2 + 2 * offset];
+        r_AU[k] = 0;
+        r_AV[k] = 0;
+        r_AW[k] = 0;
+      }
+#pragma unroll
+      for (int k = 0; k < Nq; ++k) {
+        const int id = e * Np + k * Nq2 + j * Nq + i;
+        if (Trilinear) {
+          trilinearGeometricFactors(s_xyz, s_z[i], s_z[j], s_z[k],
+                                    s_w[i] * s_w[j] * s_w[k], r_G);
+        } else {
+          const int gbase = e * p_Nggeo * Np + k * Nq2 + j * Nq + i;
+          for (int g = 0; g < p_Nggeo; g++) r_G[g] = ggeo[gbase + g * Np];
+        }
+        const double r_G00 = r_G[p_G00ID], r_G01 = r_G[p_G01ID], r_G02 = r_G[p_G02ID];
+        const double r_G11 = r_G[p_G11ID], r_G12 = r_G[p_G12ID], r_G22 = r_G[p_G22ID];
+        const double r_GwJ = r_G[p_GWJID];
+        r_lam0 = lambda[id + 0 * offset];
+        r_lam1 = lambda[id + 1 * offset];
+#pragma omp barrier
+        s_U[j*Nq+i] = r_U[k];
+        s_V[j*Nq+i] = r_V[k];
+        s_W[j*Nq+i] = r_W[k];
+        r_Ut = 0;
+        r_Vt = 0;
+        r_Wt = 0;
+#pragma unroll
+        for (int m = 0; m < Nq; m++) {
+          double Dkm = s_D[k*Nq+m];
+          r_Ut += Dkm * r_U[m];
+          r_Vt += Dkm * r_V[m];
+          r_Wt += Dkm * r_W[m];
+        }
+#pragma omp barrier
+        double Ur = 0, Us = 0;
+        double Vr = 0, Vs = 0;
+        double Wr = 0, Ws = 0;
+#pragma unroll
+        for (int m = 0; m < Nq; m++) {
+          double Dim = s_D[i*Nq+m];
+          double Djm = s_D[j*Nq+m];
+          Ur += Dim * s_U[j*Nq+m];
+          Us += Djm * s_U[m*Nq+i];
+          Vr += Dim * s_V[j*Nq+m];
+          Vs += Djm * s_V[m*Nq+i];
+          Wr += Dim * s_W[j*Nq+m];
+          Ws += Djm * s_W[m*Nq+i];
+        }
+        s_GUr[j*Nq+i] = r_lam0 * (r_G00 * Ur + r_G01 * Us + r_G02 * r_Ut);
+        s_GVr[j*Nq+i] = r_lam0 * (r_G00 * Vr + r_G01 * Vs + r_G02 * r_Vt);
+        s_GWr[j*Nq+i] = r_lam0 * (r_G00 * Wr + r_G01 * Ws + r_G02 * r_Wt);
+        s_GUs[j*Nq+i] = r_lam0 * (r_G01 * Ur + r_G11 * Us + r_G12 * r_Ut);
+        s_GVs[j*Nq+i] = r_lam0 * (r_G01 * Vr + r_G11 * Vs + r_G12 * r_Vt);
+        s_GWs[j*Nq+i] = r_lam0 * (r_G01 * Wr + r_G11 * Ws + r_G12 * r_Wt);
+        r_Ut = r_lam0 * (r_G02 * Ur + r_G12 * Us + r_G22 * r_Ut);
+        r_Vt = r_lam0 * (r_G02 * Vr + r_G12 * Vs + r_G22 * r_Vt);
+        r_Wt = r_lam0 * (r_G02 * Wr + r_G12 * Ws + r_G22 * r_Wt);
+        r_AU[k] += r_GwJ * r_lam1 * r_U[k];
+        r_AV[k] += r_GwJ * r_lam1 * r_V[k];
+        r_AW[k] += r_GwJ * r_lam1 * r_W[k];
+#pragma omp barrier
+        double AUtmp = 0, AVtmp = 0, AWtmp = 0;
+#pragma unroll
+        for (int m = 0; m < Nq; m++) {
+          double Dmi = s_D[m*Nq+i];
+          double Dmj = s_D[m*Nq+j];
+          double Dkm = s_D[k*Nq+m];
+          AUtmp += Dmi * s_GUr[j*Nq+m];
+          AUtmp += Dmj * s_GUs[m*Nq+i];
+          AVtmp += Dmi * s_GVr[j*Nq+m];
+          AVtmp += Dmj * s_GVs[m*Nq+i];
+          AWtmp += Dmi * s_GWr[j*Nq+m];
+          AWtmp += Dmj * s_GWs[m*Nq+i];
+          r_AU[m] += Dkm * r_Ut;
+          r_AV[m] += Dkm * r_Vt;
+          r_AW[m] += Dkm * r_Wt;
+        }
+        r_AU[k] += AUtmp;
+        r_AV[k] += AVtmp;
+        r_AW[k] += AWtmp;
+      }
+#pragma unroll
+      for (int k = 0; k < Nq; k++) {
+        const int id = e * Np + k * Nq2 + j * Nq + i;
+        Aq_d[id + 0 * offset] = r_AU[k];
+        Aq_d[id + 1 * offset] = r_AV[k];
+        Aq_d[id + 2 * offset] = r_AW[k];
+      }
+    }
+  }
+}
+
+// Aq_d = A q for Ndim fields of offset nodes each
+template <int Nq, bool Trilinear>
+void axhelm(const int Ndim, const int Nelements, const int offset,
+            const dfloat *ggeo, const dfloat *EXYZ,
+            const dfloat *gllz, const dfloat *gllw,
+            const dfloat *DrV, const dfloat *lambda,
+            const dfloat *q, dfloat *Aq_d)
+{
+  if (Ndim > 1)
+    axhelm3<Nq, Trilinear>(Nelements, offset, ggeo, EXYZ, gllz, gllw, DrV, lambda, q, Aq_d);
+  else
+    axhelm1<Nq, Trilinear>(Nelements, offset, ggeo, EXYZ, gllz, gllw, DrV, lambda, q, Aq_d);
+}
+
+#endif
@@ -7,7 +7,9 @@
 #include <math.h>
 #include <omp.h>
 
+// default order; orders 1 to MAX_POLYNOMIAL_DEGREE are selected at run time
 #define POLYNOMIAL_DEGREE  7
+#define MAX_POLYNOMIAL_DEGREE 15
 #define p_Nggeo 7
 #define p_G00ID 1
 #define p_G01ID 2
@@ -19,9 +21,12 @@
 
 #include "meshBasis.hpp"
 
-// cpu reference 
+// cpu reference
 #include "axhelmReference.cpp"
 
+// templated device kernels
+#include "axhelmKernels.hpp"
+
 
 dfloat *drandAlloc(int Nelem){
 
@@ -34,33 +39,259 @@ dfloat *drandAlloc(int Nelem){
   return v;
 }
 
-int main(int argc, char **argv){
+// Structured NX x NY x NZ mesh of the unit cube with numElements trilinear
+// hexahedra. The interior vertices are perturbed randomly, so that every
+// element has its own non-affine geometry. Returns the element vertices
+// (see trilinearGeometricFactors for the layout), the global number of each
+// of the Nq^3 nodes of every element and the physical node coordinates.
+static dlong meshBox(const int N, const int numElements,
+                     const dfloat *r, dfloat *EXYZ, dlong *globalIds, dfloat *xyz)
+{
+  int NX = (int)(cbrt((double)numElements) + 0.5);
+  while (numElements % NX) NX--;
+  int NY = (int)(sqrt((double)(numElements / NX)) + 0.5);
+  while ((numElements / NX) % NY) NY--;
+  const int NZ = numElements / (NX * NY);
+
+  // lattice of element vertices
+  const int VX = NX + 1, VY = NY + 1, VZ = NZ + 1;
+  dfloat *V = (dfloat*) malloc(3 * VX * VY * VZ * sizeof(dfloat));
+  const dfloat h[3] = {(dfloat)1 / NX, (dfloat)1 / NY, (dfloat)1 / NZ};
+  for (int c = 0; c < VZ; c++)
+    for (int b = 0; b < VY; b++)
+      for (int a = 0; a < VX; a++) {
+        const int v = a + VX * (b + VY * c);
+        const int l[3] = {a, b, c};
+        const int L[3] = {NX, NY, NZ};
+        for (int d = 0; d < 3; d++) {
+          dfloat x = l[d] * h[d];
+          if (l[d] > 0 && l[d] < L[d]) x += 0.3 * h[d] * (drand48() - 0.5);
+          V[3 * v + d] = x;
+        }
+      }
 
-  if (argc<4) {
-    printf("Usage: ./axhelm Ndim numElements [nRepetitions]\n");
-    return 1;
+  const int Nq = N + 1;
+  const int Np = Nq * Nq * Nq;
+  const dlong GX = NX * N + 1, GY = NY * N + 1, GZ = NZ * N + 1;
+
+  for (int ez = 0; ez < NZ; ez++)
+    for (int ey = 0; ey < NY; ey++)
+      for (int ex = 0; ex < NX; ex++) {
+        const int e = ex + NX * (ey + NY * ez);
+        dfloat *xyze = EXYZ + e * 24;
+        for (int v = 0; v < 8; v++) {
+          const int a = ex + (v & 1), b = ey + ((v >> 1) & 1), c = ez + ((v >> 2) & 1);
+          for (int d = 0; d < 3; d++)
+            xyze[8 * d + v] = V[3 * (a + VX * (b + VY * c)) + d];
+        }
+        for (int k = 0; k < Nq; k++)
+          for (int j = 0; j < Nq; j++)
+            for (int i = 0; i < Nq; i++) {
+              const int n = e * Np + i + Nq * (j + Nq * k);
+              globalIds[n] = (ex * N + i) + GX * ((ey * N + j) + GY * (ez * N + k));
+              for (int d = 0; d < 3; d++) {
+                dfloat x = 0;
+                for (int v = 0; v < 8; v++) {
+                  const dfloat sa = (v & 1) ? 1 : -1, sb = (v & 2) ? 1 : -1, sc = (v & 4) ? 1 : -1;
+                  x += 0.125 * (1 + sa * r[i]) * (1 + sb * r[j]) * (1 + sc * r[k]) * xyze[8 * d + v];
+                }
+                xyz[3 * n + d] = x;
+              }
+            }
+      }
+
+  free(V);
+  return GX * GY * GZ;
+}
+
+// dot product of two device vectors
+static dfloat deviceDot(const int n, const dfloat *a, const dfloat *b)
+{
+  dfloat sum = 0;
+#pragma omp target teams distribute parallel for thread_limit(256) reduction(+:sum) map(tofrom: sum)
+  for (int i = 0; i < n; i++) sum += a[i] * b[i];
+  return sum;
+}
+
+// Ap = Q^T A Q p for the assembled (continuous) field p, where Q copies
+// every global node to the element nodes that share it
+template <int Nq, bool Trilinear>
+static void helmholtzOperator(const int Ndim, const int Nelements, const int offset,
+                              const dlong Nglobal, const dlong *globalIds,
+                              const dfloat *ggeo, const dfloat *EXYZ,
+                              const dfloat *gllz, const dfloat *gllw,
+                              const dfloat *DrV, const dfloat *lambda,
+                              const dfloat *p, dfloat *qL, dfloat *AqL, dfloat *Ap)
+{
+  const int Nlocal = Ndim * offset;
+  const dlong Ntotal = Ndim * Nglobal;
+
+#pragma omp target teams distribute parallel for thread_limit(256)
+  for (int n = 0; n < Nlocal; n++) {
+    const int fld = n / offset;
+    qL[n] = p[fld * Nglobal + globalIds[n - fld * offset]];
   }
 
-  const int Ndim = atoi(argv[1]);
-  const int Nelements = atoi(argv[2]);
-  int Ntests = 1;
-  if(argc>=4)
-    Ntests = atoi(argv[3]);
+  axhelm<Nq, Trilinear>(Ndim, Nelements, offset, ggeo, EXYZ, gllz, gllw, DrV, lambda, qL, AqL);
+
+#pragma omp target teams distribute parallel for thread_limit(256)
+  for (dlong n = 0; n < Ntotal; n++) Ap[n] = 0;
+
+#pragma omp target teams distribute parallel for thread_limit(256)
+  for (int n = 0; n < Nlocal; n++) {
+    const int fld = n / offset;
+    #pragma omp atomic update
+    Ap[fld * Nglobal + globalIds[n - fld * offset]] += AqL[n];
+  }
+}
+
+// Conjugate gradient solve of the assembled Helmholtz problem
+// (-lap + lambda1) u = f on the box mesh, with f manufactured from the
+// discrete operator applied to a smooth field, so that the error of the
+// solve can be measured. Reports the solve throughput in GDOF/s, counting
+// one application of the operator to every global degree of freedom per
+// iteration.
+template <int Nq, bool Trilinear>
+static void helmholtzCG(const int Ndim, const int Nelements, const int maxIterations,
+                        const dfloat tolerance, const dlong Nglobal, const dlong *globalIds,
+                        const dfloat *xyz, const dfloat *ggeo, const dfloat *EXYZ,
+                        const dfloat *gllz, const dfloat *gllw,
+                        const dfloat *DrV, const dfloat *lambda)
+{
+  const int Np = Nq * Nq * Nq;
+  const int offset = Nelements * Np;
+  const int Nlocal = Ndim * offset;
+  const dlong Ntotal = Ndim * Nglobal;
+  const int geoSize = Trilinear ? 0 : Np * Nelements * p_Nggeo;
+  const int vertSize = Trilinear ? 24 * Nelements : 0;
+
+  // exact solution
+  dfloat *ue = (dfloat*) calloc(Ntotal, sizeof(dfloat));
+  for (int n = 0; n < offset; n++) {
+    const dfloat x = xyz[3 * n], y = xyz[3 * n + 1], z = xyz[3 * n + 2];
+    for (int fld = 0; fld < Ndim; fld++)
+      ue[fld * Nglobal + globalIds[n]] = sin(M_PI * (fld + 1) * x) * sin(M_PI * y) * sin(M_PI * z);
+  }
 
-  const int Nq = POLYNOMIAL_DEGREE + 1;
+  dfloat *u  = (dfloat*) calloc(Ntotal, sizeof(dfloat));
+  dfloat *f  = (dfloat*) calloc(Ntotal, sizeof(dfloat));
+  dfloat *r  = (dfloat*) calloc(Ntotal, sizeof(dfloat));
+  dfloat *p  = (dfloat*) calloc(Ntotal, sizeof(dfloat));
+  dfloat *Ap = (dfloat*) calloc(Ntotal, sizeof(dfloat));
+  dfloat *qL  = (dfloat*) calloc(Nlocal, sizeof(dfloat));
+  dfloat *AqL = (dfloat*) calloc(Nlocal, sizeof(dfloat));
+
+  int it = 0;
+  dfloat rdotr0, rdotr;
+  double elapsed;
+
+#pragma omp target data map(to: ggeo[0:geoSize], EXYZ[0:vertSize], \
+                                gllz[0:Nq], gllw[0:Nq], DrV[0:Nq*Nq], \
+                                lambda[0:2*offset], globalIds[0:offset], \
+                                ue[0:Ntotal]) \
+                        map(from: u[0:Ntotal]) \
+                        map(alloc: f[0:Ntotal], r[0:Ntotal], p[0:Ntotal], Ap[0:Ntotal], \
+                                   qL[0:Nlocal], AqL[0:Nlocal])
+  {
+    helmholtzOperator<Nq, Trilinear>(Ndim, Nelements, offset, Nglobal, globalIds,
+                                     ggeo, EXYZ, gllz, gllw, DrV, lambda, ue, qL, AqL, f);
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    // u = 0, r = p = f
+#pragma omp target teams distribute parallel for thread_limit(256)
+    for (dlong n = 0; n < Ntotal; n++) {
+      u[n] = 0;
+      r[n] = f[n];
+      p[n] = f[n];
+    }
+    rdotr0 = rdotr = deviceDot(Ntotal, r, r);
+
+    while (it < maxIterations && rdotr > tolerance * tolerance * rdotr0) {
+      helmholtzOperator<Nq, Trilinear>(Ndim, Nelements, offset, Nglobal, globalIds,
+                                       ggeo, EXYZ, gllz, gllw, DrV, lambda, p, qL, AqL, Ap);
+
+      const dfloat alpha = rdotr / deviceDot(Ntotal, p, Ap);
+
+      dfloat rdotrNew = 0;
+#pragma omp target teams distribute parallel for thread_limit(256) reduction(+:rdotrNew) map(tofrom: rdotrNew)
+      for (dlong n = 0; n < Ntotal; n++) {
+        u[n] += alpha * p[n];
+        r[n] -= alpha * Ap[n];
+        rdotrNew += r[n] * r[n];
+      }
+
+      const dfloat beta = rdotrNew / rdotr;
+#pragma omp target teams distribute parallel for thread_limit(256)
+      for (dlong n = 0; n < Ntotal; n++) p[n] = r[n] + beta * p[n];
+
+      rdotr = rdotrNew;
+      it++;
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+    elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+  }
+
+  dfloat maxError = 0;
+  for (dlong n = 0; n < Ntotal; n++) {
+    dfloat diff = fabs(u[n] - ue[n]);
+    maxError = (maxError < diff) ? diff : maxError;
+  }
+
+  std::cout << " CG: Ndim=" << Ndim
+    << " N=" << Nq - 1
+    << " Nglobal=" << Nglobal
+    << " iterations=" << it
+    << " relative residual=" << sqrt(rdotr / rdotr0)
+    << " maxError=" << maxError
+    << " elapsed time=" << elapsed
+    << " GDOF/s=" << (double)Ntotal * it / elapsed
+    << "\n";
+
+  free(ue);
+  free(u);
+  free(f);
+  free(r);
+  free(p);
+  free(Ap);
+  free(qL);
+  free(AqL);
+}
+
+template <int Nq>
+static int run(const int Ndim, const int Nelements, const int Ntests,
+               const bool trilinear, const int cgIterations)
+{
+  const int N = Nq - 1;
   const int Np = Nq*Nq*Nq;
   const int offset = Nelements*Np;
 
-
   // build element nodes and operators
   dfloat *rV, *wV, *DrV;
-  meshJacobiGQ(0,0,POLYNOMIAL_DEGREE, &rV, &wV);
-  meshDmatrix1D(POLYNOMIAL_DEGREE, Nq, rV, &DrV);
+  meshJacobiGL(0,0,N, &rV, &wV);
+  meshDmatrix1D(N, Nq, rV, &DrV);
 
   std::cout << "word size: " << sizeof(dfloat) << " bytes\n";
 
+  // mesh and the geometric factors of its nodes
+  dfloat *EXYZ = (dfloat*) calloc(24*Nelements, sizeof(dfloat));
+  dlong *globalIds = (dlong*) calloc(offset, sizeof(dlong));
+  dfloat *xyz = (dfloat*) calloc(3*offset, sizeof(dfloat));
+  const dlong Nglobal = meshBox(N, Nelements, rV, EXYZ, globalIds, xyz);
+
+  dfloat *ggeo = (dfloat*) calloc(Np*Nelements*p_Nggeo, sizeof(dfloat));
+  for(int e=0;e<Nelements;++e){
+    for(int n=0;n<Np;++n){
+      const int i = n % Nq, j = (n / Nq) % Nq, k = n / (Nq*Nq);
+      dfloat G[p_Nggeo];
+      trilinearGeometricFactors(EXYZ + e*24, rV[i], rV[j], rV[k], wV[i]*wV[j]*wV[k], G);
+      for(int g=0;g<p_Nggeo;++g)
+        ggeo[e*p_Nggeo*Np + g*Np + n] = G[g];
+    }
+  }
+
   // populate device arrays
-  dfloat *ggeo = drandAlloc(Np*Nelements*p_Nggeo);
   dfloat *q    = drandAlloc((Ndim*Np)*Nelements);
   dfloat *Aq   = drandAlloc((Ndim*Np)*Nelements);
   dfloat *Aq_d = drandAlloc((Ndim*Np)*Nelements);
@@ -74,216 +305,29 @@ int main(int argc, char **argv){
 
   for(int n=0;n<Ndim;++n){
     dfloat *x = q + n*offset;
-    dfloat *Ax = Aq + n*offset; 
+    dfloat *Ax = Aq + n*offset;
     axhelmReference(Nq, Nelements, lambda1, ggeo, DrV, x, Ax);
   }
 
+  // only the geometry used by the selected kernel is moved to the device
+  const int geoSize = trilinear ? 0 : Np*Nelements*p_Nggeo;
+  const int vertSize = trilinear ? 24*Nelements : 0;
+
   auto start = std::chrono::high_resolution_clock::now();
 
-#pragma omp target data map(to: ggeo[0:Np*Nelements*p_Nggeo], \
+#pragma omp target data map(to: ggeo[0:geoSize], \
+    EXYZ[0:vertSize], \
+    rV[0:Nq], wV[0:Nq], \
     q[0:Ndim*Np*Nelements], \
     DrV[0:Nq*Nq], \
     lambda[0:2*offset]) \
   map(from: Aq_d[0:Ndim*Np*Nelements])
   {
-
     for(int test = 0; test < Ntests; ++test) {
-      if (Ndim > 1) {
-#pragma omp target teams num_teams(Nelements) thread_limit(64) 
-        {
-          double s_D[64];
-          double s_U[64];
-          double s_V[64];
-          double s_W[64];
-          double s_GUr[64];
-          double s_GUs[64];
-          double s_GVr[64];
-          double s_GVs[64];
-          double s_GWr[64];
-          double s_GWs[64];
-#pragma omp parallel 
-          {
-            double r_Ut, r_Vt, r_Wt;
-            double r_U[8], r_V[8], r_W[8];
-            double r_AU[8], r_AV[8], r_AW[8];
-            double r_G00, r_G01, r_G02, r_G11, r_G12, r_G22, r_GwJ;
-            double r_lam0, r_lam1;
-
-            int e = omp_get_team_num();
-            int j = omp_get_thread_num() / 8; 
-            int i = omp_get_thread_num() % 8; 
-
-            s_D[j*8+i] = DrV[j*8+i];
-            const int base = i + j * 8 + e * 512;
-            for (int k = 0; k < 8; k++) {
-              r_U[k] = q[base + k * 8 * 8 + 0 * offset];
-              r_V[k] = q[base + k * 8 * 8 + 1 * offset];
-              r_W[k] = q[base + k * 8 * 8 + 2 * offset];
-              r_AU[k] = 0;
-              r_AV[k] = 0;
-              r_AW[k] = 0;
-            }
-#pragma unroll 8
-            for (int k = 0; k < 8; ++k) {
-              const int id = e * 512 + k * 8 * 8 + j * 8 + i;
-              const int gbase = e * p_Nggeo * 512 + k * 8 * 8 + j * 8 + i;
-              r_G00 = ggeo[gbase + p_G00ID * 512];
-              r_G01 = ggeo[gbase + p_G01ID * 512];
-              r_G02 = ggeo[gbase + p_G02ID * 512];
-              r_G11 = ggeo[gbase + p_G11ID * 512];
-              r_G12 = ggeo[gbase + p_G12ID * 512];
-              r_G22 = ggeo[gbase + p_G22ID * 512];
-              r_GwJ = ggeo[gbase + p_GWJID * 512];
-              r_lam0 = lambda[id + 0 * offset];
-              r_lam1 = lambda[id + 1 * offset];
-#pragma omp barrier
-              s_U[j*8+i] = r_U[k];
-              s_V[j*8+i] = r_V[k];
-              s_W[j*8+i] = r_W[k];
-              r_Ut = 0;
-              r_Vt = 0;
-              r_Wt = 0;
-#pragma unroll 8
-              for (int m = 0; m < 8; m++) {
-                double Dkm = s_D[k*8+m];
-                r_Ut += Dkm * r_U[m];
-                r_Vt += Dkm * r_V[m];
-                r_Wt += Dkm * r_W[m];
-              }
-#pragma omp barrier
-              double Ur = 0, Us = 0;
-              double Vr = 0, Vs = 0;
-              double Wr = 0, Ws = 0;
-#pragma unroll 8
-              for (int m = 0; m < 8; m++) {
-                double Dim = s_D[i*8+m];
-                double Djm = s_D[j*8+m];
-                Ur += Dim * s_U[j*8+m];
-                Us += Djm * s_U[m*8+i];
-                Vr += Dim * s_V[j*8+m];
-                Vs += Djm * s_V[m*8+i];
-                Wr += Dim * s_W[j*8+m];
-                Ws += Djm * s_W[m*8+i];
-              }
-              s_GUr[j*8+i] = r_lam0 * (r_G00 * Ur + r_G01 * Us + r_G02 * r_Ut);
-              s_GVr[j*8+i] = r_lam0 * (r_G00 * Vr + r_G01 * Vs + r_G02 * r_Vt);
-              s_GWr[j*8+i] = r_lam0 * (r_G00 * Wr + r_G01 * Ws + r_G02 * r_Wt);
-              s_GUs[j*8+i] = r_lam0 * (r_G01 * Ur + r_G11 * Us + r_G12 * r_Ut);
-              s_GVs[j*8+i] = r_lam0 * (r_G01 * Vr + r_G11 * Vs + r_G12 * r_Vt);
-              s_GWs[j*8+i] = r_lam0 * (r_G01 * Wr + r_G11 * Ws + r_G12 * r_Wt);
-              r_Ut = r_lam0 * (r_G02 * Ur + r_G12 * Us + r_G22 * r_Ut);
-              r_Vt = r_lam0 * (r_G02 * Vr + r_G12 * Vs + r_G22 * r_Vt);
-              r_Wt = r_lam0 * (r_G02 * Wr + r_G12 * Ws + r_G22 * r_Wt);
-              r_AU[k] += r_GwJ * r_lam1 * r_U[k];
-              r_AV[k] += r_GwJ * r_lam1 * r_V[k];
-              r_AW[k] += r_GwJ * r_lam1 * r_W[k];
-#pragma omp barrier
-              double AUtmp = 0, AVtmp = 0, AWtmp = 0;
-#pragma unroll 8
-              for (int m = 0; m < 8; m++) {
-                double Dmi = s_D[m*8+i];
-                double Dmj = s_D[m*8+j];
-                double Dkm = s_D[k*8+m];
-                AUtmp += Dmi * s_GUr[j*8+m];
-                AUtmp += Dmj * s_GUs[m*8+i];
-                AVtmp += Dmi * s_GVr[j*8+m];
-                AVtmp += Dmj * s_GVs[m*8+i];
-                AWtmp += Dmi * s_GWr[j*8+m];
-                AWtmp += Dmj * s_GWs[m*8+i];
-                r_AU[m] += Dkm * r_Ut;
-                r_AV[m] += Dkm * r_Vt;
-                r_AW[m] += Dkm * r_Wt;
-              }
-              r_AU[k] += AUtmp;
-              r_AV[k] += AVtmp;
-              r_AW[k] += AWtmp;
-            }
-#pragma unroll 8
-            for (int k = 0; k < 8; k++) {
-              const int id = e * 512 + k * 8 * 8 + j * 8 + i;
-              Aq_d[id + 0 * offset] = r_AU[k];
-              Aq_d[id + 1 * offset] = r_AV[k];
-              Aq_d[id + 2 * offset] = r_AW[k];
-            }
-          }
-        }
-      }  else {
-#pragma omp target teams num_teams(Nelements) thread_limit(64) 
-        {
-
-          double s_D[64];
-          double s_q[64];
-          double s_Gqr[64];
-          double s_Gqs[64];
-#pragma omp parallel
-          {
-
-            double r_qt, r_Gqt, r_Auk;
-            double r_q[8];
-            double r_Aq[8];
-            double r_G00, r_G01, r_G02, r_G11, r_G12, r_G22, r_GwJ;
-            double r_lam0, r_lam1;
-
-            int e = omp_get_team_num();
-            int j = omp_get_thread_num() / 8; 
-            int i = omp_get_thread_num() % 8; 
-
-            s_D[j*8+i] = DrV[j*8+i];
-            const int base = i + j * 8 + e * 512;
-            for (int k = 0; k < 8; ++k) {
-              r_q[k] = q[base + k * 8 * 8];
-              r_Aq[k] = 0;
-            }
-#pragma unroll 8
-            for (int k = 0; k < 8; ++k) {
-              const int id = e * 512 + k * 8 * 8 + j * 8 + i;
-              const int gbase = e * p_Nggeo * 512 + k * 8 * 8 + j * 8 + i;
-              r_G00 = ggeo[gbase + p_G00ID * 512];
-              r_G01 = ggeo[gbase + p_G01ID * 512];
-              r_G02 = ggeo[gbase + p_G02ID * 512];
-              r_G11 = ggeo[gbase + p_G11ID * 512];
-              r_G12 = ggeo[gbase + p_G12ID * 512];
-              r_G22 = ggeo[gbase + p_G22ID * 512];
-              r_GwJ = ggeo[gbase + p_GWJID * 512];
-              r_lam0 = lambda[id + 0 * offset];
-              r_lam1 = lambda[id + 1 * offset];
-#pragma omp barrier
-              s_q[j*8+i] = r_q[k];
-              r_qt = 0;
-#pragma unroll 8
-              for (int m = 0; m < 8; ++m) {
-                r_qt += s_D[k*8+m] * r_q[m];
-              }
-#pragma omp barrier
-              double qr = 0;
-              double qs = 0;
-#pragma unroll 8
-              for (int m = 0; m < 8; ++m) {
-                qr += s_D[i*8+m] * s_q[j*8+m];
-                qs += s_D[j*8+m] * s_q[m*8+i];
-              }
-              s_Gqs[j*8+i] = r_lam0 * (r_G01 * qr + r_G11 * qs + r_G12 * r_qt);
-              s_Gqr[j*8+i] = r_lam0 * (r_G00 * qr + r_G01 * qs + r_G02 * r_qt);
-              r_Gqt = r_lam0 * (r_G02 * qr + r_G12 * qs + r_G22 * r_qt);
-              r_Auk = r_GwJ * r_lam1 * r_q[k];
-#pragma omp barrier
-#pragma unroll 8
-              for (int m = 0; m < 8; ++m) {
-                r_Auk += s_D[m*8+j] * s_Gqs[m*8+i];
-                r_Aq[m] += s_D[k*8+m] * r_Gqt;
-                r_Auk += s_D[m*8+i] * s_Gqr[j*8+m];
-              }
-              r_Aq[k] += r_Auk;
-#pragma omp barrier
-            }
-#pragma unroll 8
-            for (int k = 0; k < 8; ++k) {
-              const int id = e * 512 + k * 8 * 8 + j * 8 + i;
-              Aq_d[id] = r_Aq[k];
-            }
-          }
-        }
-      }
+      if (trilinear)
+        axhelm<Nq, true>(Ndim, Nelements, offset, ggeo, EXYZ, rV, wV, DrV, lambda, q, Aq_d);
+      else
+        axhelm<Nq, false>(Ndim, Nelements, offset, ggeo, EXYZ, rV, wV, DrV, lambda, q, Aq_d);
     }
   }
 
@@ -298,31 +342,93 @@ int main(int argc, char **argv){
   }
   std::cout << "Correctness check: maxError = " << maxDiff << "\n";
 
-  free(ggeo);
-  free(q);
-  free(Aq);
-  free(Aq_d);
-  free(lambda);
-  free(rV);
-  free(wV);
-  free(DrV);
-
   // print statistics
-  const dfloat GDOFPerSecond = Ndim*POLYNOMIAL_DEGREE*POLYNOMIAL_DEGREE*POLYNOMIAL_DEGREE*Nelements/elapsed;
-  const long long bytesMoved = (Ndim*2*Np+7*Np+2*Np)*sizeof(dfloat); // x, Mx, opa, lambda
+  const dfloat GDOFPerSecond = Ndim*N*N*N*Nelements/elapsed;
+  long long bytesMoved = (Ndim*2*Np+2*Np)*sizeof(dfloat); // x, Mx, lambda
+  if(trilinear)
+    bytesMoved += 24*sizeof(dfloat); // vertices
+  else
+    bytesMoved += 7*Np*sizeof(dfloat); // opa
   const double bw = bytesMoved*Nelements/elapsed;
   double flopCount = Ndim*Np*12*Nq;
   if(Ndim == 1) flopCount += 22*Np;
   if(Ndim == 3) flopCount += 69*Np;
+  if(trilinear) flopCount += 310*Np; // trilinearGeometricFactors
   double gflops = flopCount*Nelements/elapsed;
   std::cout << " NRepetitions=" << Ntests
     << " Ndim=" << Ndim
-    << " N=" << POLYNOMIAL_DEGREE
+    << " N=" << N
     << " Nelements=" << Nelements
+    << " geometry=" << (trilinear ? "trilinear" : "ggeo")
     << " elapsed time=" << elapsed
     << " GDOF/s=" << GDOFPerSecond
     << " GB/s=" << bw
     << " GFLOPS/s=" << gflops
     << "\n";
+
+  if(cgIterations > 0){
+    const dfloat tolerance = 1e-8;
+    if(trilinear)
+      helmholtzCG<Nq, true>(Ndim, Nelements, cgIterations, tolerance, Nglobal, globalIds,
+                            xyz, ggeo, EXYZ, rV, wV, DrV, lambda);
+    else
+      helmholtzCG<Nq, false>(Ndim, Nelements, cgIterations, tolerance, Nglobal, globalIds,
+                             xyz, ggeo, EXYZ, rV, wV, DrV, lambda);
+  }
+
+  free(ggeo);
+  free(EXYZ);
+  free(globalIds);
+  free(xyz);
+  free(q);
+  free(Aq);
+  free(Aq_d);
+  free(lambda);
+  free(rV);
+  free(wV);
+  free(DrV);
   return 0;
 }
+
+int main(int argc, char **argv){
+
+  if (argc<4) {
+    printf("Usage: ./axhelm Ndim numElements nRepetitions [N] [geometry] [cgIterations]\n");
+    printf("  N            polynomial degree, 1 to %d (default %d)\n",
+           MAX_POLYNOMIAL_DEGREE, POLYNOMIAL_DEGREE);
+    printf("  geometry     0: precomputed geometric factors (default)\n");
+    printf("               1: geometric factors recomputed from trilinear element vertices\n");
+    printf("  cgIterations maximum iterations of a CG Helmholtz solve (default 0: no solve)\n");
+    return 1;
+  }
+
+  const int Ndim = atoi(argv[1]);
+  const int Nelements = atoi(argv[2]);
+  int Ntests = 1;
+  if(argc>=4)
+    Ntests = atoi(argv[3]);
+  const int N = (argc>=5) ? atoi(argv[4]) : POLYNOMIAL_DEGREE;
+  const bool trilinear = (argc>=6) ? atoi(argv[5]) != 0 : false;
+  const int cgIterations = (argc>=7) ? atoi(argv[6]) : 0;
+
+  switch(N){
+    case  1: return run< 2>(Ndim, Nelements, Ntests, trilinear, cgIterations);
+    case  2: return run< 3>(Ndim, Nelements, Ntests, trilinear, cgIterations);
+    case  3: return run< 4>(Ndim, Nelements, Ntests, trilinear, cgIterations);
+    case  4: return run< 5>(Ndim, Nelements, Ntests, trilinear, cgIterations);
+    case  5: return run< 6>(Ndim, Nelements, Ntests, trilinear, cgIterations);
+    case  6: return run< 7>(Ndim, Nelements, Ntests, trilinear, cgIterations);
+    case  7: return run< 8>(Ndim, Nelements, Ntests, trilinear, cgIterations);
+    case  8: return run< 9>(Ndim, Nelements, Ntests, trilinear, cgIterations);
+    case  9: return run<10>(Ndim, Nelements, Ntests, trilinear, cgIterations);
+    case 10: return run<11>(Ndim, Nelements, Ntests, trilinear, cgIterations);
+    case 11: return run<12>(Ndim, Nelements, Ntests, trilinear, cgIterations);
+    case 12: return run<13>(Ndim, Nelements, Ntests, trilinear, cgIterations);
+    case 13: return run<14>(Ndim, Nelements, Ntests, trilinear, cgIterations);
+    case 14: return run<15>(Ndim, Nelements, Ntests, trilinear, cgIterations);
+    case 15: return run<16>(Ndim, Nelements, Ntests, trilinear, cgIterations);
+    default:
+      printf("Polynomial degree %d is not in 1 to %d\n", N, MAX_POLYNOMIAL_DEGREE);
+      return 1;
+  }
+}
@@ -11,17 +11,21 @@
 #include "timer.h"
 #endif
 
+#include <omp.h>
 #include "util.h"
+#include "graph.h"
 
 #define MAX_THREADS_PER_BLOCK 256
+#define NUM_TEAMS 256
 
+//--direction-optimizing bfs: switch to bottom-up when the frontier has more
+//--than 1/ALPHA of the unexplored edges, back to top-down when it holds
+//--fewer than 1/BETA of the nodes and shrinks
+#define ALPHA 14
+#define BETA 24
 
-//Structure to hold a node information
-struct Node
-{
-  int starting;
-  int no_of_edges;
-};
+//--levels launched between two reads of the termination flag
+#define LEVELS_PER_CHECK 4
 
 
 //----------------------------------------------------------
@@ -130,9 +134,214 @@ void run_bfs_gpu(int no_of_nodes, Node *d_graph_nodes, int edge_list_size, \
 #endif
 }
 
+//----------------------------------------------------------
+//--direction-optimizing breadth first search on GPUs
+//--the frontier is a queue in top-down levels and a bitmap in bottom-up
+//--levels; the traversal state, including the choice of direction and the
+//--termination flag, stays on the device
+//----------------------------------------------------------
+enum { S_MODE, S_SIZE, S_NEXT, S_NEXT_EDGES, S_UNEXPLORED, S_TAIL, S_CONVERT,
+       S_DONE, S_LEVELS, S_BOTTOM_UP, NUM_STATE };
+enum { TOP_DOWN, BOTTOM_UP };
+
+void run_bfs_gpu_do(int no_of_nodes, Node *d_graph_nodes, int edge_list_size,
+    int *d_graph_edges, Node *d_in_nodes, int *d_in_edges, int source, int *d_cost)
+{
+  const int words = (no_of_nodes + 31) / 32;
+  //--two queues and two bitmaps, used alternately as current and next frontier
+  int *d_queue = (int*) malloc(sizeof(int)*2*no_of_nodes);
+  unsigned *d_bitmap = (unsigned*) calloc(2*words, sizeof(unsigned));
+  long long d_state[NUM_STATE] = {0};
+
+  d_queue[0] = source;
+  d_bitmap[source >> 5] = 1u << (source & 31);
+  d_state[S_MODE] = TOP_DOWN;
+  d_state[S_SIZE] = 1;
+  d_state[S_UNEXPLORED] = edge_list_size - d_graph_nodes[source].no_of_edges;
+
+#ifdef  PROFILING
+  timer kernel_timer;
+  double kernel_time = 0.0;    
+  kernel_timer.reset();
+  kernel_timer.start();
+#endif
+
+#pragma omp target data map(to: d_graph_nodes[0:no_of_nodes], \
+                                d_graph_edges[0:edge_list_size], \
+                                d_in_nodes[0:no_of_nodes], \
+                                d_in_edges[0:edge_list_size], \
+                                d_queue[0:2*no_of_nodes], \
+                                d_bitmap[0:2*words], \
+                                d_state[0:NUM_STATE]) \
+                        map(tofrom: d_cost[0:no_of_nodes])
+{
+  for (int level = 0; ; level++) {
+    const int cur = level & 1, nxt = cur ^ 1;
+    int *q_cur = d_queue + cur * no_of_nodes, *q_next = d_queue + nxt * no_of_nodes;
+    unsigned *bm_cur = d_bitmap + cur * words, *bm_next = d_bitmap + nxt * words;
+
+    //--top-down levels set the bits of the next frontier, clear it first
+#pragma omp target teams num_teams(NUM_TEAMS) thread_limit(MAX_THREADS_PER_BLOCK)
+    {
+#pragma omp parallel
+      {
+        if (!d_state[S_DONE] && d_state[S_MODE] == TOP_DOWN) {
+          const int stride = omp_get_num_teams() * omp_get_num_threads();
+          for (int w = omp_get_team_num() * omp_get_num_threads() + omp_get_thread_num();
+               w < words; w += stride)
+            bm_next[w] = 0;
+        }
+      }
+    }
+
+    //--top-down: expand the nodes of the queue, claiming each unvisited
+    //--neighbor through its bit in the next frontier
+#pragma omp target teams num_teams(NUM_TEAMS) thread_limit(MAX_THREADS_PER_BLOCK)
+    {
+#pragma omp parallel
+      {
+        if (!d_state[S_DONE] && d_state[S_MODE] == TOP_DOWN) {
+          const int size = (int)d_state[S_SIZE];
+          const int stride = omp_get_num_teams() * omp_get_num_threads();
+          long long edges = 0;
+          for (int i = omp_get_team_num() * omp_get_num_threads() + omp_get_thread_num();
+               i < size; i += stride) {
+            const int tid = q_cur[i];
+            for(int e=d_graph_nodes[tid].starting; 
+                e<(d_graph_nodes[tid].no_of_edges + d_graph_nodes[tid].starting); e++){
+              const int id = d_graph_edges[e];
+              if (d_cost[id] >= 0) continue;
+              const unsigned bit = 1u << (id & 31);
+              unsigned old;
+#pragma omp atomic capture
+              { old = bm_next[id >> 5]; bm_next[id >> 5] |= bit; }
+              if (old & bit) continue;
+              d_cost[id] = level + 1;
+              long long t;
+#pragma omp atomic capture
+              t = d_state[S_NEXT]++;
+              q_next[t] = id;
+              edges += d_graph_nodes[id].no_of_edges;
+            }
+          }
+#pragma omp atomic update
+          d_state[S_NEXT_EDGES] += edges;
+        }
+      }
+    }
+
+    //--bottom-up: every unvisited node looks for a parent in the frontier;
+    //--a thread owns the 32 nodes of a bitmap word and writes it whole
+#pragma omp target teams num_teams(NUM_TEAMS) thread_limit(MAX_THREADS_PER_BLOCK)
+    {
+#pragma omp parallel
+      {
+        if (!d_state[S_DONE] && d_state[S_MODE] == BOTTOM_UP) {
+          const int stride = omp_get_num_teams() * omp_get_num_threads();
+          long long found = 0, edges = 0;
+          for (int w = omp_get_team_num() * omp_get_num_threads() + omp_get_thread_num();
+               w < words; w += stride) {
+            unsigned bits = 0;
+            const int end = (w + 1) * 32 < no_of_nodes ? (w + 1) * 32 : no_of_nodes;
+            for (int id = w * 32; id < end; id++) {
+              if (d_cost[id] >= 0) continue;
+              for(int e=d_in_nodes[id].starting; 
+                  e<(d_in_nodes[id].no_of_edges + d_in_nodes[id].starting); e++){
+                const int parent = d_in_edges[e];
+                if ((bm_cur[parent >> 5] >> (parent & 31)) & 1) {
+                  d_cost[id] = level + 1;
+                  bits |= 1u << (id & 31);
+                  found++;
+                  edges += d_graph_nodes[id].no_of_edges;
+                  break;
+                }
+              }
+            }
+            bm_next[w] = bits;
+          }
+#pragma omp atomic update
+          d_state[S_NEXT] += found;
+#pragma omp atomic update
+          d_state[S_NEXT_EDGES] += edges;
+        }
+      }
+    }
+
+    //--choose the direction of the next level and detect termination
+#pragma omp target
+    {
+      if (!d_state[S_DONE]) {
+        const long long n_f = d_state[S_NEXT], m_f = d_state[S_NEXT_EDGES];
+        d_state[S_UNEXPLORED] -= m_f;
+        d_state[S_CONVERT] = 0;
+        d_state[S_LEVELS]++;
+        if (d_state[S_MODE] == BOTTOM_UP) d_state[S_BOTTOM_UP]++;
+        if (n_f == 0)
+          d_state[S_DONE] = 1;
+        else if (d_state[S_MODE] == TOP_DOWN) {
+          if (m_f > d_state[S_UNEXPLORED] / ALPHA)
+            d_state[S_MODE] = BOTTOM_UP;
+        }
+        else if (n_f < no_of_nodes / BETA && n_f < d_state[S_SIZE]) {
+          d_state[S_MODE] = TOP_DOWN;
+          d_state[S_CONVERT] = 1;
+        }
+        d_state[S_SIZE] = n_f;
+        d_state[S_NEXT] = 0;
+        d_state[S_NEXT_EDGES] = 0;
+        d_state[S_TAIL] = 0;
+      }
+    }
+
+    //--back to top-down: turn the bitmap frontier into a queue
+#pragma omp target teams num_teams(NUM_TEAMS) thread_limit(MAX_THREADS_PER_BLOCK)
+    {
+#pragma omp parallel
+      {
+        if (d_state[S_CONVERT]) {
+          const int stride = omp_get_num_teams() * omp_get_num_threads();
+          for (int w = omp_get_team_num() * omp_get_num_threads() + omp_get_thread_num();
+               w < words; w += stride) {
+            const unsigned bits = bm_next[w];
+            if (!bits) continue;
+            int count = 0;
+            for (unsigned b = bits; b; b &= b - 1) count++;
+            long long t;
+#pragma omp atomic capture
+            { t = d_state[S_TAIL]; d_state[S_TAIL] += count; }
+            for (int b = 0; b < 32; b++)
+              if ((bits >> b) & 1) q_next[t++] = w * 32 + b;
+          }
+        }
+      }
+    }
+
+    if (level % LEVELS_PER_CHECK == LEVELS_PER_CHECK - 1) {
+#pragma omp target update from (d_state[0:NUM_STATE])
+      if (d_state[S_DONE]) break;
+    }
+  }
+}
+
+  //--statistics
+#ifdef  PROFILING
+  kernel_timer.stop();
+  kernel_time = kernel_timer.getTimeInSeconds();
+  std::cout<<"kernel time(s):"<<kernel_time<<std::endl;    
+#endif
+  printf("%lld levels, %lld of them bottom-up\n", d_state[S_LEVELS], d_state[S_BOTTOM_UP]);
+
+  free(d_queue);
+  free(d_bitmap);
+}
+
 void Usage(int argc, char**argv){
 
-  fprintf(stderr,"Usage: %s <input_file>\n", argv[0]);
+  fprintf(stderr,"Usage: %s <input_file> [direction_optimizing]\n", argv[0]);
+  fprintf(stderr,"  input_file: Rodinia graph, edge list (.el), Matrix Market (.mtx)\n"
+                 "              or binary CSR (.csr)\n");
+  fprintf(stderr,"  direction_optimizing: 1 (default) or 0 for the level-synchronous\n"
+                 "              mask kernels\n");
 
 }
 //----------------------------------------------------------
@@ -144,62 +353,46 @@ int main(int argc, char * argv[])
 {
   int no_of_nodes;
   int edge_list_size;
-  FILE *fp;
-  Node* h_graph_nodes;
-  char *h_graph_mask, *h_updating_graph_mask, *h_graph_visited;
+  Graph graph = {0, 0, NULL, NULL}, in_graph;
+  char *h_graph_mask = NULL, *h_updating_graph_mask = NULL, *h_graph_visited = NULL;
   try{
     char *input_f;
-    if(argc!=2){
+    if(argc!=2 && argc!=3){
       Usage(argc, argv);
       exit(0);
     }
 
     input_f = argv[1];
+    const bool direction_optimizing = argc == 3 ? atoi(argv[2]) != 0 : true;
     printf("Reading File\n");
     //Read in Graph from a file
-    fp = fopen(input_f,"r");
-    if(!fp){
+    if(!load_graph(input_f, graph)){
       printf("Error Reading graph file %s\n", input_f);
       return 1;
     }
+    no_of_nodes = graph.no_of_nodes;
+    edge_list_size = graph.edge_list_size;
+    Node* h_graph_nodes = graph.nodes;
+    int* h_graph_edges = graph.edges;
+    printf("Number of nodes = %d, number of edges = %d\n", no_of_nodes, edge_list_size);
 
     int source = 0;
 
-    fscanf(fp,"%d",&no_of_nodes);
-
     // allocate host memory
-    h_graph_nodes = (Node*) malloc(sizeof(Node)*no_of_nodes);
     h_graph_mask = (char*) malloc(sizeof(char)*no_of_nodes);
     h_updating_graph_mask = (char*) malloc(sizeof(char)*no_of_nodes);
     h_graph_visited = (char*) malloc(sizeof(char)*no_of_nodes);
 
-    int start, edgeno;   
     // initalize the memory
     for(int i = 0; i < no_of_nodes; i++){
-      fscanf(fp,"%d %d",&start,&edgeno);
-      h_graph_nodes[i].starting = start;
-      h_graph_nodes[i].no_of_edges = edgeno;
       h_graph_mask[i]=0;
       h_updating_graph_mask[i]=0;
       h_graph_visited[i]=0;
     }
-    //read the source node from the file
-    fscanf(fp,"%d",&source);
-    source=0;
     //set the source node as 1 in the mask
     h_graph_mask[source]=1;
     h_graph_visited[source]=1;
-    fscanf(fp,"%d",&edge_list_size);
-    int id,cost;
-    int* h_graph_edges = (int*) malloc(sizeof(int)*edge_list_size);
-    for(int i=0; i < edge_list_size ; i++){
-      fscanf(fp,"%d",&id);
-      fscanf(fp,"%d",&cost);
-      h_graph_edges[i] = id;
-    }
 
-    if(fp)
-      fclose(fp);    
     // allocate mem for the result on host side
     int  *h_cost = (int*) malloc(sizeof(int)*no_of_nodes);
     int *h_cost_ref = (int*)malloc(sizeof(int)*no_of_nodes);
@@ -210,9 +403,20 @@ int main(int argc, char * argv[])
     h_cost[source]=0;
     h_cost_ref[source]=0;    
     //---------------------------------------------------------
-    printf("run bfs (#nodes = %d) on device\n", no_of_nodes);
-    run_bfs_gpu(no_of_nodes,h_graph_nodes,edge_list_size,h_graph_edges, 
-        h_graph_mask, h_updating_graph_mask, h_graph_visited, h_cost);  
+    if (direction_optimizing) {
+      // incoming edges for the bottom-up levels
+      transpose(graph, in_graph);
+      printf("run direction-optimizing bfs (#nodes = %d) on device\n", no_of_nodes);
+      run_bfs_gpu_do(no_of_nodes,h_graph_nodes,edge_list_size,h_graph_edges,
+          in_graph.nodes, in_graph.edges, source, h_cost);
+      free(in_graph.nodes);
+      free(in_graph.edges);
+    }
+    else {
+      printf("run bfs (#nodes = %d) on device\n", no_of_nodes);
+      run_bfs_gpu(no_of_nodes,h_graph_nodes,edge_list_size,h_graph_edges, 
+          h_graph_mask, h_updating_graph_mask, h_graph_visited, h_cost);  
+    }
     //---------------------------------------------------------
     //
     printf("run bfs (#nodes = %d) on host (cpu) \n", no_of_nodes);
@@ -233,15 +437,19 @@ int main(int argc, char * argv[])
     compare_results<int>(h_cost_ref, h_cost, no_of_nodes);
     //release host memory    
     free(h_graph_nodes);
+    free(h_graph_edges);
     free(h_graph_mask);
     free(h_updating_graph_mask);
     free(h_graph_visited);
+    free(h_cost);
+    free(h_cost_ref);
 
   }
   catch(std::string msg){
     std::cout<<"--cambine: exception in main ->"<<msg<<std::endl;
     //release host memory
-    free(h_graph_nodes);
+    free(graph.nodes);
+    free(graph.edges);
     free(h_graph_mask);
     free(h_updating_graph_mask);
     free(h_graph_visited);    
@@ -0,0 +1,167 @@
+#ifndef _GRAPH_H_
+#define _GRAPH_H_
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+//Structure to hold a node information
+struct Node
+{
+  int starting;
+  int no_of_edges;
+};
+
+//-------------------------------------------------------------------
+//--graph in compressed sparse row form
+//-------------------------------------------------------------------
+struct Graph
+{
+  int no_of_nodes;
+  int edge_list_size;
+  Node *nodes;
+  int *edges;
+};
+
+//--build the rows of a graph from a list of (src, dst) pairs
+inline void csr_from_pairs(Graph &g, int no_of_nodes, const std::vector<int> &src,
+    const std::vector<int> &dst){
+  const int m = (int)src.size();
+  g.no_of_nodes = no_of_nodes;
+  g.edge_list_size = m;
+  g.nodes = (Node*) malloc(sizeof(Node)*no_of_nodes);
+  g.edges = (int*) malloc(sizeof(int)*(m > 0 ? m : 1));
+  for (int i = 0; i < no_of_nodes; i++) g.nodes[i].no_of_edges = 0;
+  for (int e = 0; e < m; e++) g.nodes[src[e]].no_of_edges++;
+  int start = 0;
+  for (int i = 0; i < no_of_nodes; i++){
+    g.nodes[i].starting = start;
+    start += g.nodes[i].no_of_edges;
+    g.nodes[i].no_of_edges = 0;
+  }
+  for (int e = 0; e < m; e++){
+    Node &n = g.nodes[src[e]];
+    g.edges[n.starting + n.no_of_edges++] = dst[e];
+  }
+}
+
+//--transpose (incoming edges) of a graph, used by the bottom-up steps
+inline void transpose(const Graph &g, Graph &t){
+  std::vector<int> src(g.edge_list_size), dst(g.edge_list_size);
+  for (int u = 0; u < g.no_of_nodes; u++)
+    for (int i = g.nodes[u].starting; i < g.nodes[u].starting + g.nodes[u].no_of_edges; i++){
+      src[i] = g.edges[i];
+      dst[i] = u;
+    }
+  csr_from_pairs(t, g.no_of_nodes, src, dst);
+}
+
+//--Rodinia format: #nodes, (start, #edges) per node, source, #edges,
+//--(dst, cost) per edge
+inline bool read_rodinia(FILE *fp, Graph &g){
+  if (fscanf(fp,"%d",&g.no_of_nodes) != 1) return false;
+  g.nodes = (Node*) malloc(sizeof(Node)*g.no_of_nodes);
+  for (int i = 0; i < g.no_of_nodes; i++)
+    fscanf(fp,"%d %d",&g.nodes[i].starting,&g.nodes[i].no_of_edges);
+  int source;
+  fscanf(fp,"%d",&source);
+  fscanf(fp,"%d",&g.edge_list_size);
+  g.edges = (int*) malloc(sizeof(int)*g.edge_list_size);
+  int id, cost;
+  for (int i = 0; i < g.edge_list_size; i++){
+    fscanf(fp,"%d",&id);
+    fscanf(fp,"%d",&cost);
+    g.edges[i] = id;
+  }
+  return true;
+}
+
+//--edge list: one "src dst" pair of 0-based ids per line, further
+//--columns are ignored, lines starting with '#' or '%' are comments
+inline bool read_edge_list(FILE *fp, Graph &g){
+  std::vector<int> src, dst;
+  char line[1024];
+  int no_of_nodes = 0;
+  while (fgets(line, sizeof(line), fp)){
+    if (line[0] == '#' || line[0] == '%') continue;
+    int u, v;
+    if (sscanf(line, "%d %d", &u, &v) != 2) continue;
+    if (u < 0 || v < 0) return false;
+    src.push_back(u);
+    dst.push_back(v);
+    if (u >= no_of_nodes) no_of_nodes = u + 1;
+    if (v >= no_of_nodes) no_of_nodes = v + 1;
+  }
+  csr_from_pairs(g, no_of_nodes, src, dst);
+  return true;
+}
+
+//--Matrix Market coordinate file, 1-based; symmetric matrices
+//--contribute both directions of every off-diagonal entry
+inline bool read_matrix_market(FILE *fp, Graph &g){
+  char line[1024];
+  if (!fgets(line, sizeof(line), fp) || strncmp(line, "%%MatrixMarket", 14) != 0)
+    return false;
+  const bool symmetric = strstr(line, "symmetric") != NULL;
+  do {
+    if (!fgets(line, sizeof(line), fp)) return false;
+  } while (line[0] == '%');
+  int rows, cols, nnz;
+  if (sscanf(line, "%d %d %d", &rows, &cols, &nnz) != 3) return false;
+  std::vector<int> src, dst;
+  src.reserve(symmetric ? 2*nnz : nnz);
+  dst.reserve(symmetric ? 2*nnz : nnz);
+  for (int e = 0; e < nnz; e++){
+    int u, v;
+    if (!fgets(line, sizeof(line), fp) || sscanf(line, "%d %d", &u, &v) != 2) return false;
+    src.push_back(u - 1);
+    dst.push_back(v - 1);
+    if (symmetric && u != v){
+      src.push_back(v - 1);
+      dst.push_back(u - 1);
+    }
+  }
+  csr_from_pairs(g, rows > cols ? rows : cols, src, dst);
+  return true;
+}
+
+//--binary CSR: int32 #nodes, int32 #edges, #nodes+1 int32 row offsets
+//--and #edges int32 column ids
+inline bool read_csr(FILE *fp, Graph &g){
+  int n, m;
+  if (fread(&n, sizeof(int), 1, fp) != 1 || fread(&m, sizeof(int), 1, fp) != 1)
+    return false;
+  std::vector<int> offsets(n + 1);
+  if (fread(offsets.data(), sizeof(int), n + 1, fp) != (size_t)(n + 1)) return false;
+  g.no_of_nodes = n;
+  g.edge_list_size = m;
+  g.nodes = (Node*) malloc(sizeof(Node)*n);
+  g.edges = (int*) malloc(sizeof(int)*(m > 0 ? m : 1));
+  for (int i = 0; i < n; i++){
+    g.nodes[i].starting = offsets[i];
+    g.nodes[i].no_of_edges = offsets[i+1] - offsets[i];
+  }
+  return fread(g.edges, sizeof(int), m, fp) == (size_t)m;
+}
+
+//--pick the reader from the file extension: .el, .mtx, .csr,
+//--anything else is read as a Rodinia graph
+inline bool load_graph(const char *file_name, Graph &g){
+  const char *ext = strrchr(file_name, '.');
+  const bool binary = ext && strcmp(ext, ".csr") == 0;
+  FILE *fp = fopen(file_name, binary ? "rb" : "r");
+  if (!fp) return false;
+  bool ok;
+  if (binary)
+    ok = read_csr(fp, g);
+  else if (ext && strcmp(ext, ".el") == 0)
+    ok = read_edge_list(fp, g);
+  else if (ext && strcmp(ext, ".mtx") == 0)
+    ok = read_matrix_market(fp, g);
+  else
+    ok = read_rodinia(fp, g);
+  fclose(fp);
+  return ok;
+}
+
+#endif
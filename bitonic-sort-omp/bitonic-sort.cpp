@@ -34,9 +34,22 @@
 // each stage, a part of step, the host redefines the ordered sequenes and sends
 // data to the kernel. The kernel swaps the elements accordingly in parallel.
 //
+// FusedBitonicSort runs the same network with every compare-exchange placing
+// the smaller element first: the first step of each stage compares mirrored
+// elements of a sequence instead of reversing the order of every other
+// sequence. Elements past the end of an array of any size then behave as
+// +infinity and never move, so no padding is needed. Steps whose distance is
+// below TILE_SIZE are fused into one kernel that works on a tile held in
+// team-local memory. SegmentedBitonicSort sorts many independent arrays, one
+// team per array.
+//
 #include <math.h>
+#include <omp.h>
+#include <chrono>
 #include <iostream>
 #include <limits>
+#include <algorithm>
+#include <vector>
 
 using namespace std;
 
@@ -101,6 +114,165 @@ void ParallelBitonicSort(int data_gpu[], int n) {
   }    // end step
 }
 
+// Number of elements sorted in team-local memory by the fused kernels and the
+// number of threads of a team.
+#define TILE_SIZE 2048
+#define TILE_THREADS 256
+
+#pragma omp declare target
+// Put the smaller of a[i] and a[j] (i < j) at i. Elements at len and beyond
+// are +infinity and stay in place.
+inline void CompareExchange(int *a, int i, int j, int len) {
+  if (j < len && a[i] > a[j]) {
+    int temp = a[i];
+    a[i] = a[j];
+    a[j] = temp;
+  }
+}
+
+// First step of a stage: element r of each sequence of seq_len elements is
+// compared with element seq_len-1-r. span/2 pairs cover the array.
+inline void MirrorStep(int *a, int len, int span, int seq_len, int localid, int nthreads) {
+  int h_len = seq_len / 2;
+  for (int p = localid; p < span / 2; p += nthreads) {
+    int first = (p / h_len) * seq_len;
+    int r = p % h_len;
+    CompareExchange(a, first + r, first + seq_len - 1 - r, len);
+  }
+}
+
+// Other steps of a stage: element i is compared with element i+dist.
+inline void HalfStep(int *a, int len, int span, int dist, int localid, int nthreads) {
+  for (int p = localid; p < span / 2; p += nthreads) {
+    int i = 2 * dist * (p / dist) + p % dist;
+    CompareExchange(a, i, i + dist, len);
+  }
+}
+
+// Sort a[0:len) with the threads of a team, which call it together.
+inline void TeamSort(int *a, int len, int localid, int nthreads) {
+  int span = 1;
+  while (span < len) span <<= 1;
+  for (int seq_len = 2; seq_len <= span; seq_len <<= 1) {
+    MirrorStep(a, len, span, seq_len, localid, nthreads);
+    #pragma omp barrier
+    for (int dist = seq_len / 4; dist > 0; dist >>= 1) {
+      HalfStep(a, len, span, dist, localid, nthreads);
+      #pragma omp barrier
+    }
+  }
+}
+
+// Steps of distance dist, dist/2, ..., 1 on a[0:len), len <= TILE_SIZE.
+inline void TeamMerge(int *a, int len, int dist, int localid, int nthreads) {
+  for (; dist > 0; dist >>= 1) {
+    HalfStep(a, len, TILE_SIZE, dist, localid, nthreads);
+    #pragma omp barrier
+  }
+}
+#pragma omp end declare target
+
+// Sort an array of any size. Stages up to TILE_SIZE elements run in one
+// kernel per tile; every longer stage runs its steps of distance TILE_SIZE
+// and more over the whole array, then the rest of the stage in the tiles.
+void FusedBitonicSort(int data_gpu[], int size) {
+  if (size < 2) return;
+  int span = 1;
+  while (span < size) span <<= 1;
+  int num_tiles = (size + TILE_SIZE - 1) / TILE_SIZE;
+
+#pragma omp target data map(tofrom: data_gpu[0:size])
+  {
+    #pragma omp target teams num_teams(num_tiles) thread_limit(TILE_THREADS)
+    {
+      int tile[TILE_SIZE];
+      #pragma omp parallel
+      {
+        int localid = omp_get_thread_num();
+        int nthreads = omp_get_num_threads();
+        for (int t = omp_get_team_num(); t < num_tiles; t += omp_get_num_teams()) {
+          int first = t * TILE_SIZE;
+          int len = std::min(TILE_SIZE, size - first);
+          for (int i = localid; i < len; i += nthreads) tile[i] = data_gpu[first + i];
+          #pragma omp barrier
+          TeamSort(tile, len, localid, nthreads);
+          for (int i = localid; i < len; i += nthreads) data_gpu[first + i] = tile[i];
+          #pragma omp barrier
+        }
+      }
+    }
+
+    for (int seq_len = 2 * TILE_SIZE; seq_len <= span; seq_len <<= 1) {
+      int h_len = seq_len / 2;
+      #pragma omp target teams distribute parallel for thread_limit(TILE_THREADS)
+      for (int p = 0; p < span / 2; p++) {
+        int first = (p / h_len) * seq_len;
+        int r = p % h_len;
+        CompareExchange(data_gpu, first + r, first + seq_len - 1 - r, size);
+      }
+
+      for (int dist = seq_len / 4; dist >= TILE_SIZE; dist >>= 1) {
+        #pragma omp target teams distribute parallel for thread_limit(TILE_THREADS)
+        for (int p = 0; p < span / 2; p++) {
+          int i = 2 * dist * (p / dist) + p % dist;
+          CompareExchange(data_gpu, i, i + dist, size);
+        }
+      }
+
+      #pragma omp target teams num_teams(num_tiles) thread_limit(TILE_THREADS)
+      {
+        int tile[TILE_SIZE];
+        #pragma omp parallel
+        {
+          int localid = omp_get_thread_num();
+          int nthreads = omp_get_num_threads();
+          for (int t = omp_get_team_num(); t < num_tiles; t += omp_get_num_teams()) {
+            int first = t * TILE_SIZE;
+            int len = std::min(TILE_SIZE, size - first);
+            for (int i = localid; i < len; i += nthreads) tile[i] = data_gpu[first + i];
+            #pragma omp barrier
+            TeamMerge(tile, len, TILE_SIZE / 2, localid, nthreads);
+            for (int i = localid; i < len; i += nthreads) data_gpu[first + i] = tile[i];
+            #pragma omp barrier
+          }
+        }
+      }
+    }
+  }
+}
+
+// Sort num_segments independent arrays; segment s is
+// data_gpu[offsets[s]:offsets[s+1]). A segment that fits in a tile is sorted
+// in team-local memory, a longer one in place.
+void SegmentedBitonicSort(int data_gpu[], const int offsets[], int num_segments) {
+  if (num_segments < 1) return;
+  int size = offsets[num_segments];
+
+  #pragma omp target teams num_teams(num_segments) thread_limit(TILE_THREADS) \
+    map(tofrom: data_gpu[0:size]) map(to: offsets[0:num_segments+1])
+  {
+    int tile[TILE_SIZE];
+    #pragma omp parallel
+    {
+      int localid = omp_get_thread_num();
+      int nthreads = omp_get_num_threads();
+      for (int s = omp_get_team_num(); s < num_segments; s += omp_get_num_teams()) {
+        int first = offsets[s];
+        int len = offsets[s + 1] - first;
+        if (len <= TILE_SIZE) {
+          for (int i = localid; i < len; i += nthreads) tile[i] = data_gpu[first + i];
+          #pragma omp barrier
+          TeamSort(tile, len, localid, nthreads);
+          for (int i = localid; i < len; i += nthreads) data_gpu[first + i] = tile[i];
+        } else {
+          TeamSort(data_gpu + first, len, localid, nthreads);
+        }
+        #pragma omp barrier
+      }
+    }
+  }
+}
+
 // Loop over the bitonic sequences at each stage in serial.
 void SwapElements(int step, int stage, int num_sequence, int seq_len,
                   int *array) {
@@ -202,7 +374,14 @@ int main(int argc, char *argv[]) {
   DisplayArray(data_gpu, size);
 #endif
 
+  // Keep the input for the fused and the segmented sorts.
+  std::vector<int> input(data_gpu, data_gpu + size);
+
+  auto start = std::chrono::steady_clock::now();
   ParallelBitonicSort(data_gpu, n);
+  auto end = std::chrono::steady_clock::now();
+  std::cout << "Parallel bitonic sort time: "
+            << std::chrono::duration<double, std::milli>(end - start).count() << " ms\n";
 
 #if DEBUG
   std::cout << "\ndata after sorting using parallel bitonic sort:\n";
@@ -223,6 +402,43 @@ int main(int argc, char *argv[]) {
     }
   }
 
+  // Fused sort of the same input, then of a size that is not a power of two.
+  int sizes[2] = {size, size - size / 4};
+  for (int t = 0; t < 2 && pass; t++) {
+    std::vector<int> fused(input.begin(), input.begin() + sizes[t]);
+    start = std::chrono::steady_clock::now();
+    FusedBitonicSort(fused.data(), sizes[t]);
+    end = std::chrono::steady_clock::now();
+    std::cout << "Fused bitonic sort time (" << sizes[t] << " elements): "
+              << std::chrono::duration<double, std::milli>(end - start).count() << " ms\n";
+
+    std::vector<int> expected(input.begin(), input.begin() + sizes[t]);
+    std::sort(expected.begin(), expected.end());
+    if (fused != expected) pass = false;
+  }
+
+  // Segmented sort: short segments as in top-k, every 64th one longer than
+  // a tile.
+  if (pass) {
+    std::vector<int> offsets(1, 0);
+    while (offsets.back() < size) {
+      int len = (offsets.size() % 64 == 0) ? rand() % (4 * TILE_SIZE) + 1 : rand() % 1024 + 1;
+      offsets.push_back(std::min(size, offsets.back() + len));
+    }
+    int num_segments = offsets.size() - 1;
+
+    std::vector<int> segmented(input);
+    start = std::chrono::steady_clock::now();
+    SegmentedBitonicSort(segmented.data(), offsets.data(), num_segments);
+    end = std::chrono::steady_clock::now();
+    std::cout << "Segmented bitonic sort time (" << num_segments << " segments): "
+              << std::chrono::duration<double, std::milli>(end - start).count() << " ms\n";
+
+    for (int s = 0; s < num_segments; s++)
+      std::sort(input.begin() + offsets[s], input.begin() + offsets[s + 1]);
+    if (segmented != input) pass = false;
+  }
+
   // Clean CPU memory.
   free(data_cpu);
   free(data_gpu);
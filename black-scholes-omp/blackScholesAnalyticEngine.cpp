@@ -16,6 +16,9 @@
 
 #include "blackScholesAnalyticEngineKernelsCpu.cpp"
 
+//SoA batch pricing with greeks and implied volatility
+#include "blackScholesAnalyticEngineBatch.cpp"
+
 //function to run the black scholes analytic engine on the gpu
 void runBlackScholesAnalyticEngine()
 {
@@ -324,9 +327,100 @@ void runBlackScholesAnalyticEngine()
 		printf("Summation of output prices on CPU: %f\n", totResult);
 		printf("Output price at index %d on CPU:: %f\n\n", numVals/2, outputVals[numVals/2]);
 
-		printf("Speedup on GPU: %f\n", mtimeCpu / mtimeGpu);
+		printf("Speedup on GPU: %f\n\n", mtimeCpu / mtimeGpu);
+
 
+		//run the batch pricing with the options as separate arrays
+		optionBatchStruct batch;
+		batch.type = (int*)malloc(numVals * sizeof(int));
+		batch.spot = (float*)malloc(numVals * sizeof(float));
+		batch.strike = (float*)malloc(numVals * sizeof(float));
+		batch.t = (float*)malloc(numVals * sizeof(float));
+		batch.r = (float*)malloc(numVals * sizeof(float));
+		batch.q = (float*)malloc(numVals * sizeof(float));
+		batch.vol = (float*)malloc(numVals * sizeof(float));
+		for (int i=0; i<numVals; i++)
+		{
+			batch.type[i] = values[i].type;
+			batch.spot[i] = values[i].spot;
+			batch.strike[i] = values[i].strike;
+			batch.t[i] = values[i].t;
+			batch.r[i] = values[i].r;
+			batch.q[i] = values[i].q;
+			batch.vol[i] = values[i].vol;
+		}
 		delete [] values;
+
+		optionGreeksStruct greeks;
+		greeks.price = (float*)malloc(numVals * sizeof(float));
+		greeks.delta = (float*)malloc(numVals * sizeof(float));
+		greeks.gamma = (float*)malloc(numVals * sizeof(float));
+		greeks.vega = (float*)malloc(numVals * sizeof(float));
+		greeks.theta = (float*)malloc(numVals * sizeof(float));
+		greeks.rho = (float*)malloc(numVals * sizeof(float));
+
+		gettimeofday(&start, NULL);
+		priceOptionsBatch(batch, greeks, numVals);
+		gettimeofday(&end, NULL);
+		seconds  = end.tv_sec  - start.tv_sec;
+		useconds = end.tv_usec - start.tv_usec;
+		float mtimeBatch = ((seconds) * 1000 + ((float)useconds)/1000.0) + 0.5f;
+
+		printf("Run batch pricing with greeks on GPU\n");
+		printf("Processing time on GPU: %f (ms)\n", mtimeBatch);
+		float maxPriceDiff = 0.0f;
+		totResult = 0.0f;
+		for (int i=0; i<numVals; i++)
+		{
+			totResult += greeks.price[i];
+			maxPriceDiff = fmaxf(maxPriceDiff, fabsf(greeks.price[i] - outputVals[i]));
+		}
+		int mid = numVals/2;
+		printf("Summation of output prices on GPU: %f\n", totResult);
+		printf("Maximum difference to the prices on CPU: %e\n", maxPriceDiff);
+		printf("Output at index %d on GPU: price %f delta %f gamma %f vega %f theta %f rho %f\n\n",
+				mid, greeks.price[mid], greeks.delta[mid], greeks.gamma[mid],
+				greeks.vega[mid], greeks.theta[mid], greeks.rho[mid]);
+
+		//recover the volatilities from the batch prices
+		float* inputVols = batch.vol;
+		batch.vol = (float*)malloc(numVals * sizeof(float));
+
+		gettimeofday(&start, NULL);
+		impliedVolBatch(batch, greeks.price, 1.0e-5f, numVals);
+		gettimeofday(&end, NULL);
+		seconds  = end.tv_sec  - start.tv_sec;
+		useconds = end.tv_usec - start.tv_usec;
+		float mtimeVol = ((seconds) * 1000 + ((float)useconds)/1000.0) + 0.5f;
+
+		printf("Run batch implied volatility on GPU\n");
+		printf("Processing time on GPU: %f (ms)\n", mtimeVol);
+		float maxVolDiff = 0.0f;
+		int numFailed = 0;
+		for (int i=0; i<numVals; i++)
+		{
+			if (batch.vol[i] < 0.0f)
+				numFailed++;
+			else
+				maxVolDiff = fmaxf(maxVolDiff, fabsf(batch.vol[i] - inputVols[i]));
+		}
+		printf("Maximum difference to the input volatilities: %e\n", maxVolDiff);
+		printf("Prices outside the no-arbitrage bounds: %d\n", numFailed);
+
+		free(batch.type);
+		free(batch.spot);
+		free(batch.strike);
+		free(batch.t);
+		free(batch.r);
+		free(batch.q);
+		free(batch.vol);
+		free(inputVols);
+		free(greeks.price);
+		free(greeks.delta);
+		free(greeks.gamma);
+		free(greeks.vega);
+		free(greeks.theta);
+		free(greeks.rho);
 		free(outputVals);
 	}
 }
@@ -0,0 +1,200 @@
+//blackScholesAnalyticEngineBatch.cpp
+//Batch pricing of options stored as separate arrays (structure of arrays)
+//and batch implied volatility from market prices
+
+#ifndef BLACK_SCHOLES_ANALYTIC_ENGINE_BATCH_CPP
+#define BLACK_SCHOLES_ANALYTIC_ENGINE_BATCH_CPP
+
+#include <math.h>
+
+//needed for optionInputStruct and the option types
+#include "blackScholesAnalyticEngineStructs.h"
+
+//needed for the error function
+#include "blackScholesAnalyticEngineKernels.cpp"
+
+//bracket and stopping criteria of the implied volatility solver
+#define IMPLIED_VOL_MIN 1.0e-4f
+#define IMPLIED_VOL_MAX 5.0f
+#define IMPLIED_VOL_TOL 1.0e-6f
+#define IMPLIED_VOL_MAX_ITER 64
+
+//options in the batch are stored as separate arrays so that consecutive
+//lanes read consecutive addresses
+typedef struct
+{
+	int* type;
+	float* spot;
+	float* strike;
+	float* t;
+	float* r;
+	float* q;
+	float* vol;
+} optionBatchStruct;
+
+//price and sensitivities of each option in the batch; theta is per year,
+//vega and rho are per unit change of the volatility and the rate
+typedef struct
+{
+	float* price;
+	float* delta;
+	float* gamma;
+	float* vega;
+	float* theta;
+	float* rho;
+} optionGreeksStruct;
+
+#pragma omp declare target
+
+//cumulative standard normal distribution
+inline float cumNormBatch(float x)
+{
+	normalDistStruct normDist;
+	initCumNormDist(normDist);
+	return 0.5f * (1.0f + errorFunct(normDist, x * (float)M_SQRT_2));
+}
+
+//standard normal density
+inline float normPdfBatch(float x)
+{
+	return (float)(M_SQRT_2 * M_1_SQRTPI) * expf(-0.5f * x * x);
+}
+
+//price of one option and, if greeks is set, its sensitivities; the value
+//and the vega are always returned since the implied volatility solver
+//needs both
+inline void priceOptionGreeks(int type, float spot, float strike, float t, float r, float q, float vol,
+		bool greeks, float& value, float& vega, float& delta, float& gamma, float& theta, float& rho)
+{
+	float sqrtT = sqrtf(t);
+	float stdDev = vol * sqrtT;
+	float dividendDiscount = expf(-q * t);
+	float riskFreeDiscount = expf(-r * t);
+	float forwardPrice = spot * dividendDiscount / riskFreeDiscount;
+
+	float d1 = logf(forwardPrice / strike) / stdDev + 0.5f * stdDev;
+	float d2 = d1 - stdDev;
+	float n_d1 = normPdfBatch(d1);
+
+	//N(d1) and N(d2) for a call, N(-d1) and N(-d2) for a put
+	float sign = (type == CALL) ? 1.0f : -1.0f;
+	float cum_d1 = cumNormBatch(sign * d1);
+	float cum_d2 = cumNormBatch(sign * d2);
+
+	value = sign * riskFreeDiscount * (forwardPrice * cum_d1 - strike * cum_d2);
+	vega = spot * dividendDiscount * n_d1 * sqrtT;
+
+	if (greeks)
+	{
+		delta = sign * dividendDiscount * cum_d1;
+		gamma = dividendDiscount * n_d1 / (spot * stdDev);
+		theta = -spot * dividendDiscount * n_d1 * vol / (2.0f * sqrtT)
+			+ sign * (q * spot * dividendDiscount * cum_d1 - r * strike * riskFreeDiscount * cum_d2);
+		rho = sign * strike * t * riskFreeDiscount * cum_d2;
+	}
+}
+
+//implied volatility of one option from its market price. Newton steps on
+//the volatility are kept inside a bracket that shrinks on every
+//iteration; a step that leaves the bracket, or a vanishing vega, falls
+//back to bisection. Returns -1 if the price is outside the no-arbitrage
+//bounds and no volatility reproduces it.
+inline float impliedVolOption(int type, float spot, float strike, float t, float r, float q,
+		float marketPrice, float tol)
+{
+	float dividendDiscount = expf(-q * t);
+	float riskFreeDiscount = expf(-r * t);
+	float forwardPrice = spot * dividendDiscount / riskFreeDiscount;
+
+	float lowerBound = (type == CALL) ? riskFreeDiscount * fmaxf(forwardPrice - strike, 0.0f)
+	                                  : riskFreeDiscount * fmaxf(strike - forwardPrice, 0.0f);
+	float upperBound = (type == CALL) ? spot * dividendDiscount : strike * riskFreeDiscount;
+	if (!(marketPrice > lowerBound && marketPrice < upperBound))
+		return -1.0f;
+
+	//initial guess at the inflection point of the price in the volatility
+	float lo = IMPLIED_VOL_MIN;
+	float hi = IMPLIED_VOL_MAX;
+	float vol = sqrtf(2.0f * fabsf(logf(forwardPrice / strike)) / t);
+	vol = fminf(fmaxf(vol, 0.1f), 0.5f * hi);
+
+	float value, vega, unused;
+	for (int iter = 0; iter < IMPLIED_VOL_MAX_ITER; iter++)
+	{
+		priceOptionGreeks(type, spot, strike, t, r, q, vol, false,
+				value, vega, unused, unused, unused, unused);
+		float diff = value - marketPrice;
+		if (fabsf(diff) < tol || hi - lo < IMPLIED_VOL_TOL)
+			break;
+
+		//the price increases with the volatility
+		if (diff > 0.0f)
+			hi = vol;
+		else
+			lo = vol;
+
+		float newton = vol - diff / vega;
+		vol = (vega > 0.0f && newton > lo && newton < hi) ? newton : 0.5f * (lo + hi);
+	}
+	return vol;
+}
+
+#pragma omp end declare target
+
+
+//price a batch of options and compute their sensitivities in the same pass
+void priceOptionsBatch(optionBatchStruct options, optionGreeksStruct results, int numVals)
+{
+	const int* type = options.type;
+	const float* spot = options.spot;
+	const float* strike = options.strike;
+	const float* t = options.t;
+	const float* r = options.r;
+	const float* q = options.q;
+	const float* vol = options.vol;
+	float* price = results.price;
+	float* delta = results.delta;
+	float* gamma = results.gamma;
+	float* vega = results.vega;
+	float* theta = results.theta;
+	float* rho = results.rho;
+
+	#pragma omp target teams distribute parallel for simd thread_limit(THREAD_BLOCK_SIZE) \
+		map(to: type[0:numVals], spot[0:numVals], strike[0:numVals], t[0:numVals], \
+		        r[0:numVals], q[0:numVals], vol[0:numVals]) \
+		map(from: price[0:numVals], delta[0:numVals], gamma[0:numVals], vega[0:numVals], \
+		          theta[0:numVals], rho[0:numVals])
+	for (int optionNum = 0; optionNum < numVals; optionNum++)
+	{
+		priceOptionGreeks(type[optionNum], spot[optionNum], strike[optionNum], t[optionNum],
+				r[optionNum], q[optionNum], vol[optionNum], true,
+				price[optionNum], vega[optionNum], delta[optionNum],
+				gamma[optionNum], theta[optionNum], rho[optionNum]);
+	}
+}
+
+
+//implied volatility of a batch of options from their market prices; the
+//vol array of the batch receives the result
+void impliedVolBatch(optionBatchStruct options, const float* marketPrices, float tol, int numVals)
+{
+	const int* type = options.type;
+	const float* spot = options.spot;
+	const float* strike = options.strike;
+	const float* t = options.t;
+	const float* r = options.r;
+	const float* q = options.q;
+	float* vol = options.vol;
+
+	#pragma omp target teams distribute parallel for simd thread_limit(THREAD_BLOCK_SIZE) \
+		map(to: type[0:numVals], spot[0:numVals], strike[0:numVals], t[0:numVals], \
+		        r[0:numVals], q[0:numVals], marketPrices[0:numVals]) \
+		map(from: vol[0:numVals])
+	for (int optionNum = 0; optionNum < numVals; optionNum++)
+	{
+		vol[optionNum] = impliedVolOption(type[optionNum], spot[optionNum], strike[optionNum],
+				t[optionNum], r[optionNum], q[optionNum], marketPrices[optionNum], tol);
+	}
+}
+
+#endif //BLACK_SCHOLES_ANALYTIC_ENGINE_BATCH_CPP
@@ -16,6 +16,7 @@
 #include <fstream>
 #include <math.h>
 #include "util.h"
+#include "mesh_reorder.h"
 
 /*
  * Options 
@@ -427,41 +428,80 @@ int main(int argc, char** argv){
       h_ff_flux_contribution_momentum_z,
       h_ff_flux_contribution_density_energy);
 
+  // An optional second argument names a binary cache of the reordered
+  // mesh. It is read instead of the text mesh when it exists and was built
+  // from the current text mesh (same size and modification time), and
+  // written after the text mesh has been parsed and reordered otherwise.
+  const char* cache_file_name = (argc > 2) ? argv[2] : NULL;
+
   int nel;
   int nelr;
-  std::ifstream file(data_file_name, std::ifstream::in);
-  if(!file.good()){
-    throw(std::string("can not find/open file! ")+data_file_name);
+  FILE* cache = NULL;
+  if (cache_file_name != NULL)
+    nel = open_mesh_cache(cache_file_name, data_file_name, NNB, NDIM, &cache);
+
+  std::ifstream file;
+  if (cache == NULL) {
+    file.open(data_file_name, std::ifstream::in);
+    if(!file.good()){
+      throw(std::string("can not find/open file! ")+data_file_name);
+    }
+    file >> nel;
   }
-  file >> nel;
   nelr = block_length*((nel / block_length )+ std::min(1, nel % block_length));
   std::cout<<"--cambine: nel="<<nel<<", nelr="<<nelr<<std::endl;
   float* h_areas = new float[nelr];
   int* h_elements_surrounding_elements = new int[nelr*NNB];
   float* h_normals = new float[nelr*NDIM*NNB];
+  int* h_perm = new int[nel];
 
   float* h_variables = new float[nelr*NVAR];
   float* h_old_variables = new float[nelr*NVAR];
   float* h_step_factors = new float[nelr]; 
   float* h_fluxes = new float[nelr*NVAR];
 
-  // read in data
-  for(int i = 0; i < nel; i++)
-  {
-    file >> h_areas[i];
-    for(int j = 0; j < NNB; j++)
+  double reorder_start = get_time();
+  if (cache != NULL) {
+    if (!read_mesh_cache(cache, nel, nelr, NNB, NDIM, h_areas,
+                         h_elements_surrounding_elements, h_normals, h_perm))
+      throw(std::string("can not read mesh cache! ")+cache_file_name);
+    std::cout << "Read reordered mesh from " << cache_file_name << std::endl;
+  }
+  else {
+    // read in data
+    for(int i = 0; i < nel; i++)
     {
-      file >> h_elements_surrounding_elements[i + j*nelr];
-      if(h_elements_surrounding_elements[i+j*nelr] < 0) h_elements_surrounding_elements[i+j*nelr] = -1;
-      h_elements_surrounding_elements[i + j*nelr]--; //it's coming in with Fortran numbering        
-
-      for(int k = 0; k < NDIM; k++)
+      file >> h_areas[i];
+      for(int j = 0; j < NNB; j++)
       {
-        file >> h_normals[i + (j + k*NNB)*nelr];
-        h_normals[i + (j + k*NNB)*nelr] = -h_normals[i + (j + k*NNB)*nelr];
+        file >> h_elements_surrounding_elements[i + j*nelr];
+        if(h_elements_surrounding_elements[i+j*nelr] < 0) h_elements_surrounding_elements[i+j*nelr] = -1;
+        h_elements_surrounding_elements[i + j*nelr]--; //it's coming in with Fortran numbering        
+
+        for(int k = 0; k < NDIM; k++)
+        {
+          file >> h_normals[i + (j + k*NNB)*nelr];
+          h_normals[i + (j + k*NNB)*nelr] = -h_normals[i + (j + k*NNB)*nelr];
+        }
       }
     }
+
+    // renumber the elements so that neighbors are close in memory
+    double distance = neighbor_distance(nel, nelr, NNB, h_elements_surrounding_elements);
+    rcm_order(nel, nelr, NNB, h_elements_surrounding_elements, h_perm);
+    apply_order(nel, nelr, NNB, NDIM, h_perm, h_areas, h_elements_surrounding_elements, h_normals);
+    printf("Average neighbor distance: %.1lf (file order) %.1lf (RCM order)\n", distance,
+           neighbor_distance(nel, nelr, NNB, h_elements_surrounding_elements));
+
+    if (cache_file_name != NULL) {
+      if (write_mesh_cache(cache_file_name, data_file_name, nel, nelr, NNB, NDIM, h_areas,
+                           h_elements_surrounding_elements, h_normals, h_perm))
+        std::cout << "Wrote reordered mesh to " << cache_file_name << std::endl;
+      else
+        std::cout << "Warning: can not write mesh cache " << cache_file_name << std::endl;
+    }
   }
+  printf("Mesh read and reorder time = %lf(s)\n", get_time() - reorder_start);
 
   // fill in remaining data
   int last = nel-1;
@@ -522,6 +562,11 @@ int main(int argc, char** argv){
   }
 #ifdef OUTPUT
   std::cout << "Saving solution..." << std::endl;
+  // restore the file order of the elements
+  memcpy(h_old_variables, h_variables, sizeof(float)*nelr*NVAR);
+  for(int i = 0; i < nel; i++)
+    for(int j = 0; j < NVAR; j++)
+      h_variables[h_perm[i] + j*nelr] = h_old_variables[i + j*nelr];
   dump(h_variables, nel, nelr);
 #endif
 
@@ -532,6 +577,7 @@ int main(int argc, char** argv){
   delete[] h_areas;
   delete[] h_elements_surrounding_elements;
   delete[] h_normals;
+  delete[] h_perm;
   delete[] h_variables;
   delete[] h_old_variables;
   delete[] h_fluxes;
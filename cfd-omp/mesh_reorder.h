@@ -0,0 +1,194 @@
+#ifndef _MESH_REORDER_
+#define _MESH_REORDER_
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <vector>
+
+//-------------------------------------------------------------------
+//--Reverse Cuthill-McKee reordering of the elements
+//
+// The neighbor gathers in compute_flux follow the element adjacency
+// graph. Numbering the elements in RCM order keeps the neighbors of an
+// element close to it in memory, so the gathers hit nearby cache lines.
+//
+// The arrays use the same layout as the kernels: element i, neighbor j
+// is stored at [i + j*nelr], and normal component k of neighbor j is
+// stored at [i + (j + k*NNB)*nelr]. Only the first nel elements are
+// reordered; the padding elements are filled in afterwards.
+//-------------------------------------------------------------------
+
+// perm[new] = old
+void rcm_order(int nel, int nelr, int nnb, const int* ese, int* perm)
+{
+  std::vector<int> degree(nel, 0);
+  for (int i = 0; i < nel; i++)
+    for (int j = 0; j < nnb; j++)
+      if (ese[i + j*nelr] >= 0) degree[i]++;
+
+  // visit the start candidates from the lowest degree up
+  std::vector<int> seeds(nel);
+  for (int i = 0; i < nel; i++) seeds[i] = i;
+  std::stable_sort(seeds.begin(), seeds.end(),
+      [&](int a, int b) { return degree[a] < degree[b]; });
+
+  std::vector<char> visited(nel, 0);
+  std::vector<int> nbs;
+  int head = 0, tail = 0;
+  for (int s = 0; s < nel; s++) {
+    int seed = seeds[s];
+    if (visited[seed]) continue;
+    visited[seed] = 1;
+    perm[tail++] = seed;
+
+    // breadth-first search, neighbors sorted by increasing degree
+    while (head < tail) {
+      int e = perm[head++];
+      nbs.clear();
+      for (int j = 0; j < nnb; j++) {
+        int nb = ese[e + j*nelr];
+        if (nb >= 0 && nb < nel && !visited[nb]) {
+          visited[nb] = 1;
+          nbs.push_back(nb);
+        }
+      }
+      std::sort(nbs.begin(), nbs.end(),
+          [&](int a, int b) { return degree[a] < degree[b]; });
+      for (size_t k = 0; k < nbs.size(); k++) perm[tail++] = nbs[k];
+    }
+  }
+
+  std::reverse(perm, perm + nel);
+}
+
+// Permute the mesh arrays in place and renumber the neighbor indices.
+// Boundary markers (negative neighbors) and indices outside the first
+// nel elements are left untouched.
+void apply_order(int nel, int nelr, int nnb, int ndim, const int* perm,
+                 float* areas, int* ese, float* normals)
+{
+  std::vector<int> inv(nel);
+  for (int i = 0; i < nel; i++) inv[perm[i]] = i;
+
+  std::vector<float> f(nel);
+  for (int i = 0; i < nel; i++) f[i] = areas[perm[i]];
+  std::copy(f.begin(), f.end(), areas);
+
+  std::vector<int> n(nel);
+  for (int j = 0; j < nnb; j++) {
+    int* col = ese + j*nelr;
+    for (int i = 0; i < nel; i++) {
+      int nb = col[perm[i]];
+      n[i] = (nb >= 0 && nb < nel) ? inv[nb] : nb;
+    }
+    std::copy(n.begin(), n.end(), col);
+  }
+
+  for (int c = 0; c < nnb*ndim; c++) {
+    float* col = normals + c*nelr;
+    for (int i = 0; i < nel; i++) f[i] = col[perm[i]];
+    std::copy(f.begin(), f.end(), col);
+  }
+}
+
+// Average distance between an element and its neighbors in the numbering
+double neighbor_distance(int nel, int nelr, int nnb, const int* ese)
+{
+  double sum = 0.0;
+  long count = 0;
+  for (int j = 0; j < nnb; j++)
+    for (int i = 0; i < nel; i++) {
+      int nb = ese[i + j*nelr];
+      if (nb >= 0) {
+        sum += nb > i ? nb - i : i - nb;
+        count++;
+      }
+    }
+  return count ? sum / count : 0.0;
+}
+
+//-------------------------------------------------------------------
+//--Binary cache of the reordered mesh
+//
+// Layout: magic, size and modification time of the text mesh it was
+// built from, nel, nnb, ndim, then the first nel entries of each column
+// of areas, elements_surrounding_elements, normals, and perm.
+//-------------------------------------------------------------------
+static const char mesh_cache_magic[8] = {'C','F','D','R','C','M','0','2'};
+
+// Size and modification time identifying the text mesh
+static bool mesh_source_id(const char* mesh_path, long long id[2])
+{
+  struct stat st;
+  if (stat(mesh_path, &st) != 0) return false;
+  id[0] = (long long)st.st_size;
+  id[1] = (long long)st.st_mtime;
+  return true;
+}
+
+// Returns the number of elements in the cache, or -1 if it is missing,
+// was written for a different mesh layout, or the text mesh has changed
+// since (or no longer exists).
+int open_mesh_cache(const char* path, const char* mesh_path, int nnb, int ndim,
+                    FILE** fp)
+{
+  *fp = NULL;
+  long long source[2];
+  if (!mesh_source_id(mesh_path, source)) return -1;
+  *fp = fopen(path, "rb");
+  if (*fp == NULL) return -1;
+  char magic[8];
+  long long cached_source[2];
+  int header[3];
+  if (fread(magic, 1, 8, *fp) != 8 ||
+      memcmp(magic, mesh_cache_magic, 8) != 0 ||
+      fread(cached_source, sizeof(long long), 2, *fp) != 2 ||
+      cached_source[0] != source[0] || cached_source[1] != source[1] ||
+      fread(header, sizeof(int), 3, *fp) != 3 ||
+      header[0] <= 0 || header[1] != nnb || header[2] != ndim) {
+    fclose(*fp);
+    *fp = NULL;
+    return -1;
+  }
+  return header[0];
+}
+
+bool read_mesh_cache(FILE* fp, int nel, int nelr, int nnb, int ndim,
+                     float* areas, int* ese, float* normals, int* perm)
+{
+  bool ok = fread(areas, sizeof(float), nel, fp) == (size_t)nel;
+  for (int j = 0; ok && j < nnb; j++)
+    ok = fread(ese + j*nelr, sizeof(int), nel, fp) == (size_t)nel;
+  for (int c = 0; ok && c < nnb*ndim; c++)
+    ok = fread(normals + c*nelr, sizeof(float), nel, fp) == (size_t)nel;
+  ok = ok && fread(perm, sizeof(int), nel, fp) == (size_t)nel;
+  fclose(fp);
+  return ok;
+}
+
+bool write_mesh_cache(const char* path, const char* mesh_path, int nel, int nelr,
+                      int nnb, int ndim, const float* areas, const int* ese,
+                      const float* normals, const int* perm)
+{
+  long long source[2];
+  if (!mesh_source_id(mesh_path, source)) return false;
+  FILE* fp = fopen(path, "wb");
+  if (fp == NULL) return false;
+  int header[3] = {nel, nnb, ndim};
+  bool ok = fwrite(mesh_cache_magic, 1, 8, fp) == 8 &&
+            fwrite(source, sizeof(long long), 2, fp) == 2 &&
+            fwrite(header, sizeof(int), 3, fp) == 3 &&
+            fwrite(areas, sizeof(float), nel, fp) == (size_t)nel;
+  for (int j = 0; ok && j < nnb; j++)
+    ok = fwrite(ese + j*nelr, sizeof(int), nel, fp) == (size_t)nel;
+  for (int c = 0; ok && c < nnb*ndim; c++)
+    ok = fwrite(normals + c*nelr, sizeof(float), nel, fp) == (size_t)nel;
+  ok = ok && fwrite(perm, sizeof(int), nel, fp) == (size_t)nel;
+  ok = (fclose(fp) == 0) && ok;
+  if (!ok) remove(path);
+  return ok;
+}
+
+#endif
@@ -13,6 +13,7 @@
 #include <stdlib.h>
 #include <math.h>
 #include "WKFUtils.h"
+#include "clenergy.h"
 
 #define MAXATOMS 4000
 
@@ -22,19 +23,6 @@
 #define BLOCKSIZEY    8 
 #define BLOCKSIZE    BLOCKSIZEX * BLOCKSIZEY
 
-struct float4 {
-  float x;
-  float y;
-  float z;
-  float w;
-};
-
-struct int3 {
-  int x;
-  int y;
-  int z;
-};
-
 int copyatoms(float *atoms, int count, float zplane, float4* atominfo) {
 
   if (count > MAXATOMS) {
@@ -81,6 +69,20 @@ int initatoms(float **atombuf, int count, int3 volsize, float gridspacing) {
 }
 
 
+// Compare a potential with the direct summation
+void error_report(const char *name, const float *energy, const float *ref, int count) {
+  double err2 = 0.0, ref2 = 0.0, maxerr = 0.0;
+  for (int i = 0; i < count; i++) {
+    double d = (double) energy[i] - ref[i];
+    err2 += d * d;
+    ref2 += (double) ref[i] * ref[i];
+    maxerr = fabs(d) > maxerr ? fabs(d) : maxerr;
+  }
+  printf("%s: relative RMS error %g, max absolute error %g\n",
+         name, sqrt(err2 / ref2), maxerr);
+}
+
+
 int main(int argc, char** argv) {
   float *energy = NULL;
   float *atoms = NULL;
@@ -95,7 +97,7 @@ int main(int argc, char** argv) {
   printf("  Single-threaded single-device test run.\n");
 
   // number of atoms to simulate
-  int atomcount = 1000000;
+  int atomcount = (argc > 1) ? atoi(argv[1]) : 1000000;
 
   // setup energy grid size
   // XXX this is a large test case to clearly illustrate that even while
@@ -106,7 +108,7 @@ int main(int argc, char** argv) {
   volsize.z = 1;
 
   // set voxel spacing
-  float gridspacing = 0.1f;
+  float gridspacing = (argc > 2) ? atof(argv[2]) : 0.1f;
 
   // setup CUDA grid and block sizes
   // XXX we have to make a trade-off between the number of threads per
@@ -173,12 +175,14 @@ int main(int argc, char** argv) {
     // RUN the kernel...
     wkf_timer_start(runtimer);
 
-    #pragma omp target teams distribute parallel for collapse(2) nowait
+    #pragma omp target teams distribute parallel for collapse(2)
     for (unsigned int yindex = 0; yindex < volsize.y; yindex++) { 
       for (unsigned int xindex = 0; xindex < volsize.x / UNROLLX; xindex++) { 
-      unsigned int outaddr = yindex * volsize.x + xindex; 
+      // each thread of a block of BLOCKSIZEX computes UNROLLX points, BLOCKSIZEX apart
+      unsigned int xpoint = (xindex / BLOCKSIZEX) * BLOCKSIZEX * UNROLLX + xindex % BLOCKSIZEX;
+      unsigned int outaddr = yindex * volsize.x + xpoint; 
       float coory = gridspacing * yindex;
-      float coorx = gridspacing * xindex;
+      float coorx = gridspacing * xpoint;
 
       float energyvalx1=0.0f;
       float energyvalx2=0.0f;
@@ -263,7 +267,37 @@ int main(int argc, char** argv) {
 
   /* 59/8 FLOPS per atom eval */
   printf("FP performance: %g GFLOPS\n", atomevalssec * (59.0/8.0));
-  
+
+  // cutoff and multilevel summation, compared with the direct summation
+  printf("\nBinned cutoff summation (cutoff %g A) and multilevel summation (a = %g A, h = %g A)\n",
+         CUTOFF, MSM_A, MSM_H);
+  float *energy_cutoff = (float *) malloc(volmemsz);
+  float *energy_msm = (float *) malloc(volmemsz);
+  atom_bins bins;
+
+  wkf_timer_start(runtimer);
+  if (bin_atoms(atoms, atomcount, CUTOFF / 2, &bins))
+    return -1;
+  wkf_timer_stop(runtimer);
+  printf("Binning time: %f seconds (%d x %d x %d bins)\n",
+         wkf_timer_time(runtimer), bins.nx, bins.ny, bins.nz);
+
+  wkf_timer_start(runtimer);
+  cutoff_potential(energy_cutoff, &bins, volsize, gridspacing, 0.0f, CUTOFF, KERNEL_CUTOFF);
+  wkf_timer_stop(runtimer);
+  printf("Cutoff time: %f seconds\n", wkf_timer_time(runtimer));
+
+  wkf_timer_start(runtimer);
+  msm_potential(energy_msm, &bins, volsize, gridspacing, 0.0f);
+  wkf_timer_stop(runtimer);
+  printf("MSM time: %f seconds\n", wkf_timer_time(runtimer));
+
+  error_report("Cutoff", energy_cutoff, energy, volmem);
+  error_report("MSM", energy_msm, energy, volmem);
+
+  free_bins(&bins);
+  free(energy_cutoff);
+  free(energy_msm);
   free(atoms);
   free(atominfo);
   free(energy);
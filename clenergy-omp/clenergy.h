@@ -0,0 +1,58 @@
+/*
+ * Coulombic potential on a lattice: shared types and the cutoff and
+ * multilevel summation methods that complement the direct summation
+ */
+#ifndef CLENERGY_H
+#define CLENERGY_H
+
+struct float4 {
+  float x;
+  float y;
+  float z;
+  float w;
+};
+
+struct int3 {
+  int x;
+  int y;
+  int z;
+};
+
+// cutoff of the truncated Coulomb potential (Angstrom)
+#define CUTOFF     12.0f
+
+// multilevel summation: splitting distance and spacing of the finest grid
+// (Angstrom), and the size below which a grid is summed directly
+#define MSM_A      12.0f
+#define MSM_H      2.5f
+#define MSM_TOP    16
+#define MSM_LEVELS 12
+
+// short-range kernels of the binned summation
+enum { KERNEL_CUTOFF = 0, KERNEL_MSM = 1 };
+
+// Atoms sorted into cubic bins: the atoms of bin b are
+// atoms[start[b]] .. atoms[start[b+1]-1], with the charge in w.
+struct atom_bins {
+  float4 *atoms;
+  int *start;
+  int count;
+  int nx, ny, nz;
+  float x0, y0, z0;
+  float size;
+};
+
+int bin_atoms(const float *atoms, int count, float binsize, atom_bins *bins);
+void free_bins(atom_bins *bins);
+
+// Potential of the binned atoms on the z = zplane slab of the lattice,
+// using only the atoms within the cutoff of each lattice point
+void cutoff_potential(float *energy, const atom_bins *bins, int3 volsize,
+                      float gridspacing, float zplane, float cutoff, int kernel);
+
+// Potential by multilevel summation: the short-range part is summed over
+// the bins, the long-range part on a hierarchy of grids
+void msm_potential(float *energy, const atom_bins *bins, int3 volsize,
+                   float gridspacing, float zplane);
+
+#endif
@@ -0,0 +1,148 @@
+/*
+ * Binned cutoff summation of the Coulombic potential
+ *
+ * The atoms are sorted into cubic bins. Every lattice point only visits the
+ * bins that overlap the sphere of the cutoff around it, so the cost grows
+ * with the number of atoms within the cutoff instead of the atom count.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "clenergy.h"
+
+int bin_atoms(const float *atoms, int count, float binsize, atom_bins *bins) {
+  float lo[3] = {  INFINITY,  INFINITY,  INFINITY };
+  float hi[3] = { -INFINITY, -INFINITY, -INFINITY };
+  int i, k;
+
+  for (i=0; i<count; i++) {
+    for (k=0; k<3; k++) {
+      lo[k] = fminf(lo[k], atoms[i*4 + k]);
+      hi[k] = fmaxf(hi[k], atoms[i*4 + k]);
+    }
+  }
+
+  bins->count = count;
+  bins->size = binsize;
+  bins->x0 = lo[0];
+  bins->y0 = lo[1];
+  bins->z0 = lo[2];
+  bins->nx = (int) ((hi[0] - lo[0]) / binsize) + 1;
+  bins->ny = (int) ((hi[1] - lo[1]) / binsize) + 1;
+  bins->nz = (int) ((hi[2] - lo[2]) / binsize) + 1;
+
+  int nbins = bins->nx * bins->ny * bins->nz;
+  int *bin = (int *) malloc(count * sizeof(int));
+  bins->start = (int *) calloc(nbins + 1, sizeof(int));
+  bins->atoms = (float4 *) malloc(count * sizeof(float4));
+  if (bin == NULL || bins->start == NULL || bins->atoms == NULL) {
+    printf("Cannot allocate the atom bins\n");
+    return -1;
+  }
+
+  // counting sort of the atoms by bin
+  for (i=0; i<count; i++) {
+    int bx = (int) ((atoms[i*4    ] - lo[0]) / binsize);
+    int by = (int) ((atoms[i*4 + 1] - lo[1]) / binsize);
+    int bz = (int) ((atoms[i*4 + 2] - lo[2]) / binsize);
+    bx = bx < bins->nx ? bx : bins->nx - 1;
+    by = by < bins->ny ? by : bins->ny - 1;
+    bz = bz < bins->nz ? bz : bins->nz - 1;
+    bin[i] = (bz * bins->ny + by) * bins->nx + bx;
+    bins->start[bin[i] + 1]++;
+  }
+  for (k=0; k<nbins; k++)
+    bins->start[k+1] += bins->start[k];
+
+  int *fill = (int *) malloc(nbins * sizeof(int));
+  for (k=0; k<nbins; k++)
+    fill[k] = bins->start[k];
+  for (i=0; i<count; i++) {
+    float4 a = { atoms[i*4], atoms[i*4 + 1], atoms[i*4 + 2], atoms[i*4 + 3] };
+    bins->atoms[fill[bin[i]]++] = a;
+  }
+
+  free(fill);
+  free(bin);
+  return 0;
+}
+
+void free_bins(atom_bins *bins) {
+  free(bins->atoms);
+  free(bins->start);
+}
+
+#pragma omp declare target
+// Coulomb with a smooth switch to zero at the cutoff
+inline float cutoff_kernel(float r2, float inv_rc2) {
+  float s = 1.0f - r2 * inv_rc2;
+  return s * s / sqrtf(r2);
+}
+
+// Short-range part 1/r - g_a(r) of the multilevel summation, where g_a is
+// 1/r softened inside the splitting distance a (zero beyond a)
+inline float msm_short_kernel(float r2, float inv_a) {
+  float s = r2 * inv_a * inv_a;
+  return 1.0f / sqrtf(r2) - inv_a * (1.875f - s * (1.25f - 0.375f * s));
+}
+#pragma omp end declare target
+
+void cutoff_potential(float *energy, const atom_bins *bins, int3 volsize,
+                      float gridspacing, float zplane, float cutoff, int kernel) {
+  const float4 *batoms = bins->atoms;
+  const int *bstart = bins->start;
+  const int count = bins->count;
+  const int nx = bins->nx, ny = bins->ny, nz = bins->nz;
+  const int nbins = nx * ny * nz;
+  const float x0 = bins->x0, y0 = bins->y0, z0 = bins->z0;
+  const float inv_size = 1.0f / bins->size;
+  const float rc2 = cutoff * cutoff;
+  const float inv_rc2 = 1.0f / rc2;
+  const float inv_a = 1.0f / cutoff;
+  const int volx = volsize.x, voly = volsize.y;
+
+  #pragma omp target teams distribute parallel for collapse(2) thread_limit(256) \
+    map(to: batoms[0:count], bstart[0:nbins+1]) map(from: energy[0:volx*voly])
+  for (int yindex = 0; yindex < voly; yindex++) {
+    for (int xindex = 0; xindex < volx; xindex++) {
+      float coorx = gridspacing * xindex;
+      float coory = gridspacing * yindex;
+
+      // bins overlapping the cube around the cutoff sphere
+      int bx0 = (int) floorf((coorx - cutoff - x0) * inv_size);
+      int bx1 = (int) floorf((coorx + cutoff - x0) * inv_size);
+      int by0 = (int) floorf((coory - cutoff - y0) * inv_size);
+      int by1 = (int) floorf((coory + cutoff - y0) * inv_size);
+      int bz0 = (int) floorf((zplane - cutoff - z0) * inv_size);
+      int bz1 = (int) floorf((zplane + cutoff - z0) * inv_size);
+      bx0 = bx0 > 0 ? bx0 : 0;  bx1 = bx1 < nx - 1 ? bx1 : nx - 1;
+      by0 = by0 > 0 ? by0 : 0;  by1 = by1 < ny - 1 ? by1 : ny - 1;
+      bz0 = bz0 > 0 ? bz0 : 0;  bz1 = bz1 < nz - 1 ? bz1 : nz - 1;
+
+      float energyval = 0.0f;
+      // lattice points farther than the cutoff from the bin grid see no bins
+      if (bx0 <= bx1 && by0 <= by1 && bz0 <= bz1) {
+        for (int bz = bz0; bz <= bz1; bz++) {
+          for (int by = by0; by <= by1; by++) {
+            // the bins of a row are contiguous
+            int row = (bz * ny + by) * nx;
+            int first = bstart[row + bx0];
+            int last = bstart[row + bx1 + 1];
+            for (int atomid = first; atomid < last; atomid++) {
+              float dx = coorx - batoms[atomid].x;
+              float dy = coory - batoms[atomid].y;
+              float dz = zplane - batoms[atomid].z;
+              float r2 = dx*dx + dy*dy + dz*dz;
+              if (r2 < rc2) {
+                energyval += batoms[atomid].w * (kernel == KERNEL_CUTOFF ?
+                    cutoff_kernel(r2, inv_rc2) : msm_short_kernel(r2, inv_a));
+              }
+            }
+          }
+        }
+      }
+      energy[yindex * volx + xindex] = energyval;
+    }
+  }
+}
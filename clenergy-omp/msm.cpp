@@ -0,0 +1,298 @@
+/*
+ * Multilevel summation of the Coulombic potential
+ *
+ * The kernel is split into a short-range part and a hierarchy of smooth
+ * parts on successively coarser grids:
+ *
+ *   1/r = (1/r - g_a) + (g_a - g_2a) + (g_2a - g_4a) + ... + g_(2^(L-1) a)
+ *
+ * where g_a is 1/r softened inside a. The short-range part is summed over
+ * the atom bins (cutoff_potential). The charges are spread to the finest
+ * grid with C1 cubic interpolation and restricted to the coarser grids.
+ * On level l < L-1 the grid potential is the convolution with
+ * g_(2^l a) - g_(2^(l+1) a), which vanishes beyond 2^(l+1) a, i.e. beyond
+ * the same number of grid points on every level. The top level is summed
+ * directly. The grid potentials are then prolongated back to the finest
+ * grid and interpolated to the lattice.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "clenergy.h"
+
+struct msm_grid {
+  int nx, ny, nz;   // grid points
+  int ox, oy, oz;   // index of the first point, in units of the level spacing
+  float h;          // spacing
+  float *q;         // charges
+  float *e;         // potential
+};
+
+static int floordiv(int a, int b) {
+  return (a >= 0) ? a / b : -((-a + b - 1) / b);
+}
+
+#pragma omp declare target
+// C1 cubic interpolation basis
+inline float phi(float t) {
+  t = fabsf(t);
+  if (t <= 1.0f) return (1.0f - t) * (1.0f + t - 1.5f * t * t);
+  if (t <= 2.0f) return -0.5f * (t - 1.0f) * (2.0f - t) * (2.0f - t);
+  return 0.0f;
+}
+
+// Softened 1/r: equal to 1/r beyond a, an even polynomial inside
+inline float gamma_a(float r, float a) {
+  if (r >= a) return 1.0f / r;
+  float s = (r * r) / (a * a);
+  return (1.875f - s * (1.25f - 0.375f * s)) / a;
+}
+
+// Weight of the fine point 2M + k in the coarse point M, k in [-3, 3]
+inline float restrict_weight(int k) {
+  k = k < 0 ? -k : k;
+  return k == 0 ? 1.0f : k == 1 ? 0.5625f : k == 3 ? -0.0625f : 0.0f;
+}
+#pragma omp end declare target
+
+// The coarse grid covers the support of all the fine points
+static void coarsen(const msm_grid &f, msm_grid &c) {
+  int lo, hi;
+  c.h = 2.0f * f.h;
+  lo = floordiv(f.ox - 3 + 1, 2);  hi = floordiv(f.ox + f.nx - 1 + 3, 2);
+  c.ox = lo;  c.nx = hi - lo + 1;
+  lo = floordiv(f.oy - 3 + 1, 2);  hi = floordiv(f.oy + f.ny - 1 + 3, 2);
+  c.oy = lo;  c.ny = hi - lo + 1;
+  lo = floordiv(f.oz - 3 + 1, 2);  hi = floordiv(f.oz + f.nz - 1 + 3, 2);
+  c.oz = lo;  c.nz = hi - lo + 1;
+}
+
+void msm_potential(float *energy, const atom_bins *bins, int3 volsize,
+                   float gridspacing, float zplane) {
+  const float a = MSM_A;
+  const float h = MSM_H;
+  int i, l;
+
+  // short-range part
+  cutoff_potential(energy, bins, volsize, gridspacing, zplane, a, KERNEL_MSM);
+
+  // The finest grid covers the atoms and the lattice, with one spacing of
+  // margin below and two above for the interpolation support.
+  const float4 *batoms = bins->atoms;
+  const int count = bins->count;
+  float lo[3], hi[3];
+  lo[0] = fminf(bins->x0, 0.0f);
+  lo[1] = fminf(bins->y0, 0.0f);
+  lo[2] = fminf(bins->z0, zplane);
+  hi[0] = fmaxf(bins->x0 + bins->nx * bins->size, gridspacing * (volsize.x - 1));
+  hi[1] = fmaxf(bins->y0 + bins->ny * bins->size, gridspacing * (volsize.y - 1));
+  hi[2] = fmaxf(bins->z0 + bins->nz * bins->size, zplane);
+  const float gx0 = lo[0] - h, gy0 = lo[1] - h, gz0 = lo[2] - h;
+
+  msm_grid grid[MSM_LEVELS];
+  grid[0].h = h;
+  grid[0].ox = grid[0].oy = grid[0].oz = 0;
+  grid[0].nx = (int) ((hi[0] - gx0) / h) + 3;
+  grid[0].ny = (int) ((hi[1] - gy0) / h) + 3;
+  grid[0].nz = (int) ((hi[2] - gz0) / h) + 3;
+
+  int levels = 1;
+  while (levels < MSM_LEVELS &&
+         (grid[levels-1].nx > MSM_TOP || grid[levels-1].ny > MSM_TOP || grid[levels-1].nz > MSM_TOP)) {
+    coarsen(grid[levels-1], grid[levels]);
+    levels++;
+  }
+
+  for (l = 0; l < levels; l++) {
+    int n = grid[l].nx * grid[l].ny * grid[l].nz;
+    grid[l].q = (float *) malloc(n * sizeof(float));
+    grid[l].e = (float *) malloc(n * sizeof(float));
+    #pragma omp target enter data map(alloc: grid[l].q[0:n], grid[l].e[0:n])
+  }
+  printf("MSM: %d levels, finest grid %d x %d x %d, top grid %d x %d x %d\n", levels,
+         grid[0].nx, grid[0].ny, grid[0].nz,
+         grid[levels-1].nx, grid[levels-1].ny, grid[levels-1].nz);
+
+  // stencil of g_a - g_2a on the finest grid; on level l it is scaled by 1/2^l
+  const int R = (int) ceilf(2.0f * a / h);
+  const int sw = 2 * R + 1;
+  float *stencil = (float *) malloc(sw * sw * sw * sizeof(float));
+  for (int k = -R; k <= R; k++)
+    for (int j = -R; j <= R; j++)
+      for (i = -R; i <= R; i++) {
+        float r = h * sqrtf((float) (i*i + j*j + k*k));
+        stencil[((k+R) * sw + (j+R)) * sw + (i+R)] =
+          (r < 2.0f * a) ? gamma_a(r, a) - gamma_a(r, 2.0f * a) : 0.0f;
+      }
+
+  #pragma omp target data map(to: batoms[0:count], stencil[0:sw*sw*sw])
+  {
+    // anterpolation: spread the charges to the finest grid
+    {
+      float *q0 = grid[0].q;
+      const int nx = grid[0].nx, ny = grid[0].ny, n = nx * ny * grid[0].nz;
+
+      #pragma omp target teams distribute parallel for thread_limit(256)
+      for (int m = 0; m < n; m++)
+        q0[m] = 0.0f;
+
+      #pragma omp target teams distribute parallel for thread_limit(256)
+      for (int atomid = 0; atomid < count; atomid++) {
+        float tx = (batoms[atomid].x - gx0) / h;
+        float ty = (batoms[atomid].y - gy0) / h;
+        float tz = (batoms[atomid].z - gz0) / h;
+        int ix = (int) floorf(tx), iy = (int) floorf(ty), iz = (int) floorf(tz);
+        for (int k = iz - 1; k <= iz + 2; k++) {
+          float wz = batoms[atomid].w * phi(tz - k);
+          for (int j = iy - 1; j <= iy + 2; j++) {
+            float wyz = wz * phi(ty - j);
+            for (int i = ix - 1; i <= ix + 2; i++) {
+              float w = wyz * phi(tx - i);
+              #pragma omp atomic update
+              q0[(k * ny + j) * nx + i] += w;
+            }
+          }
+        }
+      }
+    }
+
+    // restriction of the charges to the coarser grids
+    for (l = 0; l + 1 < levels; l++) {
+      const msm_grid f = grid[l], c = grid[l+1];
+      const float *qf = f.q;
+      float *qc = c.q;
+
+      #pragma omp target teams distribute parallel for collapse(3) thread_limit(256)
+      for (int k = 0; k < c.nz; k++)
+        for (int j = 0; j < c.ny; j++)
+          for (int i = 0; i < c.nx; i++) {
+            // the fine points 2M-3 .. 2M+3 around the coarse point M
+            int fx = 2 * (i + c.ox) - f.ox, fy = 2 * (j + c.oy) - f.oy, fz = 2 * (k + c.oz) - f.oz;
+            float sum = 0.0f;
+            for (int dz = -3; dz <= 3; dz++) {
+              if (fz + dz < 0 || fz + dz >= f.nz) continue;
+              for (int dy = -3; dy <= 3; dy++) {
+                if (fy + dy < 0 || fy + dy >= f.ny) continue;
+                float wyz = restrict_weight(dz) * restrict_weight(dy);
+                for (int dx = -3; dx <= 3; dx++) {
+                  if (fx + dx < 0 || fx + dx >= f.nx) continue;
+                  sum += wyz * restrict_weight(dx) * qf[((fz+dz) * f.ny + fy+dy) * f.nx + fx+dx];
+                }
+              }
+            }
+            qc[(k * c.ny + j) * c.nx + i] = sum;
+          }
+    }
+
+    // grid-to-grid: cutoff convolutions on all levels but the top
+    for (l = 0; l + 1 < levels; l++) {
+      const msm_grid g = grid[l];
+      const float *q = g.q;
+      float *e = g.e;
+      const float scale = 1.0f / (float) (1 << l);
+
+      #pragma omp target teams distribute parallel for collapse(3) thread_limit(256)
+      for (int k = 0; k < g.nz; k++)
+        for (int j = 0; j < g.ny; j++)
+          for (int i = 0; i < g.nx; i++) {
+            int k0 = k - R > 0 ? k - R : 0, k1 = k + R < g.nz - 1 ? k + R : g.nz - 1;
+            int j0 = j - R > 0 ? j - R : 0, j1 = j + R < g.ny - 1 ? j + R : g.ny - 1;
+            int i0 = i - R > 0 ? i - R : 0, i1 = i + R < g.nx - 1 ? i + R : g.nx - 1;
+            float sum = 0.0f;
+            for (int kk = k0; kk <= k1; kk++)
+              for (int jj = j0; jj <= j1; jj++) {
+                const float *s = stencil + ((kk - k + R) * sw + (jj - j + R)) * sw + R - i;
+                const float *qr = q + (kk * g.ny + jj) * g.nx;
+                for (int ii = i0; ii <= i1; ii++)
+                  sum += s[ii] * qr[ii];
+              }
+            e[(k * g.ny + j) * g.nx + i] = scale * sum;
+          }
+    }
+
+    // top level: direct sum with the softened kernel
+    {
+      const msm_grid g = grid[levels-1];
+      const float *q = g.q;
+      float *e = g.e;
+      const float at = a * (float) (1 << (levels - 1));
+      const int n = g.nx * g.ny * g.nz;
+
+      #pragma omp target teams distribute parallel for thread_limit(256)
+      for (int m = 0; m < n; m++) {
+        int i = m % g.nx, j = (m / g.nx) % g.ny, k = m / (g.nx * g.ny);
+        float sum = 0.0f;
+        for (int mm = 0; mm < n; mm++) {
+          int ii = mm % g.nx, jj = (mm / g.nx) % g.ny, kk = mm / (g.nx * g.ny);
+          float r = g.h * sqrtf((float) ((ii-i)*(ii-i) + (jj-j)*(jj-j) + (kk-k)*(kk-k)));
+          sum += gamma_a(r, at) * q[mm];
+        }
+        e[m] = sum;
+      }
+    }
+
+    // prolongation of the potentials to the finest grid
+    for (l = levels - 2; l >= 0; l--) {
+      const msm_grid f = grid[l], c = grid[l+1];
+      const float *ec = c.e;
+      float *ef = f.e;
+
+      #pragma omp target teams distribute parallel for collapse(3) thread_limit(256)
+      for (int k = 0; k < f.nz; k++)
+        for (int j = 0; j < f.ny; j++)
+          for (int i = 0; i < f.nx; i++) {
+            // the coarse points M with |J - 2M| <= 3 around the fine point J
+            int fx = i + f.ox, fy = j + f.oy, fz = k + f.oz;
+            float sum = 0.0f;
+            for (int cz = (fz - 2) >> 1; cz <= (fz + 3) >> 1; cz++) {
+              if (cz - c.oz < 0 || cz - c.oz >= c.nz) continue;
+              for (int cy = (fy - 2) >> 1; cy <= (fy + 3) >> 1; cy++) {
+                if (cy - c.oy < 0 || cy - c.oy >= c.ny) continue;
+                float wyz = restrict_weight(fz - 2*cz) * restrict_weight(fy - 2*cy);
+                for (int cx = (fx - 2) >> 1; cx <= (fx + 3) >> 1; cx++) {
+                  if (cx - c.ox < 0 || cx - c.ox >= c.nx) continue;
+                  sum += wyz * restrict_weight(fx - 2*cx) *
+                         ec[((cz - c.oz) * c.ny + cy - c.oy) * c.nx + cx - c.ox];
+                }
+              }
+            }
+            ef[(k * f.ny + j) * f.nx + i] += sum;
+          }
+    }
+
+    // interpolation of the long-range part to the lattice
+    {
+      const float *e0 = grid[0].e;
+      const int nx = grid[0].nx, ny = grid[0].ny;
+      const int volx = volsize.x, voly = volsize.y;
+
+      #pragma omp target teams distribute parallel for collapse(2) thread_limit(256) \
+        map(tofrom: energy[0:volx*voly])
+      for (int yindex = 0; yindex < voly; yindex++)
+        for (int xindex = 0; xindex < volx; xindex++) {
+          float tx = (gridspacing * xindex - gx0) / h;
+          float ty = (gridspacing * yindex - gy0) / h;
+          float tz = (zplane - gz0) / h;
+          int ix = (int) floorf(tx), iy = (int) floorf(ty), iz = (int) floorf(tz);
+          float sum = 0.0f;
+          for (int k = iz - 1; k <= iz + 2; k++)
+            for (int j = iy - 1; j <= iy + 2; j++) {
+              float wyz = phi(tz - k) * phi(ty - j);
+              for (int i = ix - 1; i <= ix + 2; i++)
+                sum += wyz * phi(tx - i) * e0[(k * ny + j) * nx + i];
+            }
+          energy[yindex * volx + xindex] += sum;
+        }
+    }
+  }
+
+  for (l = 0; l < levels; l++) {
+    int n = grid[l].nx * grid[l].ny * grid[l].nz;
+    float *q = grid[l].q, *e = grid[l].e;
+    #pragma omp target exit data map(delete: q[0:n], e[0:n])
+    free(q);
+    free(e);
+  }
+  free(stencil);
+}
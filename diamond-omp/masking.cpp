@@ -17,6 +17,7 @@
  ****/
 
 #include "../diamond-sycl/src/basic/masking.h"
+#include "striped_sw.h"
 
 
 #define SEQ_LEN 33
@@ -388,4 +389,7 @@ void mask_seqs(Sequence_set &seqs, const Masking &masking, bool hard_mask)
     p += seqs.length(i);
   }
   if (error == 0) printf("Success\n");
+
+  // score the masked sequences against each other
+  striped_sw_search(seqs);
 }
@@ -0,0 +1,311 @@
+/****
+  DIAMOND protein aligner
+  Copyright (C) 2013-2017 Benjamin Buchfink <buchfink@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ****/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+#include "striped_sw.h"
+#include "../diamond-sycl/src/basic/config.h"
+#include "../diamond-sycl/src/basic/score_matrix.h"
+#include "../diamond-sycl/src/util/simd.h"
+#include "../diamond-sycl/src/util/Timer.h"
+
+using std::vector;
+
+// Striped Smith-Waterman with affine gaps (Farrar, Bioinformatics 2007).
+// Query position i lives in lane i / segLen of vector i % segLen, so the
+// inner loop over a subject residue has no dependency between lanes; the
+// vertical gaps that cross lanes are fixed up afterwards by the lazy-F loop.
+// Scores are computed with 16 unsigned 8-bit lanes first and recomputed
+// with 8 signed 16-bit lanes when the 8-bit range saturates.
+
+#ifdef __SSE2__
+
+struct Striped_profile
+{
+  Striped_profile(const Letter *query, int qlen):
+    seg8((qlen + 15) / 16),
+    seg16((qlen + 7) / 8)
+  {
+    posix_memalign((void**)&p8, 16, 32 * seg8 * sizeof(__m128i));
+    posix_memalign((void**)&p16, 16, 32 * seg16 * sizeof(__m128i));
+
+    // padding beyond the query end scores 0 and cannot raise the maximum
+    uint8_t *b = (uint8_t*)p8;
+    for (int a = 0; a < 32; a++)
+      for (int i = 0; i < seg8; i++)
+        for (int k = 0; k < 16; k++) {
+          const int q = k * seg8 + i;
+          *b++ = q < qlen ? score_matrix.biased_score(a, query[q]) : score_matrix.bias();
+        }
+
+    int16_t *w = (int16_t*)p16;
+    for (int a = 0; a < 32; a++)
+      for (int i = 0; i < seg16; i++)
+        for (int k = 0; k < 8; k++) {
+          const int q = k * seg16 + i;
+          *w++ = q < qlen ? score_matrix(a, query[q]) : 0;
+        }
+  }
+  ~Striped_profile()
+  {
+    free(p8);
+    free(p16);
+  }
+  const int seg8, seg16;
+  __m128i *p8, *p16;
+};
+
+static inline int hmax_epu8(__m128i v)
+{
+  v = _mm_max_epu8(v, _mm_srli_si128(v, 8));
+  v = _mm_max_epu8(v, _mm_srli_si128(v, 4));
+  v = _mm_max_epu8(v, _mm_srli_si128(v, 2));
+  v = _mm_max_epu8(v, _mm_srli_si128(v, 1));
+  return _mm_extract_epi16(v, 0) & 0xff;
+}
+
+static inline int hmax_epi16(__m128i v)
+{
+  v = _mm_max_epi16(v, _mm_srli_si128(v, 8));
+  v = _mm_max_epi16(v, _mm_srli_si128(v, 4));
+  v = _mm_max_epi16(v, _mm_srli_si128(v, 2));
+  return (int16_t)_mm_extract_epi16(v, 0);
+}
+
+// Returns the local alignment score, or -1 if it saturated the 8-bit range.
+// buf holds at least 3 * profile.seg8 vectors.
+static int striped_sw8(const Striped_profile &profile, const Letter *subject, int slen, __m128i *buf)
+{
+  const int segLen = profile.seg8;
+  const int bias = score_matrix.bias();
+  const __m128i vZero = _mm_setzero_si128(),
+    vGapO = _mm_set1_epi8((char)(score_matrix.gap_open() + score_matrix.gap_extend())),
+    vGapE = _mm_set1_epi8((char)score_matrix.gap_extend()),
+    vBias = _mm_set1_epi8((char)bias);
+
+  __m128i *pvHStore = buf, *pvHLoad = buf + segLen, *pvE = buf + 2 * segLen;
+  for (int i = 0; i < 3 * segLen; i++)
+    buf[i] = vZero;
+
+  __m128i vMax = vZero;
+  for (int j = 0; j < slen; j++) {
+    const __m128i *vP = &profile.p8[(subject[j] & 31) * segLen];
+    __m128i vF = vZero;
+    __m128i vH = _mm_slli_si128(pvHStore[segLen - 1], 1);
+    std::swap(pvHLoad, pvHStore);
+
+    for (int i = 0; i < segLen; i++) {
+      vH = _mm_subs_epu8(_mm_adds_epu8(vH, vP[i]), vBias);
+      const __m128i e = pvE[i];
+      vH = _mm_max_epu8(vH, e);
+      vH = _mm_max_epu8(vH, vF);
+      vMax = _mm_max_epu8(vMax, vH);
+      pvHStore[i] = vH;
+
+      vH = _mm_subs_epu8(vH, vGapO);
+      pvE[i] = _mm_max_epu8(_mm_subs_epu8(e, vGapE), vH);
+      vF = _mm_max_epu8(_mm_subs_epu8(vF, vGapE), vH);
+      vH = pvHLoad[i];
+    }
+
+    // carry F into the next lane until it no longer beats opening a gap
+    vF = _mm_slli_si128(vF, 1);
+    int i = 0;
+    for (;;) {
+      vH = pvHStore[i];
+      const __m128i vT = _mm_subs_epu8(vH, vGapO);
+      if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_subs_epu8(vF, vT), vZero)) == 0xffff)
+        break;
+      vH = _mm_max_epu8(vH, vF);
+      vMax = _mm_max_epu8(vMax, vH);
+      pvHStore[i] = vH;
+      pvE[i] = _mm_max_epu8(pvE[i], _mm_subs_epu8(vH, vGapO));
+      vF = _mm_subs_epu8(vF, vGapE);
+      if (++i == segLen) {
+        vF = _mm_slli_si128(vF, 1);
+        i = 0;
+      }
+    }
+  }
+
+  const int best = hmax_epu8(vMax);
+  return best + bias >= 255 ? -1 : best;
+}
+
+// buf holds at least 3 * profile.seg16 vectors.
+static int striped_sw16(const Striped_profile &profile, const Letter *subject, int slen, __m128i *buf)
+{
+  const int segLen = profile.seg16;
+  const __m128i vZero = _mm_setzero_si128(),
+    vGapO = _mm_set1_epi16((short)(score_matrix.gap_open() + score_matrix.gap_extend())),
+    vGapE = _mm_set1_epi16((short)score_matrix.gap_extend());
+
+  __m128i *pvHStore = buf, *pvHLoad = buf + segLen, *pvE = buf + 2 * segLen;
+  for (int i = 0; i < 3 * segLen; i++)
+    buf[i] = vZero;
+
+  // E and F never drop below zero (unsigned subtraction), which keeps H >= 0
+  __m128i vMax = vZero;
+  for (int j = 0; j < slen; j++) {
+    const __m128i *vP = &profile.p16[(subject[j] & 31) * segLen];
+    __m128i vF = vZero;
+    __m128i vH = _mm_slli_si128(pvHStore[segLen - 1], 2);
+    std::swap(pvHLoad, pvHStore);
+
+    for (int i = 0; i < segLen; i++) {
+      vH = _mm_adds_epi16(vH, vP[i]);
+      const __m128i e = pvE[i];
+      vH = _mm_max_epi16(vH, e);
+      vH = _mm_max_epi16(vH, vF);
+      vMax = _mm_max_epi16(vMax, vH);
+      pvHStore[i] = vH;
+
+      vH = _mm_subs_epu16(vH, vGapO);
+      pvE[i] = _mm_max_epi16(_mm_subs_epu16(e, vGapE), vH);
+      vF = _mm_max_epi16(_mm_subs_epu16(vF, vGapE), vH);
+      vH = pvHLoad[i];
+    }
+
+    vF = _mm_slli_si128(vF, 2);
+    int i = 0;
+    for (;;) {
+      vH = pvHStore[i];
+      const __m128i vT = _mm_subs_epu16(vH, vGapO);
+      if (_mm_movemask_epi8(_mm_cmpgt_epi16(vF, vT)) == 0)
+        break;
+      vH = _mm_max_epi16(vH, vF);
+      vMax = _mm_max_epi16(vMax, vH);
+      pvHStore[i] = vH;
+      pvE[i] = _mm_max_epi16(pvE[i], _mm_subs_epu16(vH, vGapO));
+      vF = _mm_subs_epu16(vF, vGapE);
+      if (++i == segLen) {
+        vF = _mm_slli_si128(vF, 2);
+        i = 0;
+      }
+    }
+  }
+
+  return hmax_epi16(vMax);
+}
+
+// Gotoh reference used to verify the striped scores
+static int smith_waterman(const Letter *query, int qlen, const Letter *subject, int slen)
+{
+  const int gap_open = score_matrix.gap_open() + score_matrix.gap_extend(),
+        gap_extend = score_matrix.gap_extend();
+  vector<int> H(qlen + 1, 0), E(qlen + 1, 0);
+  int best = 0;
+  for (int j = 0; j < slen; j++) {
+    int diag = 0, up = 0, F = 0;
+    for (int i = 1; i <= qlen; i++) {
+      E[i] = std::max(E[i] - gap_extend, H[i] - gap_open);
+      F = std::max(F - gap_extend, up - gap_open);
+      int h = diag + score_matrix(query[i - 1], subject[j]);
+      h = std::max(std::max(h, 0), std::max(E[i], F));
+      diag = H[i];
+      H[i] = up = h;
+      best = std::max(best, h);
+    }
+  }
+  return best;
+}
+
+#endif
+
+void striped_sw_search(const Sequence_set &seqs, unsigned n_queries)
+{
+#ifdef __SSE2__
+  const int n = seqs.get_length();
+  if (n_queries > (unsigned)n) n_queries = n;
+
+  // length-sorted database so that a batch holds subjects of similar cost
+  vector<int> db(n);
+  size_t db_letters = 0;
+  for (int i = 0; i < n; i++) {
+    db[i] = i;
+    db_letters += seqs.length(i);
+  }
+  std::stable_sort(db.begin(), db.end(), [&seqs](int a, int b) {
+    return seqs.length(a) < seqs.length(b);
+  });
+
+  vector<Striped_profile*> profiles(n_queries);
+  size_t query_letters = 0;
+  int max_seg = 0;
+  for (unsigned q = 0; q < n_queries; q++) {
+    profiles[q] = new Striped_profile(seqs.ptr(q), (int)seqs.length(q));
+    query_letters += seqs.length(q);
+    max_seg = std::max(max_seg, std::max(profiles[q]->seg8, profiles[q]->seg16));
+  }
+
+  printf("Scoring %u masked queries against %d sequences (%zu letters)...\n",
+         n_queries, n, db_letters);
+
+  vector<int> scores((size_t)n_queries * n);
+  const int batches = (n + SW_BATCH - 1) / SW_BATCH;
+  int overflow = 0;
+
+  Timer t;
+  t.start();
+
+  #pragma omp parallel num_threads(config.threads_) reduction(+: overflow)
+  {
+    __m128i *buf = NULL;
+    posix_memalign((void**)&buf, 16, 3 * max_seg * sizeof(__m128i));
+
+    #pragma omp for schedule(dynamic)
+    for (int b = 0; b < batches; b++) {
+      const int end = std::min(n, (b + 1) * SW_BATCH);
+      for (unsigned q = 0; q < n_queries; q++)
+        for (int k = b * SW_BATCH; k < end; k++) {
+          const int s = db[k];
+          int score = striped_sw8(*profiles[q], seqs.ptr(s), (int)seqs.length(s), buf);
+          if (score < 0) {
+            score = striped_sw16(*profiles[q], seqs.ptr(s), (int)seqs.length(s), buf);
+            overflow++;
+          }
+          scores[(size_t)q * n + s] = score;
+        }
+    }
+    free(buf);
+  }
+
+  const double elapsed = t.getElapsedTimeInMicroSec() / 1e6;
+  message_stream << "Total time (striped Smith-Waterman) on the CPU = " << elapsed << " s" << std::endl;
+  printf("%d of %zu alignments recomputed with 16-bit scores\n", overflow, scores.size());
+  printf("GCUPS: %.3f\n", (double)query_letters * db_letters / elapsed * 1e-9);
+
+  printf("Verify the scores of the first query...\n");
+  int error = 0;
+  for (int s = 0; s < n; s++) {
+    const int ref = smith_waterman(seqs.ptr(0), (int)seqs.length(0), seqs.ptr(s), (int)seqs.length(s));
+    if (ref != scores[s]) {
+      if (error < 10) printf("error at i=%d  host=%d  striped=%d\n", s, ref, scores[s]);
+      error++;
+    }
+  }
+  if (error == 0) printf("Success\n");
+
+  for (unsigned q = 0; q < n_queries; q++)
+    delete profiles[q];
+#else
+  printf("The striped Smith-Waterman requires SSE2\n");
+#endif
+}
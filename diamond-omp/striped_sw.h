@@ -0,0 +1,34 @@
+/****
+  DIAMOND protein aligner
+  Copyright (C) 2013-2017 Benjamin Buchfink <buchfink@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ****/
+
+#ifndef STRIPED_SW_H_
+#define STRIPED_SW_H_
+
+#include "../diamond-sycl/src/data/sequence_set.h"
+
+// number of masked sequences scored as queries against the whole set
+#define SW_QUERIES 64
+
+// database sequences handed to a thread at a time
+#define SW_BATCH 256
+
+// Score the first n_queries sequences of seqs against all of seqs with a
+// striped Smith-Waterman and report the throughput in GCUPS.
+void striped_sw_search(const Sequence_set &seqs, unsigned n_queries = SW_QUERIES);
+
+#endif
@@ -0,0 +1,333 @@
+/*
+   Batched ksw_extend2
+
+   Each thread of a team extends one seed (inter-task parallelism). The jobs
+   are sorted by their score range and query length and cut into buckets of
+   BUCKET_SIZE jobs, one bucket per team, so the lanes of a team have similar
+   trip counts. The score rows and the query profiles of a bucket are stored
+   interleaved by lane, so neighboring lanes touch neighboring addresses.
+
+   H and E are non-negative and bounded by h0 + max(mat) * min(qlen, tlen),
+   so a bucket stores its score rows in 8 or 16 bits whenever that bound
+   fits. The arithmetic itself is done in int, so the results are identical
+   to the scalar ksw_extend2.
+*/
+#ifndef __EXTEND2_BATCH
+#define __EXTEND2_BATCH
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include <omp.h>
+#include "read_data.h"
+
+#ifndef BUCKET_SIZE
+#define BUCKET_SIZE 64
+#endif
+
+// largest alphabet of a scoring matrix (mat[25])
+#define MAX_M 5
+
+struct extend2_job {
+  int qlen, tlen;
+  int qoff, toff;   // offsets of the query and the target in the packed sequences
+  int m;
+  int o_del, e_del, o_ins, e_ins;
+  int w, end_bonus, zdrop, h0;
+};
+
+struct extend2_res {
+  int qle, tle, gtle, gscore, max_off, score;
+};
+
+struct extend2_bucket {
+  int first;        // first job (in sorted order)
+  int count;
+  int qmax;         // longest query in the bucket
+  long eh_off;      // offset of the score rows, in elements
+  long qp_off;      // offset of the query profiles, in bytes
+};
+
+enum { SCORE_8 = 0, SCORE_16 = 1, SCORE_32 = 2 };
+
+#pragma omp declare target
+template <typename T>
+void extend2_lane(const extend2_job &jb, const char *mat,
+                  const unsigned char *query, const unsigned char *target,
+                  T *eh_h, T *eh_e, char *qp, const int qmax, const int lane,
+                  extend2_res &r)
+{
+  // element j of this lane
+#define EH_H(j) eh_h[(long)(j) * BUCKET_SIZE + lane]
+#define EH_E(j) eh_e[(long)(j) * BUCKET_SIZE + lane]
+#define QP(k, j) qp[((long)(k) * qmax + (j)) * BUCKET_SIZE + lane]
+
+  const int qlen = jb.qlen;
+  const int tlen = jb.tlen;
+  const int m = jb.m;
+  const int o_del = jb.o_del;
+  const int e_del = jb.e_del;
+  const int o_ins = jb.o_ins;
+  const int e_ins = jb.e_ins;
+  const int end_bonus = jb.end_bonus;
+  const int zdrop = jb.zdrop;
+  const int h0 = jb.h0;
+  int w = jb.w;
+
+  int oe_del = o_del + e_del;
+  int oe_ins = o_ins + e_ins;
+  int i, j, k;
+  int beg, end;
+  int max, max_i, max_j, max_ins, max_del, max_ie;
+  int gscore;
+  int max_off;
+
+  // generate the query profile
+  for (k = 0; k < m; ++k) {
+    const char *p = mat + k * m;
+    for (j = 0; j < qlen; ++j)
+      QP(k, j) = p[query[j]];
+  }
+
+  for (j = 0; j <= qlen; ++j) {
+    EH_H(j) = 0;
+    EH_E(j) = 0;
+  }
+
+  // fill the first row
+  EH_H(0) = h0;
+  EH_H(1) = h0 > oe_ins? h0 - oe_ins : 0;
+
+  for (j = 2; j <= qlen && EH_H(j-1) > e_ins; ++j)
+    EH_H(j) = EH_H(j-1) - e_ins;
+
+  // adjust $w if it is too large
+  k = m * m;
+  for (i = 0, max = 0; i < k; ++i) // get the max score
+    max = max > mat[i]? max : mat[i];
+  max_ins = (int)((double)(qlen * max + end_bonus - o_ins) / e_ins + 1.);
+  max_ins = max_ins > 1? max_ins : 1;
+  w = w < max_ins? w : max_ins;
+  max_del = (int)((double)(qlen * max + end_bonus - o_del) / e_del + 1.);
+  max_del = max_del > 1? max_del : 1;
+  w = w < max_del? w : max_del;
+  // DP loop
+  max = h0, max_i = max_j = -1; max_ie = -1, gscore = -1;
+  max_off = 0;
+  beg = 0, end = qlen;
+  for (i = 0; i < tlen; ++i) {
+    int t, f = 0, h1, m = 0, mj = -1;
+    const int row = target[i];
+
+    // apply the band and the constraint (if provided)
+    if (beg < i - w) beg = i - w;
+    if (end > i + w + 1) end = i + w + 1;
+    if (end > qlen) end = qlen;
+
+    // compute the first column
+    if (beg == 0) {
+      h1 = h0 - (o_del + e_del * (i + 1));
+      if (h1 < 0) h1 = 0;
+    }
+    else
+      h1 = 0;
+
+    for (j = beg; j < end; ++j) {
+      int h, M = EH_H(j), e = EH_E(j); // get H(i-1,j-1) and E(i-1,j)
+      EH_H(j) = h1;                    // set H(i,j-1) for the next row
+      M = M? M + QP(row, j) : 0;
+      h = M > e? M : e;
+      h = h > f? h : f;
+      h1 = h;                          // save H(i,j) to h1 for the next column
+      mj = m > h? mj : j;              // record the position where max score is achieved
+      m = m > h? m : h;
+      t = M - oe_del;
+      t = t > 0? t : 0;
+      e -= e_del;
+      e = e > t? e : t;                // computed E(i+1,j)
+      EH_E(j) = e;                     // save E(i+1,j) for the next row
+      t = M - oe_ins;
+      t = t > 0? t : 0;
+      f -= e_ins;
+      f = f > t? f : t;                // computed F(i,j+1)
+    }
+    EH_H(end) = h1; EH_E(end) = 0;
+    if (j == qlen) {
+      max_ie = gscore > h1? max_ie : i;
+      gscore = gscore > h1? gscore : h1;
+    }
+    if (m == 0) break;
+    if (m > max) {
+      max = m, max_i = i, max_j = mj;
+      max_off = max_off > abs(mj - i)? max_off : abs(mj - i);
+    } else if (zdrop > 0) {
+      if (i - max_i > mj - max_j) {
+        if (max - m - ((i - max_i) - (mj - max_j)) * e_del > zdrop) break;
+      } else {
+        if (max - m - ((mj - max_j) - (i - max_i)) * e_ins > zdrop) break;
+      }
+    }
+    // update beg and end for the next round
+    for (j = beg; j < end && EH_H(j) == 0 && EH_E(j) == 0; ++j);
+    beg = j;
+    for (j = end; j >= beg && EH_H(j) == 0 && EH_E(j) == 0; --j);
+    end = j + 2 < qlen? j + 2 : qlen;
+  }
+  r.qle = max_j + 1;
+  r.tle = max_i + 1;
+  r.gtle = max_ie + 1;
+  r.gscore = gscore;
+  r.max_off = max_off;
+  r.score = max;
+
+#undef EH_H
+#undef EH_E
+#undef QP
+}
+#pragma omp end declare target
+
+// Run the buckets [b0, b1) whose score rows are stored in T
+template <typename T>
+void extend2_buckets(const extend2_bucket *buckets, const int b0, const int b1,
+                     const int *order, const extend2_job *jobs, const char *mats,
+                     const unsigned char *queries, const unsigned char *targets,
+                     char *qp, extend2_res *res, const long eh_elems)
+{
+  if (b0 == b1) return;
+
+  T *eh_h = (T*) malloc (sizeof(T) * eh_elems);
+  T *eh_e = (T*) malloc (sizeof(T) * eh_elems);
+
+#pragma omp target data map(alloc: eh_h[0:eh_elems], eh_e[0:eh_elems])
+  {
+#pragma omp target teams num_teams(b1 - b0) thread_limit(BUCKET_SIZE)
+    {
+#pragma omp parallel
+      {
+        const extend2_bucket bk = buckets[b0 + omp_get_team_num()];
+        for (int lane = omp_get_thread_num(); lane < bk.count; lane += omp_get_num_threads()) {
+          const int id = order[bk.first + lane];
+          const extend2_job jb = jobs[id];
+          extend2_res r;
+          extend2_lane<T>(jb, mats + id * 25, queries + jb.qoff, targets + jb.toff,
+                          eh_h + bk.eh_off, eh_e + bk.eh_off, qp + bk.qp_off,
+                          bk.qmax, lane, r);
+          res[id] = r;
+        }
+      }
+    }
+  }
+
+  free(eh_h);
+  free(eh_e);
+}
+
+// Extend n seeds. The results are returned in the order of the input.
+void extend2_batch(const struct extend2_dat *d, const int n, extend2_res *res)
+{
+  std::vector<extend2_job> jobs(n);
+  std::vector<char> mats((size_t)n * 25);
+  std::vector<int> width(n);
+  long qtotal = 0, ttotal = 0;
+
+  for (int i = 0; i < n; i++) {
+    extend2_job &jb = jobs[i];
+    jb.qlen = d[i].qlen;  jb.tlen = d[i].tlen;
+    jb.qoff = qtotal;     jb.toff = ttotal;
+    jb.m = d[i].m;
+    jb.o_del = d[i].o_del; jb.e_del = d[i].e_del;
+    jb.o_ins = d[i].o_ins; jb.e_ins = d[i].e_ins;
+    jb.w = d[i].w; jb.end_bonus = d[i].end_bonus;
+    jb.zdrop = d[i].zdrop; jb.h0 = d[i].h0;
+    memcpy(&mats[(size_t)i * 25], d[i].mat, 25);
+    qtotal += jb.qlen;
+    ttotal += jb.tlen;
+
+    // bound of the stored scores
+    int max = 0;
+    for (int k = 0; k < jb.m * jb.m; k++)
+      max = max > d[i].mat[k] ? max : d[i].mat[k];
+    long bound = (long)jb.h0 + (long)max * std::min(jb.qlen, jb.tlen);
+    width[i] = jb.h0 < 0 ? SCORE_32 :
+               bound <= 0xFF ? SCORE_8 :
+               bound <= 0xFFFF ? SCORE_16 : SCORE_32;
+  }
+
+  std::vector<unsigned char> queries(qtotal + 1), targets(ttotal + 1);
+  for (int i = 0; i < n; i++) {
+    memcpy(&queries[jobs[i].qoff], d[i].query, jobs[i].qlen);
+    memcpy(&targets[jobs[i].toff], d[i].target, jobs[i].tlen);
+  }
+
+  // sort the jobs by score width, then by length
+  std::vector<int> order(n);
+  for (int i = 0; i < n; i++) order[i] = i;
+  std::sort(order.begin(), order.end(), [&](int a, int b) {
+    if (width[a] != width[b]) return width[a] < width[b];
+    if (jobs[a].qlen != jobs[b].qlen) return jobs[a].qlen < jobs[b].qlen;
+    return jobs[a].tlen < jobs[b].tlen;
+  });
+
+  // cut each width class into buckets
+  std::vector<extend2_bucket> buckets;
+  int first_bucket[SCORE_32 + 2];
+  long eh_elems[SCORE_32 + 1] = {0, 0, 0};
+  long qp_bytes = 0;
+  int s = 0;
+  for (int c = SCORE_8; c <= SCORE_32; c++) {
+    first_bucket[c] = buckets.size();
+    while (s < n && width[order[s]] == c) {
+      extend2_bucket bk;
+      bk.first = s;
+      bk.count = 0;
+      bk.qmax = 0;
+      while (bk.count < BUCKET_SIZE && s < n && width[order[s]] == c) {
+        bk.qmax = std::max(bk.qmax, jobs[order[s]].qlen);
+        bk.count++;
+        s++;
+      }
+      bk.eh_off = eh_elems[c];
+      bk.qp_off = qp_bytes;
+      eh_elems[c] += (long)(bk.qmax + 1) * BUCKET_SIZE;
+      qp_bytes += (long)bk.qmax * MAX_M * BUCKET_SIZE;
+      buckets.push_back(bk);
+    }
+  }
+  first_bucket[SCORE_32 + 1] = buckets.size();
+
+  const int nb = buckets.size();
+  const extend2_bucket *p_buckets = buckets.data();
+  const int *p_order = order.data();
+  const extend2_job *p_jobs = jobs.data();
+  const char *p_mats = mats.data();
+  const unsigned char *p_queries = queries.data();
+  const unsigned char *p_targets = targets.data();
+  char *qp = (char*) malloc (qp_bytes + 1);
+
+#pragma omp target data map(to: p_buckets[0:nb], p_order[0:n], p_jobs[0:n], \
+                                p_mats[0:n*25], p_queries[0:qtotal+1], \
+                                p_targets[0:ttotal+1]) \
+                        map(alloc: qp[0:qp_bytes+1]) \
+                        map(from: res[0:n])
+  {
+    extend2_buckets<unsigned char>(p_buckets, first_bucket[SCORE_8], first_bucket[SCORE_16],
+        p_order, p_jobs, p_mats, p_queries, p_targets, qp, res, eh_elems[SCORE_8]);
+    extend2_buckets<unsigned short>(p_buckets, first_bucket[SCORE_16], first_bucket[SCORE_32],
+        p_order, p_jobs, p_mats, p_queries, p_targets, qp, res, eh_elems[SCORE_16]);
+    extend2_buckets<int>(p_buckets, first_bucket[SCORE_32], first_bucket[SCORE_32 + 1],
+        p_order, p_jobs, p_mats, p_queries, p_targets, qp, res, eh_elems[SCORE_32]);
+  }
+
+#ifdef VERBOSE
+  printf("batch: %d jobs in %d buckets (8-bit: %d, 16-bit: %d, 32-bit: %d)\n", n, nb,
+      first_bucket[SCORE_16] - first_bucket[SCORE_8],
+      first_bucket[SCORE_32] - first_bucket[SCORE_16],
+      first_bucket[SCORE_32 + 1] - first_bucket[SCORE_32]);
+#endif
+
+  free(qp);
+}
+
+#endif
@@ -24,7 +24,9 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <chrono>
 #include "read_data.h"
+#include "extend2_batch.h"
 
 static void check(int a, int b, const char *s)
 {
@@ -203,6 +205,9 @@ int main(int argc, char *argv[])
 {
   int iterations = atoi(argv[1]);
 
+  // 1 (default): extend all the seeds in one batch, 0: one seed at a time
+  int batched = (argc > 2) ? atoi(argv[2]) : 1;
+
   struct extend2_dat d;
 
   // list the file names (17 in total)
@@ -210,9 +215,44 @@ int main(int argc, char *argv[])
 #include "filelist.txt"
   };
 
+  if (!batched) {
+    for (int f = 0; f < iterations; f++) {
+      read_data(files[f%17], &d);
+      extend2(&d);
+    }
+    return 0;
+  }
+
+  struct extend2_dat inputs[17];
+  for (int f = 0; f < 17; f++)
+    read_data(files[f], &inputs[f]);
+
+  // the seeds share the sequences of the input files
+  struct extend2_dat *seeds = (struct extend2_dat*) malloc (sizeof(struct extend2_dat) * iterations);
+  extend2_res *res = (extend2_res*) malloc (sizeof(extend2_res) * iterations);
+  for (int f = 0; f < iterations; f++)
+    seeds[f] = inputs[f%17];
+
+  auto start = std::chrono::steady_clock::now();
+  extend2_batch(seeds, iterations, res);
+  auto end = std::chrono::steady_clock::now();
+  auto time = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+  printf("Batched extension of %d seeds: %.3f (ms)\n", iterations, time * 1e-6);
+
   for (int f = 0; f < iterations; f++) {
-    read_data(files[f%17], &d);
-    extend2(&d);
+    check(seeds[f].qle, res[f].qle, "qle");
+    check(seeds[f].tle, res[f].tle, "tle");
+    check(seeds[f].gtle, res[f].gtle, "gtle");
+    check(seeds[f].gscore, res[f].gscore, "gscore");
+    check(seeds[f].max_off, res[f].max_off, "max_off");
+    check(seeds[f].score, res[f].score, "score");
+  }
+
+  for (int f = 0; f < 17; f++) {
+    free(inputs[f].query);
+    free(inputs[f].target);
   }
+  free(seeds);
+  free(res);
   return 0;
 }
@@ -0,0 +1,104 @@
+//========================================================================================================================================================================================================200
+//	FRAME READER
+//
+//	A producer thread decodes and crops frames ahead of the tracking kernel into a ring of host buffers.
+//	The consumer waits for a frame with wait(), uploads it, and hands the slot back with release() once
+//	the upload has completed. Frame n always lives in slot n % slots.
+//========================================================================================================================================================================================================200
+
+#ifndef FRAME_READER_H
+#define FRAME_READER_H
+
+#include <string.h>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#ifndef FRAME_RING
+#define FRAME_RING 4
+#endif
+
+class frame_reader {
+public:
+	frame_reader(avi_t* frames, int frames_processed, int frame_elem, fp* ring, int slots)
+		: frames_(frames), count_(frames_processed), elem_(frame_elem), ring_(ring), slots_(slots),
+		  decoded_(0), released_(0), decode_time_(0) {
+		producer_ = std::thread(&frame_reader::run, this);
+	}
+
+	~frame_reader() {
+		producer_.join();
+	}
+
+	// block until frame_no has been decoded and return its slot
+	fp* wait(int frame_no) {
+		std::unique_lock<std::mutex> lock(mutex_);
+		cv_.wait(lock, [&] { return decoded_ > frame_no; });
+		return slot(frame_no);
+	}
+
+	// non-blocking variant of wait()
+	bool ready(int frame_no) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		return decoded_ > frame_no;
+	}
+
+	// frames are released in order; the slot of frame_no may be overwritten afterwards
+	void release(int frame_no) {
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			released_ = frame_no + 1;
+		}
+		cv_.notify_all();
+	}
+
+	fp* slot(int frame_no) {
+		return ring_ + (size_t)(frame_no % slots_) * elem_;
+	}
+
+	// host time spent decoding, only valid after the last frame has been waited for
+	long long decode_time() const {
+		return decode_time_;
+	}
+
+private:
+	void run() {
+		for(int frame_no = 0; frame_no < count_; frame_no++){
+			{
+				std::unique_lock<std::mutex> lock(mutex_);
+				cv_.wait(lock, [&] { return frame_no - released_ < slots_; });
+			}
+
+			long long start = get_time();
+			fp* frame = get_frame(	frames_,				// pointer to video file
+									frame_no,				// number of frame that needs to be returned
+									0,						// cropped?
+									0,						// scaled?
+									1);						// converted
+			memcpy(slot(frame_no), frame, sizeof(fp) * elem_);
+			// AVI library allocates memory for every frame fetched
+			free(frame);
+
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				decode_time_ += get_time() - start;
+				decoded_ = frame_no + 1;
+			}
+			cv_.notify_all();
+		}
+	}
+
+	avi_t* frames_;
+	int count_;
+	int elem_;
+	fp* ring_;
+	int slots_;
+	int decoded_;
+	int released_;
+	long long decode_time_;
+	std::mutex mutex_;
+	std::condition_variable cv_;
+	std::thread producer_;
+};
+
+#endif
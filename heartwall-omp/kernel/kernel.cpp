@@ -1,6 +1,8 @@
 #include "../main.h"                // (in main directory)            needed to recognized input parameters
 #include "../util/avi/avilib.h"          // (in directory)              needed by avi functions
 #include "../util/avi/avimod.h"          // (in directory)              needed by avi functions
+#include "../util/timer/timer.h"         // (in directory)              needed by frame reader
+#include "frame_reader.h"
 #include <iostream>
 #include <omp.h>
 #include <math.h>
@@ -370,8 +372,18 @@ kernel_gpu_wrapper(  params_common common,
 
   //buffer<fp,1> d_frame(common.frame_elem);
   int allPoints = common.allPoints; 
+
+  // ring of frames decoded ahead by the frame reader; every slot stays mapped for the whole run,
+  // so uploading the next frame does not overwrite the frame the kernel is working on
+  int slots = FRAME_RING < 2 ? 2 : FRAME_RING;
+  fp* frame_ring = (fp*) malloc (sizeof(fp) * common.frame_elem * slots);
+  long long wait_time = 0;
+  long long track_time = 0;
+  // decoding of the following frames overlaps with the upload and tracking below
+  frame_reader reader(frames, common.frames_processed, common.frame_elem, frame_ring, slots);
   
-#pragma omp target data map(alloc: endoT[0:common.in_elem * common.endoPoints],\
+#pragma omp target data map(alloc: frame_ring[0:common.frame_elem * slots],\
+                                    endoT[0:common.in_elem * common.endoPoints],\
                                     epiT[0:common.in_elem * common.epiPoints],\
                                     in2[0:common.in2_elem * common.allPoints],\
                                     conv[0:common.conv_elem * common.allPoints],\
@@ -402,6 +414,8 @@ kernel_gpu_wrapper(  params_common common,
                                     tEpiRowLoc[0:common.epiPoints * common.no_frames],\
                                     tEpiColLoc[0:common.epiPoints * common.no_frames]) 
   {
+  int uploaded = 0;     // frames whose upload has been issued
+
 #ifdef TEST_CHECKSUM
 #pragma omp target data map(alloc: checksum[0:CHECK])
 #endif
@@ -412,19 +426,22 @@ kernel_gpu_wrapper(  params_common common,
     //  get and write current frame to GPU buffer
     //==================================================50
 
-    // Extract a cropped version of the first frame from the video file
-    frame = get_frame(  frames,                // pointer to video file
-        frame_no,              // number of frame that needs to be returned
-        0,                  // cropped?
-        0,                  // scaled?
-        1);                  // converted
+    // the upload of this frame was issued in the previous iteration if it had been decoded in time
+    frame = reader.slot(frame_no);
+    if(uploaded == frame_no){
+      long long start = get_time();
+      reader.wait(frame_no);
+      wait_time += get_time() - start;
+      #pragma omp target update to(frame[0:common.frame_elem]) depend(out: frame[0]) nowait
+      uploaded++;
+    }
 
-    // copy frame to GPU memory
-    //q.submit ([&](handler &cgh) {
-     //   auto d_frame_acc = d_frame.get_access<sycl_write>(cgh);
-      //  cgh.copy(frame, d_frame_acc);
-       // });
-    #pragma omp target data map(to: frame[0:common.frame_elem])
+    // start copying the next frame while this one is tracked
+    if(uploaded < common.frames_processed && reader.ready(uploaded)){
+      fp* next = reader.slot(uploaded);
+      #pragma omp target update to(next[0:common.frame_elem]) depend(out: next[0]) nowait
+      uploaded++;
+    }
 
     //==================================================50
     //  launch kernel
@@ -479,17 +496,19 @@ kernel_gpu_wrapper(  params_common common,
 #endif
 */
 
-#pragma omp target teams num_teams(allPoints) thread_limit(NUMBER_THREADS)
+    // waits for the upload of the current frame; tracking of consecutive frames stays in order
+    long long start = get_time();
+#pragma omp target teams num_teams(allPoints) thread_limit(NUMBER_THREADS) depend(in: frame[0])
 {
 #pragma omp parallel
 {
 #include "kernel.h"
 }
 }
+    track_time += get_time() - start;
 
-
-    // free frame after each loop iteration, since AVI library allocates memory for every frame fetched
-    free(frame);
+    // the upload out of this slot has completed, so the reader may refill it
+    reader.release(frame_no);
 
     //==================================================50
     //  print frame progress
@@ -517,6 +536,7 @@ kernel_gpu_wrapper(  params_common common,
     //==================================================50
 
   }
+  #pragma omp taskwait
 }
 
 #ifdef TEST_CHECKSUM
@@ -544,10 +564,14 @@ kernel_gpu_wrapper(  params_common common,
   free(in_final_sum);
   free(in_sqr_final_sum);
   free(denomT);
+  free(frame_ring);
 
   //  PRINT FRAME PROGRESS END
 
   printf("\n");
+  printf("frame ring of %d slots: decode %.3f s (overlapped), decode wait %.3f s, tracking %.3f s\n",
+         slots, (float) reader.decode_time() / 1000000, (float) wait_time / 1000000,
+         (float) track_time / 1000000);
   fflush(NULL);
 }
 
@@ -74,10 +74,20 @@ inline void DecodePixel(uchar1 pixel, unsigned int (&bins)[ACTIVE_CHANNELS])
 {
     bins[0] = (unsigned int) pixel;
 }
+
+// Decode uint1 pixel (a packed color) into bins
+template <int NUM_BINS, int ACTIVE_CHANNELS>
+inline void DecodePixel(uint1 pixel, unsigned int (&bins)[ACTIVE_CHANNELS])
+{
+    bins[0] = pixel;
+}
 #pragma omp end declare target
 
 #include "histogram_gmem_atomics.hpp"
 #include "histogram_smem_atomics.hpp"
+#include "histogram_private.hpp"
+#include "histogram_sort_rle.hpp"
+#include "histogram_range.hpp"
 
 struct less_than_value
 {
@@ -347,6 +357,13 @@ void DecodePixelGold(uchar1 pixel, unsigned int (&bins)[ACTIVE_CHANNELS])
     bins[0] = (unsigned int) pixel;
 }
 
+// Decode uint1 pixel into bins
+template <int NUM_BINS, int ACTIVE_CHANNELS>
+void DecodePixelGold(uint1 pixel, unsigned int (&bins)[ACTIVE_CHANNELS])
+{
+    bins[0] = pixel;
+}
+
 
 // Compute reference histogram.  Specialized for uchar4
 template <
@@ -432,6 +449,49 @@ void RunTest(
 }
 
 
+/**
+ * Implementations that keep per-block or per-thread histograms of at most
+ * 1024 bins; they are skipped for larger histograms
+ */
+template <bool SMALL>
+struct SmallBinTests
+{
+    template <int ACTIVE_CHANNELS, int NUM_BINS, typename PixelType>
+    static void Run(
+        std::vector<std::pair<std::string, double> >&   timings,
+        PixelType*                                      pixels,
+        const int                                       width,
+        const int                                       height,
+        unsigned int *                                  d_hist,
+        unsigned int *                                  h_hist,
+        int                                             timing_iterations)
+    {
+    }
+};
+
+template <>
+struct SmallBinTests<true>
+{
+    template <int ACTIVE_CHANNELS, int NUM_BINS, typename PixelType>
+    static void Run(
+        std::vector<std::pair<std::string, double> >&   timings,
+        PixelType*                                      pixels,
+        const int                                       width,
+        const int                                       height,
+        unsigned int *                                  d_hist,
+        unsigned int *                                  h_hist,
+        int                                             timing_iterations)
+    {
+        RunTest<ACTIVE_CHANNELS, NUM_BINS>(timings, pixels, width, height, d_hist, h_hist, timing_iterations,
+            "Shared memory atomics", "smem atomics", run_smem_atomics<ACTIVE_CHANNELS, NUM_BINS, PixelType>);
+        RunTest<ACTIVE_CHANNELS, NUM_BINS>(timings, pixels, width, height, d_hist, h_hist, timing_iterations,
+            "Global memory atomics", "gmem atomics", run_gmem_atomics<ACTIVE_CHANNELS, NUM_BINS, PixelType>);
+        RunTest<ACTIVE_CHANNELS, NUM_BINS>(timings, pixels, width, height, d_hist, h_hist, timing_iterations,
+            "Per-thread histograms", "private", run_private_hist<ACTIVE_CHANNELS, NUM_BINS, PixelType>);
+    }
+};
+
+
 /**
  * Evaluate corpus of histogram implementations
  */
@@ -462,10 +522,12 @@ void TestMethods(
     std::vector<std::pair<std::string, double> > timings;
 
     // Run experiments
+    SmallBinTests<(ACTIVE_CHANNELS * NUM_BINS <= 1024)>::template Run<ACTIVE_CHANNELS, NUM_BINS>(
+        timings, h_pixels, width, height, d_hist, h_hist, timing_iterations);
     RunTest<ACTIVE_CHANNELS, NUM_BINS>(timings, h_pixels, width, height, d_hist, h_hist, timing_iterations,
-        "Shared memory atomics", "smem atomics", run_smem_atomics<ACTIVE_CHANNELS, NUM_BINS, PixelType>);
+        "Sort and run-length encode", "sort rle", run_sort_rle<ACTIVE_CHANNELS, NUM_BINS, PixelType>);
     RunTest<ACTIVE_CHANNELS, NUM_BINS>(timings, h_pixels, width, height, d_hist, h_hist, timing_iterations,
-        "Global memory atomics", "gmem atomics", run_gmem_atomics<ACTIVE_CHANNELS, NUM_BINS, PixelType>);
+        "Bin edge search", "bin edges", run_range_hist<ACTIVE_CHANNELS, NUM_BINS, PixelType>);
 
     // Report timings
     if (!g_report)
@@ -539,6 +601,29 @@ void TestGenres(
         }
         TestMethods<4, 3, 256>(float4_pixels, width, height, timing_iterations, bandwidth_GBs);
         free(float4_pixels);
+        if (g_report) printf(", ");
+    }
+
+    {
+        if (!g_report) printf("1 channel 16-bit color tests (65536-bin):\n\n"); fflush(stdout);
+        size_t      image_bytes     = num_pixels * sizeof(uint1);
+        uint1*      uint1_pixels    = (uint1*) malloc(image_bytes);
+
+        // Pack the first 2 channels
+        for (int i = 0; i < num_pixels; ++i)
+            uint1_pixels[i] = ((unsigned int) uchar4_pixels[i].x << 8) | uchar4_pixels[i].y;
+
+        TestMethods<1, 1, 1 << 16>(uint1_pixels, width, height, timing_iterations, bandwidth_GBs);
+
+        if (!g_report) printf("1 channel 24-bit color tests (16777216-bin):\n\n"); fflush(stdout);
+
+        // Pack the first 3 channels
+        for (int i = 0; i < num_pixels; ++i)
+            uint1_pixels[i] = ((unsigned int) uchar4_pixels[i].x << 16) |
+                              ((unsigned int) uchar4_pixels[i].y << 8) | uchar4_pixels[i].z;
+
+        TestMethods<1, 1, 1 << 24>(uint1_pixels, width, height, timing_iterations, bandwidth_GBs);
+        free(uint1_pixels);
         if (g_report) printf("\n");
     }
 }
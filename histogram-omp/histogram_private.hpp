@@ -0,0 +1,75 @@
+// Every thread counts into a private copy of the histogram, so the
+// pixel loop needs no atomics. The copies are merged by a second kernel.
+template <
+  int         ACTIVE_CHANNELS,
+      int         NUM_BINS,
+  typename    PixelType>
+double run_private_hist(
+    PixelType* image,
+    int width,
+    int height,
+    unsigned int* d_hist,
+    bool warmup)
+{
+  const int total_blocks = 64;
+  const int block_threads = 64;
+  const int num_subhists = total_blocks * block_threads;
+  const int hist_size = ACTIVE_CHANNELS * NUM_BINS;
+  const int num_pixels = width * height;
+
+  auto start = std::chrono::steady_clock::now();
+
+  unsigned int *sub_hist = (unsigned int *) malloc ((size_t)num_subhists * hist_size * sizeof(unsigned int));
+#pragma omp target data map (alloc: sub_hist[0: (size_t)num_subhists * hist_size]) \
+                        map(to: image[0:num_pixels]) \
+                        map(from: d_hist[0:hist_size])
+  {
+    // zero all the sub-histograms, including those of teams and threads
+    // the runtime does not start for the counting kernel
+#pragma omp target teams distribute parallel for thread_limit(128)
+    for (size_t i = 0; i < (size_t)num_subhists * hist_size; i++)
+      sub_hist[i] = 0;
+
+#pragma omp target teams num_teams(total_blocks) thread_limit(block_threads)
+    {
+#pragma omp parallel
+      {
+        int t = omp_get_thread_num();
+        int nt = omp_get_num_threads();
+        int g = omp_get_team_num();
+        int ng = omp_get_num_teams();
+
+        unsigned int* out = sub_hist + ((size_t)g * block_threads + t) * hist_size;
+
+        for (int i = g * nt + t; i < num_pixels; i += ng * nt)
+        {
+          PixelType pixel = image[i];
+
+          unsigned int bins[ACTIVE_CHANNELS];
+          DecodePixel<NUM_BINS>(pixel, bins);
+
+#pragma unroll
+          for (int CHANNEL = 0; CHANNEL < ACTIVE_CHANNELS; ++CHANNEL)
+            out[(NUM_BINS * CHANNEL) + bins[CHANNEL]]++;
+        }
+      }
+    }
+
+    // merge the sub-histograms
+#pragma omp target teams distribute parallel for thread_limit(128)
+    for (int i = 0; i < hist_size; i++)
+    {
+      unsigned int total = 0;
+      for (int j = 0; j < num_subhists; j++)
+        total += sub_hist[i + (size_t)hist_size * j];
+
+      d_hist[i] = total;
+    }
+  }
+  free(sub_hist);
+
+  auto end = std::chrono::steady_clock::now();
+  std::chrono::duration<double> elapsed_seconds = end-start;
+  float elapsed_millis = elapsed_seconds.count()  * 1000;
+  return elapsed_millis;
+}
@@ -0,0 +1,163 @@
+// Histogram of samples over arbitrary, ascending bin edges.
+
+enum
+{
+  RANGE_SMEM_BINS = 4096    // largest histogram privatized in local memory
+};
+
+#pragma omp declare target
+// Bin b counts edges[b] <= x < edges[b+1]; the last bin also counts
+// x == edges[num_bins]. Returns -1 for samples outside the edges or NaN.
+inline int FindBin(float x, const float* edges, int num_bins)
+{
+  if (!(x >= edges[0] && x <= edges[num_bins])) return -1;
+  int lo = 0, hi = num_bins;
+  while (hi - lo > 1)
+  {
+    int mid = (lo + hi) / 2;
+    if (edges[mid] <= x) lo = mid; else hi = mid;
+  }
+  return lo;
+}
+#pragma omp end declare target
+
+/**
+ * Count num_samples samples, read with the given stride (in samples), into
+ * hist[0:num_bins] using the bin edges edges[0:num_bins+1]. The arrays are
+ * mapped to the device here unless the caller has mapped them already.
+ */
+template <typename SampleT>
+void histogram_range(
+    const SampleT* samples,
+    int num_samples,
+    int stride,
+    const float* edges,
+    int num_bins,
+    unsigned int* hist)
+{
+  const int total_blocks = 256;
+
+#pragma omp target data map(to: samples[0:((size_t)num_samples - 1) * stride + 1], edges[0:num_bins + 1]) \
+                        map(from: hist[0:num_bins])
+  {
+#pragma omp target teams distribute parallel for thread_limit(128)
+    for (int i = 0; i < num_bins; i++)
+      hist[i] = 0;
+
+    if (num_bins <= RANGE_SMEM_BINS)
+    {
+      // privatize per block in local memory, then add into the result
+#pragma omp target teams num_teams(total_blocks) thread_limit(128)
+      {
+        unsigned int smem[RANGE_SMEM_BINS];
+#pragma omp parallel
+        {
+          int t = omp_get_thread_num();
+          int nt = omp_get_num_threads();
+          int g = omp_get_team_num();
+          int ng = omp_get_num_teams();
+
+          for (int i = t; i < num_bins; i += nt) smem[i] = 0;
+#pragma omp barrier
+
+          for (int i = g * nt + t; i < num_samples; i += ng * nt)
+          {
+            int bin = FindBin((float) samples[(size_t)i * stride], edges, num_bins);
+            if (bin >= 0)
+            {
+#pragma omp atomic update
+              smem[bin]++;
+            }
+          }
+#pragma omp barrier
+
+          for (int i = t; i < num_bins; i += nt)
+            if (smem[i])
+            {
+#pragma omp atomic update
+              hist[i] += smem[i];
+            }
+        }
+      }
+    }
+    else
+    {
+#pragma omp target teams distribute parallel for thread_limit(128)
+      for (int i = 0; i < num_samples; i++)
+      {
+        int bin = FindBin((float) samples[(size_t)i * stride], edges, num_bins);
+        if (bin >= 0)
+        {
+#pragma omp atomic update
+          hist[bin]++;
+        }
+      }
+    }
+  }
+}
+
+// Sample type and bin edges equivalent to DecodePixel for each pixel type
+template <typename PixelType> struct RangePixel;
+
+template <> struct RangePixel<float4>
+{
+  typedef float SampleT;
+  static float Edge(int b, int num_bins) { return float(b) / float(num_bins); }
+};
+
+template <> struct RangePixel<uchar4>
+{
+  typedef unsigned char SampleT;
+  static float Edge(int b, int num_bins) { return float(b); }
+};
+
+template <> struct RangePixel<uchar1>
+{
+  typedef unsigned char SampleT;
+  static float Edge(int b, int num_bins) { return float(b); }
+};
+
+template <> struct RangePixel<uint1>
+{
+  typedef unsigned int SampleT;
+  static float Edge(int b, int num_bins) { return float(b); }
+};
+
+// Runs histogram_range on each active channel with the edges of the pixel decoder
+template <
+  int         ACTIVE_CHANNELS,
+      int         NUM_BINS,
+  typename    PixelType>
+double run_range_hist(
+    PixelType* image,
+    int width,
+    int height,
+    unsigned int* d_hist,
+    bool warmup)
+{
+  typedef typename RangePixel<PixelType>::SampleT SampleT;
+  const int num_channels = sizeof(PixelType) / sizeof(SampleT);
+  const int num_pixels = width * height;
+
+  float *edges = (float *) malloc ((NUM_BINS + 1) * sizeof(float));
+  for (int b = 0; b <= NUM_BINS; b++)
+    edges[b] = RangePixel<PixelType>::Edge(b, NUM_BINS);
+
+  auto start = std::chrono::steady_clock::now();
+
+  const SampleT* samples = reinterpret_cast<const SampleT*>(image);
+#pragma omp target data map(to: samples[0:num_pixels * num_channels], edges[0:NUM_BINS + 1]) \
+                        map(from: d_hist[0:NUM_BINS * ACTIVE_CHANNELS])
+  {
+    for (int CHANNEL = 0; CHANNEL < ACTIVE_CHANNELS; ++CHANNEL)
+      histogram_range(samples + CHANNEL, num_pixels, num_channels, edges, NUM_BINS,
+                      d_hist + NUM_BINS * CHANNEL);
+  }
+
+  auto end = std::chrono::steady_clock::now();
+  free(edges);
+
+  std::chrono::duration<double> elapsed_seconds = end-start;
+  float elapsed_millis = elapsed_seconds.count()  * 1000;
+  return elapsed_millis;
+}
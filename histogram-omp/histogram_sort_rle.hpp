@@ -0,0 +1,228 @@
+// Histogram by sorting the bin indices and run-length encoding the sorted
+// sequence. Its cost does not depend on the number of bins, so it suits bin
+// counts (64K-16M) for which per-block histograms do not fit in local memory.
+
+enum
+{
+  RLE_RADIX_BITS  = 8,
+  RLE_DIGITS      = 1 << RLE_RADIX_BITS,
+  RLE_THREADS     = 64,
+  RLE_ITEMS       = 16,
+  RLE_MAX_BLOCKS  = 1024
+};
+
+// One stable LSD radix sort pass over the digit at shift
+inline void rle_sort_pass(
+    const unsigned int* in,
+    unsigned int* out,
+    unsigned int* isums,
+    int n,
+    int shift,
+    int num_blocks)
+{
+  // count the digits of each block's region
+#pragma omp target teams num_teams(num_blocks) thread_limit(RLE_THREADS)
+  {
+    unsigned int l_hist[RLE_DIGITS];
+#pragma omp parallel
+    {
+      int t = omp_get_thread_num();
+      int nt = omp_get_num_threads();
+      int g = omp_get_team_num();
+      int region = (n + num_blocks - 1) / num_blocks;
+      int begin = g * region;
+      int end = begin + region < n ? begin + region : n;
+
+      for (int d = t; d < RLE_DIGITS; d += nt) l_hist[d] = 0;
+#pragma omp barrier
+      for (int i = begin + t; i < end; i += nt)
+      {
+#pragma omp atomic update
+        l_hist[(in[i] >> shift) & (RLE_DIGITS - 1)]++;
+      }
+#pragma omp barrier
+      for (int d = t; d < RLE_DIGITS; d += nt)
+        isums[d * num_blocks + g] = l_hist[d];
+    }
+  }
+
+  // exclusive scan of the counts in digit-major order
+#pragma omp target teams num_teams(1) thread_limit(RLE_DIGITS)
+  {
+    unsigned int l_totals[RLE_DIGITS];
+#pragma omp parallel
+    {
+      int t = omp_get_thread_num();
+      int nt = omp_get_num_threads();
+      for (int d = t; d < RLE_DIGITS; d += nt)
+      {
+        unsigned int sum = 0;
+        for (int g = 0; g < num_blocks; g++) sum += isums[d * num_blocks + g];
+        l_totals[d] = sum;
+      }
+#pragma omp barrier
+      if (t == 0)
+      {
+        unsigned int seed = 0;
+        for (int d = 0; d < RLE_DIGITS; d++)
+        {
+          unsigned int c = l_totals[d];
+          l_totals[d] = seed;
+          seed += c;
+        }
+      }
+#pragma omp barrier
+      for (int d = t; d < RLE_DIGITS; d += nt)
+      {
+        unsigned int seed = l_totals[d];
+        for (int g = 0; g < num_blocks; g++)
+        {
+          unsigned int c = isums[d * num_blocks + g];
+          isums[d * num_blocks + g] = seed;
+          seed += c;
+        }
+      }
+    }
+  }
+
+  // scatter; each thread owns RLE_ITEMS consecutive keys of a window,
+  // and their ranks are scanned over the threads to keep the pass stable
+#pragma omp target teams num_teams(num_blocks) thread_limit(RLE_THREADS)
+  {
+    unsigned short l_counts[RLE_DIGITS * RLE_THREADS];
+    unsigned int l_seeds[RLE_DIGITS];
+    unsigned int l_totals[RLE_DIGITS];
+#pragma omp parallel
+    {
+      int t = omp_get_thread_num();
+      int nt = omp_get_num_threads();
+      int g = omp_get_team_num();
+      int region = (n + num_blocks - 1) / num_blocks;
+      int begin = g * region;
+      int end = begin + region < n ? begin + region : n;
+
+      for (int d = t; d < RLE_DIGITS; d += nt)
+        l_seeds[d] = isums[d * num_blocks + g];
+#pragma omp barrier
+
+      for (int window = begin; window < end; window += nt * RLE_ITEMS)
+      {
+        int first = window + t * RLE_ITEMS;
+        for (int d = 0; d < RLE_DIGITS; d++) l_counts[d * nt + t] = 0;
+
+        unsigned int key[RLE_ITEMS];
+        for (int k = 0; k < RLE_ITEMS; k++)
+          if (first + k < end)
+          {
+            key[k] = in[first + k];
+            l_counts[((key[k] >> shift) & (RLE_DIGITS - 1)) * nt + t]++;
+          }
+#pragma omp barrier
+
+        for (int d = t; d < RLE_DIGITS; d += nt)
+        {
+          unsigned short seed = 0;
+          for (int j = 0; j < nt; j++)
+          {
+            unsigned short c = l_counts[d * nt + j];
+            l_counts[d * nt + j] = seed;
+            seed += c;
+          }
+          l_totals[d] = seed;
+        }
+#pragma omp barrier
+
+        for (int k = 0; k < RLE_ITEMS; k++)
+          if (first + k < end)
+          {
+            unsigned int d = (key[k] >> shift) & (RLE_DIGITS - 1);
+            out[l_seeds[d] + l_counts[d * nt + t]++] = key[k];
+          }
+#pragma omp barrier
+
+        for (int d = t; d < RLE_DIGITS; d += nt) l_seeds[d] += l_totals[d];
+#pragma omp barrier
+      }
+    }
+  }
+}
+
+template <
+  int         ACTIVE_CHANNELS,
+      int         NUM_BINS,
+  typename    PixelType>
+double run_sort_rle(
+    PixelType* image,
+    int width,
+    int height,
+    unsigned int* d_hist,
+    bool warmup)
+{
+  const int num_pixels = width * height;
+  const int n = num_pixels * ACTIVE_CHANNELS;
+  const unsigned int hist_size = ACTIVE_CHANNELS * NUM_BINS;
+
+  // only sort the digits the bin indices can have
+  int key_bits = 0;
+  while (key_bits < 32 && (hist_size - 1) >> key_bits) key_bits++;
+  const int num_passes = (key_bits + RLE_RADIX_BITS - 1) / RLE_RADIX_BITS;
+
+  const int window = RLE_THREADS * RLE_ITEMS;
+  int num_blocks = (n + window * 16 - 1) / (window * 16);
+  if (num_blocks > RLE_MAX_BLOCKS) num_blocks = RLE_MAX_BLOCKS;
+  if (num_blocks < 1) num_blocks = 1;
+
+  auto start = std::chrono::steady_clock::now();
+
+  unsigned int *keys = (unsigned int *) malloc (n * sizeof(unsigned int));
+  unsigned int *keys_alt = (unsigned int *) malloc (n * sizeof(unsigned int));
+  unsigned int *run_start = (unsigned int *) malloc (hist_size * sizeof(unsigned int));
+  unsigned int *isums = (unsigned int *) malloc (RLE_DIGITS * num_blocks * sizeof(unsigned int));
+
+#pragma omp target data map (alloc: keys[0:n], keys_alt[0:n], run_start[0:hist_size], \
+                                    isums[0:RLE_DIGITS * num_blocks]) \
+                        map(to: image[0:num_pixels]) \
+                        map(from: d_hist[0:hist_size])
+  {
+    // bin index of every sample
+#pragma omp target teams distribute parallel for thread_limit(128)
+    for (int i = 0; i < num_pixels; i++)
+    {
+      unsigned int bins[ACTIVE_CHANNELS];
+      DecodePixel<NUM_BINS>(image[i], bins);
+#pragma unroll
+      for (int CHANNEL = 0; CHANNEL < ACTIVE_CHANNELS; ++CHANNEL)
+        keys[i * ACTIVE_CHANNELS + CHANNEL] = (NUM_BINS * CHANNEL) + bins[CHANNEL];
+    }
+
+    unsigned int *in = keys;
+    unsigned int *out = keys_alt;
+    for (int pass = 0; pass < num_passes; pass++)
+    {
+      rle_sort_pass(in, out, isums, n, pass * RLE_RADIX_BITS, num_blocks);
+      unsigned int *tmp = in; in = out; out = tmp;
+    }
+
+    // run-length encode the sorted bins: a run's count is its end minus its start
+#pragma omp target teams distribute parallel for thread_limit(128)
+    for (unsigned int i = 0; i < hist_size; i++)
+      d_hist[i] = 0;
+
+#pragma omp target teams distribute parallel for thread_limit(128)
+    for (int i = 0; i < n; i++)
+      if (i == 0 || in[i] != in[i - 1]) run_start[in[i]] = i;
+
+#pragma omp target teams distribute parallel for thread_limit(128)
+    for (int i = 0; i < n; i++)
+      if (i == n - 1 || in[i] != in[i + 1]) d_hist[in[i]] = i + 1 - run_start[in[i]];
+  }
+  free(keys);
+  free(keys_alt);
+  free(run_start);
+  free(isums);
+
+  auto end = std::chrono::steady_clock::now();
+  std::chrono::duration<double> elapsed_seconds = end-start;
+  float elapsed_millis = elapsed_seconds.count()  * 1000;
+  return elapsed_millis;
+}
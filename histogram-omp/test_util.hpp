@@ -87,6 +87,8 @@ typedef struct {
 
 typedef unsigned char uchar1 ;
 
+typedef unsigned int uint1 ;
+
 /******************************************************************************
  * Assertion macros
  ******************************************************************************/
@@ -0,0 +1,78 @@
+#include <cstdlib>
+#include <cstdio>
+#include <cmath>
+
+///////////////////////////////////////////////////////////////////////////////
+// Reference for ForwardBackwardGPU on a single observation sequence. Besides
+// logLik and posteriorPath, it returns the log posterior alpha + beta - logLik
+// of every state at every observation in gamma[nObs*nState].
+///////////////////////////////////////////////////////////////////////////////
+static float logSumExp(const float *x, const int n)
+{
+    float m = -INFINITY;
+    for (int i = 0; i < n; i++) m = fmaxf(m, x[i]);
+    float sum = 0.0f;
+    for (int i = 0; i < n; i++) sum += expf(x[i] - m);
+    return m + logf(sum);
+}
+
+int ForwardBackwardCPU(float &logLik,
+                       int *posteriorPath,
+                       float *gamma,
+                       const int *obs,
+                       const int nObs,
+                       const float *initProb,
+                       const float *mtState,
+                       const int nState,
+                       const float *mtEmit)
+{
+    float *alpha = (float*)malloc(sizeof(float)*nObs*nState);
+    float *beta = (float*)malloc(sizeof(float)*nObs*nState);
+
+    for (int i = 0; i < nState; i++) alpha[i] = initProb[i];
+
+    for (int t = 1; t < nObs; t++)
+    {
+        #pragma omp parallel for
+        for (int iState = 0; iState < nState; iState++)
+        {
+            float *x = (float*)malloc(sizeof(float)*nState);
+            for (int preState = 0; preState < nState; preState++)
+                x[preState] = alpha[(t-1)*nState + preState] + mtState[iState*nState + preState];
+            alpha[t*nState + iState] = logSumExp(x, nState) + mtEmit[obs[t]*nState + iState];
+            free(x);
+        }
+    }
+    logLik = logSumExp(alpha + (nObs-1)*nState, nState);
+
+    for (int i = 0; i < nState; i++) beta[(nObs-1)*nState + i] = 0.0f;
+
+    for (int t = nObs-2; t >= 0; t--)
+    {
+        #pragma omp parallel for
+        for (int preState = 0; preState < nState; preState++)
+        {
+            float *x = (float*)malloc(sizeof(float)*nState);
+            for (int iState = 0; iState < nState; iState++)
+                x[iState] = mtState[iState*nState + preState] + mtEmit[obs[t+1]*nState + iState]
+                          + beta[(t+1)*nState + iState];
+            beta[t*nState + preState] = logSumExp(x, nState);
+            free(x);
+        }
+    }
+
+    for (int t = 0; t < nObs; t++)
+    {
+        int best = 0;
+        for (int i = 0; i < nState; i++)
+        {
+            gamma[t*nState + i] = alpha[t*nState + i] + beta[t*nState + i] - logLik;
+            if (gamma[t*nState + i] > gamma[t*nState + best]) best = i;
+        }
+        posteriorPath[t] = best;
+    }
+
+    free(alpha);
+    free(beta);
+    return 1;
+}
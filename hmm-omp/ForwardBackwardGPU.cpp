@@ -0,0 +1,148 @@
+#include <cstdlib>
+#include <cstdio>
+#include <cmath>
+#include <omp.h>
+#include "TeamReduce.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// Posterior decoding of nSeq independent observation sequences of length
+// nObs, stored one after the other in obs. The model is used as in the
+// Viterbi search, i.e. initProb, mtState and mtEmit are added, and the
+// forward and backward variables are kept in log space:
+//
+//   alpha(t,i) = logsumexp_j(alpha(t-1,j) + mtState[i][j]) + mtEmit[obs(t)][i]
+//   beta(t,j)  = logsumexp_i(mtState[i][j] + mtEmit[obs(t+1)][i] + beta(t+1,i))
+//
+// For every sequence, logLik is logsumexp_i(alpha(nObs-1,i)) and posteriorPath
+// holds the state of the largest alpha(t,i) + beta(t,i) at every t.
+//
+// Each team decodes one sequence in a single kernel. The forward variables
+// of all observations are kept on the device; the backward variables only
+// for two consecutive observations.
+///////////////////////////////////////////////////////////////////////////////
+int ForwardBackwardGPU(float *__restrict__ logLik,
+    int   *__restrict__ posteriorPath,
+    const int *__restrict__ obs,
+    const int nSeq,
+    const int nObs,
+    const float *__restrict__ initProb,
+    const float *__restrict__ mtState,
+    const int nState,
+    const int nEmit,
+    const float *__restrict__ mtEmit)
+{
+  const int chunk = batchChunk(sizeof(float)*(nObs+2)*nState, nSeq);
+  float *alpha = (float*)malloc(sizeof(float)*nObs*nState*chunk);
+  float *beta = (float*)malloc(sizeof(float)*2*nState*chunk);
+
+#pragma omp target data map(to: initProb[0:nState], \
+                                mtState[0:nState*nState], \
+                                mtEmit[0:nEmit*nState], \
+                                obs[0:nSeq*nObs]) \
+                        map(alloc: alpha[0:nObs*nState*chunk], \
+                                   beta[0:2*nState*chunk]) \
+                        map(from: logLik[0:nSeq], posteriorPath[0:nSeq*nObs])
+  {
+    for (int s0 = 0; s0 < nSeq; s0 += chunk)
+    {
+      const int n = (nSeq - s0 < chunk) ? nSeq - s0 : chunk;
+
+      #pragma omp target teams num_teams(n) thread_limit(BATCH_THREADS)
+      {
+        float prob_sh[BATCH_THREADS];
+        int state_sh[BATCH_THREADS];
+        #pragma omp parallel
+        {
+          const int seq = omp_get_team_num();
+          const int tid = omp_get_thread_num();
+          const int nThreads = omp_get_num_threads();
+          const int *o = obs + (size_t)(s0 + seq) * nObs;
+          int *pp = posteriorPath + (size_t)(s0 + seq) * nObs;
+          float *a = alpha + (size_t)nObs * nState * seq;
+          float *bNext = beta + (size_t)2 * nState * seq;
+          float *b = bNext + nState;
+
+          // forward
+          for (int iState = tid; iState < nState; iState += nThreads)
+            a[iState] = initProb[iState];
+          #pragma omp barrier
+
+          for (int t = 1; t < nObs; t++)
+          {
+            const float *aOld = a + (size_t)(t-1) * nState;
+            float *aNew = a + (size_t)t * nState;
+            for (int iState = tid; iState < nState; iState += nThreads)
+            {
+              const float *tr = mtState + (size_t)iState * nState;
+              float m = -INFINITY;
+              for (int preState = 0; preState < nState; preState++)
+                m = fmaxf(m, aOld[preState] + tr[preState]);
+              float sum = 0.0f;
+              for (int preState = 0; preState < nState; preState++)
+                sum += expf(aOld[preState] + tr[preState] - m);
+              aNew[iState] = m + logf(sum) + mtEmit[o[t]*nState+iState];
+            }
+            #pragma omp barrier
+          }
+
+          const float *aLast = a + (size_t)(nObs-1) * nState;
+          float ll = teamLogSumExp(aLast, nState, prob_sh, tid, nThreads);
+
+          float maxProb = -INFINITY;
+          int maxState = -1;
+          for (int iState = tid; iState < nState; iState += nThreads)
+          {
+            if (aLast[iState] > maxProb)
+            {
+              maxProb = aLast[iState];
+              maxState = iState;
+            }
+          }
+          teamArgmax(maxProb, maxState, prob_sh, state_sh, tid, nThreads);
+          if (tid == 0)
+          {
+            logLik[s0 + seq] = ll;
+            pp[nObs-1] = maxState;
+          }
+
+          // backward
+          for (int iState = tid; iState < nState; iState += nThreads)
+            bNext[iState] = 0.0f;
+          #pragma omp barrier
+
+          for (int t = nObs-2; t >= 0; t--)
+          {
+            const float *em = mtEmit + (size_t)o[t+1] * nState;
+            const float *at = a + (size_t)t * nState;
+            float maxProb = -INFINITY;
+            int maxState = -1;
+            for (int preState = tid; preState < nState; preState += nThreads)
+            {
+              float m = -INFINITY;
+              for (int iState = 0; iState < nState; iState++)
+                m = fmaxf(m, mtState[iState*nState + preState] + em[iState] + bNext[iState]);
+              float sum = 0.0f;
+              for (int iState = 0; iState < nState; iState++)
+                sum += expf(mtState[iState*nState + preState] + em[iState] + bNext[iState] - m);
+              b[preState] = m + logf(sum);
+
+              float g = at[preState] + b[preState];
+              if (g > maxProb)
+              {
+                maxProb = g;
+                maxState = preState;
+              }
+            }
+            teamArgmax(maxProb, maxState, prob_sh, state_sh, tid, nThreads);
+            if (tid == 0) pp[t] = maxState;
+            float *tmp = b; b = bNext; bNext = tmp;
+          }
+        }
+      }
+    }
+  }
+
+  free(alpha);
+  free(beta);
+  return 1;
+}
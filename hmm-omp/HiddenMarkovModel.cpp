@@ -11,6 +11,8 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <math.h>
+#include <chrono>
 
 // forward declaractions
 int initHMM(float *initProb, float *mtState, float *mtObs, const int &nState, const int &nEmit);
@@ -31,8 +33,36 @@ int ViterbiGPU(float &viterbiProb,
                const int nState,
                const int nEmit,
                float *__restrict__ mtEmit);
-
-
+int ViterbiBatchGPU(float *__restrict__ viterbiProb,
+               int *__restrict__ viterbiPath,
+               const int *__restrict__ obs,
+               const int nSeq,
+               const int nObs,
+               const float *__restrict__ initProb,
+               const float *__restrict__ mtState,
+               const int nState,
+               const int nEmit,
+               const float *__restrict__ mtEmit);
+int ForwardBackwardGPU(float *__restrict__ logLik,
+               int *__restrict__ posteriorPath,
+               const int *__restrict__ obs,
+               const int nSeq,
+               const int nObs,
+               const float *__restrict__ initProb,
+               const float *__restrict__ mtState,
+               const int nState,
+               const int nEmit,
+               const float *__restrict__ mtEmit);
+int ForwardBackwardCPU(float &logLik,
+               int *posteriorPath,
+               float *gamma,
+               const int *obs,
+               const int nObs,
+               const float *initProb,
+               const float *mtState,
+               const int nState,
+               const float *mtEmit);
+bool BatchTest(const int nSeq, const int nObs, const int nState, const int nEmit);
 
 // main function
 //*****************************************************************************
@@ -98,6 +128,14 @@ int main(int argc, const char **argv)
     else
       printf("Fail");
     printf("\n");
+
+    // many short sequences against one smaller model
+    pass = BatchTest(1024, 32, 256, 256);
+    if (pass)
+      printf("Success");
+    else
+      printf("Fail");
+    printf("\n");
         
     free(initProb);
     free(mtState);
@@ -162,3 +200,74 @@ int initHMM(float *initProb, float *mtState, float *mtObs, const int &nState, co
 
     return 1;
 }
+
+// Decode nSeq random observation sequences of length nObs with the batched
+// Viterbi search and posterior decoding, and check them against the CPU.
+// The posterior decoding is only checked for the first few sequences.
+//*****************************************************************************
+bool BatchTest(const int nSeq, const int nObs, const int nState, const int nEmit)
+{
+    float *initProb = (float*)malloc(sizeof(float)*nState);
+    float *mtState  = (float*)malloc(sizeof(float)*nState*nState);
+    float *mtEmit   = (float*)malloc(sizeof(float)*nEmit*nState);
+    initHMM(initProb, mtState, mtEmit, nState, nEmit);
+
+    int *obs = (int*)malloc(sizeof(int)*nSeq*nObs);
+    for (int i = 0; i < nSeq*nObs; i++)
+        obs[i] = rand() % nEmit;
+
+    float *viterbiProbGPU = (float*)malloc(sizeof(float)*nSeq);
+    int *viterbiPathGPU = (int*)malloc(sizeof(int)*nSeq*nObs);
+    float *logLikGPU = (float*)malloc(sizeof(float)*nSeq);
+    int *posteriorPathGPU = (int*)malloc(sizeof(int)*nSeq*nObs);
+
+    printf("\n# of states = %d\n# of possible observations = %d \n# of sequences = %d\nSize of observational sequence = %d\n",
+        nState, nEmit, nSeq, nObs);
+
+    printf("\nCompute Viterbi paths on GPU\n");
+    auto start = std::chrono::steady_clock::now();
+    ViterbiBatchGPU(viterbiProbGPU, viterbiPathGPU, obs, nSeq, nObs, initProb, mtState, nState, nEmit, mtEmit);
+    auto end = std::chrono::steady_clock::now();
+    printf("Batched Viterbi: %.3f ms\n", std::chrono::duration<double, std::milli>(end - start).count());
+
+    printf("\nCompute posterior decoding on GPU\n");
+    start = std::chrono::steady_clock::now();
+    ForwardBackwardGPU(logLikGPU, posteriorPathGPU, obs, nSeq, nObs, initProb, mtState, nState, nEmit, mtEmit);
+    end = std::chrono::steady_clock::now();
+    printf("Batched forward-backward: %.3f ms\n", std::chrono::duration<double, std::milli>(end - start).count());
+
+    printf("\nCompute Viterbi paths and posterior decoding on CPU\n");
+    bool pass = true;
+    int *path = (int*)malloc(sizeof(int)*nObs);
+    float *gamma = (float*)malloc(sizeof(float)*nObs*nState);
+    for (int s = 0; s < nSeq && pass; s++)
+    {
+        float prob;
+        ViterbiCPU(prob, path, obs + s*nObs, nObs, initProb, mtState, nState, mtEmit);
+        for (int i = 0; i < nObs; i++)
+            if (path[i] != viterbiPathGPU[s*nObs + i]) pass = false;
+    }
+
+    for (int s = 0; s < 8 && s < nSeq && pass; s++)
+    {
+        float logLik;
+        ForwardBackwardCPU(logLik, path, gamma, obs + s*nObs, nObs, initProb, mtState, nState, mtEmit);
+        if (fabsf(logLik - logLikGPU[s]) > 1e-4f * fabsf(logLik)) pass = false;
+        // a different state is fine if its posterior is as large, up to rounding
+        for (int t = 0; t < nObs; t++)
+            if (gamma[t*nState + posteriorPathGPU[s*nObs + t]] < gamma[t*nState + path[t]] - 1e-3f)
+                pass = false;
+    }
+
+    free(path);
+    free(gamma);
+    free(initProb);
+    free(mtState);
+    free(mtEmit);
+    free(obs);
+    free(viterbiProbGPU);
+    free(viterbiPathGPU);
+    free(logLikGPU);
+    free(posteriorPathGPU);
+    return pass;
+}
@@ -0,0 +1,84 @@
+#ifndef TEAM_REDUCE_H
+#define TEAM_REDUCE_H
+
+#include <cmath>
+
+// threads per team of the batched kernels
+#define BATCH_THREADS 256
+
+#pragma omp declare target
+
+// Team-wide argmax of the per-thread candidates (v, idx), called by all the
+// threads of a team. Ties go to the lower index, like a sequential scan.
+// v_sh and idx_sh are team-local arrays of BATCH_THREADS elements.
+inline void teamArgmax(float &v, int &idx, float *v_sh, int *idx_sh,
+                       const int tid, const int nThreads)
+{
+  v_sh[tid] = v;
+  idx_sh[tid] = idx;
+  #pragma omp barrier
+  for (int s = 1; s < nThreads; s *= 2)
+  {
+    if (tid % (2*s) == 0 && tid + s < nThreads)
+    {
+      float w = v_sh[tid+s];
+      int j = idx_sh[tid+s];
+      if (w > v_sh[tid] || (w == v_sh[tid] && j < idx_sh[tid]))
+      {
+        v_sh[tid] = w;
+        idx_sh[tid] = j;
+      }
+    }
+    #pragma omp barrier
+  }
+  v = v_sh[0];
+  idx = idx_sh[0];
+  #pragma omp barrier
+}
+
+// Team-wide log(sum(exp(x))) of the values x[0:n]
+inline float teamLogSumExp(const float *x, const int n, float *v_sh,
+                           const int tid, const int nThreads)
+{
+  float m = -INFINITY;
+  for (int i = tid; i < n; i += nThreads)
+    m = fmaxf(m, x[i]);
+  v_sh[tid] = m;
+  #pragma omp barrier
+  for (int s = 1; s < nThreads; s *= 2)
+  {
+    if (tid % (2*s) == 0 && tid + s < nThreads)
+      v_sh[tid] = fmaxf(v_sh[tid], v_sh[tid+s]);
+    #pragma omp barrier
+  }
+  m = v_sh[0];
+  #pragma omp barrier
+
+  float sum = 0.0f;
+  for (int i = tid; i < n; i += nThreads)
+    sum += expf(x[i] - m);
+  v_sh[tid] = sum;
+  #pragma omp barrier
+  for (int s = 1; s < nThreads; s *= 2)
+  {
+    if (tid % (2*s) == 0 && tid + s < nThreads)
+      v_sh[tid] += v_sh[tid+s];
+    #pragma omp barrier
+  }
+  sum = v_sh[0];
+  #pragma omp barrier
+  return m + logf(sum);
+}
+
+#pragma omp end declare target
+
+// Number of sequences decoded per kernel launch, so that the per-sequence
+// device storage of a launch stays below 256 MB
+inline int batchChunk(const size_t bytesPerSeq, const int nSeq)
+{
+  size_t chunk = ((size_t)256 << 20) / (bytesPerSeq ? bytesPerSeq : 1);
+  if (chunk < 1) chunk = 1;
+  return chunk < (size_t)nSeq ? (int)chunk : nSeq;
+}
+
+#endif
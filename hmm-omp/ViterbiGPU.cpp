@@ -11,38 +11,50 @@
 
 #include <cstdlib>
 #include <cstdio>
+#include <cstring>
+#include <omp.h>
+#include "TeamReduce.h"
 
 ///////////////////////////////////////////////////////////////////////////////
 // Using Viterbi algorithm to search for a Hidden Markov Model for the most
 // probable state path given the observation sequence.
+//
+// The traceback is kept in P, a 16-bit type when the state indices fit.
+// The probabilities of two consecutive observations are ping-pong buffers.
 ///////////////////////////////////////////////////////////////////////////////
-int ViterbiGPU(float &viterbiProb,
+template <typename P>
+static int viterbi(float &viterbiProb,
     int   *__restrict__ viterbiPath,
     int   *__restrict__ obs, 
     const int nObs, 
     float *__restrict__ initProb,
     float *__restrict__ mtState, 
-    //const int &nState,
     const int nState,
     const int nEmit,
     float *__restrict__ mtEmit)
 {
+  float *maxProbOld = (float*)malloc(sizeof(float)*nState);
+  float *maxProbNew = (float*)malloc(sizeof(float)*nState);
+  P *path = (P*)malloc(sizeof(P)*(nObs-1)*nState);
+  memcpy(maxProbOld, initProb, sizeof(float)*nState);
 
-  float maxProbNew[nState];
-  int path[(nObs-1)*nState];
-  float *maxProbOld = initProb;
+  // the probabilities of the last observation
+  float *maxProbLast = (nObs % 2 == 0) ? maxProbNew : maxProbOld;
 
-#pragma omp target data map(to:initProb[0:nState], \
-                               mtState[0:nState*nState], \
+#pragma omp target data map(to:mtState[0:nState*nState], \
                                mtEmit[0:nEmit*nState], \
                                obs[0:nObs],\
                                maxProbOld[0:nState]) \
-                        map(from: maxProbNew[0:nState], path[0:(nObs-1)*nState])
+                        map(alloc: maxProbNew[0:nState]) \
+                        map(from: path[0:(nObs-1)*nState])
   {
 
     // main iteration of Viterbi algorithm
     for (int t = 1; t < nObs; t++) // for every input observation
     { 
+      float *pOld = (t % 2 == 1) ? maxProbOld : maxProbNew;
+      float *pNew = (t % 2 == 1) ? maxProbNew : maxProbOld;
+
       #pragma omp target teams distribute parallel for thread_limit(256)
       for (int iState = 0; iState < nState; iState++) 
       {
@@ -51,23 +63,19 @@ int ViterbiGPU(float &viterbiProb,
         int maxState = -1;
         for (int preState = 0; preState < nState; preState++) 
         {
-          float p = maxProbOld[preState] + mtState[iState*nState + preState];
+          float p = pOld[preState] + mtState[iState*nState + preState];
           if (p > maxProb) 
           {
             maxProb = p;
             maxState = preState;
           }
         }
-        maxProbNew[iState] = maxProb + mtEmit[obs[t]*nState+iState];
+        pNew[iState] = maxProb + mtEmit[obs[t]*nState+iState];
         path[(t-1)*nState+iState] = maxState;
       }
-
-      #pragma omp target teams distribute parallel for thread_limit(256)
-      for (int iState = 0; iState < nState; iState++) 
-      {
-        maxProbOld[iState] = maxProbNew[iState];
-      }
     }
+
+    #pragma omp target update from (maxProbLast[0:nState])
   }
 
   // find the final most probable state
@@ -75,9 +83,9 @@ int ViterbiGPU(float &viterbiProb,
   int maxState = -1;
   for (int i = 0; i < nState; i++) 
   {
-    if (maxProbNew[i] > maxProb) 
+    if (maxProbLast[i] > maxProb) 
     {
-      maxProb = maxProbNew[i];
+      maxProb = maxProbLast[i];
       maxState = i;
     }
   }
@@ -90,5 +98,148 @@ int ViterbiGPU(float &viterbiProb,
     viterbiPath[t] = path[t*nState+viterbiPath[t+1]];
   }
 
+  free(maxProbOld);
+  free(maxProbNew);
+  free(path);
+  return 1;
+}
+
+int ViterbiGPU(float &viterbiProb,
+    int   *__restrict__ viterbiPath,
+    int   *__restrict__ obs, 
+    const int nObs, 
+    float *__restrict__ initProb,
+    float *__restrict__ mtState, 
+    const int nState,
+    const int nEmit,
+    float *__restrict__ mtEmit)
+{
+  if (nState <= 32768)
+    return viterbi<short>(viterbiProb, viterbiPath, obs, nObs, initProb, mtState, nState, nEmit, mtEmit);
+  else
+    return viterbi<int>(viterbiProb, viterbiPath, obs, nObs, initProb, mtState, nState, nEmit, mtEmit);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Viterbi paths of nSeq independent observation sequences of length nObs,
+// stored one after the other in obs. Each team decodes one sequence, with
+// the whole time loop and the backtrace in a single kernel; the threads of
+// the team share the states. Only the paths and their probabilities are
+// copied back.
+///////////////////////////////////////////////////////////////////////////////
+template <typename P>
+static int viterbiBatch(float *__restrict__ viterbiProb,
+    int   *__restrict__ viterbiPath,
+    const int *__restrict__ obs,
+    const int nSeq,
+    const int nObs,
+    const float *__restrict__ initProb,
+    const float *__restrict__ mtState,
+    const int nState,
+    const int nEmit,
+    const float *__restrict__ mtEmit)
+{
+  const int chunk = batchChunk(sizeof(P)*(nObs-1)*nState + sizeof(float)*2*nState, nSeq);
+  float *maxProb = (float*)malloc(sizeof(float)*2*nState*chunk);
+  P *path = (P*)malloc(sizeof(P)*(nObs-1)*nState*chunk);
+
+#pragma omp target data map(to: initProb[0:nState], \
+                                mtState[0:nState*nState], \
+                                mtEmit[0:nEmit*nState], \
+                                obs[0:nSeq*nObs]) \
+                        map(alloc: maxProb[0:2*nState*chunk], \
+                                   path[0:(nObs-1)*nState*chunk]) \
+                        map(from: viterbiProb[0:nSeq], viterbiPath[0:nSeq*nObs])
+  {
+    for (int s0 = 0; s0 < nSeq; s0 += chunk)
+    {
+      const int n = (nSeq - s0 < chunk) ? nSeq - s0 : chunk;
+
+      #pragma omp target teams num_teams(n) thread_limit(BATCH_THREADS)
+      {
+        float prob_sh[BATCH_THREADS];
+        int state_sh[BATCH_THREADS];
+        #pragma omp parallel
+        {
+          const int seq = omp_get_team_num();
+          const int tid = omp_get_thread_num();
+          const int nThreads = omp_get_num_threads();
+          const int *o = obs + (size_t)(s0 + seq) * nObs;
+          float *pOld = maxProb + (size_t)2 * nState * seq;
+          float *pNew = pOld + nState;
+          P *tb = path + (size_t)(nObs-1) * nState * seq;
+
+          for (int iState = tid; iState < nState; iState += nThreads)
+            pOld[iState] = initProb[iState];
+          #pragma omp barrier
+
+          for (int t = 1; t < nObs; t++)
+          {
+            for (int iState = tid; iState < nState; iState += nThreads)
+            {
+              float maxProb = 0.0;
+              int maxState = -1;
+              for (int preState = 0; preState < nState; preState++)
+              {
+                float p = pOld[preState] + mtState[iState*nState + preState];
+                if (p > maxProb)
+                {
+                  maxProb = p;
+                  maxState = preState;
+                }
+              }
+              pNew[iState] = maxProb + mtEmit[o[t]*nState+iState];
+              tb[(t-1)*nState+iState] = maxState;
+            }
+            #pragma omp barrier
+            float *tmp = pOld; pOld = pNew; pNew = tmp;
+          }
+
+          // find the final most probable state
+          float maxProb = 0.0;
+          int maxState = -1;
+          for (int iState = tid; iState < nState; iState += nThreads)
+          {
+            if (pOld[iState] > maxProb)
+            {
+              maxProb = pOld[iState];
+              maxState = iState;
+            }
+          }
+          teamArgmax(maxProb, maxState, prob_sh, state_sh, tid, nThreads);
+
+          // backtrace to find the Viterbi path
+          if (tid == 0)
+          {
+            int *vp = viterbiPath + (size_t)(s0 + seq) * nObs;
+            viterbiProb[s0 + seq] = maxProb;
+            vp[nObs-1] = maxState;
+            for (int t = nObs-2; t >= 0; t--)
+              vp[t] = (vp[t+1] < 0) ? -1 : tb[t*nState+vp[t+1]];
+          }
+        }
+      }
+    }
+  }
+
+  free(maxProb);
+  free(path);
   return 1;
 }
+
+int ViterbiBatchGPU(float *__restrict__ viterbiProb,
+    int   *__restrict__ viterbiPath,
+    const int *__restrict__ obs,
+    const int nSeq,
+    const int nObs,
+    const float *__restrict__ initProb,
+    const float *__restrict__ mtState,
+    const int nState,
+    const int nEmit,
+    const float *__restrict__ mtEmit)
+{
+  if (nState <= 32768)
+    return viterbiBatch<short>(viterbiProb, viterbiPath, obs, nSeq, nObs, initProb, mtState, nState, nEmit, mtEmit);
+  else
+    return viterbiBatch<int>(viterbiProb, viterbiPath, obs, nSeq, nObs, initProb, mtState, nState, nEmit, mtEmit);
+}
@@ -0,0 +1,383 @@
+#include <aio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <float.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <omp.h>
+#include "bucketsort.h"
+#include "mergesort.h"
+#include "externalsort.h"
+
+////////////////////////////////////////////////////////////////////////////////
+// Asynchronous transfers: a request is issued with aio_read or aio_write and
+// completed by waitTransfer, which finishes a short transfer synchronously
+////////////////////////////////////////////////////////////////////////////////
+typedef struct {
+  struct aiocb cb;
+  int pending;    // 0: none, 1: issued, 2: issue failed, done when waited for
+  int write;
+} transfer;
+
+static void startTransfer(transfer *t, int fd, void *buf, size_t bytes,
+    off_t offset, int write)
+{
+  memset(&t->cb, 0, sizeof(t->cb));
+  t->cb.aio_fildes = fd;
+  t->cb.aio_buf = buf;
+  t->cb.aio_nbytes = bytes;
+  t->cb.aio_offset = offset;
+  t->write = write;
+  t->pending = ((write ? aio_write(&t->cb) : aio_read(&t->cb)) == 0) ? 1 : 2;
+}
+
+// Returns 0 once the transfer is complete, -1 on an I/O error. The time spent
+// waiting is added to waited.
+static int waitTransfer(transfer *t, double *waited)
+{
+  if (!t->pending) return 0;
+  double start = omp_get_wtime();
+  ssize_t done = 0;
+  if (t->pending == 1) {
+    const struct aiocb *list[1] = { &t->cb };
+    while (aio_error(&t->cb) == EINPROGRESS)
+      aio_suspend(list, 1, NULL);
+    done = aio_return(&t->cb);
+    if (done < 0) done = 0;
+  }
+  char *buf = (char *)t->cb.aio_buf;
+  size_t bytes = t->cb.aio_nbytes;
+  while ((size_t)done < bytes) {
+    ssize_t n = t->write ?
+      pwrite(t->cb.aio_fildes, buf + done, bytes - done, t->cb.aio_offset + done) :
+      pread(t->cb.aio_fildes, buf + done, bytes - done, t->cb.aio_offset + done);
+    if (n <= 0) break;
+    done += n;
+  }
+  t->pending = 0;
+  *waited += omp_get_wtime() - start;
+  return ((size_t)done == bytes) ? 0 : -1;
+}
+
+// Order-independent checksum of a list: the sum of the bit patterns
+static unsigned long long checksum(const float *list, long long n)
+{
+  unsigned long long sum = 0;
+  for (long long i = 0; i < n; i++) {
+    unsigned int bits;
+    memcpy(&bits, list + i, sizeof(bits));
+    sum += bits;
+  }
+  return sum;
+}
+
+static int compareFloat(const void *a, const void *b) {
+  if(*((float *)a) < *((float *)b)) return -1;
+  else if(*((float *)a) > *((float *)b)) return 1;
+  else return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Sort a list with the bucket sort and merge sort pipeline. list and scratch
+// hold listsize + DIVISIONS*4 floats; the sorted list is returned and is one
+// of the two.
+////////////////////////////////////////////////////////////////////////////////
+float *sortInCore(float *list, float *scratch, int listsize)
+{
+  float datamin = FLT_MAX;
+  float datamax = -FLT_MAX;
+  for (int i = 0; i < listsize; i++) {
+    datamin = fminf(list[i], datamin);
+    datamax = fmaxf(list[i], datamax);
+  }
+  // the pivot points need a range of values to split
+  if (!(datamin < datamax)) return list;
+  if (listsize < IN_CORE_MIN_SIZE) {
+    qsort(list, listsize, sizeof(float), compareFloat);
+    return list;
+  }
+
+  int *sizes = (int*) malloc(DIVISIONS * sizeof(int));
+  int *nullElements = (int*) malloc(DIVISIONS * sizeof(int));
+  unsigned int *origOffsets = (unsigned int *) malloc((DIVISIONS + 1) * sizeof(int));
+
+  // the float4 padding at the end of each bucket must sort before the
+  // bucket's elements, the merge sort drops the first nullElements of each
+  for (int i = 0; i < listsize + DIVISIONS*4; i++)
+    scratch[i] = -FLT_MAX;
+
+  bucketSort(list, scratch, listsize, sizes, nullElements, datamin, datamax, origOffsets);
+
+  int newlistsize = 0;
+  for(int i = 0; i < DIVISIONS; i++){
+    newlistsize += sizes[i] * 4;
+  }
+  float *result = (float*) runMergeSort(newlistsize, DIVISIONS, (float4*) scratch,
+      (float4*) list, sizes, nullElements, origOffsets);
+
+  free(sizes);
+  free(nullElements);
+  free(origOffsets);
+  return result;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Reader of one sorted run during the merge: two buffers, one being consumed
+// while the next part of the run is read into the other
+////////////////////////////////////////////////////////////////////////////////
+typedef struct {
+  float *buf[2];
+  transfer io[2];
+  int len[2];
+  int cur, pos;
+  long long next, end;  // next element to request, end of the run
+} runReader;
+
+static void requestRun(runReader *rd, int b, int fd)
+{
+  long long count = rd->end - rd->next;
+  if (count > EXTERNAL_MERGE_BUFFER) count = EXTERNAL_MERGE_BUFFER;
+  rd->len[b] = (int)count;
+  if (count > 0)
+    startTransfer(&rd->io[b], fd, rd->buf[b], count * sizeof(float),
+        (off_t)rd->next * sizeof(float), 0);
+  rd->next += count;
+}
+
+// Moves to the next element; returns 0 when the run is exhausted
+static int advanceRun(runReader *rd, int fd, double *waited, int *error)
+{
+  if (++rd->pos < rd->len[rd->cur]) return 1;
+  int other = rd->cur ^ 1;
+  if (rd->len[other] == 0) return 0;
+  if (waitTransfer(&rd->io[other], waited)) *error = 1;
+  requestRun(rd, rd->cur, fd);
+  rd->cur = other;
+  rd->pos = 0;
+  return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Sort a binary file of floats that may not fit in memory. Runs of runSize
+// floats are sorted on the device and written to a temporary file, then the
+// runs are merged with a heap into the output file.
+////////////////////////////////////////////////////////////////////////////////
+int externalSort(const char *inputPath, const char *outputPath, int runSize)
+{
+  int in = open(inputPath, O_RDONLY);
+  if (in < 0) {
+    printf("Error reading file %s\n", inputPath);
+    return -1;
+  }
+  struct stat st;
+  fstat(in, &st);
+  long long numElements = st.st_size / sizeof(float);
+  if (numElements < runSize) runSize = numElements > 0 ? (int)numElements : 1;
+  long long numRuns = (numElements + runSize - 1) / runSize;
+  double gigabytes = numElements * sizeof(float) * 1e-9;
+  printf("External sort of %lld floats in %lld runs of up to %d floats.\n",
+      numElements, numRuns, runSize);
+
+  char *runPath = (char *) malloc(strlen(outputPath) + 6);
+  sprintf(runPath, "%s.runs", outputPath);
+  int runs = open(runPath, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  int out = open(outputPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (runs < 0 || out < 0) {
+    printf("Error writing file %s\n", runs < 0 ? runPath : outputPath);
+    close(in);
+    free(runPath);
+    return -1;
+  }
+  int error = 0;
+
+  //  ////////////////////////////////////////////////////////////////////////////
+  //  // Phase 1 - Sorted runs. Three buffer sets rotate: run r+1 is read into
+  //  // one while run r is sorted in another and run r-1 is written from the
+  //  // third.
+  //  ////////////////////////////////////////////////////////////////////////////
+  float *list[3], *scratch[3], *result[3];
+  transfer reads[3], writes[3];
+  size_t bufferBytes = ((size_t)runSize + DIVISIONS*4) * sizeof(float);
+  for (int s = 0; s < 3; s++) {
+    list[s] = (float *) malloc(bufferBytes);
+    scratch[s] = (float *) malloc(bufferBytes);
+    reads[s].pending = writes[s].pending = 0;
+  }
+
+  unsigned long long inputSum = 0;
+  double readWait = 0, writeWait = 0, sortTime = 0;
+  double phaseStart = omp_get_wtime();
+  if (numRuns > 0)
+    startTransfer(&reads[0], in, list[0], (size_t)runSize * sizeof(float), 0, 0);
+
+  for (long long r = 0; r < numRuns && !error; r++) {
+    int s = r % 3;
+    long long first = r * runSize;
+    int n = (int)(numElements - first < runSize ? numElements - first : runSize);
+    if (waitTransfer(&reads[s], &readWait)) error = 1;
+
+    if (r + 1 < numRuns) {
+      // the buffers of run r+1 were last used to write run r-2
+      int s1 = (r + 1) % 3;
+      long long next = first + runSize;
+      long long n1 = numElements - next < runSize ? numElements - next : runSize;
+      if (waitTransfer(&writes[s1], &writeWait)) error = 1;
+      startTransfer(&reads[s1], in, list[s1], n1 * sizeof(float),
+          (off_t)next * sizeof(float), 0);
+    }
+
+    inputSum += checksum(list[s], n);
+    double sortStart = omp_get_wtime();
+    result[s] = sortInCore(list[s], scratch[s], n);
+    sortTime += omp_get_wtime() - sortStart;
+
+    startTransfer(&writes[s], runs, result[s], n * sizeof(float),
+        (off_t)first * sizeof(float), 1);
+  }
+  for (int s = 0; s < 3; s++) {
+    if (waitTransfer(&reads[s], &readWait)) error = 1;
+    if (waitTransfer(&writes[s], &writeWait)) error = 1;
+  }
+  double runTime = omp_get_wtime() - phaseStart;
+
+  for (int s = 0; s < 3; s++) {
+    free(list[s]);
+    free(scratch[s]);
+  }
+
+  printf("Run formation: %0.3f s, %0.3f GB/s\n", runTime, gigabytes / runTime);
+  printf("  --Sort time: %0.3f s, %0.3f GB/s\n", sortTime, gigabytes / sortTime);
+  printf("  --Read wait: %0.3f s, write wait: %0.3f s\n", readWait, writeWait);
+
+  //  ////////////////////////////////////////////////////////////////////////////
+  //  // Phase 2 - k-way merge of the runs with read-ahead on every run and
+  //  // write-behind on the output
+  //  ////////////////////////////////////////////////////////////////////////////
+  runReader *readers = (runReader *) malloc(numRuns * sizeof(runReader));
+  float *heapVal = (float *) malloc(numRuns * sizeof(float));
+  int *heapRun = (int *) malloc(numRuns * sizeof(int));
+  float *outBuf[2];
+  transfer outIO[2];
+  for (int b = 0; b < 2; b++) {
+    outBuf[b] = (float *) malloc(EXTERNAL_OUTPUT_BUFFER * sizeof(float));
+    outIO[b].pending = 0;
+  }
+
+  readWait = writeWait = 0;
+  phaseStart = omp_get_wtime();
+
+  int heapSize = 0;
+  for (long long r = 0; r < numRuns; r++) {
+    runReader *rd = readers + r;
+    rd->buf[0] = (float *) malloc(EXTERNAL_MERGE_BUFFER * sizeof(float));
+    rd->buf[1] = (float *) malloc(EXTERNAL_MERGE_BUFFER * sizeof(float));
+    rd->io[0].pending = rd->io[1].pending = 0;
+    rd->next = r * runSize;
+    rd->end = rd->next + runSize < numElements ? rd->next + runSize : numElements;
+    rd->cur = rd->pos = 0;
+    requestRun(rd, 0, runs);
+    requestRun(rd, 1, runs);
+  }
+  // fill the heap in run order, sifting each new head up
+  for (long long r = 0; r < numRuns; r++) {
+    runReader *rd = readers + r;
+    if (waitTransfer(&rd->io[0], &readWait)) error = 1;
+    int i = heapSize++;
+    float v = rd->buf[0][0];
+    while (i > 0 && v < heapVal[(i - 1) / 2]) {
+      heapVal[i] = heapVal[(i - 1) / 2];
+      heapRun[i] = heapRun[(i - 1) / 2];
+      i = (i - 1) / 2;
+    }
+    heapVal[i] = v;
+    heapRun[i] = (int)r;
+  }
+
+  unsigned long long outputSum = 0;
+  long long written = 0;
+  int ob = 0, opos = 0, sorted = 1;
+  float last = -FLT_MAX;
+  while (heapSize > 0 && !error) {
+    float v = heapVal[0];
+    int r = heapRun[0];
+    if (v < last) sorted = 0;
+    last = v;
+    outBuf[ob][opos++] = v;
+    if (opos == EXTERNAL_OUTPUT_BUFFER) {
+      outputSum += checksum(outBuf[ob], opos);
+      startTransfer(&outIO[ob], out, outBuf[ob], opos * sizeof(float),
+          (off_t)written * sizeof(float), 1);
+      written += opos;
+      ob ^= 1;
+      opos = 0;
+      if (waitTransfer(&outIO[ob], &writeWait)) error = 1;
+    }
+
+    // replace the head by the next element of its run and restore the heap
+    runReader *rd = readers + r;
+    if (advanceRun(rd, runs, &readWait, &error)) {
+      v = rd->buf[rd->cur][rd->pos];
+    } else {
+      heapSize--;
+      v = heapVal[heapSize];
+      r = heapRun[heapSize];
+    }
+    int i = 0;
+    while (2 * i + 1 < heapSize) {
+      int c = 2 * i + 1;
+      if (c + 1 < heapSize && heapVal[c + 1] < heapVal[c]) c++;
+      if (!(heapVal[c] < v)) break;
+      heapVal[i] = heapVal[c];
+      heapRun[i] = heapRun[c];
+      i = c;
+    }
+    heapVal[i] = v;
+    heapRun[i] = r;
+  }
+  if (opos > 0) {
+    outputSum += checksum(outBuf[ob], opos);
+    startTransfer(&outIO[ob], out, outBuf[ob], opos * sizeof(float),
+        (off_t)written * sizeof(float), 1);
+    written += opos;
+  }
+  for (int b = 0; b < 2; b++)
+    if (waitTransfer(&outIO[b], &writeWait)) error = 1;
+  double mergeTime = omp_get_wtime() - phaseStart;
+
+  printf("Merge: %0.3f s, %0.3f GB/s\n", mergeTime, gigabytes / mergeTime);
+  printf("  --Read wait: %0.3f s, write wait: %0.3f s\n", readWait, writeWait);
+  printf("Total: %0.3f s, %0.3f GB/s\n", runTime + mergeTime,
+      gigabytes / (runTime + mergeTime));
+
+  for (long long r = 0; r < numRuns; r++) {
+    runReader *rd = readers + r;
+    for (int b = 0; b < 2; b++) {
+      waitTransfer(&rd->io[b], &readWait);
+      free(rd->buf[b]);
+    }
+  }
+  free(readers);
+  free(heapVal);
+  free(heapRun);
+  free(outBuf[0]);
+  free(outBuf[1]);
+
+  close(in);
+  close(runs);
+  close(out);
+  unlink(runPath);
+  free(runPath);
+
+  printf("Checking result...");
+  if (!error && sorted && written == numElements && outputSum == inputSum) {
+    printf("PASSED.\n");
+    return 0;
+  }
+  printf("FAILED.\n");
+  return -1;
+}
@@ -0,0 +1,18 @@
+#ifndef __EXTERNALSORT
+#define __EXTERNALSORT
+
+#include "bucketsort.h"
+
+// Default number of floats in a run sorted on the device
+#define EXTERNAL_RUN_SIZE     (1 << 25)
+// Floats per read-ahead buffer of a run, two buffers per run
+#define EXTERNAL_MERGE_BUFFER (1 << 20)
+// Floats per write-behind buffer of the merged output, two buffers
+#define EXTERNAL_OUTPUT_BUFFER (1 << 22)
+// Shorter lists are sorted on the host
+#define IN_CORE_MIN_SIZE      (DIVISIONS * 64)
+
+float *sortInCore(float *list, float *scratch, int listsize);
+int externalSort(const char *inputPath, const char *outputPath, int runSize);
+
+#endif
@@ -13,8 +13,10 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include "bucketsort.h"
 #include "mergesort.h"
+#include "externalsort.h"
 #include <time.h>
 #define TIMER 
 
@@ -43,12 +45,65 @@ float4* runMergeSort(int listsize, int divisions,
 
 int main(int argc, char** argv)
 {
+  if(argc < 2) {
+    printf("Usage: %s r | <text file> | -b <binary file> |\n"
+           "       -e <binary input> <binary output> [run size] | -g <binary file> <count>\n", argv[0]);
+    return 0;
+  }
+
+  // Write random floats between -1 and 1 to a binary file, the negative
+  // keys exercise the bucket padding that has to sort before them
+  if(strcmp(argv[1],"-g") == 0 && argc == 4) {
+    long long count = atoll(argv[3]);
+    FILE *fp = fopen(argv[2],"wb");
+    if(fp == NULL) {
+      printf("Error writing file \n");
+      exit(EXIT_FAILURE);
+    }
+    float *chunk = (float *)malloc(EXTERNAL_MERGE_BUFFER * sizeof(float));
+    for(long long i = 0; i < count; i += EXTERNAL_MERGE_BUFFER) {
+      long long n = count - i < EXTERNAL_MERGE_BUFFER ? count - i : EXTERNAL_MERGE_BUFFER;
+      for(long long j = 0; j < n; j++)
+        chunk[j] = 2.0f * rand() / RAND_MAX - 1.0f;
+      fwrite(chunk, sizeof(float), n, fp);
+    }
+    free(chunk);
+    fclose(fp);
+    return 0;
+  }
+
+  // Sort a binary file of floats through memory-sized runs
+  if(strcmp(argv[1],"-e") == 0 && argc >= 4) {
+    int runSize = argc > 4 ? atoi(argv[4]) : EXTERNAL_RUN_SIZE;
+    return externalSort(argv[2], argv[3], runSize > 0 ? runSize : EXTERNAL_RUN_SIZE) ? EXIT_FAILURE : 0;
+  }
+
   // Fill our data set with random float values
   int numElements = 0 ;
+  int binary = strcmp(argv[1],"-b") == 0 && argc > 2;
+  float *mapped = NULL;
 
   if(strcmp(argv[1],"r") ==0) {
     numElements = SIZE;
   }
+  else if(binary) {
+    int fd = open(argv[2], O_RDONLY);
+    struct stat st;
+    if(fd < 0 || fstat(fd, &st) != 0) {
+      printf("Error reading file \n");
+      exit(EXIT_FAILURE);
+    }
+    numElements = st.st_size / sizeof(float);
+    if(numElements > 0) {
+      mapped = (float *)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if(mapped == MAP_FAILED) {
+        printf("Error reading file \n");
+        exit(EXIT_FAILURE);
+      }
+      madvise(mapped, st.st_size, MADV_SEQUENTIAL);
+    }
+    close(fd);
+  }
   else {
     FILE *fp;
     fp = fopen(argv[1],"r");
@@ -89,6 +144,14 @@ int main(int argc, char** argv)
       datamax = fmaxf(cpu_idata[i], datamax);
     }
   }
+  else if(binary) {
+    for(int i = 0; i < numElements; i++) {
+      cpu_idata[i] = mapped[i];
+      datamin = fminf(cpu_idata[i], datamin);
+      datamax = fmaxf(cpu_idata[i],datamax);
+    }
+    if(numElements > 0) munmap(mapped, numElements * sizeof(float));
+  }
   else {
     FILE *fp;
     fp = fopen(argv[1],"r");
@@ -98,20 +161,27 @@ int main(int argc, char** argv)
       datamax = fmaxf(cpu_idata[i],datamax);
     }
   }
-  FILE *tp;
-  const char filename2[]="./hybridinput.txt";
-  tp = fopen(filename2,"w");
-  for(int i = 0; i < SIZE; i++) {
-    fprintf(tp,"%f ",cpu_idata[i]); 
-  }
+  if(!binary) {
+    FILE *tp;
+    const char filename2[]="./hybridinput.txt";
+    tp = fopen(filename2,"w");
+    for(int i = 0; i < numElements; i++) {
+      fprintf(tp,"%f ",cpu_idata[i]); 
+    }
 
-  fclose(tp);
+    fclose(tp);
+  }
   memcpy(cpu_odata, cpu_idata, mem_size);
 
   int *sizes = (int*) malloc(DIVISIONS * sizeof(int));
   int *nullElements = (int*) malloc(DIVISIONS * sizeof(int));
   unsigned int *origOffsets = (unsigned int *) malloc((DIVISIONS + 1) * sizeof(int));
 
+  // the float4 padding at the end of each bucket must sort before the
+  // bucket's elements, the merge sort drops the first nullElements of each
+  for (int i = 0; i < numElements + DIVISIONS*4; i++)
+    d_output[i] = -FLT_MAX;
+
   clock_t bucketsort_start = clock();
   bucketSort(cpu_idata,d_output,numElements,sizes,nullElements,datamin,datamax, origOffsets);
   clock_t bucketsort_diff = clock() - bucketsort_start;
@@ -43,15 +43,18 @@ void init_spins( signed char* lattice, const float* randvals,
   }
 }
 
-template<bool is_black>
+template<bool is_black, bool measure>
 void update_lattice(signed char *lattice,
     signed char *op_lattice,
     float* randvals,
     const float inv_temp,
     const long long nx,
-    const long long ny) {
+    const long long ny,
+    long long &mag,
+    long long &anti) {
 
-  #pragma omp target teams distribute parallel for collapse(2) thread_limit(THREADS)
+  long long m = 0, a = 0;
+  #pragma omp target teams distribute parallel for collapse(2) thread_limit(THREADS) reduction(+:m,a)
   for (int i = 0; i < nx; i++)
     for (int j = 0; j < ny; j++) {
       // Set stencil indices with periodicity
@@ -77,20 +80,214 @@ void update_lattice(signed char *lattice,
       float acceptance_ratio = exp((double)(-2.0f * inv_temp * nn_sum * lij));
       if (randvals[i*ny + j] < acceptance_ratio) {
         lattice[i * ny + j] = -lij;
+        lij = -lij;
+      }
+
+      // Every bond has one white end, so the white half-sweep counts
+      // each anti-aligned bond once
+      if (measure) {
+        m += lij;
+        if (!is_black) a += (4 - nn_sum * lij) / 2;
       }
     }
+
+  if (measure) {
+    mag += m;
+    anti += a;
+  }
 }
 
 
+template<bool measure>
 void update(signed char* lattice_b, signed char* lattice_w, float* randvals,
-	          const float inv_temp, const long long nx, const long long ny) {
+	          const float inv_temp, const long long nx, const long long ny,
+            long long &mag, long long &anti) {
 
   // Update black
-  update_lattice<true>(lattice_b, lattice_w, randvals, inv_temp, nx, ny / 2);
+  update_lattice<true, measure>(lattice_b, lattice_w, randvals, inv_temp, nx, ny / 2, mag, anti);
 
   // Update white
-  update_lattice<false>(lattice_w, lattice_b, randvals, inv_temp, nx, ny / 2);
+  update_lattice<false, measure>(lattice_w, lattice_b, randvals, inv_temp, nx, ny / 2, mag, anti);
+
+}
+
+
+// Multi-spin coding
+//
+// Each sublattice row of ny/2 spins is packed into ny/128 64-bit words,
+// one bit per spin (1 = up, 0 = down); bit k of word w holds column
+// w*64 + k. The number of anti-aligned neighbors of all 64 spins in a
+// word is evaluated with a bit-sliced adder, and the random numbers are
+// drawn in the update kernel from a Philox4x32-10 stream keyed by the
+// seed and counted by word, half-sweep and draw.
+
+typedef unsigned long long spin_word;
+
+#pragma omp declare target
+inline int popcount64(spin_word x) {
+  x = x - ((x >> 1) & 0x5555555555555555ULL);
+  x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+  x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+  return (int)((x * 0x0101010101010101ULL) >> 56);
+}
+
+struct philox_stream {
+  unsigned int ctr[4];
+  unsigned int key[2];
+  spin_word buf;
+  bool has_buf;
+
+  philox_stream(unsigned long long seed, unsigned long long word,
+                unsigned long long step) {
+    ctr[0] = (unsigned int)word;
+    ctr[1] = (unsigned int)(word >> 32);
+    ctr[2] = (unsigned int)step;
+    ctr[3] = (unsigned int)(step >> 32) << 16;  // low 16 bits count draws
+    key[0] = (unsigned int)seed;
+    key[1] = (unsigned int)(seed >> 32);
+    has_buf = false;
+  }
+
+  // 64 random bits; one Philox block yields two words
+  spin_word next() {
+    if (has_buf) {
+      has_buf = false;
+      return buf;
+    }
+    unsigned int c0 = ctr[0], c1 = ctr[1], c2 = ctr[2], c3 = ctr[3];
+    unsigned int k0 = key[0], k1 = key[1];
+    for (int r = 0; r < 10; r++) {
+      unsigned long long p0 = (unsigned long long)0xD2511F53U * c0;
+      unsigned long long p1 = (unsigned long long)0xCD9E8D57U * c2;
+      unsigned int hi0 = (unsigned int)(p0 >> 32), lo0 = (unsigned int)p0;
+      unsigned int hi1 = (unsigned int)(p1 >> 32), lo1 = (unsigned int)p1;
+      c0 = hi1 ^ c1 ^ k0;
+      c1 = lo1;
+      c2 = hi0 ^ c3 ^ k1;
+      c3 = lo0;
+      k0 += 0x9E3779B9U;
+      k1 += 0xBB67AE85U;
+    }
+    ctr[3]++;
+    buf = ((spin_word)c3 << 32) | c2;
+    has_buf = true;
+    return ((spin_word)c1 << 32) | c0;
+  }
+};
+
+// Lanes in p1_lanes accept with probability p1 / 2^32, lanes in p0_lanes
+// with probability p0 / 2^32. The lanes compare the bits of a uniform
+// 32-bit number with the bits of their threshold from the top; a lane
+// stops drawing once the first differing bit decides it, so most words
+// are done after a few draws.
+inline spin_word accept_mask(philox_stream &rng, spin_word p1_lanes, spin_word p0_lanes,
+                             unsigned int p1, unsigned int p0) {
+  spin_word accept = 0;
+  spin_word undecided = p1_lanes | p0_lanes;
+  for (int b = 31; b >= 0 && undecided; b--) {
+    spin_word pb = (((p1 >> b) & 1) ? p1_lanes : 0) | (((p0 >> b) & 1) ? p0_lanes : 0);
+    spin_word r = rng.next();
+    accept |= undecided & pb & ~r;
+    undecided &= ~(r ^ pb);
+  }
+  return accept;
+}
+#pragma omp end declare target
+
+void init_spins_msc(spin_word* lattice, const unsigned long long seed,
+                    const unsigned long long color,
+                    const long long nx, const long long nwords) {
+  #pragma omp target teams distribute parallel for thread_limit(THREADS)
+  for (long long tid = 0; tid < nx * nwords; tid++) {
+    philox_stream rng(seed, tid, color);
+    lattice[tid] = rng.next();
+  }
+}
 
+template<bool is_black, bool measure>
+void update_lattice_msc(spin_word *lattice,
+    const spin_word *op_lattice,
+    const unsigned int p1,
+    const unsigned int p0,
+    const unsigned long long seed,
+    const unsigned long long step,
+    const long long nx,
+    const long long nwords,
+    long long &mag,
+    long long &anti) {
+
+  long long m = 0, a = 0;
+  #pragma omp target teams distribute parallel for collapse(2) thread_limit(THREADS) reduction(+:m,a)
+  for (int i = 0; i < nx; i++)
+    for (int w = 0; w < nwords; w++) {
+      int ipp = (i + 1 < nx) ? i + 1 : 0;
+      int inn = (i - 1 >= 0) ? i - 1: nx - 1;
+
+      // The off-column neighbor is one bit over, with the bit at the
+      // word edge taken from the neighboring word
+      bool right = is_black ? (i % 2) : !(i % 2);
+      spin_word same = op_lattice[i * nwords + w];
+      spin_word side;
+      if (right) {
+        int wpp = (w + 1 < nwords) ? w + 1 : 0;
+        side = (same >> 1) | (op_lattice[i * nwords + wpp] << 63);
+      } else {
+        int wnn = (w - 1 >= 0) ? w - 1 : nwords - 1;
+        side = (same << 1) | (op_lattice[i * nwords + wnn] >> 63);
+      }
+      spin_word up = op_lattice[inn * nwords + w];
+      spin_word down = op_lattice[ipp * nwords + w];
+
+      // Count the anti-aligned neighbors k = 2*(c0 + c1 + carry) + low
+      spin_word s = lattice[i * nwords + w];
+      spin_word na = s ^ up, nb = s ^ down, nc = s ^ same, nd = s ^ side;
+      spin_word s0 = na ^ nb, c0 = na & nb;
+      spin_word s1 = nc ^ nd, c1 = nc & nd;
+      spin_word low = s0 ^ s1, carry = s0 & s1;
+
+      // k >= 2 never raises the energy; k = 1 and k = 0 raise it by
+      // 4J and 8J
+      spin_word ge2 = c0 | c1 | carry;
+      spin_word eq1 = ~ge2 & low;
+      spin_word eq0 = ~ge2 & ~low;
+
+      philox_stream rng(seed, (unsigned long long)i * nwords + w, step);
+      spin_word flip = ge2 | accept_mask(rng, eq1, eq0, p1, p0);
+      s ^= flip;
+      lattice[i * nwords + w] = s;
+
+      if (measure) {
+        m += 2 * popcount64(s) - 64;
+        if (!is_black)
+          a += popcount64(s ^ up) + popcount64(s ^ down) +
+               popcount64(s ^ same) + popcount64(s ^ side);
+      }
+    }
+
+  if (measure) {
+    mag += m;
+    anti += a;
+  }
+}
+
+template<bool measure>
+void update_msc(spin_word* lattice_b, spin_word* lattice_w,
+                const unsigned int p1, const unsigned int p0,
+                const unsigned long long seed, const unsigned long long sweep,
+                const long long nx, const long long nwords,
+                long long &mag, long long &anti) {
+
+  // Step 0 and 1 seed the initial spins
+  update_lattice_msc<true, measure>(lattice_b, lattice_w, p1, p0, seed,
+                                    2 * sweep + 2, nx, nwords, mag, anti);
+  update_lattice_msc<false, measure>(lattice_w, lattice_b, p1, p0, seed,
+                                     2 * sweep + 3, nx, nwords, mag, anti);
+}
+
+// Acceptance probability exp(-de * inv_temp) as a 32-bit threshold
+unsigned int acceptance_threshold(const float de, const float inv_temp) {
+  double p = exp(-(double)de * inv_temp) * 4294967296.0;
+  return p >= 4294967295.0 ? 0xFFFFFFFFU : (unsigned int)p;
 }
 
 static void usage(const char *pname) {
@@ -118,7 +315,15 @@ static void usage(const char *pname) {
           "\t\tcoefficient of critical temperature\n"
           "\n"
           "\t-s|--seed <SEED>\n"
-          "\t\tseed for random number generation\n\n",
+          "\t\tseed for random number generation\n"
+          "\n"
+          "\t-m|--multispin\n"
+          "\t\tpack 64 spins per word and draw the random numbers in the update\n"
+          "\t\t(lattice columns must be a multiple of 128)\n"
+          "\n"
+          "\t-o|--observe <INTERVAL>\n"
+          "\t\tmeasure magnetization and energy every INTERVAL trial iterations\n"
+          "\t\t(default: last iteration only)\n\n",
           bname);
   exit(EXIT_SUCCESS);
 }
@@ -132,22 +337,26 @@ int main(int argc, char **argv) {
   int nwarmup = 100;
   int niters = 1000;
   unsigned long long seed = 1234ULL;
+  bool multispin = false;
+  int observe = 0;
   double duration;
 
   while (1) {
     static struct option long_options[] = {
         {     "lattice-n", required_argument, 0, 'x'},
         {     "lattice-m", required_argument, 0, 'y'},
-        {         "alpha", required_argument, 0, 'y'},
+        {         "alpha", required_argument, 0, 'a'},
         {          "seed", required_argument, 0, 's'},
         {       "nwarmup", required_argument, 0, 'w'},
         {        "niters", required_argument, 0, 'n'},
+        {     "multispin",       no_argument, 0, 'm'},
+        {       "observe", required_argument, 0, 'o'},
         {          "help",       no_argument, 0, 'h'},
         {               0,                 0, 0,   0}
     };
 
     int option_index = 0;
-    int ch = getopt_long(argc, argv, "x:y:a:s:w:n:h", long_options, &option_index);
+    int ch = getopt_long(argc, argv, "x:y:a:s:w:n:mo:h", long_options, &option_index);
     if (ch == -1) break;
 
     switch(ch) {
@@ -165,6 +374,10 @@ int main(int argc, char **argv) {
         nwarmup = atoi(optarg); break;
       case 'n':
         niters = atoi(optarg); break;
+      case 'm':
+        multispin = true; break;
+      case 'o':
+        observe = atoi(optarg); break;
       case 'h':
         usage(argv[0]); break;
       case '?':
@@ -181,8 +394,68 @@ int main(int argc, char **argv) {
     exit(EXIT_FAILURE);
   }
 
+  if (multispin && ny % 128 != 0) {
+    fprintf(stderr, "ERROR: Lattice columns must be a multiple of 128 with multi-spin coding.\n");
+    exit(EXIT_FAILURE);
+  }
+
   float inv_temp = 1.0f / (alpha*TCRIT);
 
+  // Observables of the measured sweeps
+  long long mag = 0, anti = 0;
+  int nmeasure = 0;
+  double sum_absm = 0.0, sum_e = 0.0;
+  double last_m = 0.0, last_e = 0.0;
+  double naivesum = 0.0;
+  const double nspins = (double) nx * ny;
+
+  if (multispin) {
+
+  const long long nwords = ny / 128;
+  spin_word* lattice_b = (spin_word*) malloc(nx * nwords * sizeof(*lattice_b));
+  spin_word* lattice_w = (spin_word*) malloc(nx * nwords * sizeof(*lattice_w));
+  const unsigned int p1 = acceptance_threshold(4.0f, inv_temp);
+  const unsigned int p0 = acceptance_threshold(8.0f, inv_temp);
+
+#pragma omp target data map(from: lattice_b[0:nx*nwords], lattice_w[0:nx*nwords])
+{
+  init_spins_msc(lattice_b, seed, 0, nx, nwords);
+  init_spins_msc(lattice_w, seed, 1, nx, nwords);
+
+  printf("Starting warmup...\n");
+  for (int i = 0; i < nwarmup; i++) {
+    update_msc<false>(lattice_b, lattice_w, p1, p0, seed, i, nx, nwords, mag, anti);
+  }
+
+  printf("Starting trial iterations...\n");
+  auto t0 = std::chrono::high_resolution_clock::now();
+  for (int i = 0; i < niters; i++) {
+    unsigned long long sweep = (unsigned long long) nwarmup + i;
+    if (i == niters - 1 || (observe > 0 && (i + 1) % observe == 0)) {
+      mag = anti = 0;
+      update_msc<true>(lattice_b, lattice_w, p1, p0, seed, sweep, nx, nwords, mag, anti);
+      last_m = mag / nspins;
+      last_e = -(2.0 * nspins - 2.0 * anti) / nspins;
+      sum_absm += fabs(last_m);
+      sum_e += last_e;
+      nmeasure++;
+    } else {
+      update_msc<false>(lattice_b, lattice_w, p1, p0, seed, sweep, nx, nwords, mag, anti);
+    }
+    if (i % 1000 == 0) printf("Completed %d/%d iterations...\n", i+1, niters);
+  }
+  auto t1 = std::chrono::high_resolution_clock::now();
+  duration = (double) std::chrono::duration_cast<std::chrono::microseconds>(t1-t0).count();
+}
+
+  for (long long i = 0; i < nx*nwords; i++) {
+    naivesum += 2 * popcount64(lattice_b[i]) - 64;
+    naivesum += 2 * popcount64(lattice_w[i]) - 64;
+  }
+  free(lattice_b);
+  free(lattice_w);
+
+  } else {
 
   // for verification across difference platforms, generate random values once
   srand(seed);
@@ -204,13 +477,23 @@ int main(int argc, char **argv) {
   // Warmup iterations
   printf("Starting warmup...\n");
   for (int i = 0; i < nwarmup; i++) {
-    update(lattice_b, lattice_w, randvals, inv_temp, nx, ny);
+    update<false>(lattice_b, lattice_w, randvals, inv_temp, nx, ny, mag, anti);
   }
 
   printf("Starting trial iterations...\n");
   auto t0 = std::chrono::high_resolution_clock::now();
   for (int i = 0; i < niters; i++) {
-    update( lattice_b, lattice_w, randvals, inv_temp, nx, ny);
+    if (i == niters - 1 || (observe > 0 && (i + 1) % observe == 0)) {
+      mag = anti = 0;
+      update<true>(lattice_b, lattice_w, randvals, inv_temp, nx, ny, mag, anti);
+      last_m = mag / nspins;
+      last_e = -(2.0 * nspins - 2.0 * anti) / nspins;
+      sum_absm += fabs(last_m);
+      sum_e += last_e;
+      nmeasure++;
+    } else {
+      update<false>(lattice_b, lattice_w, randvals, inv_temp, nx, ny, mag, anti);
+    }
     if (i % 1000 == 0) printf("Completed %d/%d iterations...\n", i+1, niters);
   }
   auto t1 = std::chrono::high_resolution_clock::now();
@@ -219,9 +502,18 @@ int main(int argc, char **argv) {
 #pragma omp target exit data map(from: lattice_b[0:nx*ny/2], lattice_w[0:nx*ny/2]) \
 	                     map(delete: randvals[0:nx*ny/2])
 
+  for (int i = 0; i < nx*ny/2; i++) {
+    naivesum += lattice_b[i];
+    naivesum += lattice_w[i];
+  }
+  free(randvals);
+  free(lattice_b);
+  free(lattice_w);
+  }
 
   printf("REPORT:\n");
   printf("\tnGPUs: %d\n", 1);
+  printf("\tmulti-spin coding: %s\n", multispin ? "yes" : "no");
   printf("\ttemperature: %f * %f\n", alpha, TCRIT);
   printf("\tseed: %llu\n", seed);
   printf("\twarmup iterations: %d\n", nwarmup);
@@ -229,15 +521,13 @@ int main(int argc, char **argv) {
   printf("\tlattice dimensions: %lld x %lld\n", nx, ny);
   printf("\telapsed time: %f sec\n", duration * 1e-6);
   printf("\tupdates per ns: %f\n", (double) (nx * ny) * niters / duration * 1e-3);
-
-  double naivesum = 0.0;
-  for (int i = 0; i < nx*ny/2; i++) {
-    naivesum += lattice_b[i];
-    naivesum += lattice_w[i];
+  printf("\tmagnetization per spin: %f\n", last_m);
+  printf("\tenergy per spin: %f\n", last_e);
+  if (nmeasure > 1) {
+    printf("\taverage |magnetization| over %d sweeps: %f\n", nmeasure, sum_absm / nmeasure);
+    printf("\taverage energy over %d sweeps: %f\n", nmeasure, sum_e / nmeasure);
   }
+
   printf("checksum = %lf\n", naivesum);
-  free(randvals);
-  free(lattice_b);
-  free(lattice_w);
   return 0;
 }
@@ -4,11 +4,12 @@
 // SPDX-License-Identifier: MIT
 // =============================================================
 
-// ISO2DFD: HIP Port of the 2D-Finite-Difference-Wave Propagation, 
+// ISO2DFD: HIP Port of the 2D-Finite-Difference-Wave Propagation,
 //
 // ISO2DFD is a finite difference stencil kernel for solving the 2D acoustic
-// isotropic wave equation. Kernels in this sample are implemented as 2nd order
-// in space, 2nd order in time scheme without boundary conditions. Using HIP,
+// isotropic wave equation. Kernels in this sample are implemented as 2nd,
+// 4th, 8th or 16th order in space, 2nd order in time scheme, optionally with
+// an absorbing sponge layer at the boundaries. Using HIP,
 // the sample will explicitly run on the GPU as well as CPU to
 // calculate a result.  If successful, the output will include GPU device name.
 //
@@ -18,6 +19,8 @@
 
 #include <fstream>
 #include <iostream>
+#include <utility>
+#include <omp.h>
 #include "iso2dfd.h"
 
 #define MIN(a, b) (a) < (b) ? (a) : (b)
@@ -29,18 +32,28 @@
 void usage(std::string programName) {
   std::cout << " Incorrect parameters " << std::endl;
   std::cout << " Usage: ";
-  std::cout << programName << " n1 n2 Iterations " << std::endl
-            << std::endl;
+  std::cout << programName
+            << " n1 n2 Iterations [Order] [Sponge] [TileSteps] [Shots]"
+            << std::endl << std::endl;
   std::cout << " n1 n2      : Grid sizes for the stencil " << std::endl;
   std::cout << " Iterations : No. of timesteps. " << std::endl;
+  std::cout << " Order      : Order in space, 2 (default), 4, 8 or 16 "
+            << std::endl;
+  std::cout << " Sponge     : Width of the absorbing layer in grid points, "
+               "0 (default) for none " << std::endl;
+  std::cout << " TileSteps  : Timesteps advanced per cache-resident tile, "
+               "0 (default) for one sweep per timestep " << std::endl;
+  std::cout << " Shots      : No. of sources over the same velocity model, "
+               "1 (default) " << std::endl;
 }
 
 /*
  * Host-Code
  * Function used for initialization
+ * Shot s has its source at row nRows / 2 and column (s + 1) nCols / (nShots + 1)
  */
 void initialize(float* ptr_prev, float* ptr_next, float* ptr_vel, size_t nRows,
-                size_t nCols) {
+                size_t nCols, int nShots) {
   std::cout << "Initializing ... " << std::endl;
 
   // Define source wavelet
@@ -53,23 +66,47 @@ void initialize(float* ptr_prev, float* ptr_next, float* ptr_vel, size_t nRows,
     size_t offset = i * nCols;
 
     for (int k = 0; k < nCols; k++) {
-      ptr_prev[offset + k] = 0.0f;
-      ptr_next[offset + k] = 0.0f;
       // pre-compute squared value of sample wave velocity v*v (v = 1500 m/s)
       ptr_vel[offset + k] = 2250000.0f;
     }
   }
+  for (size_t i = 0; i < nShots * nRows * nCols; i++) {
+    ptr_prev[i] = 0.0f;
+    ptr_next[i] = 0.0f;
+  }
   // Add a source to initial wavefield as an initial condition
-  for (int s = 11; s >= 0; s--) {
-    for (int i = nRows / 2 - s; i < nRows / 2 + s; i++) {
-      size_t offset = i * nCols;
-      for (int k = nCols / 2 - s; k < nCols / 2 + s; k++) {
-        ptr_prev[offset + k] = wavelet[s];
+  for (int shot = 0; shot < nShots; shot++) {
+    float* prev = ptr_prev + shot * nRows * nCols;
+    int col = (shot + 1) * nCols / (nShots + 1);
+    for (int s = 11; s >= 0; s--) {
+      for (int i = nRows / 2 - s; i < nRows / 2 + s; i++) {
+        size_t offset = i * nCols;
+        for (int k = col - s; k < col + s; k++) {
+          prev[offset + k] = wavelet[s];
+        }
       }
     }
   }
 }
 
+/*
+ * Host-Code
+ * Coefficients of the central difference of order 2R for the second
+ * derivative, c_k = 2 (-1)^(k+1) (R!)^2 / (k^2 (R-k)! (R+k)!) and
+ * c_0 = -2 (c_1 + ... + c_R)
+ */
+void fd_coefficients(int R, float* coef) {
+  double sum = 0;
+  for (int k = 1; k <= R; k++) {
+    double c = 2.0 / ((double)k * k);
+    for (int i = 1; i <= k; i++) c *= (double)(R - k + i) / (R + i);
+    if (k % 2 == 0) c = -c;
+    coef[k] = c;
+    sum += c;
+  }
+  coef[0] = -2 * sum;
+}
+
 /*
  * Host-Code
  * Utility function to calculate L2-norm between resulting buffer and reference
@@ -109,29 +146,58 @@ bool within_epsilon(float* output, float* reference, const size_t dimx,
   return error;
 }
 
+#pragma omp declare target
+/*
+ * Laplacian of radius R times dxy^2 at gid of a grid with row length nCols
+ */
+template <int R>
+inline float laplacian(const float* prev, const float* coef, const int gid,
+                       const int nCols) {
+  float value = 2.0f * coef[0] * prev[gid];
+#pragma unroll
+  for (int k = 1; k <= R; k++)
+    value += coef[k] * (prev[gid + k] + prev[gid - k] +
+                        prev[gid + k * nCols] + prev[gid - k * nCols]);
+  return value;
+}
+
+/*
+ * Damping per time step in the sponge layer of width W inside the halo of
+ * radius R; zero in the interior. invW is 1 / W, or 0 without a sponge.
+ */
+inline float sponge_eta(const int row, const int col, const int nRows,
+                        const int nCols, const int R, const int W,
+                        const float invW) {
+  int d = row - R;
+  d = d < nRows - 1 - R - row ? d : nRows - 1 - R - row;
+  d = d < col - R ? d : col - R;
+  d = d < nCols - 1 - R - col ? d : nCols - 1 - R - col;
+  const float x = fmaxf((W - d) * invW, 0.0f);
+  return SPONGE_DAMPING * x * x;
+}
+#pragma omp end declare target
+
 /*
  * Host-Code
  * CPU implementation for wavefield modeling
  * Updates wavefield for the number of iterations given in nIteratons parameter
  */
+template <int R>
 void iso_2dfd_iteration_cpu(float* next, float* prev, float* vel,
-                            const float dtDIVdxy, int nRows, int nCols,
-                            int nIterations) {
+                            const float* coef, const float dtDIVdxy, int nRows,
+                            int nCols, int W, int nIterations) {
   float* swap;
-  float value = 0.0;
-  int gid = 0;
+  const float invW = W > 0 ? 1.0f / W : 0.0f;
   for (unsigned int k = 0; k < nIterations; k += 1) {
-    for (unsigned int i = 1; i < nRows - HALF_LENGTH; i += 1) {
-      for (unsigned int j = 1; j < nCols - HALF_LENGTH; j += 1) {
-        value = 0.0;
-
+    for (int i = R; i < nRows - R; i += 1) {
+      for (int j = R; j < nCols - R; j += 1) {
         // Stencil code to update grid
-        gid = j + (i * nCols);
-        value = 0.0;
-        value += prev[gid + 1] - 2.0 * prev[gid] + prev[gid - 1];
-        value += prev[gid + nCols] - 2.0 * prev[gid] + prev[gid - nCols];
+        int gid = j + (i * nCols);
+        float value = laplacian<R>(prev, coef, gid, nCols);
         value *= dtDIVdxy * vel[gid];
-        next[gid] = 2.0f * prev[gid] - next[gid] + value;
+        const float eta = sponge_eta(i, j, nRows, nCols, R, W, invW);
+        next[gid] = (2.0f * prev[gid] - (1.0f - eta) * next[gid] + value) /
+                    (1.0f + eta);
       }
     }
 
@@ -144,122 +210,275 @@ void iso_2dfd_iteration_cpu(float* next, float* prev, float* vel,
 
 /*
  * Device-Code - GPU
- * SYCL implementation for single iteration of iso2dfd kernel
- *
- * Range kernel is used to spawn work-items in x, y dimension
+ * Single iteration of the interior of the grid, inside the halo of radius R
+ * and the sponge layer of width W, for nShots wavefields
  *
+ * The loop bounds exclude the halo and the sponge, so no grid point branches
  */
-void iso_2dfd_kernel(float* next, const float* prev, const float* vel, 
-                     const float dtDIVdxy, const int nRows, const int nCols) {
-  #pragma omp target teams distribute parallel for simd collapse(2) thread_limit(256) 
-  for (int gidRow = 0; gidRow < nRows ; gidRow++)
-    for (int gidCol = 0; gidCol < nCols ; gidCol++) {
-      size_t gid = (gidRow)*nCols + gidCol;
-      // Computation to solve wave equation in 2D
-      // First check if gid is inside the effective grid (not in halo)
-      if ((gidCol >= HALF_LENGTH && gidCol < nCols - HALF_LENGTH) &&
-          (gidRow >= HALF_LENGTH && gidRow < nRows - HALF_LENGTH)) {
-        // Stencil code to update grid point at position given by global id (gid)
-        // New time step for grid point is computed based on the values of the
-        //    the immediate neighbors in both the horizontal and vertical
-        //    directions, as well as the value of grid point at a previous time step
-        float value = 0.0;
-        value += prev[gid + 1] - 2.0 * prev[gid] + prev[gid - 1];
-        value += prev[gid + nCols] - 2.0 * prev[gid] + prev[gid - nCols];
+template <int R>
+void iso_2dfd_interior(float* next, const float* prev, const float* vel,
+                       const float* coef, const float dtDIVdxy,
+                       const int nRows, const int nCols, const int nShots,
+                       const int W) {
+  const int lo = R + W;
+  const int hiRow = nRows - R - W;
+  const int hiCol = nCols - R - W;
+  const size_t nsize = (size_t)nRows * nCols;
+  #pragma omp target teams distribute parallel for simd collapse(3) thread_limit(256)
+  for (int shot = 0; shot < nShots; shot++)
+    for (int gidRow = lo; gidRow < hiRow; gidRow++)
+      for (int gidCol = lo; gidCol < hiCol; gidCol++) {
+        size_t gid = (gidRow)*nCols + gidCol;
+        size_t sid = shot * nsize + gid;
+        float value = laplacian<R>(prev + shot * nsize, coef, gid, nCols);
         value *= dtDIVdxy * vel[gid];
-        next[gid] = 2.0f * prev[gid] - next[gid] + value;
+        next[sid] = 2.0f * prev[sid] - next[sid] + value;
       }
+}
+
+/*
+ * Device-Code - GPU
+ * Single iteration of the sponge layer of width W: the strips at the top and
+ * bottom over all columns, then the strips at the left and right
+ */
+template <int R>
+void iso_2dfd_sponge(float* next, const float* prev, const float* vel,
+                     const float* coef, const float dtDIVdxy,
+                     const int nRows, const int nCols, const int nShots,
+                     const int W) {
+  const float invW = 1.0f / W;
+  const size_t nsize = (size_t)nRows * nCols;
+  #pragma omp target teams distribute parallel for simd collapse(3) thread_limit(256)
+  for (int shot = 0; shot < nShots; shot++)
+    for (int i = 0; i < 2 * W; i++)
+      for (int gidCol = R; gidCol < nCols - R; gidCol++) {
+        const int gidRow = i < W ? R + i : nRows - R - 2 * W + i;
+        size_t gid = (gidRow)*nCols + gidCol;
+        size_t sid = shot * nsize + gid;
+        float value = laplacian<R>(prev + shot * nsize, coef, gid, nCols);
+        value *= dtDIVdxy * vel[gid];
+        const float eta = sponge_eta(gidRow, gidCol, nRows, nCols, R, W, invW);
+        next[sid] = (2.0f * prev[sid] - (1.0f - eta) * next[sid] + value) /
+                    (1.0f + eta);
+      }
+
+  #pragma omp target teams distribute parallel for simd collapse(3) thread_limit(256)
+  for (int shot = 0; shot < nShots; shot++)
+    for (int gidRow = R + W; gidRow < nRows - R - W; gidRow++)
+      for (int i = 0; i < 2 * W; i++) {
+        const int gidCol = i < W ? R + i : nCols - R - 2 * W + i;
+        size_t gid = (gidRow)*nCols + gidCol;
+        size_t sid = shot * nsize + gid;
+        float value = laplacian<R>(prev + shot * nsize, coef, gid, nCols);
+        value *= dtDIVdxy * vel[gid];
+        const float eta = sponge_eta(gidRow, gidCol, nRows, nCols, R, W, invW);
+        next[sid] = (2.0f * prev[sid] - (1.0f - eta) * next[sid] + value) /
+                    (1.0f + eta);
+      }
+}
+
+/*
+ * Device-Code - GPU
+ * Time-tiled iterations: every team loads a TILE x TILE block of one shot
+ * with a halo of steps * R points into team-local memory, advances it
+ * steps time steps there, recomputing the shrinking halo, and writes the
+ * block back. prev/next hold the time levels n and n-1 and are only read;
+ * prev_out/next_out receive the levels n+steps and n+steps-1.
+ */
+template <int R>
+void iso_2dfd_tiled(float* next_out, float* prev_out, const float* next,
+                    const float* prev, const float* vel, const float* coef,
+                    const float dtDIVdxy, const int nRows, const int nCols,
+                    const int nShots, const int W, const int steps) {
+  constexpr int L = TILE + 2 * MAX_TILE_HALO;
+  const int H = steps * R;
+  const int LW = TILE + 2 * H;
+  const int tilesRow = (nRows + TILE - 1) / TILE;
+  const int tilesCol = (nCols + TILE - 1) / TILE;
+  const int nTiles = tilesRow * tilesCol;
+  const float invW = W > 0 ? 1.0f / W : 0.0f;
+  const size_t nsize = (size_t)nRows * nCols;
+
+  #pragma omp target teams num_teams(nTiles * nShots) thread_limit(256)
+  {
+    float s_a[L * L];
+    float s_b[L * L];
+    float s_v[L * L];
+    #pragma omp parallel
+    {
+      const int tid = omp_get_thread_num();
+      const int nthreads = omp_get_num_threads();
+      const int shot = omp_get_team_num() / nTiles;
+      const int tile = omp_get_team_num() % nTiles;
+      const int row0 = (tile / tilesCol) * TILE - H;
+      const int col0 = (tile % tilesCol) * TILE - H;
+      const float* p = prev + shot * nsize;
+      const float* q = next + shot * nsize;
+
+      for (int i = tid; i < LW * LW; i += nthreads) {
+        const int gr = row0 + i / LW, gc = col0 + i % LW;
+        const int li = (i / LW) * L + i % LW;
+        const bool in = gr >= 0 && gr < nRows && gc >= 0 && gc < nCols;
+        const size_t g = in ? (size_t)gr * nCols + gc : 0;
+        s_a[li] = in ? p[g] : 0.0f;
+        s_b[li] = in ? q[g] : 0.0f;
+        s_v[li] = in ? vel[g] : 0.0f;
+      }
+      #pragma omp barrier
+
+      // pa holds level n+t-1, pb level n+t-2 and receives level n+t
+      float* pa = s_a;
+      float* pb = s_b;
+      for (int t = 1; t <= steps; t++) {
+        // the valid region shrinks by R per step; the halo of the grid
+        // is never updated
+        const int r0 = t * R > R - row0 ? t * R : R - row0;
+        const int r1 = LW - t * R < nRows - R - row0 ? LW - t * R : nRows - R - row0;
+        const int c0 = t * R > R - col0 ? t * R : R - col0;
+        const int c1 = LW - t * R < nCols - R - col0 ? LW - t * R : nCols - R - col0;
+        const int w = c1 - c0;
+        const int n = (w > 0 && r1 > r0) ? w * (r1 - r0) : 0;
+        for (int i = tid; i < n; i += nthreads) {
+          const int lr = r0 + i / w, lc = c0 + i % w;
+          const int li = lr * L + lc;
+          float value = laplacian<R>(pa, coef, li, L);
+          value *= dtDIVdxy * s_v[li];
+          const float eta = sponge_eta(row0 + lr, col0 + lc, nRows, nCols, R, W, invW);
+          pb[li] = (2.0f * pa[li] - (1.0f - eta) * pb[li] + value) / (1.0f + eta);
+        }
+        #pragma omp barrier
+        float* swap = pa;
+        pa = pb;
+        pb = swap;
+      }
+
+      for (int i = tid; i < TILE * TILE; i += nthreads) {
+        const int lr = H + i / TILE, lc = H + i % TILE;
+        const int gr = row0 + lr, gc = col0 + lc;
+        if (gr < nRows && gc < nCols) {
+          const size_t g = shot * nsize + (size_t)gr * nCols + gc;
+          prev_out[g] = pa[lr * L + lc];
+          next_out[g] = pb[lr * L + lc];
+        }
+      }
+    }
   }
 }
 
-int main(int argc, char* argv[]) {
+template <int R>
+int run(size_t nRows, size_t nCols, unsigned int nIterations, int W,
+        int tileSteps, int nShots) {
   // Arrays used to update the wavefield
   float* prev_base;
   float* next_base;
   float* next_cpu;
   // Array to store wave velocity
   float* vel_base;
+  // Stencil coefficients
+  float coef[R + 1];
 
   bool error = false;
 
-  size_t nRows, nCols;
-  unsigned int nIterations;
-
-  // Read parameters
-  try {
-    nRows = std::stoi(argv[1]);
-    nCols = std::stoi(argv[2]);
-    nIterations = std::stoi(argv[3]);
-  }
-
-  catch (...) {
-    usage(argv[0]);
-    return 1;
-  }
-
   // Compute the total size of grid
   size_t nsize = nRows * nCols;
+  size_t total = nsize * nShots;
 
   // Allocate arrays to hold wavefield and velocity
-  prev_base = new float[nsize];
-  next_base = new float[nsize];
-  next_cpu = new float[nsize];
+  prev_base = new float[total];
+  next_base = new float[total];
+  next_cpu = new float[total];
   vel_base = new float[nsize];
 
   // Compute constant value (delta t)^2 (delta x)^2. To be used in wavefield
   // update
   float dtDIVdxy = (DT * DT) / (DXY * DXY);
+  fd_coefficients(R, coef);
 
   // Initialize arrays and introduce initial conditions (source)
-  initialize(prev_base, next_base, vel_base, nRows, nCols);
+  initialize(prev_base, next_base, vel_base, nRows, nCols, nShots);
 
   std::cout << "Grid Sizes: " << nRows << " " << nCols << std::endl;
   std::cout << "Iterations: " << nIterations << std::endl;
+  std::cout << "Order: " << 2 * R << std::endl;
+  std::cout << "Sponge: " << W << std::endl;
+  if (tileSteps > 0)
+    std::cout << "Timesteps per tile: " << tileSteps << std::endl;
+  std::cout << "Shots: " << nShots << std::endl;
   std::cout << std::endl;
 
+  // The time-tiled kernel reads one pair of wavefields and writes the other
+  float* prev_tile = tileSteps > 0 ? new float[total] : prev_base;
+  float* next_tile = tileSteps > 0 ? new float[total] : next_base;
+  const size_t tileSize = tileSteps > 0 ? total : 0;
 
   // Start timer
   auto start = std::chrono::steady_clock::now();
 
   std::cout << "Computing wavefield in device .." << std::endl;
 
-#pragma omp target data map(next_base[0:nsize], prev_base[0:nsize]) \
-                        map(to: vel_base[0:nsize])
-  // Iterate over time steps
-  for (unsigned int k = 0; k < nIterations; k += 1) {
-    // alternating the 'next' and 'prev' parameters which effectively
-    //    swaps their content at every iteration.
-    if (k % 2 == 0)
-      iso_2dfd_kernel(next_base, prev_base, vel_base, dtDIVdxy, nRows, nCols);
-    else
-      iso_2dfd_kernel(prev_base, next_base, vel_base, dtDIVdxy, nRows, nCols);
-  }  // end for
-
+  float* prev = prev_base;
+  float* next = next_base;
+#pragma omp target data map(next_base[0:total], prev_base[0:total]) \
+                        map(alloc: prev_tile[0:tileSize], next_tile[0:tileSize]) \
+                        map(to: vel_base[0:nsize], coef[0:R+1])
+  {
+    if (tileSteps > 0) {
+      float* prev_out = prev_tile;
+      float* next_out = next_tile;
+      for (unsigned int k = 0; k < nIterations; k += tileSteps) {
+        const int steps = MIN(tileSteps, (int)(nIterations - k));
+        iso_2dfd_tiled<R>(next_out, prev_out, next, prev, vel_base, coef,
+                          dtDIVdxy, nRows, nCols, nShots, W, steps);
+        std::swap(prev, prev_out);
+        std::swap(next, next_out);
+      }
+    } else {
+      // Iterate over time steps
+      for (unsigned int k = 0; k < nIterations; k += 1) {
+        iso_2dfd_interior<R>(next, prev, vel_base, coef, dtDIVdxy, nRows,
+                             nCols, nShots, W);
+        if (W > 0)
+          iso_2dfd_sponge<R>(next, prev, vel_base, coef, dtDIVdxy, nRows,
+                             nCols, nShots, W);
+        // the new time level becomes 'prev' of the next iteration
+        std::swap(prev, next);
+      }  // end for
+    }
+    #pragma omp target update from(prev[0:total])
+  }
 
   // Compute and display time used by device
   auto end = std::chrono::steady_clock::now();
   auto time = std::chrono::duration_cast<std::chrono::milliseconds>(end - start)
                   .count();
   std::cout << "Elapsed time: " << time << " ms" << std::endl;
+  std::cout << "Throughput: "
+            << (double)(nRows - 2 * R) * (nCols - 2 * R) * nIterations *
+                   nShots / ((time > 0 ? time : 1) * 1e3)
+            << " Mpoints/s" << std::endl;
   std::cout << std::endl;
 
-  // Output final wavefield (computed by device) to binary file
+  // Output final wavefields (computed by device) to binary file
   std::ofstream outFile;
   outFile.open("wavefield_snapshot.bin", std::ios::out | std::ios::binary);
-  outFile.write(reinterpret_cast<char*>(next_base), nsize * sizeof(float));
+  outFile.write(reinterpret_cast<char*>(prev), total * sizeof(float));
   outFile.close();
 
-  // Compute wavefield on CPU (for validation)
-  
+  // Compute wavefield on CPU (for validation) for the first and last shot
   std::cout << "Computing wavefield in CPU .." << std::endl;
+  float* prev_cpu = new float[total];
   // Re-initialize arrays
-  initialize(prev_base, next_cpu, vel_base, nRows, nCols);
+  initialize(prev_cpu, next_cpu, vel_base, nRows, nCols, nShots);
 
   // Compute wavefield on CPU
   // Start timer for CPU
   start = std::chrono::steady_clock::now();
-  iso_2dfd_iteration_cpu(next_cpu, prev_base, vel_base, dtDIVdxy, nRows, nCols,
-                         nIterations);
+  for (int shot = 0; shot < nShots; shot += (nShots > 1 ? nShots - 1 : 1)) {
+    iso_2dfd_iteration_cpu<R>(next_cpu + shot * nsize, prev_cpu + shot * nsize,
+                              vel_base, coef, dtDIVdxy, nRows, nCols, W,
+                              nIterations);
+  }
+  float* latest_cpu = nIterations % 2 ? next_cpu : prev_cpu;
 
   // Compute and display time used by CPU
   end = std::chrono::steady_clock::now();
@@ -270,7 +489,10 @@ int main(int argc, char* argv[]) {
 
   // Compute error (difference between final wavefields computed in device and
   // CPU)
-  error = within_epsilon(next_base, next_cpu, nRows, nCols, HALF_LENGTH, 0.1f);
+  for (int shot = 0; shot < nShots; shot += (nShots > 1 ? nShots - 1 : 1)) {
+    error |= within_epsilon(prev + shot * nsize, latest_cpu + shot * nsize,
+                            nRows, nCols, R, 0.1f);
+  }
 
   // If error greater than threshold (last parameter in error function call),
   // report
@@ -283,7 +505,7 @@ int main(int argc, char* argv[]) {
 
   // Output final wavefield (computed by CPU) to binary file
   outFile.open("wavefield_snapshot_cpu.bin", std::ios::out | std::ios::binary);
-  outFile.write(reinterpret_cast<char*>(next_cpu), nsize * sizeof(float));
+  outFile.write(reinterpret_cast<char*>(latest_cpu), total * sizeof(float));
   outFile.close();
 
   std::cout << "Final wavefields (from device and CPU) written to disk"
@@ -293,7 +515,55 @@ int main(int argc, char* argv[]) {
   // Cleanup
   delete[] prev_base;
   delete[] next_base;
+  delete[] prev_cpu;
+  delete[] next_cpu;
   delete[] vel_base;
+  if (tileSteps > 0) {
+    delete[] prev_tile;
+    delete[] next_tile;
+  }
 
   return error ? 1 : 0;
 }
+
+int main(int argc, char* argv[]) {
+  size_t nRows, nCols;
+  unsigned int nIterations;
+  int order = 2 * HALF_LENGTH, W = 0, tileSteps = 0, nShots = 1;
+
+  // Read parameters
+  try {
+    nRows = std::stoi(argv[1]);
+    nCols = std::stoi(argv[2]);
+    nIterations = std::stoi(argv[3]);
+    if (argc > 4) order = std::stoi(argv[4]);
+    if (argc > 5) W = std::stoi(argv[5]);
+    if (argc > 6) tileSteps = std::stoi(argv[6]);
+    if (argc > 7) nShots = std::stoi(argv[7]);
+  }
+
+  catch (...) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  const int R = order / 2;
+  if ((order != 2 && order != 4 && order != 8 && order != 16) || W < 0 ||
+      tileSteps < 0 || nShots < 1 || 2 * (R + W) >= (int)(MIN(nRows, nCols)) ||
+      (nShots + 1) * 12 > (int)nCols || nRows < 24) {
+    usage(argv[0]);
+    return 1;
+  }
+  // the halo of a tile is limited by the team-local memory
+  if (tileSteps * R > MAX_TILE_HALO) {
+    tileSteps = MAX_TILE_HALO / R;
+    std::cout << "Timesteps per tile limited to " << tileSteps << std::endl;
+  }
+
+  switch (R) {
+    case 1: return run<1>(nRows, nCols, nIterations, W, tileSteps, nShots);
+    case 2: return run<2>(nRows, nCols, nIterations, W, tileSteps, nShots);
+    case 4: return run<4>(nRows, nCols, nIterations, W, tileSteps, nShots);
+    default: return run<MAX_HALF_LENGTH>(nRows, nCols, nIterations, W, tileSteps, nShots);
+  }
+}
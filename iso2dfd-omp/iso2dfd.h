@@ -12,12 +12,27 @@
 
 /*
  * Parameters to define coefficients
- * HALF_LENGTH: Radius of the stencil
- * Sample source code is tested for HALF_LENGTH=1 resulting in
+ * HALF_LENGTH: Default radius of the stencil, 1 results in the
  * 2nd order Stencil finite difference kernel
+ * MAX_HALF_LENGTH: Radius of the highest (16th) order stencil
  */
 #define DT 0.002f
 #define DXY 20.0f
 #define HALF_LENGTH 1
+#define MAX_HALF_LENGTH 8
+
+/*
+ * Absorbing boundary
+ * SPONGE_DAMPING: damping per time step at the outer edge of the sponge
+ */
+#define SPONGE_DAMPING 0.1f
+
+/*
+ * Time tiling
+ * TILE: rows and columns of grid points written by one team
+ * MAX_TILE_HALO: widest halo of a tile, time steps per tile x radius
+ */
+#define TILE 32
+#define MAX_TILE_HALO 16
 
 void usage(std::string);
@@ -1,6 +1,7 @@
 #include <stdio.h>      /* defines printf for tests */
 #include <stdlib.h>     /* defines atol and posix_memalign */
 #include <string.h>     /* defines memcpy */
+#include <stdint.h>     /* defines uint8_t and uint64_t */
 
 #define rot(x,k) (((x)<<(k)) | ((x)>>(32-(k))))
 
@@ -124,8 +125,51 @@ unsigned int mixRemainder(unsigned int a,
   final(a,b,c);
   return c;
 }
+
+/*
+   hashlittle2 over a byte buffer of any alignment: c is the same value
+   hashlittle() returns for the key on a little-endian machine, b is a
+   second, nearly independent 32-bit hash. The hash table uses c as the
+   tag and b for the slot.
+ */
+struct jenkins_hasher {
+  static uint64_t hash(const uint8_t *k, uint32_t length)
+  {
+    unsigned int a,b,c;
+    a = b = c = 0xdeadbeef + length;
+
+    while (length > 12) {
+      a += k[0] + ((unsigned int)k[1]<<8) + ((unsigned int)k[2]<<16) + ((unsigned int)k[3]<<24);
+      b += k[4] + ((unsigned int)k[5]<<8) + ((unsigned int)k[6]<<16) + ((unsigned int)k[7]<<24);
+      c += k[8] + ((unsigned int)k[9]<<8) + ((unsigned int)k[10]<<16) + ((unsigned int)k[11]<<24);
+      mix(a,b,c);
+      length -= 12;
+      k += 12;
+    }
+
+    switch(length) {
+      case 12: c+=((unsigned int)k[11])<<24;
+      case 11: c+=((unsigned int)k[10])<<16;
+      case 10: c+=((unsigned int)k[9])<<8;
+      case 9 : c+=k[8];
+      case 8 : b+=((unsigned int)k[7])<<24;
+      case 7 : b+=((unsigned int)k[6])<<16;
+      case 6 : b+=((unsigned int)k[5])<<8;
+      case 5 : b+=k[4];
+      case 4 : a+=((unsigned int)k[3])<<24;
+      case 3 : a+=((unsigned int)k[2])<<16;
+      case 2 : a+=((unsigned int)k[1])<<8;
+      case 1 : a+=k[0];
+               final(a,b,c);
+      case 0 : break;
+    }
+    return ((uint64_t)c << 32) | b;
+  }
+};
 #pragma omp end declare target
 
+#include "hashtable.h"
+
 unsigned int hashlittle( const void *key, size_t length, unsigned int initval)
 {
   unsigned int a,b,c;                                          /* internal state */
@@ -188,6 +232,7 @@ int main(int argc, char** argv) {
 
   int block_size = atoi(argv[1]);  // work group size
   unsigned long N = atol(argv[2]); // total number of strings
+  int log2_capacity = (argc > 3) ? atoi(argv[3]) : 22; // log2 of the hash table slots
 
   unsigned int *keys = NULL;
   unsigned int *lens = NULL;
@@ -270,6 +315,8 @@ int main(int argc, char** argv) {
   else
     printf("PASS\n");
 
+  table_benchmark<jenkins_hasher>(log2_capacity);
+
   free(keys);
   free(lens);
   free(initvals);
@@ -26,4 +26,10 @@ It is given as is, without any guarantee.
 //StreamCipher
 #define SC_NB_OUTPUT_BLOCK 64 // number of output blocks in stream cipher mode
 
+//File tree hash
+#define FILE_LEAF_BLOCKS NB_INPUT_BLOCK  // input blocks of a full leaf
+#define FILE_LEAF_SIZE_B (FILE_LEAF_BLOCKS * INPUT_BLOCK_SIZE_B)
+#define FILE_BATCH_LEAVES (NB_THREADS * NB_THREADS_BLOCKS) // leaves hashed per batch
+#define FILE_NODE_FANIN 8  // chaining values absorbed by an inner node
+
 #endif // KECCAKTREE_H_INCLUDED
@@ -0,0 +1,314 @@
+/*
+GPU Implementation of Keccak by Guillaume Sevestre, 2010
+
+This code is hereby put in the public domain.
+It is given as is, without any guarantee.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "KeccakF.h"
+#include "KeccakTreeGPU.h"
+#include "KeccakTreeFile.h"
+
+//round constants of the device Keccak-f, in KeccakTreeGPU.cpp
+extern tKeccakLane KeccakF_RoundConstants_h[22];
+
+#define BLOCK_WORDS (INPUT_BLOCK_SIZE_B/4)
+#define LEAF_WORDS (FILE_LEAF_SIZE_B/4)
+#define BATCH_WORDS ((size_t)FILE_BATCH_LEAVES * LEAF_WORDS)
+
+
+//absorb len bytes of data followed by pad10*1 padding whose first byte is
+//pad; the bytes of the last word past len are ignored
+#pragma omp declare target
+static void absorb_padded(tKeccakLane * Kstate, const tKeccakLane * data, unsigned int len,
+                          unsigned int pad, const tKeccakLane * rc)
+{
+   unsigned int nfull = len / INPUT_BLOCK_SIZE_B;
+   unsigned int tail = len % INPUT_BLOCK_SIZE_B;
+   unsigned int k, ind_word;
+
+   for (k=0; k<nfull; k++)
+   {
+      for (ind_word=0; ind_word<BLOCK_WORDS; ind_word++)
+         Kstate[ind_word] ^= data[k * BLOCK_WORDS + ind_word];
+      KeccakFunr(Kstate, rc);
+   }
+
+   const tKeccakLane * last = data + nfull * BLOCK_WORDS;
+   for (ind_word=0; ind_word<BLOCK_WORDS; ind_word++)
+   {
+      unsigned int lo = ind_word * 4;
+      tKeccakLane word = 0;
+      if (lo + 4 <= tail)
+         word = last[ind_word];
+      else if (lo < tail)
+         word = last[ind_word] & ((1u << (8 * (tail - lo))) - 1);
+      if (tail >= lo && tail < lo + 4)
+         word ^= pad << (8 * (tail - lo));
+      if (ind_word == BLOCK_WORDS - 1)
+         word ^= 0x80000000u;
+      Kstate[ind_word] ^= word;
+   }
+   KeccakFunr(Kstate, rc);
+}
+#pragma omp end declare target
+
+
+//copy or read bytes of the file at offset into dst; returns 0 on success
+static int read_batch(int fd, const char * map, unsigned long long offset, char * dst, size_t bytes)
+{
+   if (map != NULL)
+   {
+      memcpy(dst, map + offset, bytes);
+      return 0;
+   }
+   while (bytes > 0)
+   {
+      ssize_t n = pread(fd, dst, bytes, offset);
+      if (n <= 0) return -1;
+      dst += n;
+      offset += n;
+      bytes -= n;
+   }
+   return 0;
+}
+
+
+int KeccakTreeFileGPU(const char *path, int use_mmap, tKeccakLane *digest,
+                      unsigned long long *file_size)
+{
+   int fd = open(path, O_RDONLY);
+   if (fd < 0) return -1;
+   struct stat st;
+   if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+   {
+      close(fd);
+      return -1;
+   }
+   const unsigned long long size = st.st_size;
+   *file_size = size;
+
+   const char * map = NULL;
+   if (use_mmap && size > 0)
+   {
+      void * p = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (p != MAP_FAILED)
+      {
+         map = (const char *)p;
+         madvise(p, size, MADV_SEQUENTIAL);
+      }
+   }
+
+   //an empty file is one empty leaf
+   const unsigned long long leaves = size ? (size + FILE_LEAF_SIZE_B - 1) / FILE_LEAF_SIZE_B : 1;
+   const unsigned long long batches = (leaves + FILE_BATCH_LEAVES - 1) / FILE_BATCH_LEAVES;
+   const unsigned long long parents = (leaves + FILE_NODE_FANIN - 1) / FILE_NODE_FANIN;
+
+   //reading into one staging buffer overlaps hashing the other
+   tKeccakLane * in0 = (tKeccakLane *) malloc(BATCH_WORDS * sizeof(tKeccakLane));
+   tKeccakLane * in1 = (tKeccakLane *) malloc(BATCH_WORDS * sizeof(tKeccakLane));
+   tKeccakLane * cv = (tKeccakLane *) malloc(leaves * FILE_DIGEST_WORDS * sizeof(tKeccakLane));
+   tKeccakLane * cv2 = (tKeccakLane *) malloc(parents * FILE_DIGEST_WORDS * sizeof(tKeccakLane));
+   const tKeccakLane * rc = KeccakF_RoundConstants_h;
+   tKeccakLane root_cv[FILE_DIGEST_WORDS];
+   int err = 0;
+
+   #pragma omp target data map(to: rc[0:22]) \
+                           map(alloc: in0[0:BATCH_WORDS], in1[0:BATCH_WORDS], \
+                                      cv[0:leaves * FILE_DIGEST_WORDS], \
+                                      cv2[0:parents * FILE_DIGEST_WORDS])
+   {
+      unsigned long long batch_bytes = size < (unsigned long long)FILE_BATCH_LEAVES * FILE_LEAF_SIZE_B ?
+                                       size : (unsigned long long)FILE_BATCH_LEAVES * FILE_LEAF_SIZE_B;
+      err = read_batch(fd, map, 0, (char *)in0, batch_bytes);
+
+      for (unsigned long long b = 0; b < batches && !err; b++)
+      {
+         tKeccakLane * in = (b % 2) ? in1 : in0;
+         const unsigned long long first = b * FILE_BATCH_LEAVES;
+         const unsigned long long offset = first * FILE_LEAF_SIZE_B;
+         const int n = (int)((leaves - first < FILE_BATCH_LEAVES) ? leaves - first : FILE_BATCH_LEAVES);
+         const size_t words = (batch_bytes + 3) / 4;
+
+         #pragma omp target update to (in[0:words]) nowait depend(out: in[0])
+
+         #pragma omp target teams distribute parallel for thread_limit(NB_THREADS) \
+                 nowait depend(in: in[0])
+         for (int l = 0; l < n; l++)
+         {
+            unsigned long long start = offset + (unsigned long long)l * FILE_LEAF_SIZE_B;
+            unsigned int len = (size - start < FILE_LEAF_SIZE_B) ? (unsigned int)(size - start) : FILE_LEAF_SIZE_B;
+            tKeccakLane Kstate[25];
+            for (int ind_word=0; ind_word<25; ind_word++) Kstate[ind_word] = 0;
+
+            absorb_padded(Kstate, in + (size_t)l * LEAF_WORDS, len, FILE_PAD_LEAF, rc);
+
+            for (int ind_word=0; ind_word<FILE_DIGEST_WORDS; ind_word++)
+               cv[(first + l) * FILE_DIGEST_WORDS + ind_word] = Kstate[ind_word];
+         }
+
+         //read the next batch while this one is hashed
+         if (b + 1 < batches)
+         {
+            const unsigned long long next = offset + (unsigned long long)n * FILE_LEAF_SIZE_B;
+            batch_bytes = size - next < (unsigned long long)FILE_BATCH_LEAVES * FILE_LEAF_SIZE_B ?
+                          size - next : (unsigned long long)FILE_BATCH_LEAVES * FILE_LEAF_SIZE_B;
+            err = read_batch(fd, map, next, (char *)((b % 2) ? in0 : in1), batch_bytes);
+         }
+
+         #pragma omp taskwait
+      }
+
+      //reduce the chaining values level by level
+      tKeccakLane * src = cv;
+      tKeccakLane * dst = cv2;
+      unsigned long long m = leaves;
+      while (m > 1 && !err)
+      {
+         const unsigned long long p = (m + FILE_NODE_FANIN - 1) / FILE_NODE_FANIN;
+         #pragma omp target teams distribute parallel for thread_limit(NB_THREADS)
+         for (unsigned long long j = 0; j < p; j++)
+         {
+            unsigned int children = (m - j * FILE_NODE_FANIN < FILE_NODE_FANIN) ?
+                                    (unsigned int)(m - j * FILE_NODE_FANIN) : FILE_NODE_FANIN;
+            tKeccakLane Kstate[25];
+            for (int ind_word=0; ind_word<25; ind_word++) Kstate[ind_word] = 0;
+
+            absorb_padded(Kstate, src + j * FILE_NODE_FANIN * FILE_DIGEST_WORDS,
+                          children * OUTPUT_BLOCK_SIZE_B, FILE_PAD_NODE, rc);
+
+            for (int ind_word=0; ind_word<FILE_DIGEST_WORDS; ind_word++)
+               dst[j * FILE_DIGEST_WORDS + ind_word] = Kstate[ind_word];
+         }
+         tKeccakLane * t = src; src = dst; dst = t;
+         m = p;
+      }
+
+      #pragma omp target update from (src[0:FILE_DIGEST_WORDS])
+      memcpy(root_cv, src, sizeof(root_cv));
+   }
+
+   if (!err)
+   {
+      //root: last chaining value and the file length
+      tKeccakLane msg[FILE_DIGEST_WORDS + 2];
+      memcpy(msg, root_cv, sizeof(root_cv));
+      msg[FILE_DIGEST_WORDS] = (tKeccakLane)size;
+      msg[FILE_DIGEST_WORDS + 1] = (tKeccakLane)(size >> 32);
+      tKeccakLane Kstate[25];
+      memset(Kstate, 0, sizeof(Kstate));
+      absorb_padded(Kstate, msg, OUTPUT_BLOCK_SIZE_B + 8, FILE_PAD_ROOT, rc);
+      memcpy(digest, Kstate, FILE_DIGEST_WORDS * sizeof(tKeccakLane));
+   }
+
+   if (map != NULL) munmap((void *)map, size);
+   close(fd);
+   free(in0);
+   free(in1);
+   free(cv);
+   free(cv2);
+   return err ? -1 : 0;
+}
+
+
+//************************
+//CPU reference, byte oriented
+//************************
+
+static void absorb_bytes_cpu(tKeccakLane * Kstate, const unsigned char * msg, size_t len, unsigned char pad)
+{
+   unsigned char block[INPUT_BLOCK_SIZE_B];
+   size_t pos = 0;
+   for (;;)
+   {
+      size_t n = (len - pos < INPUT_BLOCK_SIZE_B) ? len - pos : INPUT_BLOCK_SIZE_B;
+      memset(block, 0, INPUT_BLOCK_SIZE_B);
+      memcpy(block, msg + pos, n);
+      if (n < INPUT_BLOCK_SIZE_B)
+      {
+         block[n] ^= pad;
+         block[INPUT_BLOCK_SIZE_B - 1] ^= 0x80;
+      }
+      for (int w = 0; w < BLOCK_WORDS; w++)
+         Kstate[w] ^= (tKeccakLane)block[4*w] | ((tKeccakLane)block[4*w+1] << 8) |
+                      ((tKeccakLane)block[4*w+2] << 16) | ((tKeccakLane)block[4*w+3] << 24);
+      KeccakF_CPU(Kstate);
+      pos += n;
+      if (n < INPUT_BLOCK_SIZE_B) break;
+   }
+}
+
+static void squeeze_cpu(const tKeccakLane * Kstate, unsigned char * out)
+{
+   for (int w = 0; w < FILE_DIGEST_WORDS; w++)
+      for (int b = 0; b < 4; b++)
+         out[4*w + b] = (unsigned char)(Kstate[w] >> (8 * b));
+}
+
+int KeccakTreeFileCPU(const char *path, tKeccakLane *digest)
+{
+   FILE * fp = fopen(path, "rb");
+   if (fp == NULL) return -1;
+
+   unsigned char * leaf = (unsigned char *) malloc(FILE_LEAF_SIZE_B);
+   size_t cap = 1024, m = 0;
+   unsigned char * cvs = (unsigned char *) malloc(cap * OUTPUT_BLOCK_SIZE_B);
+   unsigned long long size = 0;
+   tKeccakLane Kstate[25];
+
+   //leaves
+   for (;;)
+   {
+      size_t n = fread(leaf, 1, FILE_LEAF_SIZE_B, fp);
+      if (n == 0 && m > 0) break;
+      if (m == cap)
+      {
+         cap *= 2;
+         cvs = (unsigned char *) realloc(cvs, cap * OUTPUT_BLOCK_SIZE_B);
+      }
+      memset(Kstate, 0, sizeof(Kstate));
+      absorb_bytes_cpu(Kstate, leaf, n, FILE_PAD_LEAF);
+      squeeze_cpu(Kstate, cvs + m * OUTPUT_BLOCK_SIZE_B);
+      m++;
+      size += n;
+      if (n < FILE_LEAF_SIZE_B) break;
+   }
+   int err = ferror(fp);
+   fclose(fp);
+
+   //inner nodes, in place
+   while (m > 1)
+   {
+      size_t p = (m + FILE_NODE_FANIN - 1) / FILE_NODE_FANIN;
+      for (size_t j = 0; j < p; j++)
+      {
+         size_t children = (m - j * FILE_NODE_FANIN < FILE_NODE_FANIN) ? m - j * FILE_NODE_FANIN : FILE_NODE_FANIN;
+         memset(Kstate, 0, sizeof(Kstate));
+         absorb_bytes_cpu(Kstate, cvs + j * FILE_NODE_FANIN * OUTPUT_BLOCK_SIZE_B,
+                          children * OUTPUT_BLOCK_SIZE_B, FILE_PAD_NODE);
+         squeeze_cpu(Kstate, cvs + j * OUTPUT_BLOCK_SIZE_B);
+      }
+      m = p;
+   }
+
+   //root
+   unsigned char msg[OUTPUT_BLOCK_SIZE_B + 8];
+   memcpy(msg, cvs, OUTPUT_BLOCK_SIZE_B);
+   for (int b = 0; b < 8; b++)
+      msg[OUTPUT_BLOCK_SIZE_B + b] = (unsigned char)(size >> (8 * b));
+   memset(Kstate, 0, sizeof(Kstate));
+   absorb_bytes_cpu(Kstate, msg, sizeof(msg), FILE_PAD_ROOT);
+   memcpy(digest, Kstate, FILE_DIGEST_WORDS * sizeof(tKeccakLane));
+
+   free(leaf);
+   free(cvs);
+   return err ? -1 : 0;
+}
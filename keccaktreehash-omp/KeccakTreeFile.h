@@ -0,0 +1,41 @@
+/*
+GPU Implementation of Keccak by Guillaume Sevestre, 2010
+
+This code is hereby put in the public domain.
+It is given as is, without any guarantee.
+*/
+
+#ifndef KECCAKTREEFILE_H_INCLUDED
+#define KECCAKTREEFILE_H_INCLUDED
+
+#include "KeccakTree.h"
+#include "KeccakTypes.h"
+
+//************************
+//File tree hash mode
+//The file is cut into leaves of FILE_LEAF_SIZE_B bytes, the last one may be
+//partial. Each leaf is absorbed INPUT_BLOCK_SIZE_B bytes at a time and padded
+//(pad10*1, first padding byte FILE_PAD_LEAF), and its chaining value is the
+//first OUTPUT_BLOCK_SIZE_B bytes of the state. Inner nodes absorb up to
+//FILE_NODE_FANIN chaining values of the level below and are padded with
+//FILE_PAD_NODE, until one chaining value is left. The root absorbs it
+//followed by the file length in bytes (64 bits, little endian), padded with
+//FILE_PAD_ROOT, and the digest is the first OUTPUT_BLOCK_SIZE_B bytes.
+//************************
+
+#define FILE_PAD_LEAF 0x01
+#define FILE_PAD_NODE 0x02
+#define FILE_PAD_ROOT 0x03
+
+#define FILE_DIGEST_WORDS (OUTPUT_BLOCK_SIZE_B/4)
+
+//GPU file tree hash; the leaves of one batch are hashed while the next batch
+//is read, with mmap if use_mmap is set and with read() otherwise.
+//Returns 0 on success, -1 if the file cannot be read.
+int KeccakTreeFileGPU(const char *path, int use_mmap, tKeccakLane *digest,
+                      unsigned long long *file_size);
+
+//sequential reference of the same tree hash
+int KeccakTreeFileCPU(const char *path, tKeccakLane *digest);
+
+#endif // KECCAKTREEFILE_H_INCLUDED
@@ -20,6 +20,8 @@ It is given as is, without any guarantee.
 //************************
 
 #pragma omp declare target 
+void KeccakFunr( tKeccakLane * state, const tKeccakLane *KeccakF_RoundConstants );
+
 void KeccakTreeGPU(tKeccakLane * h_inBuffer, tKeccakLane * h_outBuffer,  const tKeccakLane *h_KeccakF_RoundConstants);
 #pragma omp end declare target 
 
@@ -11,12 +11,67 @@
 #include <time.h>
 #include "KeccakTreeCPU.h"
 #include "KeccakTreeGPU.h"
+#include "KeccakTreeFile.h"
 #include "Test.h"
 
-int main()
+static void usage(const char *name)
 {
-	Print_Param();
-	TestCPU(1);
-	TestGPU();
-	return 0;
+	printf("Usage: %s                          run the tree hash speed tests\n", name);
+	printf("       %s [-m] [-c] <file> [...]   tree hash of each file\n", name);
+	printf("  -m  read the files with mmap\n");
+	printf("  -c  check each digest against the CPU implementation\n");
+}
+
+int main(int argc, char **argv)
+{
+	if (argc == 1)
+	{
+		Print_Param();
+		TestCPU(1);
+		TestGPU();
+		return 0;
+	}
+
+	int use_mmap = 0, check = 0, status = 0, files = 0;
+	for (int a = 1; a < argc; a++)
+	{
+		if (strcmp(argv[a], "-m") == 0) { use_mmap = 1; continue; }
+		if (strcmp(argv[a], "-c") == 0) { check = 1; continue; }
+		if (argv[a][0] == '-') { usage(argv[0]); return 1; }
+		files++;
+
+		tKeccakLane digest[FILE_DIGEST_WORDS];
+		unsigned long long size;
+		struct timespec t1, t2;
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		if (KeccakTreeFileGPU(argv[a], use_mmap, digest, &size) != 0)
+		{
+			fprintf(stderr, "%s: cannot read %s\n", argv[0], argv[a]);
+			status = 1;
+			continue;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &t2);
+		double seconds = (t2.tv_sec - t1.tv_sec) + (t2.tv_nsec - t1.tv_nsec) * 1e-9;
+
+		for (int w = 0; w < FILE_DIGEST_WORDS; w++)
+			for (int b = 0; b < 4; b++)
+				printf("%02x", (digest[w] >> (8 * b)) & 0xff);
+		printf("  %s\n", argv[a]);
+		printf("%llu bytes in %.3f s: %.3f GB/s\n", size, seconds, size / seconds * 1e-9);
+
+		if (check)
+		{
+			tKeccakLane ref[FILE_DIGEST_WORDS];
+			if (KeccakTreeFileCPU(argv[a], ref) != 0 ||
+			    memcmp(ref, digest, sizeof(ref)) != 0)
+			{
+				printf("FAIL: CPU digest differs\n");
+				status = 1;
+			}
+			else
+				printf("PASS\n");
+		}
+	}
+	if (files == 0) { usage(argv[0]); return 1; }
+	return status;
 }
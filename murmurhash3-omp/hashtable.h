@@ -0,0 +1,334 @@
+#ifndef HASHTABLE_H
+#define HASHTABLE_H
+
+//-----------------------------------------------------------------------------
+// Open-addressing hash table with linear probing over variable-length keys
+//
+// A batch of keys is a byte buffer and an offsets array: key i occupies
+// bytes[offsets[i]] .. bytes[offsets[i+1]-1]. The table keeps a pointer to
+// the buffer of the inserted (build) keys, and a slot holds the upper 32
+// bits of the key hash as a tag together with the index of the key in that
+// buffer, so most mismatches are rejected without touching the key bytes.
+// The values live in a separate array indexed by slot.
+//
+// Insert, lookup and delete are bulk operations, one key per thread; an
+// operation of one kind never runs concurrently with another. Inserts
+// claim empty slots with a compare-and-swap, and a key that is already in
+// the table (or inserted concurrently by another thread) is reported as a
+// duplicate, so a bulk insert also deduplicates its batch. Deletes leave
+// tombstones that lookups skip; inserts do not reuse them, so a table with
+// many deletes should be rebuilt.
+//
+// The hash is a template parameter: a struct with a static member
+//   uint64_t hash(const uint8_t* key, uint32_t len)
+// defined in a declare target region.
+//-----------------------------------------------------------------------------
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+
+#define SLOT_EMPTY      0xFFFFFFFFFFFFFFFFULL
+#define SLOT_TOMBSTONE  0xFFFFFFFFFFFFFFFEULL
+#define KEY_NOT_FOUND   0xFFFFFFFFU
+
+#define TABLE_BLOCK_SIZE 256
+
+// insert status of each key
+enum { TABLE_INSERTED = 0, TABLE_DUPLICATE = 1, TABLE_FULL = 2 };
+
+#pragma omp declare target
+inline bool slot_cas(uint64_t *slot, uint64_t expected, uint64_t desired)
+{
+  return __atomic_compare_exchange_n(slot, &expected, desired, false,
+                                     __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+inline uint64_t slot_load(const uint64_t *slot)
+{
+  return __atomic_load_n(slot, __ATOMIC_RELAXED);
+}
+
+inline bool keys_equal(const uint8_t *a, uint32_t alen, const uint8_t *b, uint32_t blen)
+{
+  if (alen != blen) return false;
+  for (uint32_t i = 0; i < alen; i++)
+    if (a[i] != b[i]) return false;
+  return true;
+}
+
+// Slot of key q of a probe batch, or KEY_NOT_FOUND
+template <class Hasher>
+inline uint32_t table_find(const uint64_t *slots, uint32_t mask,
+                           const uint8_t *build_bytes, const uint32_t *build_offsets,
+                           const uint8_t *key, uint32_t len)
+{
+  uint64_t h = Hasher::hash(key, len);
+  uint32_t tag = (uint32_t)(h >> 32);
+  uint32_t p = (uint32_t)h & mask;
+  for (uint32_t n = 0; n <= mask; n++, p = (p + 1) & mask) {
+    uint64_t cur = slot_load(slots + p);
+    if (cur == SLOT_EMPTY) break;
+    if (cur == SLOT_TOMBSTONE || (uint32_t)(cur >> 32) != tag) continue;
+    uint32_t id = (uint32_t)cur;
+    if (keys_equal(build_bytes + build_offsets[id], build_offsets[id+1] - build_offsets[id],
+                   key, len))
+      return p;
+  }
+  return KEY_NOT_FOUND;
+}
+#pragma omp end declare target
+
+// The arrays passed to the bulk operations must be present on the device.
+
+void table_clear(uint64_t *slots, uint32_t capacity)
+{
+  #pragma omp target teams distribute parallel for thread_limit(TABLE_BLOCK_SIZE)
+  for (uint32_t i = 0; i < capacity; i++)
+    slots[i] = SLOT_EMPTY;
+}
+
+// Insert the n keys of the build batch with their values
+template <class Hasher>
+void table_insert(uint64_t *slots, uint32_t *vals, uint32_t capacity,
+                  const uint8_t *bytes, const uint32_t *offsets,
+                  const uint32_t *in_vals, uint8_t *status, uint32_t n)
+{
+  const uint32_t mask = capacity - 1;
+  #pragma omp target teams distribute parallel for thread_limit(TABLE_BLOCK_SIZE)
+  for (uint32_t i = 0; i < n; i++) {
+    const uint8_t *key = bytes + offsets[i];
+    uint32_t len = offsets[i+1] - offsets[i];
+    uint64_t h = Hasher::hash(key, len);
+    uint32_t tag = (uint32_t)(h >> 32);
+    uint64_t entry = ((uint64_t)tag << 32) | i;
+    uint32_t p = (uint32_t)h & mask;
+    uint8_t s = TABLE_FULL;
+    for (uint32_t k = 0; k <= mask; k++, p = (p + 1) & mask) {
+      uint64_t cur = slot_load(slots + p);
+      if (cur == SLOT_EMPTY) {
+        if (slot_cas(slots + p, SLOT_EMPTY, entry)) {
+          vals[p] = in_vals[i];
+          s = TABLE_INSERTED;
+          break;
+        }
+        // lost the slot to another insert; it may hold the same key
+        cur = slot_load(slots + p);
+      }
+      if (cur == SLOT_TOMBSTONE || (uint32_t)(cur >> 32) != tag) continue;
+      uint32_t id = (uint32_t)cur;
+      if (keys_equal(bytes + offsets[id], offsets[id+1] - offsets[id], key, len)) {
+        s = TABLE_DUPLICATE;
+        break;
+      }
+    }
+    status[i] = s;
+  }
+}
+
+// Look up the n keys of a probe batch; keys that are not in the table
+// get KEY_NOT_FOUND
+template <class Hasher>
+void table_lookup(const uint64_t *slots, const uint32_t *vals, uint32_t capacity,
+                  const uint8_t *build_bytes, const uint32_t *build_offsets,
+                  const uint8_t *bytes, const uint32_t *offsets,
+                  uint32_t *out_vals, uint32_t n)
+{
+  const uint32_t mask = capacity - 1;
+  #pragma omp target teams distribute parallel for thread_limit(TABLE_BLOCK_SIZE)
+  for (uint32_t i = 0; i < n; i++) {
+    uint32_t p = table_find<Hasher>(slots, mask, build_bytes, build_offsets,
+                                    bytes + offsets[i], offsets[i+1] - offsets[i]);
+    out_vals[i] = (p == KEY_NOT_FOUND) ? KEY_NOT_FOUND : vals[p];
+  }
+}
+
+// Delete the n keys of a probe batch; returns the number of keys removed
+template <class Hasher>
+uint32_t table_delete(uint64_t *slots, uint32_t capacity,
+                      const uint8_t *build_bytes, const uint32_t *build_offsets,
+                      const uint8_t *bytes, const uint32_t *offsets, uint32_t n)
+{
+  const uint32_t mask = capacity - 1;
+  uint32_t removed = 0;
+  #pragma omp target teams distribute parallel for thread_limit(TABLE_BLOCK_SIZE) reduction(+:removed)
+  for (uint32_t i = 0; i < n; i++) {
+    uint32_t p = table_find<Hasher>(slots, mask, build_bytes, build_offsets,
+                                    bytes + offsets[i], offsets[i+1] - offsets[i]);
+    if (p != KEY_NOT_FOUND) {
+      uint64_t cur = slot_load(slots + p);
+      // a duplicate key in the batch may have removed it first
+      if (cur != SLOT_TOMBSTONE && slot_cas(slots + p, cur, SLOT_TOMBSTONE))
+        removed++;
+    }
+  }
+  return removed;
+}
+
+
+//-----------------------------------------------------------------------------
+// Benchmark of the bulk operations at several load factors
+//
+// The build batch holds 0.9 * capacity distinct keys of 8 to 40 bytes; the
+// first 4 bytes of a key are its index, so all keys differ. The probe batch
+// holds as many keys again that are not in the table. At each load factor
+// the table is rebuilt from a prefix of the build batch, looked up with the
+// same prefix followed by the same number of absent keys, and half of the
+// prefix is deleted.
+//-----------------------------------------------------------------------------
+
+static void make_keys(uint32_t n, uint32_t first, uint8_t *&bytes, uint32_t *&offsets)
+{
+  offsets = (uint32_t*) malloc (sizeof(uint32_t) * (n + 1));
+  offsets[0] = 0;
+  for (uint32_t i = 0; i < n; i++)
+    offsets[i+1] = offsets[i] + 8 + rand() % 33;
+  bytes = (uint8_t*) malloc (offsets[n]);
+  for (uint32_t i = 0; i < n; i++) {
+    uint32_t id = first + i;
+    uint8_t *k = bytes + offsets[i];
+    for (int b = 0; b < 4; b++) k[b] = (uint8_t)(id >> (8 * b));
+    for (uint32_t b = 4; b < offsets[i+1] - offsets[i]; b++) k[b] = rand() & 0xFF;
+  }
+}
+
+template <class Hasher>
+bool table_benchmark(int log2_capacity)
+{
+  const uint32_t capacity = 1U << log2_capacity;
+  const uint32_t max_keys = (uint32_t)(0.9 * capacity);
+  const double load_factors[] = {0.5, 0.7, 0.8, 0.9};
+
+  uint8_t *build_bytes, *probe_bytes;
+  uint32_t *build_offsets, *probe_offsets;
+  make_keys(max_keys, 0, build_bytes, build_offsets);
+  make_keys(max_keys, max_keys, probe_bytes, probe_offsets);
+  const uint32_t build_len = build_offsets[max_keys];
+  const uint32_t probe_len = probe_offsets[max_keys];
+
+  // lookups use a prefix of the build keys followed by the absent keys
+  uint8_t *query_bytes = (uint8_t*) malloc (build_len + probe_len);
+  uint32_t *query_offsets = (uint32_t*) malloc (sizeof(uint32_t) * (2 * max_keys + 1));
+
+  uint32_t *in_vals = (uint32_t*) malloc (sizeof(uint32_t) * max_keys);
+  for (uint32_t i = 0; i < max_keys; i++) in_vals[i] = i * 7 + 1;
+
+  uint64_t *slots = (uint64_t*) malloc (sizeof(uint64_t) * capacity);
+  uint32_t *vals = (uint32_t*) malloc (sizeof(uint32_t) * capacity);
+  uint8_t *status = (uint8_t*) malloc (2 * max_keys);
+  uint32_t *out_vals = (uint32_t*) malloc (sizeof(uint32_t) * 2 * max_keys);
+
+  printf("\nHash table with %u slots\n", capacity);
+  printf("%12s %14s %14s %14s\n", "load factor", "insert Mops/s", "lookup Mops/s", "delete Mops/s");
+
+  bool ok = true;
+  #pragma omp target data map(to: build_bytes[0:build_len], build_offsets[0:max_keys+1], \
+                                  in_vals[0:max_keys]) \
+                          map(alloc: slots[0:capacity], vals[0:capacity], \
+                                     query_bytes[0:build_len+probe_len], \
+                                     query_offsets[0:2*max_keys+1], \
+                                     status[0:2*max_keys], out_vals[0:2*max_keys])
+  {
+    for (int l = 0; l < 4 && ok; l++) {
+      const uint32_t n = (uint32_t)(load_factors[l] * capacity);
+
+      // the first n build keys followed by the first n absent keys
+      const uint32_t prefix = build_offsets[n];
+      memcpy(query_bytes, build_bytes, prefix);
+      memcpy(query_bytes + prefix, probe_bytes, probe_offsets[n]);
+      for (uint32_t i = 0; i <= n; i++) query_offsets[i] = build_offsets[i];
+      for (uint32_t i = 1; i <= n; i++) query_offsets[n+i] = prefix + probe_offsets[i];
+      #pragma omp target update to (query_bytes[0:prefix+probe_offsets[n]], \
+                                    query_offsets[0:2*n+1])
+
+      table_clear(slots, capacity);
+
+      auto start = std::chrono::steady_clock::now();
+      table_insert<Hasher>(slots, vals, capacity, build_bytes, build_offsets,
+                           in_vals, status, n);
+      auto end = std::chrono::steady_clock::now();
+      double t_insert = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+
+      start = std::chrono::steady_clock::now();
+      table_lookup<Hasher>(slots, vals, capacity, build_bytes, build_offsets,
+                           query_bytes, query_offsets, out_vals, 2 * n);
+      end = std::chrono::steady_clock::now();
+      double t_lookup = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+
+      #pragma omp target update from (status[0:n], out_vals[0:2*n])
+      for (uint32_t i = 0; i < n && ok; i++)
+        ok = status[i] == TABLE_INSERTED && out_vals[i] == in_vals[i] &&
+             out_vals[n+i] == KEY_NOT_FOUND;
+
+      // delete the first half of the inserted keys
+      start = std::chrono::steady_clock::now();
+      uint32_t removed = table_delete<Hasher>(slots, capacity, build_bytes, build_offsets,
+                                              query_bytes, query_offsets, n / 2);
+      end = std::chrono::steady_clock::now();
+      double t_delete = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+
+      table_lookup<Hasher>(slots, vals, capacity, build_bytes, build_offsets,
+                           query_bytes, query_offsets, out_vals, n);
+      #pragma omp target update from (out_vals[0:n])
+      ok = ok && removed == n / 2;
+      for (uint32_t i = 0; i < n && ok; i++)
+        ok = out_vals[i] == (i < n / 2 ? KEY_NOT_FOUND : in_vals[i]);
+
+      printf("%12.2f %14.2f %14.2f %14.2f\n", load_factors[l],
+             n / t_insert * 1e3, 2.0 * n / t_lookup * 1e3, (n / 2) / t_delete * 1e3);
+    }
+  }
+
+  // deduplicate a batch in which every key appears twice
+  if (ok) {
+    const uint32_t n = max_keys / 2;
+    const uint32_t half = build_offsets[n];
+    uint8_t *dup_bytes = (uint8_t*) malloc (2 * half);
+    uint32_t *dup_offsets = (uint32_t*) malloc (sizeof(uint32_t) * (2 * n + 1));
+    uint32_t *dup_vals = (uint32_t*) malloc (sizeof(uint32_t) * 2 * n);
+    memcpy(dup_bytes, build_bytes, half);
+    memcpy(dup_bytes + half, build_bytes, half);
+    for (uint32_t i = 0; i <= n; i++) dup_offsets[i] = build_offsets[i];
+    for (uint32_t i = 1; i <= n; i++) dup_offsets[n+i] = half + build_offsets[i];
+    for (uint32_t i = 0; i < 2 * n; i++) dup_vals[i] = i;
+
+    uint32_t inserted = 0;
+    #pragma omp target data map(to: dup_bytes[0:2*half], dup_offsets[0:2*n+1], \
+                                    dup_vals[0:2*n]) \
+                            map(alloc: slots[0:capacity], vals[0:capacity]) \
+                            map(from: status[0:2*n])
+    {
+      table_clear(slots, capacity);
+      table_insert<Hasher>(slots, vals, capacity, dup_bytes, dup_offsets,
+                           dup_vals, status, 2 * n);
+    }
+    for (uint32_t i = 0; i < 2 * n; i++) inserted += status[i] == TABLE_INSERTED;
+    ok = inserted == n;
+    for (uint32_t i = 0; i < n && ok; i++)
+      ok = (status[i] == TABLE_INSERTED) != (status[n+i] == TABLE_INSERTED);
+    printf("Deduplication of %u keys: %u distinct\n", 2 * n, inserted);
+
+    free(dup_bytes);
+    free(dup_offsets);
+    free(dup_vals);
+  }
+
+  printf("Hash table %s\n", ok ? "PASS" : "FAIL");
+
+  free(build_bytes);
+  free(build_offsets);
+  free(probe_bytes);
+  free(probe_offsets);
+  free(query_bytes);
+  free(query_offsets);
+  free(in_vals);
+  free(slots);
+  free(vals);
+  free(status);
+  free(out_vals);
+  return ok;
+}
+
+#endif
@@ -123,13 +123,27 @@ void MurmurHash3_x64_128 ( const void * key, const uint32_t len,
   ((uint64_t*)out)[0] = h1;
   ((uint64_t*)out)[1] = h2;
 }
+
+// 64 bits of the 128-bit hash for the hash table
+struct murmur_hasher {
+  static uint64_t hash(const uint8_t *key, uint32_t len)
+  {
+    uint64_t out[2];
+    MurmurHash3_x64_128 (key, len, 0, out);
+    return out[0];
+  }
+};
 #pragma omp end declare target 
 
+#include "hashtable.h"
+
 int main(int argc, char** argv) 
 {
   srand(3);
   uint32_t i;
   int32_t numKeys = atoi(argv[1]);
+  // log2 of the number of slots of the hash table
+  int log2_capacity = (argc > 2) ? atoi(argv[2]) : 22;
   // length of each key
   uint32_t* length = (uint32_t*) malloc (sizeof(uint32_t) * numKeys);
   // pointer to each key
@@ -199,6 +213,8 @@ int main(int argc, char** argv)
   if (error) printf("FAIL\n");
   else printf("SUCCESS\n");
 
+  table_benchmark<murmur_hasher>(log2_capacity);
+
   for (uint32_t i = 0; i < numKeys; i++) {
     free(out[i]);
     free(keys[i]);
@@ -346,14 +346,16 @@ int findIndex(float * CDF, int lengthCDF, float value) {
  * The implementation of the particle filter using OpenMP for many frames
  * @see http://openmp.org/wp/
  * @note This function is designed to work with a video of several frames. In addition, it references a provided MATLAB function which takes the video, the objxy matrix and the x and y arrays as arguments and returns the likelihoods
+ * @note Ntargets independent filters of Nparticles particles each run in the same kernels; filter t owns particles [t*Nparticles, (t+1)*Nparticles) and the seeds at the same positions
  * @param I The video to be run
  * @param IszX The x dimension of the video
  * @param IszY The y dimension of the video
  * @param Nfr The number of frames
  * @param seed The seed array used for random number generation
  * @param Nparticles The number of particles to be used
+ * @param Ntargets The number of filters to be run
  */
-int particleFilter(unsigned char * I, int IszX, int IszY, int Nfr, int * seed, int Nparticles) {
+int particleFilter(unsigned char * I, int IszX, int IszY, int Nfr, int * seed, int Nparticles, int Ntargets) {
   int max_size = IszX * IszY*Nfr;
   //original particle centroid
   float xe = roundFloat(IszY / 2.0);
@@ -375,31 +377,36 @@ int particleFilter(unsigned char * I, int IszX, int IszY, int Nfr, int * seed, i
   int * objxy = (int *) calloc(countOnes * 2, sizeof(int));
   getneighbors(disk, countOnes, objxy, radius);
 
+  int Ntotal = Nparticles * Ntargets;
+  int num_blocks = (Nparticles + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
   //initial weights are all equal (1/Nparticles)
-  float * weights = (float *) calloc(Nparticles, sizeof(float));
-  for (x = 0; x < Nparticles; x++) {
+  float * weights = (float *) calloc(Ntotal, sizeof(float));
+  for (x = 0; x < Ntotal; x++) {
     weights[x] = 1 / ((float) (Nparticles));
   }
   /****************************************************************
    **************   B E G I N   A L L O C A T E *******************
    ****************************************************************/
-  float * likelihood = (float *) calloc(Nparticles + 1, sizeof (float));
-  float * partial_sums = (float *) calloc(Nparticles + 1, sizeof (float));
-  float * arrayX = (float *) calloc(Nparticles, sizeof (float));
-  float * arrayY = (float *) calloc(Nparticles, sizeof (float));
-  float * xj = (float *) calloc(Nparticles, sizeof (float));
-  float * yj = (float *) calloc(Nparticles, sizeof (float));
-  float * CDF = (float *) calloc(Nparticles, sizeof(float));
+  float * likelihood = (float *) calloc(Ntotal + 1, sizeof (float));
+  float * partial_sums = (float *) calloc(num_blocks * Ntargets, sizeof (float));
+  float * sum_weights = (float *) calloc(Ntargets, sizeof (float));
+  float * arrayX = (float *) calloc(Ntotal, sizeof (float));
+  float * arrayY = (float *) calloc(Ntotal, sizeof (float));
+  float * xj = (float *) calloc(Ntotal, sizeof (float));
+  float * yj = (float *) calloc(Ntotal, sizeof (float));
+  float * CDF = (float *) calloc(Ntotal, sizeof(float));
 
 
   //GPU copies of arrays
-  int * ind = (int*) calloc(countOnes * Nparticles, sizeof(int));
-  float * u = (float *) calloc(Nparticles, sizeof(float));
+  int * ind = (int*) calloc(countOnes * Ntotal, sizeof(int));
+  float * u = (float *) calloc(Ntotal, sizeof(float));
+  float * u1 = (float *) calloc(Ntargets, sizeof(float));
 
   //Donnie - this loop is different because in this kernel, arrayX and arrayY
   //  are set equal to xj before every iteration, so effectively, arrayX and
   //  arrayY will be set to xe and ye before the first iteration.
-  for (x = 0; x < Nparticles; x++) {
+  for (x = 0; x < Ntotal; x++) {
 
     xj[x] = xe;
     yj[x] = ye;
@@ -410,57 +417,60 @@ int particleFilter(unsigned char * I, int IszX, int IszY, int Nfr, int * seed, i
 
   int k;
 
-  int num_blocks = (Nparticles + BLOCK_SIZE - 1) / BLOCK_SIZE;
 #ifdef DEBUG
   printf("BLOCK_SIZE=%d \n",BLOCK_SIZE);
 #endif
 
 #pragma omp target data \
-  map(alloc: likelihood[0:Nparticles+1], \
-             ind[0:countOnes*Nparticles], \
-             u[0:Nparticles], \
-             partial_sums[0:Nparticles+1], \
-             CDF[0:Nparticles]) \
-  map(from: arrayX[0:Nparticles], \
-            arrayY[0:Nparticles]) \
-  map(tofrom: weights[0:Nparticles]) \
-  map(to: xj[0:Nparticles], \
-          yj[0:Nparticles], \
-          seed[0:Nparticles], \
+  map(alloc: likelihood[0:Ntotal+1], \
+             ind[0:countOnes*Ntotal], \
+             u[0:Ntotal], \
+             u1[0:Ntargets], \
+             partial_sums[0:num_blocks*Ntargets], \
+             sum_weights[0:Ntargets], \
+             CDF[0:Ntotal]) \
+  map(from: arrayX[0:Ntotal], \
+            arrayY[0:Ntotal]) \
+  map(tofrom: weights[0:Ntotal]) \
+  map(to: xj[0:Ntotal], \
+          yj[0:Ntotal], \
+          seed[0:Ntotal], \
           I[0:IszX * IszY * Nfr], \
           objxy[0:2*countOnes])
   {
 
     for (k = 1; k < Nfr; k++) {
       /****************** L I K E L I H O O D ************************************/
-#pragma omp target teams num_teams(num_blocks) thread_limit(BLOCK_SIZE)
+#pragma omp target teams num_teams(num_blocks*Ntargets) thread_limit(BLOCK_SIZE)
       {
         float weights_local[BLOCK_SIZE];
 #pragma omp parallel
         {
-          int block_id = omp_get_team_num();
+          int block_id = omp_get_team_num() % num_blocks;
+          int target = omp_get_team_num() / num_blocks;
           int thread_id = omp_get_thread_num();
           int block_dim = omp_get_num_threads();
           int i = block_id * block_dim + thread_id;
+          int g = target * Nparticles + i;
           int y;
           int indX, indY;
           float u, v;
 
           if(i < Nparticles){
-            arrayX[i] = xj[i];
-            arrayY[i] = yj[i];
-            weights[i] = 1 / ((float) (Nparticles)); 
-            seed[i] = (A*seed[i] + C) % M;
-            u = fabsf(seed[i]/((float)M));
-            seed[i] = (A*seed[i] + C) % M;
-            v = fabsf(seed[i]/((float)M));
-            arrayX[i] += 1.0 + 5.0*(sqrtf(-2*logf(u))*cosf(2*PI*v));
-
-            seed[i] = (A*seed[i] + C) % M;
-            u = fabsf(seed[i]/((float)M));
-            seed[i] = (A*seed[i] + C) % M;
-            v = fabsf(seed[i]/((float)M));
-            arrayY[i] += -2.0 + 2.0*(sqrtf(-2*logf(u))*cosf(2*PI*v));
+            arrayX[g] = xj[g];
+            arrayY[g] = yj[g];
+            weights[g] = 1 / ((float) (Nparticles)); 
+            seed[g] = (A*seed[g] + C) % M;
+            u = fabsf(seed[g]/((float)M));
+            seed[g] = (A*seed[g] + C) % M;
+            v = fabsf(seed[g]/((float)M));
+            arrayX[g] += 1.0 + 5.0*(sqrtf(-2*logf(u))*cosf(2*PI*v));
+
+            seed[g] = (A*seed[g] + C) % M;
+            u = fabsf(seed[g]/((float)M));
+            seed[g] = (A*seed[g] + C) % M;
+            v = fabsf(seed[g]/((float)M));
+            arrayY[g] += -2.0 + 2.0*(sqrtf(-2*logf(u))*cosf(2*PI*v));
           }
 
 #pragma omp barrier
@@ -469,24 +479,24 @@ int particleFilter(unsigned char * I, int IszX, int IszY, int Nfr, int * seed, i
           {
             for(y = 0; y < countOnes; y++){
 
-              int iX = arrayX[i];
-              int iY = arrayY[i];
-              int rnd_iX = (arrayX[i] - iX) < .5f ? iX : iX++;
-              int rnd_iY = (arrayY[i] - iY) < .5f ? iY : iY++;
+              int iX = arrayX[g];
+              int iY = arrayY[g];
+              int rnd_iX = (arrayX[g] - iX) < .5f ? iX : iX++;
+              int rnd_iY = (arrayY[g] - iY) < .5f ? iY : iY++;
               indX = rnd_iX + objxy[y*2 + 1];
               indY = rnd_iY + objxy[y*2];
 
-              ind[i*countOnes + y] = abs(indX*IszY*Nfr + indY*Nfr + k);
-              if(ind[i*countOnes + y] >= max_size)
-                ind[i*countOnes + y] = 0;
+              ind[g*countOnes + y] = abs(indX*IszY*Nfr + indY*Nfr + k);
+              if(ind[g*countOnes + y] >= max_size)
+                ind[g*countOnes + y] = 0;
             }
             float likelihoodSum = 0.0;
             for(int x = 0; x < countOnes; x++)
-              likelihoodSum += ((I[ind[i*countOnes + x]] - 100) * (I[ind[i*countOnes + x]] - 100) -
-                  (I[ind[i*countOnes + x]] - 228) * (I[ind[i*countOnes + x]] - 228)) / 50.0;
-            likelihood[i] = likelihoodSum/countOnes-SCALE_FACTOR;
+              likelihoodSum += ((I[ind[g*countOnes + x]] - 100) * (I[ind[g*countOnes + x]] - 100) -
+                  (I[ind[g*countOnes + x]] - 228) * (I[ind[g*countOnes + x]] - 228)) / 50.0;
+            likelihood[g] = likelihoodSum/countOnes-SCALE_FACTOR;
 
-            weights[i] = weights[i] * expf(likelihood[i]);
+            weights[g] = weights[g] * expf(likelihood[g]);
 
           }
 
@@ -495,7 +505,7 @@ int particleFilter(unsigned char * I, int IszX, int IszY, int Nfr, int * seed, i
 #pragma omp barrier
 
           if(i < Nparticles){
-            weights_local[thread_id] = weights[i];
+            weights_local[thread_id] = weights[g];
           }
 
 #pragma omp barrier
@@ -510,65 +520,102 @@ int particleFilter(unsigned char * I, int IszX, int IszY, int Nfr, int * seed, i
           }
           if(thread_id == 0)
           {
-            partial_sums[block_id] = weights_local[0];
+            partial_sums[target * num_blocks + block_id] = weights_local[0];
           }
         }
       }
 
-#pragma omp target
+      /****************** B L O C K   O F F S E T S ******************************/
+      // One team per filter scans the block sums: each thread adds up a run
+      // of blocks, the run totals are scanned in team-local memory and each
+      // block sum is replaced by the sum of the blocks before it. The total
+      // is the sum of the weights.
+#pragma omp target teams num_teams(Ntargets) thread_limit(BLOCK_SIZE)
       {
-        float sum = 0;
-        int num_blocks = (Nparticles + BLOCK_SIZE - 1) / BLOCK_SIZE;
-        for (int x = 0; x < num_blocks; x++) {
-          sum += partial_sums[x];
+        float sums_local[BLOCK_SIZE];
+#pragma omp parallel
+        {
+          int target = omp_get_team_num();
+          int thread_id = omp_get_thread_num();
+          int block_dim = omp_get_num_threads();
+          float * sums = partial_sums + target * num_blocks;
+          int run = (num_blocks + block_dim - 1) / block_dim;
+          int first = thread_id * run;
+          int last = first + run < num_blocks ? first + run : num_blocks;
+
+          float run_sum = 0;
+          for (int b = first; b < last; b++)
+            run_sum += sums[b];
+          sums_local[thread_id] = run_sum;
+#pragma omp barrier
+
+          for (int s = 1; s < block_dim; s <<= 1) {
+            float left = thread_id >= s ? sums_local[thread_id - s] : 0;
+#pragma omp barrier
+            sums_local[thread_id] += left;
+#pragma omp barrier
+          }
+
+          float offset = thread_id > 0 ? sums_local[thread_id - 1] : 0;
+          for (int b = first; b < last; b++) {
+            float block_sum = sums[b];
+            sums[b] = offset;
+            offset += block_sum;
+          }
+
+          if (thread_id == 0) {
+            sum_weights[target] = sums_local[block_dim - 1];
+
+            // the first particle of each filter draws the offset of the
+            // systematic resampling
+            int s0 = target * Nparticles;
+            seed[s0] = (A*seed[s0] + C) % M;
+            float p = fabsf(seed[s0]/((float)M));
+            seed[s0] = (A*seed[s0] + C) % M;
+            float q = fabsf(seed[s0]/((float)M));
+            u1[target] = (1/((float)(Nparticles))) * 
+              (sqrtf(-2*logf(p))*cosf(2*PI*q));
+          }
         }
-        partial_sums[0] = sum;
       }
 
 #ifdef DEBUG
-      // this shows the sum of all partial_sum results
-#pragma omp target update from (partial_sums[0:1])
-      printf("kernel sum: frame=%d partial_sums[0]=%f\n",
-          k, partial_sums[0]);
+      // this shows the sum of the weights of the first filter
+#pragma omp target update from (sum_weights[0:1])
+      printf("kernel sum: frame=%d sum_weights[0]=%f\n",
+          k, sum_weights[0]);
 #endif
 
-#pragma omp target teams num_teams(num_blocks) thread_limit(BLOCK_SIZE)
+      /****************** N O R M A L I Z E   A N D   C D F **********************/
+      // The CDF of a block is the scan of its weights in team-local memory
+      // plus the weights of the blocks before it.
+#pragma omp target teams num_teams(num_blocks*Ntargets) thread_limit(BLOCK_SIZE)
       {
-        float u1;
-        float sumWeights; 
+        float cdf_local[BLOCK_SIZE];
 #pragma omp parallel
         {
-          int local_id = omp_get_thread_num();
-          int i = omp_get_team_num() * omp_get_num_threads() + local_id;
-          if(0 == local_id)
-            sumWeights = partial_sums[0];
-#pragma omp barrier
-          if(i < Nparticles) {
-            weights[i] = weights[i]/sumWeights;
-          }
-#pragma omp barrier
-          if(i == 0) {
-            CDF[0] = weights[0];
-            for(int x = 1; x < Nparticles; x++){
-              CDF[x] = weights[x] + CDF[x-1];
-            }
+          int block_id = omp_get_team_num() % num_blocks;
+          int target = omp_get_team_num() / num_blocks;
+          int thread_id = omp_get_thread_num();
+          int block_dim = omp_get_num_threads();
+          int i = block_id * block_dim + thread_id;
+          int g = target * Nparticles + i;
+          float sumWeights = sum_weights[target];
 
-            seed[i] = (A*seed[i] + C) % M;
-            float p = fabsf(seed[i]/((float)M));
-            seed[i] = (A*seed[i] + C) % M;
-            float q = fabsf(seed[i]/((float)M));
-            u[0] = (1/((float)(Nparticles))) * 
-              (sqrtf(-2*logf(p))*cosf(2*PI*q));
-            // do this to allow all threads in all blocks to use the same u1
-          }
+          cdf_local[thread_id] = i < Nparticles ? weights[g] : 0;
 #pragma omp barrier
-          if(0 == local_id)
-            u1 = u[0];
 
+          for (int s = 1; s < block_dim; s <<= 1) {
+            float left = thread_id >= s ? cdf_local[thread_id - s] : 0;
+#pragma omp barrier
+            cdf_local[thread_id] += left;
 #pragma omp barrier
-          if(i < Nparticles)
-          {
-            u[i] = u1 + i/((float)(Nparticles));
+          }
+
+          if(i < Nparticles) {
+            weights[g] = weights[g]/sumWeights;
+            CDF[g] = (partial_sums[target * num_blocks + block_id] + cdf_local[thread_id]) / sumWeights;
+            u[g] = u1[target] + i/((float)(Nparticles));
           }
         }
       }
@@ -595,24 +642,27 @@ int particleFilter(unsigned char * I, int IszX, int IszY, int Nfr, int * seed, i
       printf("distance: %lf\n", distance);
 #endif
 
+      /****************** R E S A M P L E ****************************************/
+      // systematic resampling: the first CDF entry not below u is found by
+      // binary search in the CDF of the particle's filter
 #pragma omp target teams distribute parallel for thread_limit(BLOCK_SIZE)
-      for (int i = 0; i < Nparticles; i++)
+      for (int g = 0; g < Ntotal; g++)
       {
-        int index = -1;
-        int x;
-
-        for(x = 0; x < Nparticles; x++){
-          if(CDF[x] >= u[i]){
-            index = x;
-            break;
-          }
-        }
-        if(index == -1){
-          index = Nparticles-1;
+        int first = (g / Nparticles) * Nparticles;
+        int lo = 0, hi = Nparticles;
+        float value = u[g];
+
+        while (lo < hi) {
+          int mid = (lo + hi) / 2;
+          if (CDF[first + mid] >= value)
+            hi = mid;
+          else
+            lo = mid + 1;
         }
+        int index = lo < Nparticles ? lo : Nparticles - 1;
 
-        xj[i] = arrayX[index];
-        yj[i] = arrayY[index];
+        xj[g] = arrayX[first + index];
+        yj[g] = arrayY[first + index];
       }
     }//end loop
   } // #pragma 
@@ -620,15 +670,6 @@ int particleFilter(unsigned char * I, int IszX, int IszY, int Nfr, int * seed, i
 
   printf("Device offloading time: %lf (s)\n", elapsed_time(offload_start, offload_end));
 
-  xe = 0;
-  ye = 0;
-  // estimate the object location by expected values
-  for (x = 0; x < Nparticles; x++) {
-    xe += arrayX[x] * weights[x];
-    ye += arrayY[x] * weights[x];
-  }
-  float distance = sqrt(pow((float) (xe - (int) roundFloat(IszY / 2.0)), 2) + pow((float) (ye - (int) roundFloat(IszX / 2.0)), 2));
-
   //Output results
   FILE *fid;
   fid=fopen("output.txt", "w+");
@@ -636,14 +677,28 @@ int particleFilter(unsigned char * I, int IszX, int IszY, int Nfr, int * seed, i
     printf( "The file was not opened for writing\n" );
     return -1;
   }
-  fprintf(fid, "XE: %lf\n", xe);
-  fprintf(fid, "YE: %lf\n", ye);
-  fprintf(fid, "distance: %lf\n", distance);
+  for (int t = 0; t < Ntargets; t++) {
+    xe = 0;
+    ye = 0;
+    // estimate the object location by expected values
+    for (x = t * Nparticles; x < (t + 1) * Nparticles; x++) {
+      xe += arrayX[x] * weights[x];
+      ye += arrayY[x] * weights[x];
+    }
+    float distance = sqrt(pow((float) (xe - (int) roundFloat(IszY / 2.0)), 2) + pow((float) (ye - (int) roundFloat(IszX / 2.0)), 2));
+
+    if (Ntargets > 1)
+      fprintf(fid, "target %d\n", t);
+    fprintf(fid, "XE: %lf\n", xe);
+    fprintf(fid, "YE: %lf\n", ye);
+    fprintf(fid, "distance: %lf\n", distance);
+  }
   fclose(fid);
 
   //free regular memory
   free(likelihood);
   free(partial_sums);
+  free(sum_weights);
   free(arrayX);
   free(arrayY);
   free(xj);
@@ -651,24 +706,26 @@ int particleFilter(unsigned char * I, int IszX, int IszY, int Nfr, int * seed, i
   free(CDF);
   free(ind);
   free(u);
+  free(u1);
   return 0;
 }
 
 int main(int argc, char * argv[]) {
 
-  const char* usage = "float.out -x <dimX> -y <dimY> -z <Nfr> -np <Nparticles>";
+  const char* usage = "float.out -x <dimX> -y <dimY> -z <Nfr> -np <Nparticles> [-nt <Ntargets>]";
   //check number of arguments
-  if (argc != 9) {
+  if (argc != 9 && argc != 11) {
     printf("%s\n", usage);
     return 0;
   }
   //check args deliminators
-  if (strcmp(argv[1], "-x") || strcmp(argv[3], "-y") || strcmp(argv[5], "-z") || strcmp(argv[7], "-np")) {
+  if (strcmp(argv[1], "-x") || strcmp(argv[3], "-y") || strcmp(argv[5], "-z") || strcmp(argv[7], "-np") ||
+      (argc == 11 && strcmp(argv[9], "-nt"))) {
     printf("%s\n", usage);
     return 0;
   }
 
-  int IszX, IszY, Nfr, Nparticles;
+  int IszX, IszY, Nfr, Nparticles, Ntargets = 1;
 
   //converting a string to a integer
   if (sscanf(argv[2], "%d", &IszX) == EOF) {
@@ -714,15 +771,26 @@ int main(int argc, char * argv[]) {
     return 0;
   }
 
+  //converting a string to a integer
+  if (argc == 11 && sscanf(argv[10], "%d", &Ntargets) == EOF) {
+    printf("ERROR: Number of targets input is incorrect");
+    return 0;
+  }
+
+  if (Ntargets <= 0) {
+    printf("Number of targets must be > 0\n");
+    return 0;
+  }
+
 #ifdef DEBUG
-  printf("dimX=%d dimY=%d Nfr=%d Nparticles=%d\n", 
-      IszX, IszY, Nfr, Nparticles);
+  printf("dimX=%d dimY=%d Nfr=%d Nparticles=%d Ntargets=%d\n", 
+      IszX, IszY, Nfr, Nparticles, Ntargets);
 #endif
 
   //establish seed
-  int * seed = (int *) calloc(Nparticles, sizeof(int));
+  int * seed = (int *) calloc(Nparticles * Ntargets, sizeof(int));
   int i;
-  for (i = 0; i < Nparticles; i++)
+  for (i = 0; i < Nparticles * Ntargets; i++)
     seed[i] = i+1;
   //        seed[i] = time(0) * i;
   //calloc matrix
@@ -733,7 +801,7 @@ int main(int argc, char * argv[]) {
   long long endVideoSequence = get_time();
   printf("VIDEO SEQUENCE TOOK %f\n", elapsed_time(start, endVideoSequence));
   //call particle filter
-  particleFilter(I, IszX, IszY, Nfr, seed, Nparticles);
+  particleFilter(I, IszX, IszY, Nfr, seed, Nparticles, Ntargets);
   long long endParticleFilter = get_time();
   printf("PARTICLE FILTER TOOK %f\n", elapsed_time(endVideoSequence, endParticleFilter));
   printf("ENTIRE PROGRAM TOOK %f\n", elapsed_time(start, endParticleFilter));
@@ -90,6 +90,7 @@ void RunBenchmark(OptionParser &op){
 // Creation: May 25, 2011
 //
 // ****************************************************************************
+#pragma omp declare target
 void calculate_participants(int point_count, int node_count, int cwrank, 
     int *thread_block_count, int *total_thread_block_count, int *active_node_count){
 
@@ -118,6 +119,7 @@ void calculate_participants(int point_count, int node_count, int cwrank,
 
   return;
 }
+#pragma omp end declare target
 
 // ****************************************************************************
 // Function: runTest
@@ -233,6 +235,12 @@ void QTC(const string& name, OptionParser& op, int matrix_type){
 
   int* cardnl = (int*) malloc (sizeof(int)*thread_block_count*2);
   int* result = (int*) malloc (sizeof(int)*point_count);
+  int* winners = (int*) malloc (sizeof(int)*point_count*2);
+  int* state = (int*) malloc (sizeof(int)*STATE_SIZE);
+  int* ungrpd_tmp = (int*) malloc (sizeof(int)*point_count);
+  int* block_cnt = (int*) malloc (sizeof(int)*((point_count+COMPACT_CHUNK-1)/COMPACT_CHUNK));
+  int* ungrpd = ungrpd_pnts_indr_host;
+  int* ungrpd_next = ungrpd_tmp;
   int* degrees = (int*) malloc (sizeof(int)*point_count);
   char* Ai_mask = (char*) malloc (sizeof(char)*thread_block_count*point_count);
   float* dist_to_clust = (float*) malloc (sizeof(float)*thread_block_count*max_degree);
@@ -263,7 +271,11 @@ void QTC(const string& name, OptionParser& op, int matrix_type){
       dist_to_clust[0:max_degree*thread_block_count], \
       clustered_pnts_mask[0:point_count], \
       cardnl[0:thread_block_count*2], \
-      result[0:point_count])
+      result[0:point_count], \
+      winners[0:point_count*2], \
+      state[0:STATE_SIZE], \
+      ungrpd_tmp[0:point_count], \
+      block_cnt[0:(point_count+COMPACT_CHUNK-1)/COMPACT_CHUNK])
   {
 
     /*
@@ -351,228 +363,342 @@ void QTC(const string& name, OptionParser& op, int matrix_type){
 
     tpb = THREADSPERBLOCK;
 
+    state[STATE_POINT_COUNT] = point_count;
+    state[STATE_ITER] = 0;
+    state[STATE_DONE] = 0;
+#pragma omp target update to (state[0:STATE_SIZE])
+
+    // A distributed run has to agree on the winner across nodes in every iteration.
+    // Otherwise the iterations run back to back on the device, which keeps the point
+    // count and the termination flag in "state", and the host only looks at the state,
+    // the winners, and the clusters once every SYNC_INTERVAL iterations.
+    int sync_interval = ( node_count > 1 ) ? 1 : SYNC_INTERVAL;
+    int winner_node = 0;
+    int clustered = 0;
+    bool this_node_participates = true;
+
     // Kernel execution
     do{
-      stringstream ss;
-      int winner_node=-1;
-      int winner_index=-1;
-      bool this_node_participates = true;
 
-      ++iter;
+      for(int b = 0; b < sync_interval; b++){
 
-      calculate_participants(point_count, node_count, cwrank, &thread_block_count, &total_thread_block_count, &active_node_count);
+        // Between two synchronizations the host point count is an upper bound, so the
+        // launch configurations below are large enough. The kernels read the actual
+        // point count from the device state.
+        calculate_participants(point_count, node_count, cwrank, &thread_block_count, &total_thread_block_count, &active_node_count);
 
-      // If there are only a few elements left to cluster, reduce the number of participating nodes (GPUs).
-      if( cwrank >= active_node_count ){
-        this_node_participates = false;
-      }
-      comm_update_communicator(cwrank, active_node_count);
-      if( !this_node_participates )
-        break;
-      cwrank = comm_get_rank();
-
-      printf("QTC\n");
-      //QTC_device<<<grid, tpb>>>((float*)distance_matrix, (char *)Ai_mask, (char *)clustered_pnts_mask,
-      //(int *)indr_mtrx, (int *)cardnl, (int *)ungrpd_pnts_indr,
-      //(float *)dist_to_clust, (int *)degrees, point_count, max_point_count,
-      //max_degree, threshold, cwrank, active_node_count,
-      //total_thread_block_count);
+        // If there are only a few elements left to cluster, reduce the number of participating nodes (GPUs).
+        if( cwrank >= active_node_count ){
+          this_node_participates = false;
+        }
+        comm_update_communicator(cwrank, active_node_count);
+        if( !this_node_participates )
+          break;
+        cwrank = comm_get_rank();
 
-#pragma omp target teams num_teams(thread_block_count) thread_limit(tpb)
-      {
-        float dist_array[THREADSPERBLOCK];
-        int point_index_array[THREADSPERBLOCK];
-#pragma omp parallel 
+        int compact_blocks = (point_count+COMPACT_CHUNK-1)/COMPACT_CHUNK;
+
+        //QTC_device<<<grid, tpb>>>((float*)distance_matrix, (char *)Ai_mask, (char *)clustered_pnts_mask,
+        //(int *)indr_mtrx, (int *)cardnl, (int *)ungrpd_pnts_indr,
+        //(float *)dist_to_clust, (int *)degrees, point_count, max_point_count,
+        //max_degree, threshold, cwrank, active_node_count,
+        //total_thread_block_count);
+
+#pragma omp target teams num_teams(thread_block_count) thread_limit(tpb) depend(inout: state[0]) nowait
         {
+          float dist_array[THREADSPERBLOCK];
+          int point_index_array[THREADSPERBLOCK];
+#pragma omp parallel 
+          {
+
+            int max_cardinality = -1;
+            int max_cardinality_index;
+
+            int tid = omp_get_thread_num();
+            int tblock_id = omp_get_team_num();
+            char *Ai_mask_ptr = &Ai_mask[tblock_id * max_point_count];
+            float *dist_to_clust_ptr = &dist_to_clust[tblock_id * max_degree];
+            int base_offset = tblock_id*node_count + cwrank;
+            int point_count = state[STATE_POINT_COUNT];
+            int tb_count, total_tb_count, nodes;
+
+            calculate_participants(point_count, node_count, cwrank, &tb_count, &total_tb_count, &nodes);
+
+            // for i loop of the algorithm.
+            // Each thread iterates over all points that the whole thread-block owns
+            if( !state[STATE_DONE] && tblock_id < tb_count ){
+              for(int i = base_offset; i < point_count; i+= total_tb_count ){
+                int seed_index = ungrpd[i];
+                int degree = degrees[seed_index];
+                if( degree <= max_cardinality ) continue;
+                int  cnt = generate_candidate_cluster_compact_storage( 
+                    dist_array, point_index_array,
+                    seed_index, degree, Ai_mask_ptr, 
+                    dist_source,
+                    clustered_pnts_mask,
+                    indr_mtrx_host,
+                    dist_to_clust_ptr,
+                    point_count, max_point_count, max_degree, NULL, threshold);
+                if( cnt > max_cardinality ){
+                  max_cardinality = cnt;
+                  max_cardinality_index = seed_index;
+                }
+              } // for (i
+            }
 
-          int max_cardinality = -1;
-          int max_cardinality_index;
-
-          int tid = omp_get_thread_num();
-          int tblock_id = omp_get_team_num();
-          char *Ai_mask_ptr = &Ai_mask[tblock_id * max_point_count];
-          float *dist_to_clust_ptr = &dist_to_clust[tblock_id * max_degree];
-          int base_offset = tblock_id*node_count + cwrank;
-
-          // for i loop of the algorithm.
-          // Each thread iterates over all points that the whole thread-block owns
-          for(int i = base_offset; i < point_count; i+= total_thread_block_count ){
-            int seed_index = ungrpd_pnts_indr_host[i];
-            int degree = degrees[seed_index];
-            if( degree <= max_cardinality ) continue;
-            int  cnt = generate_candidate_cluster_compact_storage( 
-                dist_array, point_index_array,
-                seed_index, degree, Ai_mask_ptr, 
-                dist_source,
-                clustered_pnts_mask,
-                indr_mtrx_host,
-                dist_to_clust_ptr,
-                point_count, max_point_count, max_degree, NULL, threshold);
-            if( cnt > max_cardinality ){
-              max_cardinality = cnt;
-              max_cardinality_index = seed_index;
+            // since only three elements per block go to the global memory, the offset is:
+            int card_offset = tblock_id*2;
+            // only one thread needs to write into the global memory since they all have the same information.
+            if( 0 == tid ){
+              cardnl[card_offset] = max_cardinality;
+              cardnl[card_offset+1] = max_cardinality_index;
             }
-          } // for (i
-
-          // since only three elements per block go to the global memory, the offset is:
-          int card_offset = tblock_id*2;
-          // only one thread needs to write into the global memory since they all have the same information.
-          if( 0 == tid ){
-            cardnl[card_offset] = max_cardinality;
-            cardnl[card_offset+1] = max_cardinality_index;
           }
         }
-      }
 
 #ifdef DEBUG
-      printf("iteration %d: cardinalities\n", iter);
+#pragma omp taskwait
+        printf("iteration %d: cardinalities\n", state[STATE_ITER]);
 #pragma omp target update from (cardnl[0:thread_block_count*2])
-      for (int i = 0; i < 576*2; i++)
-        printf("%d %d\n", i, cardnl[i]);
+        for (int i = 0; i < thread_block_count*2; i++)
+          printf("%d %d\n", i, cardnl[i]);
 #endif
 
-      if( thread_block_count > 1 ){
-        // We are reducing 128 numbers or less, so one thread should be sufficient.
         //reduce_card_device<<<grid2D(1), 1>>>((int *)cardnl, thread_block_count);
-        printf("reduce_card\n");
-#pragma omp target 
+        // Parallel argmax over the thread-block results. Ties go to the lower thread-block,
+        // like the sequential scan did.
+#pragma omp target teams num_teams(1) thread_limit(tpb) depend(inout: state[0]) nowait
         {
-          int max_card = -1;
-          int  winner_index;
-          for(int i=0; i<thread_block_count*2; i+=2){
-            if( cardnl[i] > max_card ){
-              max_card = cardnl[i];
-              winner_index = cardnl[i+1];
+          int card_sh[THREADSPERBLOCK];
+          int block_sh[THREADSPERBLOCK];
+#pragma omp parallel 
+          {
+            int tid = omp_get_thread_num();
+            int curThreadCount = omp_get_num_threads();
+            int max_card = -1;
+            int max_block = thread_block_count;
+
+            for(int i = tid; i < thread_block_count; i += curThreadCount){
+              if( cardnl[2*i] > max_card ){
+                max_card = cardnl[2*i];
+                max_block = i;
+              }
+            }
+            card_sh[tid] = max_card;
+            block_sh[tid] = max_block;
+#pragma omp barrier
+
+            for(int s = 1; s < curThreadCount; s *= 2){
+              if( 0 == tid % (2*s) && tid+s < curThreadCount ){
+                int card = card_sh[tid+s];
+                int block = block_sh[tid+s];
+                if( card > card_sh[tid] || (card == card_sh[tid] && block < block_sh[tid]) ){
+                  card_sh[tid] = card;
+                  block_sh[tid] = block;
+                }
+              }
+#pragma omp barrier
+            }
+
+            if( 0 == tid && block_sh[0] < thread_block_count ){
+              int winner_index = cardnl[2*block_sh[0]+1];
+              cardnl[0] = card_sh[0];
+              cardnl[1] = winner_index;
             }
           }
-          cardnl[0] = max_card;
-          cardnl[1] = winner_index;
         }
-      }
 
-      //copyFromDevice( cardinalities, cardnl, 2*sizeof(int) );
+        if( node_count > 1 ){
+          int winner_index;
+#pragma omp taskwait
+          //copyFromDevice( cardinalities, cardnl, 2*sizeof(int) );
 #pragma omp target update from (cardnl[0:2])
 
-      max_card     = cardnl[0];
-      winner_index = cardnl[1];
+          max_card     = cardnl[0];
+          winner_index = cardnl[1];
 
-      comm_barrier();
+          comm_barrier();
 
-      comm_find_winner(&max_card, &winner_node, &winner_index, cwrank, max_point_count+1);
+          comm_find_winner(&max_card, &winner_node, &winner_index, cwrank, max_point_count+1);
 
-      if( be_verbose && cwrank == winner_node){ // for non-parallel cases, both "cwrank" and "winner_node" should be zero.
-        cout << "[" << cwrank << "] Cluster Cardinality: " << max_card << " (Node: " << cwrank << ", index: " << winner_index << ")" << std::endl;
-      }
+          cardnl[0] = max_card;
+          cardnl[1] = winner_index;
+#pragma omp target update to (cardnl[0:2])
+        }
 
-      //trim_ungrouped_pnts_indr_array<<<grid2D(1), tpb>>>(winner_index, (int*)ungrpd_pnts_indr, (float*)distance_matrix,
-      //   (int *)result, (char *)Ai_mask, (char *)clustered_pnts_mask,
-      //  (int *)indr_mtrx, (int *)cardnl, (float *)dist_to_clust, (int *)degrees,
-      // point_count, max_point_count, max_degree, threshold);
-      //printf("point count: %d\n", point_count);
+        //trim_ungrouped_pnts_indr_array<<<grid2D(1), tpb>>>(winner_index, (int*)ungrpd_pnts_indr, (float*)distance_matrix,
+        //   (int *)result, (char *)Ai_mask, (char *)clustered_pnts_mask,
+        //  (int *)indr_mtrx, (int *)cardnl, (float *)dist_to_clust, (int *)degrees,
+        // point_count, max_point_count, max_degree, threshold);
 
-#pragma omp target teams num_teams(1) thread_limit(tpb)
-      {
-        int tmp_pnts[THREADSPERBLOCK];
-        int cnt_sh;
-        bool flag_sh;
-        float dist_array[THREADSPERBLOCK];
-        int point_index_array[THREADSPERBLOCK];
-#pragma omp parallel 
+        // Growing the winner cluster is inherently one thread-block's work. The points
+        // of the cluster are appended to "result", which ends up holding all clusters
+        // in the order they were found.
+#pragma omp target teams num_teams(1) thread_limit(tpb) depend(inout: state[0]) nowait
         {
-
-          int cnt;
-          int tid = omp_get_thread_num();
-          int curThreadCount = omp_get_num_threads();
-          int degree = degrees[winner_index];
-
-          generate_candidate_cluster_compact_storage( 
-              dist_array, point_index_array,
-              winner_index, degree, Ai_mask,
-              dist_source,
-              clustered_pnts_mask,
-              indr_mtrx_host,
-              dist_to_clust,
-              point_count, max_point_count, max_degree, 
-              result, threshold);
-
-
-          if( 0 == tid ){
-            cnt_sh = 0;
-            flag_sh = false;
+          float dist_array[THREADSPERBLOCK];
+          int point_index_array[THREADSPERBLOCK];
+#pragma omp parallel 
+          {
+            int point_count = state[STATE_POINT_COUNT];
+            int winner_index = cardnl[1];
+
+            if( !state[STATE_DONE] ){
+              generate_candidate_cluster_compact_storage( 
+                  dist_array, point_index_array,
+                  winner_index, degrees[winner_index], Ai_mask,
+                  dist_source,
+                  clustered_pnts_mask,
+                  indr_mtrx_host,
+                  dist_to_clust,
+                  point_count, max_point_count, max_degree, 
+                  &result[max_point_count-point_count], threshold);
+            }
           }
-#pragma omp barrier
+        }
 
-          for(int i = 0; i+tid < point_count; i+=curThreadCount){
-            // Have all threads make a coalesced read of contiguous global memory and copy the points assuming they are all good.
-            tmp_pnts[tid] = ungrpd_pnts_indr_host[i+tid];
-            int pnt = tmp_pnts[tid];
-            // If a point is bad (which should not happen very often), raise a global flag so that thread zero fixes the problem.
-            if( 1 == Ai_mask[pnt] ){
-              flag_sh = true;
-              tmp_pnts[tid] = INVALID_POINT_MARKER;
-            }else{
-              ungrpd_pnts_indr_host[cnt_sh+tid] = pnt;
-            }
+        //update_clustered_pnts_mask<<<grid2D(1), tpb>>>((char *)clustered_pnts_mask, (char *)Ai_mask, max_point_count);
+        // If a point is part of the latest winner cluster, then it should be marked as
+        // clustered for the future iterations. Otherwise it should be left as it is.
+#pragma omp target teams distribute parallel for thread_limit(tpb) depend(inout: state[0]) nowait
+        for(int i = 0; i < max_point_count; i++){
+          if( !state[STATE_DONE] )
+            clustered_pnts_mask[i] |= Ai_mask[i];
+        }
 
+        // Remove the clustered points from the ungrouped points, preserving their order.
+        // Each thread-block counts the survivors in its chunk, then scatters them after
+        // the survivors of the preceding chunks.
+#pragma omp target teams num_teams(compact_blocks) thread_limit(tpb) depend(inout: state[0]) nowait
+        {
+          int cnt_sh[THREADSPERBLOCK];
+#pragma omp parallel 
+          {
+            int tid = omp_get_thread_num();
+            int curThreadCount = omp_get_num_threads();
+            int block = omp_get_team_num();
+            int point_count = state[STATE_DONE] ? 0 : state[STATE_POINT_COUNT];
+            int end = MIN(point_count, (block+1)*COMPACT_CHUNK);
+            int cnt = 0;
+
+            for(int i = block*COMPACT_CHUNK+tid; i < end; i += curThreadCount){
+              if( 0 == Ai_mask[ungrpd[i]] )
+                cnt++;
+            }
+            cnt_sh[tid] = cnt;
 #pragma omp barrier
+            if( 0 == tid ){
+              for(int j = 1; j < curThreadCount; j++)
+                cnt += cnt_sh[j];
+              block_cnt[block] = cnt;
+            }
+          }
+        }
+
+#pragma omp target teams num_teams(compact_blocks) thread_limit(tpb) depend(inout: state[0]) nowait
+        {
+          int scan_sh[THREADSPERBLOCK];
+          int base_sh;
+#pragma omp parallel 
+          {
+            int tid = omp_get_thread_num();
+            int curThreadCount = omp_get_num_threads();
+            int block = omp_get_team_num();
+            int point_count = state[STATE_DONE] ? 0 : state[STATE_POINT_COUNT];
+            int end = MIN(point_count, (block+1)*COMPACT_CHUNK);
 
             if( 0 == tid ){
-              if( flag_sh ){
-                cnt = cnt_sh;
-                for(int j = 0; (j < curThreadCount) && (i+j < point_count); j++ ){
-                  if( INVALID_POINT_MARKER != tmp_pnts[j] ){
-                    ungrpd_pnts_indr_host[cnt] = tmp_pnts[j];
-                    cnt++;
-                  }
-                }
-                cnt_sh = cnt;
-              }else{
-                cnt_sh += curThreadCount;
-              }
-              flag_sh  = false;
+              int base = 0;
+              for(int j = 0; j < block; j++)
+                base += block_cnt[j];
+              base_sh = base;
             }
 #pragma omp barrier
+            int base = base_sh;
+
+            for(int i = block*COMPACT_CHUNK; i < end; i += curThreadCount){
+              int pnt = -1;
+              int keep = 0;
+              if( i+tid < end ){
+                pnt = ungrpd[i+tid];
+                keep = ( 0 == Ai_mask[pnt] );
+              }
+              scan_sh[tid] = keep;
+#pragma omp barrier
+              // inclusive scan of the "keep" flags
+              for(int s = 1; s < curThreadCount; s *= 2){
+                int v = ( tid >= s ) ? scan_sh[tid-s] : 0;
+#pragma omp barrier
+                scan_sh[tid] += v;
+#pragma omp barrier
+              }
+              if( keep )
+                ungrpd_next[base+scan_sh[tid]-1] = pnt;
+              base += scan_sh[curThreadCount-1];
+#pragma omp barrier
+            }
           }
         }
-      }
 
-      if( cwrank == winner_node){ // for non-parallel cases, these should both be zero.
-        if( save_clusters ){
-          ss << "p." << iter;
-          debug_out.open(ss.str().c_str());
+        int *tmp = ungrpd;
+        ungrpd = ungrpd_next;
+        ungrpd_next = tmp;
+
+        // Log the winner and decide on the device whether there is another iteration.
+#pragma omp target depend(inout: state[0]) nowait
+        {
+          if( !state[STATE_DONE] ){
+            int max_card = cardnl[0];
+            int iter = state[STATE_ITER]++;
+            winners[2*iter] = max_card;
+            winners[2*iter+1] = cardnl[1];
+            state[STATE_POINT_COUNT] -= max_card;
+            state[STATE_DONE] = !( max_card > 1 && state[STATE_POINT_COUNT] );
+          }
         }
+      }
+
+#pragma omp taskwait
+#pragma omp target update from (state[0:STATE_SIZE])
 
-        //copyFromDevice(output, (void *)result, max_card*sizeof(int) );
-#pragma omp target update from (result[0:max_card])
+      int prev_iter = iter;
+      int prev_clustered = clustered;
+      iter = state[STATE_ITER];
+      point_count = state[STATE_POINT_COUNT];
+      clustered = max_point_count - point_count;
 
+      // Report the clusters found since the last synchronization.
+      if( cwrank == winner_node && iter > prev_iter && (be_verbose || save_clusters) ){
+        int count = clustered - prev_clustered;
+#pragma omp target update from (winners[2*prev_iter:2*(iter-prev_iter)])
         if( save_clusters ){
-          for(int i=0; i<max_card; i++){
-            debug_out << pnts[2*result[i]] << " " << pnts[2*result[i]+1] << std::endl;
-          }
-          seeds_out << pnts[2*winner_index] << " " << pnts[2*winner_index+1] << std::endl;
-          debug_out.close();
+          //copyFromDevice(output, (void *)result, max_card*sizeof(int) );
+#pragma omp target update from (result[prev_clustered:count])
         }
-      }
 
-      //update_clustered_pnts_mask<<<grid2D(1), tpb>>>((char *)clustered_pnts_mask, (char *)Ai_mask, max_point_count);
-#pragma omp target teams num_teams(1) thread_limit(tpb)
-      {
-#pragma omp parallel 
-        {
-          int tid = omp_get_thread_num();
-          int curThreadCount = omp_get_num_threads();
+        for(int it = prev_iter, offset = prev_clustered; it < iter; it++){
+          max_card = winners[2*it];
+          int winner_index = winners[2*it+1];
 
-          // If a point is part of the latest winner cluster, then it should be marked as
-          // clustered for the future iterations. Otherwise it should be left as it is.
-          for(int i = 0; i+tid < max_point_count; i+=curThreadCount){
-            clustered_pnts_mask[i+tid] |= Ai_mask[i+tid];
+          if( be_verbose ){ // for non-parallel cases, both "cwrank" and "winner_node" should be zero.
+            cout << "[" << cwrank << "] Cluster Cardinality: " << max_card << " (Node: " << cwrank << ", index: " << winner_index << ")" << std::endl;
           }
+
+          if( save_clusters ){
+            stringstream ss;
+            ss << "p." << it+1;
+            debug_out.open(ss.str().c_str());
+            for(int i=offset; i<offset+max_card; i++){
+              debug_out << pnts[2*result[i]] << " " << pnts[2*result[i]+1] << std::endl;
+            }
+            seeds_out << pnts[2*winner_index] << " " << pnts[2*winner_index+1] << std::endl;
+            debug_out.close();
+          }
+          offset += max_card;
         }
       }
 
-      point_count -= max_card;
-
-    }while( max_card > 1 && point_count );
+    }while( this_node_participates && !state[STATE_DONE] );
 
     if( save_clusters ){
       seeds_out.close();
@@ -592,6 +718,10 @@ void QTC(const string& name, OptionParser& op, int matrix_type){
   free(ungrpd_pnts_indr_host);
   free(cardnl);
   free(result);
+  free(winners);
+  free(state);
+  free(ungrpd_tmp);
+  free(block_cnt);
   free(degrees);
   free(Ai_mask);
   free(dist_to_clust);
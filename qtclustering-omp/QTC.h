@@ -20,6 +20,12 @@
 
 #define INVALID_POINT_MARKER -42
 
+// Device-resident state of the clustering loop
+#define STATE_POINT_COUNT 0
+#define STATE_ITER        1
+#define STATE_DONE        2
+#define STATE_SIZE        3
+
 void QTC(const string& name, OptionParser& op, int matrix_type);
 
 #endif
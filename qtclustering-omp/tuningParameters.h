@@ -8,4 +8,10 @@
 
 #define GPU_MIN_SATURATION_FACTOR 32
 
+// clustering iterations between two looks of the host at the device state
+#define SYNC_INTERVAL 16
+
+// ungrouped points per thread-block when compacting them
+#define COMPACT_CHUNK 1024
+
 #endif
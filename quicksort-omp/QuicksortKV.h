@@ -0,0 +1,486 @@
+#ifndef QUICKSORT_KV_H
+#define QUICKSORT_KV_H
+
+// Key-value GPU quicksort with a user comparator.
+//
+// Sequences longer than KV_LOCAL_SIZE are split into blocks of KV_BLOCK_SIZE
+// elements and partitioned three ways around a pivot (less, equal, greater),
+// ping-ponging between the input arrays and a scratch copy. The work list,
+// the block offsets and the lists of finished sequences never leave the
+// device: between rounds the host only reads back the number of blocks and
+// the number of new sequences to size the next launch.
+//
+// Sequences of at most KV_LOCAL_SIZE elements are sorted by one team, with a
+// bitonic sort in team-local memory or, up to KV_INSERTION_SIZE elements, an
+// insertion sort by a single thread. Pivots are the ninther of nine evenly
+// spaced samples and elements equal to the pivot are set aside at once, so
+// sorted, reversed, all-equal and organ-pipe inputs split evenly. Sequences
+// still longer than KV_LOCAL_SIZE after 2*log2(n) rounds are heap sorted, so
+// the worst case stays O(n log n) as in introsort.
+//
+// The comparator is a function object defining a strict weak ordering; it
+// is called on the device and has to be declared in a declare target region.
+
+#include "Quicksort.h"
+
+#define KV_BLOCK_THREADS    128
+#define KV_ITEMS_PER_THREAD   8
+#define KV_BLOCK_SIZE       (KV_BLOCK_THREADS*KV_ITEMS_PER_THREAD)
+#define KV_LOCAL_THREADS    256
+#define KV_LOCAL_SIZE      2048
+#define KV_INSERTION_SIZE    32
+
+// sequence still to be partitioned
+template <class K>
+struct kv_work_record {
+  uint start;
+  uint end;
+  uint depth;
+  K    pivot;
+};
+
+// sequence left to the local or the fallback sort; parity tells whether its
+// elements are in the input arrays (0) or in the scratch arrays (1)
+typedef struct kv_segment {
+  uint start;
+  uint end;
+  uint parity;
+} kv_segment;
+
+#pragma omp declare target
+template <class K>
+struct kv_less {
+  bool operator()(const K &a, const K &b) const { return a < b; }
+};
+
+template <class K>
+struct kv_greater {
+  bool operator()(const K &a, const K &b) const { return b < a; }
+};
+
+template <class K, class Compare>
+K kv_median3(K a, K b, K c, Compare comp) {
+  if (comp(a, b)) {
+    if (comp(b, c)) return b;
+    return comp(a, c) ? c : a;
+  } else {
+    if (comp(a, c)) return a;
+    return comp(b, c) ? c : b;
+  }
+}
+
+// ninther of nine samples spread over s[start:end]
+template <class K, class Compare>
+K kv_pivot(const K *s, uint start, uint end, Compare comp) {
+  const uint step = (end - start) / 9;
+  const uint p = start + step / 2;
+  K m0 = kv_median3(s[p], s[p + step], s[p + 2*step], comp);
+  K m1 = kv_median3(s[p + 3*step], s[p + 4*step], s[p + 5*step], comp);
+  K m2 = kv_median3(s[p + 6*step], s[p + 7*step], s[p + 8*step], comp);
+  return kv_median3(m0, m1, m2, comp);
+}
+
+template <class K, class V, class Compare>
+void kv_insertion_sort(K *k, V *v, uint n, Compare comp) {
+  for (uint i = 1; i < n; i++) {
+    K key = k[i];
+    V val = v[i];
+    uint j = i;
+    for (; j > 0 && comp(key, k[j-1]); j--) {
+      k[j] = k[j-1];
+      v[j] = v[j-1];
+    }
+    k[j] = key;
+    v[j] = val;
+  }
+}
+
+template <class K, class V, class Compare>
+void kv_sift_down(K *k, V *v, uint root, uint n, Compare comp) {
+  K key = k[root];
+  V val = v[root];
+  uint child;
+  while ((child = 2*root + 1) < n) {
+    if (child + 1 < n && comp(k[child], k[child+1])) child++;
+    if (!comp(key, k[child])) break;
+    k[root] = k[child];
+    v[root] = v[child];
+    root = child;
+  }
+  k[root] = key;
+  v[root] = val;
+}
+
+template <class K, class V, class Compare>
+void kv_heap_sort(K *k, V *v, uint n, Compare comp) {
+  for (uint i = n / 2; i > 0; i--)
+    kv_sift_down(k, v, i - 1, n, comp);
+  for (uint i = n - 1; i > 0; i--) {
+    K key = k[0]; k[0] = k[i]; k[i] = key;
+    V val = v[0]; v[0] = v[i]; v[i] = val;
+    kv_sift_down(k, v, 0, i, comp);
+  }
+}
+#pragma omp end declare target
+
+inline uint kv_log2(size_t n) {
+  uint l = 0;
+  while (n >>= 1) l++;
+  return l;
+}
+
+template <class K, class V, class Compare>
+void GPUQSortKV(size_t size, K* keys, V* vals, Compare comp)
+{
+  if (size < 2) return;
+  const uint n = size;
+
+  // sequences in the work list are disjoint and longer than KV_LOCAL_SIZE;
+  // every round turns each into at most two finished sequences
+  const uint depth_limit = 2 * kv_log2(size);
+  const uint max_work = n / KV_LOCAL_SIZE + 1;
+  const uint max_blocks = n / KV_BLOCK_SIZE + max_work;
+  const uint max_done = 2 * max_work * (depth_limit + 1);
+
+  K* keys_tmp = (K*) malloc (sizeof(K) * n);
+  V* vals_tmp = (V*) malloc (sizeof(V) * n);
+  kv_work_record<K>* work = (kv_work_record<K>*) malloc (sizeof(kv_work_record<K>) * max_work);
+  kv_work_record<K>* news = (kv_work_record<K>*) malloc (sizeof(kv_work_record<K>) * max_work);
+  kv_segment* done = (kv_segment*) malloc (sizeof(kv_segment) * max_done);
+  kv_segment* deep = (kv_segment*) malloc (sizeof(kv_segment) * max_work);
+  uint* blk_off = (uint*) malloc (sizeof(uint) * (max_work + 1));
+  uint* blk_cnt = (uint*) malloc (sizeof(uint) * 3 * max_blocks);
+  uint* seq_cnt = (uint*) malloc (sizeof(uint) * 2 * max_work);
+
+  // counters: new work records, done segments, deep segments, blocks
+  uint counters[4] = {0, 0, 0, 0};
+  uint nwork = 0;
+  if (n > KV_LOCAL_SIZE) {
+    kv_work_record<K> r = {0, n, 0, kv_pivot(keys, 0, n, comp)};
+    work[0] = r;
+    nwork = 1;
+  } else {
+    kv_segment r = {0, n, 0};
+    done[0] = r;
+    counters[1] = 1;
+  }
+
+#pragma omp target data map(tofrom: keys[0:n], vals[0:n]) \
+                        map(to: counters[0:4]) \
+                        map(alloc: keys_tmp[0:n], vals_tmp[0:n], work[0:max_work], \
+                                   news[0:max_work], done[0:max_done], deep[0:max_work], \
+                                   blk_off[0:max_work+1], blk_cnt[0:3*max_blocks], \
+                                   seq_cnt[0:2*max_work])
+  {
+#pragma omp target update to (work[0:1], done[0:1])
+
+    kv_work_record<K>* wcur = work;
+    kv_work_record<K>* wnext = news;
+
+    uint parity = 0;
+    while (nwork > 0) {
+      K* sk = parity ? keys_tmp : keys;
+      V* sv = parity ? vals_tmp : vals;
+      K* dk = parity ? keys : keys_tmp;
+      V* dv = parity ? vals : vals_tmp;
+
+      // blocks of each sequence
+#pragma omp target
+      {
+        uint total = 0;
+        for (uint s = 0; s < nwork; s++) {
+          blk_off[s] = total;
+          total += (wcur[s].end - wcur[s].start + KV_BLOCK_SIZE - 1) / KV_BLOCK_SIZE;
+        }
+        blk_off[nwork] = total;
+        counters[0] = 0;
+        counters[3] = total;
+      }
+#pragma omp target update from (counters[3:1])
+      const uint nblocks = counters[3];
+
+      // count the elements of each block below, at and above the pivot
+#pragma omp target teams num_teams(nblocks) thread_limit(KV_BLOCK_THREADS)
+      {
+        uint lt[KV_BLOCK_THREADS], eq[KV_BLOCK_THREADS];
+#pragma omp parallel
+        {
+          const uint localid = omp_get_thread_num();
+          const uint nthreads = omp_get_num_threads();
+
+          for (uint b = omp_get_team_num(); b < nblocks; b += omp_get_num_teams()) {
+            uint lo = 0, hi = nwork;
+            while (hi - lo > 1) {
+              uint mid = (lo + hi) / 2;
+              if (blk_off[mid] <= b) lo = mid; else hi = mid;
+            }
+            const kv_work_record<K> w = wcur[lo];
+            const uint start = w.start + (b - blk_off[lo]) * KV_BLOCK_SIZE;
+            const uint end = (w.end - start < KV_BLOCK_SIZE) ? w.end : start + KV_BLOCK_SIZE;
+
+            uint ltp = 0, eqp = 0;
+            for (uint i = start + localid; i < end; i += nthreads) {
+              if (comp(sk[i], w.pivot)) ltp++;
+              else if (!comp(w.pivot, sk[i])) eqp++;
+            }
+            lt[localid] = ltp;
+            eq[localid] = eqp;
+#pragma omp barrier
+            if (localid == 0) {
+              uint ltsum = 0, eqsum = 0;
+              for (uint t = 0; t < nthreads; t++) {
+                ltsum += lt[t];
+                eqsum += eq[t];
+              }
+              blk_cnt[3*b]   = ltsum;
+              blk_cnt[3*b+1] = eqsum;
+              blk_cnt[3*b+2] = end - start - ltsum - eqsum;
+            }
+#pragma omp barrier
+          }
+        }
+      }
+
+      // turn the counts into the first destination of each part of a block
+#pragma omp target teams distribute parallel for thread_limit(KV_BLOCK_THREADS)
+      for (uint s = 0; s < nwork; s++) {
+        uint ltsum = 0, eqsum = 0;
+        for (uint b = blk_off[s]; b < blk_off[s+1]; b++) {
+          ltsum += blk_cnt[3*b];
+          eqsum += blk_cnt[3*b+1];
+        }
+        uint lbeg = wcur[s].start, ebeg = lbeg + ltsum, gbeg = ebeg + eqsum;
+        for (uint b = blk_off[s]; b < blk_off[s+1]; b++) {
+          uint l = blk_cnt[3*b], e = blk_cnt[3*b+1], g = blk_cnt[3*b+2];
+          blk_cnt[3*b]   = lbeg;
+          blk_cnt[3*b+1] = ebeg;
+          blk_cnt[3*b+2] = gbeg;
+          lbeg += l; ebeg += e; gbeg += g;
+        }
+        seq_cnt[2*s]   = ltsum;
+        seq_cnt[2*s+1] = eqsum;
+      }
+
+      // scatter the blocks; elements equal to the pivot are in place for good
+#pragma omp target teams num_teams(nblocks) thread_limit(KV_BLOCK_THREADS)
+      {
+        uint lt[KV_BLOCK_THREADS], eq[KV_BLOCK_THREADS], gt[KV_BLOCK_THREADS];
+#pragma omp parallel
+        {
+          const uint localid = omp_get_thread_num();
+          const uint nthreads = omp_get_num_threads();
+
+          for (uint b = omp_get_team_num(); b < nblocks; b += omp_get_num_teams()) {
+            uint lo = 0, hi = nwork;
+            while (hi - lo > 1) {
+              uint mid = (lo + hi) / 2;
+              if (blk_off[mid] <= b) lo = mid; else hi = mid;
+            }
+            const kv_work_record<K> w = wcur[lo];
+            const uint start = w.start + (b - blk_off[lo]) * KV_BLOCK_SIZE;
+            const uint end = (w.end - start < KV_BLOCK_SIZE) ? w.end : start + KV_BLOCK_SIZE;
+
+            uint ltp = 0, eqp = 0, gtp = 0;
+            for (uint i = start + localid; i < end; i += nthreads) {
+              if (comp(sk[i], w.pivot)) ltp++;
+              else if (comp(w.pivot, sk[i])) gtp++;
+              else eqp++;
+            }
+            lt[localid] = ltp;
+            eq[localid] = eqp;
+            gt[localid] = gtp;
+#pragma omp barrier
+            if (localid == 0) {
+              uint l = blk_cnt[3*b], e = blk_cnt[3*b+1], g = blk_cnt[3*b+2];
+              for (uint t = 0; t < nthreads; t++) {
+                uint tl = lt[t], te = eq[t], tg = gt[t];
+                lt[t] = l; eq[t] = e; gt[t] = g;
+                l += tl; e += te; g += tg;
+              }
+            }
+#pragma omp barrier
+            uint lfrom = lt[localid], efrom = eq[localid], gfrom = gt[localid];
+            for (uint i = start + localid; i < end; i += nthreads) {
+              K key = sk[i];
+              uint to;
+              if (comp(key, w.pivot)) to = lfrom++;
+              else if (comp(w.pivot, key)) to = gfrom++;
+              else to = efrom++;
+              dk[to] = key;
+              dv[to] = sv[i];
+            }
+#pragma omp barrier
+          }
+        }
+      }
+
+      // the elements equal to the pivot are copied back to the input arrays
+      // if they were scattered to the scratch arrays
+      if (!parity) {
+#pragma omp target teams num_teams(nblocks) thread_limit(KV_BLOCK_THREADS)
+        {
+#pragma omp parallel
+          {
+            const uint localid = omp_get_thread_num();
+            const uint nthreads = omp_get_num_threads();
+
+            for (uint b = omp_get_team_num(); b < nblocks; b += omp_get_num_teams()) {
+              uint lo = 0, hi = nwork;
+              while (hi - lo > 1) {
+                uint mid = (lo + hi) / 2;
+                if (blk_off[mid] <= b) lo = mid; else hi = mid;
+              }
+              const uint ebeg = wcur[lo].start + seq_cnt[2*lo];
+              const uint eend = ebeg + seq_cnt[2*lo+1];
+              const uint start = ebeg + (b - blk_off[lo]) * KV_BLOCK_SIZE;
+              for (uint i = start + localid; i < eend && i < start + KV_BLOCK_SIZE; i += nthreads) {
+                keys[i] = keys_tmp[i];
+                vals[i] = vals_tmp[i];
+              }
+            }
+          }
+        }
+      }
+
+      // new work records, or finished sequences for the local and the
+      // fallback sort
+#pragma omp target teams distribute parallel for thread_limit(KV_BLOCK_THREADS)
+      for (uint s = 0; s < nwork; s++) {
+        const kv_work_record<K> w = wcur[s];
+        const uint ltsum = seq_cnt[2*s], eqsum = seq_cnt[2*s+1];
+        const uint cstart[2] = {w.start, w.start + ltsum + eqsum};
+        const uint cend[2] = {w.start + ltsum, w.end};
+        for (int c = 0; c < 2; c++) {
+          const uint len = cend[c] - cstart[c];
+          uint idx;
+          if (len == 0) continue;
+          if (len <= KV_LOCAL_SIZE) {
+#pragma omp atomic capture
+            idx = counters[1]++;
+            kv_segment r = {cstart[c], cend[c], parity ^ 1};
+            done[idx] = r;
+          } else if (w.depth + 1 >= depth_limit) {
+#pragma omp atomic capture
+            idx = counters[2]++;
+            kv_segment r = {cstart[c], cend[c], parity ^ 1};
+            deep[idx] = r;
+          } else {
+#pragma omp atomic capture
+            idx = counters[0]++;
+            kv_work_record<K> r = {cstart[c], cend[c], w.depth + 1,
+                                   kv_pivot(dk, cstart[c], cend[c], comp)};
+            wnext[idx] = r;
+          }
+        }
+      }
+
+#pragma omp target update from (counters[0:1])
+      nwork = counters[0];
+      std::swap(wcur, wnext);
+      parity ^= 1;
+    }
+
+#pragma omp target update from (counters[1:2])
+    const uint ndone = counters[1];
+    const uint ndeep = counters[2];
+
+    // sequences that did not get short enough in depth_limit rounds
+    if (ndeep > 0) {
+#pragma omp target teams distribute parallel for thread_limit(KV_BLOCK_THREADS)
+      for (uint s = 0; s < ndeep; s++) {
+        const kv_segment r = deep[s];
+        const uint len = r.end - r.start;
+        K* k = (r.parity ? keys_tmp : keys) + r.start;
+        V* v = (r.parity ? vals_tmp : vals) + r.start;
+        kv_heap_sort(k, v, len, comp);
+        if (r.parity) {
+          for (uint i = 0; i < len; i++) {
+            keys[r.start + i] = k[i];
+            vals[r.start + i] = v[i];
+          }
+        }
+      }
+    }
+
+    // short sequences: insertion sort by one thread, or bitonic sort of the
+    // keys and their positions by the team, padded to a power of two
+    if (ndone > 0) {
+#pragma omp target teams num_teams(ndone) thread_limit(KV_LOCAL_THREADS)
+      {
+        K lk[KV_LOCAL_SIZE];
+        V lv[KV_LOCAL_SIZE];
+        uint li[KV_LOCAL_SIZE];
+#pragma omp parallel
+        {
+          const uint localid = omp_get_thread_num();
+          const uint nthreads = omp_get_num_threads();
+
+          for (uint s = omp_get_team_num(); s < ndone; s += omp_get_num_teams()) {
+            const kv_segment r = done[s];
+            const uint len = r.end - r.start;
+            const K* srck = (r.parity ? keys_tmp : keys) + r.start;
+            const V* srcv = (r.parity ? vals_tmp : vals) + r.start;
+
+            if (len <= KV_INSERTION_SIZE) {
+              if (localid == 0) {
+                if (r.parity) {
+                  for (uint i = 0; i < len; i++) {
+                    keys[r.start + i] = srck[i];
+                    vals[r.start + i] = srcv[i];
+                  }
+                }
+                kv_insertion_sort(keys + r.start, vals + r.start, len, comp);
+              }
+            } else {
+              uint size2 = 2;
+              while (size2 < len) size2 <<= 1;
+
+              for (uint i = localid; i < size2; i += nthreads) {
+                li[i] = i;
+                if (i < len) {
+                  lk[i] = srck[i];
+                  lv[i] = srcv[i];
+                }
+              }
+#pragma omp barrier
+              for (uint k = 2; k <= size2; k <<= 1) {
+                for (uint j = k >> 1; j > 0; j >>= 1) {
+                  for (uint i = localid; i < size2 / 2; i += nthreads) {
+                    const uint a = 2*i - (i & (j - 1));
+                    const uint c = a + j;
+                    // padding sorts after every key
+                    const bool a_pad = li[a] >= len, c_pad = li[c] >= len;
+                    const bool swap = ((a & k) == 0)
+                      ? (!c_pad && (a_pad || comp(lk[c], lk[a])))
+                      : (!a_pad && (c_pad || comp(lk[a], lk[c])));
+                    if (swap) {
+                      K tk = lk[a]; lk[a] = lk[c]; lk[c] = tk;
+                      uint ti = li[a]; li[a] = li[c]; li[c] = ti;
+                    }
+                  }
+#pragma omp barrier
+                }
+              }
+              for (uint i = localid; i < len; i += nthreads) {
+                keys[r.start + i] = lk[i];
+                vals[r.start + i] = lv[li[i]];
+              }
+            }
+#pragma omp barrier
+          }
+        }
+      }
+    }
+  }
+
+  free(keys_tmp);
+  free(vals_tmp);
+  free(work);
+  free(news);
+  free(done);
+  free(deep);
+  free(blk_off);
+  free(blk_cnt);
+  free(seq_cnt);
+}
+#endif // QUICKSORT_KV_H
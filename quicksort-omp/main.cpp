@@ -88,6 +88,7 @@ bool parseArgs(int argc, char** argv, unsigned int* test_iterations, unsigned in
 
 #include "Quicksort.h"
 #include "QuicksortKernels.h"
+#include "QuicksortKV.h"
 
 
 template <class T>
@@ -426,6 +427,64 @@ int test(uint arraySize, unsigned int  NUM_ITERATIONS,
   return 0;
 }
 
+// input patterns of the key-value sort; all but the first are adversarial
+// for a quicksort with a naive pivot
+enum { KV_RANDOM, KV_SORTED, KV_REVERSED, KV_EQUAL, KV_ORGAN_PIPE, KV_PATTERNS };
+static const char* kv_pattern_name[KV_PATTERNS] =
+  { "random", "sorted", "reversed", "all equal", "organ pipe" };
+
+  template <class K, class Compare>
+int testKV(uint arraySize, unsigned int NUM_ITERATIONS,
+    const std::string& type_name, Compare comp)
+{
+  printf("\n\n\n--------------------------------------------------------------------\n");
+  printf("Key-value sort of %d %s keys\n", arraySize, type_name.c_str());
+  std::vector<K> original(arraySize), keys(arraySize);
+  std::vector<uint> vals(arraySize);
+  uint num_failures = 0;
+
+  for (int pattern = 0; pattern < KV_PATTERNS; pattern++) {
+    for (uint i = 0; i < arraySize; i++) {
+      switch (pattern) {
+        case KV_RANDOM:     original[i] = (K)(i + 1); break;
+        case KV_SORTED:     original[i] = (K)i; break;
+        case KV_REVERSED:   original[i] = (K)(arraySize - i); break;
+        case KV_EQUAL:      original[i] = (K)42; break;
+        case KV_ORGAN_PIPE: original[i] = (K)std::min(i, arraySize - 1 - i); break;
+      }
+    }
+    if (pattern == KV_RANDOM)
+      std::random_shuffle(original.begin(), original.end());
+
+    double AverageTime = 0.0;
+    bool correct = true;
+    for (uint k = 0; k < NUM_ITERATIONS; k++) {
+      std::copy(original.begin(), original.end(), keys.begin());
+      for (uint i = 0; i < arraySize; i++) vals[i] = i;
+
+      double beginClock = seconds();
+      GPUQSortKV(arraySize, keys.data(), vals.data(), comp);
+      double endClock = seconds();
+      AverageTime += endClock - beginClock;
+
+      // keys in order, values a permutation that still points at its key
+      std::vector<char> seen(arraySize, 0);
+      for (uint i = 0; i < arraySize && correct; i++) {
+        if (i > 0 && comp(keys[i], keys[i-1])) correct = false;
+        if (vals[i] >= arraySize || seen[vals[i]]++ || original[vals[i]] != keys[i])
+          correct = false;
+      }
+    }
+    AverageTime = AverageTime/NUM_ITERATIONS;
+    std::cout << kv_pattern_name[pattern] << ": average time " << AverageTime * 1000
+              << " ms, " << (correct ? "PASS" : "FAIL") << std::endl;
+    if (!correct) num_failures++;
+  }
+  std::cout << " Number of failed patterns: " << num_failures << " out of " << KV_PATTERNS << std::endl;
+  printf("-------done--------------------------------------------------------\n");
+  return 0;
+}
+
 
 int main(int argc, char** argv)
 {
@@ -438,6 +497,8 @@ int main(int argc, char** argv)
   test<uint>(arraySize, NUM_ITERATIONS, "uint");
   test<float>(arraySize, NUM_ITERATIONS, "float");
   test<double>(arraySize, NUM_ITERATIONS, "double");
+  testKV<uint>(arraySize, NUM_ITERATIONS, "uint", kv_less<uint>());
+  testKV<double>(arraySize, NUM_ITERATIONS, "double (descending)", kv_greater<double>());
 
   return 0;
 }
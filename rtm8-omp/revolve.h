@@ -0,0 +1,43 @@
+#ifndef REVOLVE_H
+#define REVOLVE_H
+
+// Binomial checkpointing (Griewank and Walther, "Revolve") for visiting the
+// states x_{l-1}, ..., x_1, x_0 of a time-stepping chain in reverse order.
+// x_0 can always be regenerated for free, and snaps further states can be
+// held at the same time. A schedule advances m steps from its base, stores
+// that state, reverses the upper part with one snapshot less and then the
+// lower part with the same number of snapshots.
+
+// Minimal number of forward steps needed to reverse l states with snaps
+// snapshots: r*l - C(snaps+1+r, snaps+2), where r is the smallest number of
+// repetitions with C(snaps+1+r, snaps+1) >= l.
+inline long long revolveCost(long long l, int snaps)
+{
+  if (l <= 1) return 0;
+  const int c = snaps + 1;
+  long long r = 0;
+  double beta = 1;
+  while (beta < l) {
+    r++;
+    beta = beta * (c + r) / r;
+  }
+  double b = 1;
+  for (long long i = 1; i < r; i++) b = b * (c + 1 + i) / i;
+  return r * l - (long long)(b + 0.5);
+}
+
+// Number of steps to advance before storing the next snapshot (snaps > 0).
+inline long long revolveSplit(long long l, int snaps)
+{
+  long long best = 1, cost = -1;
+  for (long long m = 1; m < l; m++) {
+    const long long c = m + revolveCost(l - m, snaps - 1) + revolveCost(m, snaps);
+    if (cost < 0 || c < cost) {
+      cost = c;
+      best = m;
+    }
+  }
+  return best;
+}
+
+#endif
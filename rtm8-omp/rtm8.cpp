@@ -2,14 +2,22 @@
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <vector>
 
 #define nt 30
+#ifndef nx
 #define nx 680
+#endif
+#ifndef ny
 #define ny 134
+#endif
+#ifndef nz
 #define nz 450
+#endif
 
 #include "mysecond.c"
+#include "revolve.h"
 
 inline int indexTo1D(int x, int y, int z){
   return x + y*nx + z*nx*ny;
@@ -65,7 +73,474 @@ void rtm8_cpu(float* vsq, float* current_s, float* current_r, float* next_s, flo
 }
 
 
-int main() {
+//==============================================================================
+// Reverse-time migration with checkpointed source wavefields
+//
+// The source wavefield is propagated forward in time, but the imaging
+// condition needs it in reverse order, together with the receiver wavefield
+// that is propagated backward from the recorded data. Instead of storing the
+// whole history, states of the source wavefield are stored at the points of
+// an optimal binomial schedule (revolve.h) within a memory budget and the
+// states in between are recomputed. Snapshots live in host memory and may be
+// compressed to a fixed number of bits per value; the copy of a snapshot to
+// the host overlaps with the following stencil steps.
+//==============================================================================
+
+// 8th-order second-derivative coefficients, center first
+static const float c8[5] = {-1435.f/504, 8.f/5, -1.f/5, 8.f/315, -1.f/560};
+
+// source and receivers
+#define SRC_X (nx/2)
+#define SRC_Y (ny/2)
+#define SRC_Z 6
+#define REC_Z 6
+#define FREQ 0.04f  // peak frequency of the source in cycles per step
+
+// values per block of the snapshot compression
+#define CBLOCK 32
+
+#pragma omp declare target
+inline float laplacian8(const float *u, const float *c, int x, int y, int z)
+{
+  const int i = indexTo1D(x,y,z);
+  float lap = 3 * c[0] * u[i];
+  for (int r = 1; r <= 4; r++)
+    lap += c[r] * (u[i+r] + u[i-r] + u[i+r*nx] + u[i-r*nx] +
+                   u[i+r*nx*ny] + u[i-r*nx*ny]);
+  return lap;
+}
+#pragma omp end declare target
+
+static float ricker(int t)
+{
+  const float a = (float)(M_PI * M_PI) * FREQ * FREQ;
+  const float tau = t - 1.2f / FREQ;
+  return (1 - 2 * a * tau * tau) * expf(-a * tau * tau);
+}
+
+// next = 2 cur - next + vsq (lap(cur) + src), where next holds the previous
+// time level on entry, src is a point source at (SRC_X, SRC_Y, SRC_Z)
+static void waveStep(const float *vsq, const float *c, const float *cur, float *next, const float src)
+{
+  #pragma omp target teams distribute parallel for collapse(3) thread_limit(256)
+  for (int z = 4; z < nz - 4; z++) {
+    for (int y = 4; y < ny - 4; y++) {
+      for (int x = 4; x < nx - 4; x++) {
+        const int i = indexTo1D(x,y,z);
+        float f = laplacian8(cur, c, x, y, z);
+        if (x == SRC_X && y == SRC_Y && z == SRC_Z) f += src;
+        next[i] = 2 * cur[i] - next[i] + vsq[i] * f;
+      }
+    }
+  }
+}
+
+// Backward step of the receiver wavefield with the data plane injected at
+// depth REC_Z, followed by the imaging condition image += s * q
+static void adjointStep(const float *vsq, const float *c, const float *s,
+                        const float *cur, float *next, const float *plane, float *image)
+{
+  #pragma omp target teams distribute parallel for collapse(3) thread_limit(256)
+  for (int z = 4; z < nz - 4; z++) {
+    for (int y = 4; y < ny - 4; y++) {
+      for (int x = 4; x < nx - 4; x++) {
+        const int i = indexTo1D(x,y,z);
+        float f = laplacian8(cur, c, x, y, z);
+        if (z == REC_Z) f += plane[y*nx+x];
+        const float q = 2 * cur[i] - next[i] + vsq[i] * f;
+        next[i] = q;
+        image[i] += s[i] * q;
+      }
+    }
+  }
+}
+
+// Fixed-rate compression of the two time levels of a state into pack. With
+// bits == 0 the values are copied. Otherwise every block of CBLOCK values is
+// stored as its maximum magnitude followed by bits words holding the values
+// quantized to bits-bit unsigned integers.
+static void compressState(const float *prev, const float *cur, unsigned *pack,
+                          const int bits, const int nblocks, const int fieldWords)
+{
+  const int ArraySize = nx * ny * nz;
+  if (bits == 0) {
+    #pragma omp target teams distribute parallel for thread_limit(256)
+    for (int i = 0; i < ArraySize; i++) {
+      union { float f; unsigned u; } a, b;
+      a.f = prev[i];
+      b.f = cur[i];
+      pack[i] = a.u;
+      pack[fieldWords + i] = b.u;
+    }
+    return;
+  }
+  #pragma omp target teams distribute parallel for thread_limit(256)
+  for (int blk = 0; blk < 2 * nblocks; blk++) {
+    const int f = blk / nblocks;
+    const int b = blk - f * nblocks;
+    const float *u = (f == 0 ? prev : cur) + b * CBLOCK;
+    unsigned *out = pack + f * fieldWords;
+    const int n = (ArraySize - b * CBLOCK < CBLOCK) ? ArraySize - b * CBLOCK : CBLOCK;
+
+    float vmax = 0;
+    for (int i = 0; i < n; i++) vmax = fmaxf(vmax, fabsf(u[i]));
+    union { float f; unsigned u; } m;
+    m.f = vmax;
+    out[b] = m.u;
+
+    const int M = (1 << (bits - 1)) - 1;
+    const float scale = vmax > 0 ? M / vmax : 0;
+    unsigned w[CBLOCK];
+    for (int k = 0; k < bits; k++) w[k] = 0;
+    for (int i = 0; i < CBLOCK; i++) {
+      // u * scale rounds to +-(M+1) at the block maximum for wide codes,
+      // where -(M+1) would wrap around to the largest code
+      long v = i < n ? lrintf(u[i] * scale) : 0;
+      v = v > M ? M : (v < -M ? -M : v);
+      const unsigned q = (unsigned)(v + M);
+      const int pos = i * bits, o = pos & 31;
+      w[pos >> 5] |= q << o;
+      if (o + bits > 32) w[(pos >> 5) + 1] |= q >> (32 - o);
+    }
+    unsigned *words = out + nblocks + b * bits;
+    for (int k = 0; k < bits; k++) words[k] = w[k];
+  }
+}
+
+static void decompressState(float *prev, float *cur, const unsigned *pack,
+                            const int bits, const int nblocks, const int fieldWords)
+{
+  const int ArraySize = nx * ny * nz;
+  if (bits == 0) {
+    #pragma omp target teams distribute parallel for thread_limit(256)
+    for (int i = 0; i < ArraySize; i++) {
+      union { float f; unsigned u; } a, b;
+      a.u = pack[i];
+      b.u = pack[fieldWords + i];
+      prev[i] = a.f;
+      cur[i] = b.f;
+    }
+    return;
+  }
+  #pragma omp target teams distribute parallel for thread_limit(256)
+  for (int blk = 0; blk < 2 * nblocks; blk++) {
+    const int f = blk / nblocks;
+    const int b = blk - f * nblocks;
+    float *u = (f == 0 ? prev : cur) + b * CBLOCK;
+    const unsigned *in = pack + f * fieldWords;
+    const int n = (ArraySize - b * CBLOCK < CBLOCK) ? ArraySize - b * CBLOCK : CBLOCK;
+
+    union { float f; unsigned u; } m;
+    m.u = in[b];
+    const int M = (1 << (bits - 1)) - 1;
+    const float scale = m.f / M;
+    const unsigned mask = (1u << bits) - 1;
+    const unsigned *words = in + nblocks + b * bits;
+    for (int i = 0; i < n; i++) {
+      const int pos = i * bits, o = pos & 31;
+      unsigned q = words[pos >> 5] >> o;
+      if (o + bits > 32) q |= words[(pos >> 5) + 1] << (32 - o);
+      u[i] = ((int)(q & mask) - M) * scale;
+    }
+  }
+}
+
+static void zeroField(float *u)
+{
+  const int ArraySize = nx * ny * nz;
+  #pragma omp target teams distribute parallel for thread_limit(256)
+  for (int i = 0; i < ArraySize; i++) u[i] = 0;
+}
+
+// state of the checkpointed reversal
+struct Rtm {
+  const float *vsq, *c;
+  float *s_prev, *s_cur;     // source wavefield, time levels t-1 and t
+  float *q_prev, *q_cur;     // receiver wavefield
+  float *image;
+  const float *data;         // recorded planes, one per time step
+  unsigned *pack[2];         // device staging buffers of snapshots
+  unsigned *store;           // host snapshots
+  int *slotTime;             // time of the state held by each snapshot
+  int bits, nblocks, fieldWords, snapWords;
+  int time;                  // time of the source state on the device
+  int slotsUsed;
+  int buf, pendingBuf, pendingSlot;
+  long long advances, adjoints, stores, restores;
+  double t_stencil, t_pack, t_wait;
+};
+
+static void advance(Rtm &r)
+{
+  const float *vsq = r.vsq, *c = r.c;
+  float *cur = r.s_cur, *next = r.s_prev;
+  double t0 = mysecond();
+  waveStep(vsq, c, cur, next, ricker(r.time));
+  r.t_stencil += mysecond() - t0;
+  r.s_prev = cur;
+  r.s_cur = next;
+  r.time++;
+  r.advances++;
+}
+
+// wait for the snapshot copy in flight and move it into its host slot
+static void finishStore(Rtm &r)
+{
+  if (r.pendingBuf < 0) return;
+  double t0 = mysecond();
+  #pragma omp taskwait
+  memcpy(r.store + (size_t)r.pendingSlot * r.snapWords, r.pack[r.pendingBuf],
+         (size_t)r.snapWords * sizeof(unsigned));
+  r.t_wait += mysecond() - t0;
+  r.pendingBuf = -1;
+}
+
+// store the current state in slot; the copy to the host runs asynchronously
+static void store(Rtm &r, int slot)
+{
+  unsigned *pack = r.pack[r.buf];
+  const int snapWords = r.snapWords;
+  double t0 = mysecond();
+  compressState(r.s_prev, r.s_cur, pack, r.bits, r.nblocks, r.fieldWords);
+  r.t_pack += mysecond() - t0;
+  finishStore(r);
+  #pragma omp target update from(pack[0:snapWords]) nowait depend(out: pack[0])
+  r.pendingBuf = r.buf;
+  r.pendingSlot = slot;
+  r.buf ^= 1;
+  r.slotTime[slot] = r.time;
+  r.stores++;
+}
+
+// make the source state at time t current
+static void restore(Rtm &r, int t)
+{
+  if (r.time == t) return;
+  if (t == 0) {
+    zeroField(r.s_prev);
+    zeroField(r.s_cur);
+    r.time = 0;
+    return;
+  }
+  int slot = r.slotsUsed - 1;
+  while (r.slotTime[slot] != t) slot--;
+  finishStore(r);
+  unsigned *pack = r.pack[r.buf];
+  const int snapWords = r.snapWords;
+  double t0 = mysecond();
+  memcpy(pack, r.store + (size_t)slot * snapWords, (size_t)snapWords * sizeof(unsigned));
+  #pragma omp target update to(pack[0:snapWords])
+  decompressState(r.s_prev, r.s_cur, pack, r.bits, r.nblocks, r.fieldWords);
+  r.t_pack += mysecond() - t0;
+  r.time = t;
+  r.restores++;
+}
+
+// backward step at the time of the current source state
+static void adjoint(Rtm &r)
+{
+  if (r.time == 0) return;
+  const float *vsq = r.vsq, *c = r.c, *s = r.s_cur;
+  const float *plane = r.data + (size_t)r.time * nx * ny;
+  float *cur = r.q_cur, *next = r.q_prev, *image = r.image;
+  double t0 = mysecond();
+  adjointStep(vsq, c, s, cur, next, plane, image);
+  r.t_stencil += mysecond() - t0;
+  r.q_prev = cur;
+  r.q_cur = next;
+  r.adjoints++;
+}
+
+// visit the source states hi-1, ..., lo in reverse; the state lo is either
+// the initial state or held by the topmost snapshot
+static void reverse(Rtm &r, int lo, int hi, int snaps)
+{
+  if (hi - lo == 1) {
+    restore(r, lo);
+    adjoint(r);
+    return;
+  }
+  if (snaps == 0) {
+    for (int t = hi - 1; t >= lo; t--) {
+      restore(r, lo);
+      while (r.time < t) advance(r);
+      adjoint(r);
+    }
+    return;
+  }
+  const int m = (int)revolveSplit(hi - lo, snaps);
+  restore(r, lo);
+  while (r.time < lo + m) advance(r);
+  store(r, r.slotsUsed++);
+  reverse(r, lo + m, hi, snaps - 1);
+  r.slotsUsed--;
+  reverse(r, lo, lo + m, snaps);
+}
+
+// forward steps of the reversal with snaps snapshots, relative to the steps
+// of a single forward sweep
+static void printTradeoff(int steps, int snaps, double rawMB, double snapMB, bool selected)
+{
+  const long long cost = revolveCost(steps + 1, snaps);
+  printf("%10d %14.1f %14.1f %14lld %12.2f%s\n", snaps, snaps * rawMB, snaps * snapMB,
+         cost, (double)cost / steps, selected ? "  <" : "");
+}
+
+static int rtm(const int steps, const double memoryMB, const int bits)
+{
+  const int ArraySize = nx * ny * nz;
+  const int planeSize = nx * ny;
+  if (steps < 1 || memoryMB < 0 || bits < 0 || bits == 1 || bits > 24) {
+    printf("steps must be positive and bits 0 (uncompressed) or 2 to 24\n");
+    return 1;
+  }
+
+  const int nblocks = (ArraySize + CBLOCK - 1) / CBLOCK;
+  const int fieldWords = bits ? nblocks * (1 + bits) : ArraySize;
+  const int snapWords = 2 * fieldWords;
+  const double snapMB = (double)snapWords * sizeof(unsigned) / 1e6;
+  const double rawMB = 2.0 * ArraySize * sizeof(float) / 1e6;
+  int snaps = (int)(memoryMB / snapMB);
+  if (snaps > steps) snaps = steps;
+
+  printf("grid = %d x %d x %d, steps = %d\n", nx, ny, nz, steps);
+  printf("snapshot (MB) = %f (%s)\n", snapMB,
+         bits ? "compressed" : "uncompressed");
+  printf("snapshots in %.1f MB = %d\n", memoryMB, snaps);
+
+  // memory versus recomputation
+  printf("\n%10s %14s %14s %14s %12s\n", "snapshots", "raw (MB)", "packed (MB)",
+         "forward steps", "recompute");
+  for (int s = 0; ; ) {
+    printTradeoff(steps, s, rawMB, snapMB, s == snaps);
+    if (s >= steps) break;
+    const int next = (s == 0) ? 1 : (2 * s < steps ? 2 * s : steps);
+    if (snaps > s && snaps < next) printTradeoff(steps, snaps, rawMB, snapMB, true);
+    s = next;
+  }
+  printf("\n");
+
+  float *vsq_m = (float*)malloc(ArraySize * sizeof(float));
+  float *vsq_t = (float*)malloc(ArraySize * sizeof(float));
+  float *s0 = (float*)malloc(ArraySize * sizeof(float));
+  float *s1 = (float*)malloc(ArraySize * sizeof(float));
+  float *q0 = (float*)malloc(ArraySize * sizeof(float));
+  float *q1 = (float*)malloc(ArraySize * sizeof(float));
+  float *image = (float*)malloc(ArraySize * sizeof(float));
+  float *data = (float*)malloc((size_t)(steps + 1) * planeSize * sizeof(float));
+  unsigned *pack0 = (unsigned*)malloc((size_t)snapWords * sizeof(unsigned));
+  unsigned *pack1 = (unsigned*)malloc((size_t)snapWords * sizeof(unsigned));
+  unsigned *store = (unsigned*)malloc(((size_t)snaps * snapWords + 1) * sizeof(unsigned));
+  int *slotTime = (int*)malloc((snaps + 1) * sizeof(int));
+  const float *c = c8;
+
+  // migration velocity (squared, in grid units) and the true velocity with
+  // a dipping reflector, from which the data is modeled
+  for (int z = 0; z < nz; z++) {
+    for (int y = 0; y < ny; y++) {
+      for (int x = 0; x < nx; x++) {
+        vsq_m[indexTo1D(x,y,z)] = 0.09f;
+        vsq_t[indexTo1D(x,y,z)] = (z > nz / 2 + (x - nx / 2) / 8) ? 0.16f : 0.09f;
+      }
+    }
+  }
+
+  Rtm r;
+  memset(&r, 0, sizeof(r));
+  r.vsq = vsq_m; r.c = c;
+  r.image = image; r.data = data;
+  r.pack[0] = pack0; r.pack[1] = pack1;
+  r.store = store; r.slotTime = slotTime;
+  r.bits = bits; r.nblocks = nblocks; r.fieldWords = fieldWords; r.snapWords = snapWords;
+  r.pendingBuf = -1;
+
+  double t_model, t_migrate;
+
+#pragma omp target data map(to: vsq_m[0:ArraySize], vsq_t[0:ArraySize], c[0:5]) \
+                        map(alloc: s0[0:ArraySize], s1[0:ArraySize], \
+                                   q0[0:ArraySize], q1[0:ArraySize], \
+                                   data[0:(steps+1)*planeSize], \
+                                   pack0[0:snapWords], pack1[0:snapWords]) \
+                        map(from: image[0:ArraySize])
+{
+  // model the reflection data: wavefield in the true model minus the
+  // wavefield in the migration model, recorded at depth REC_Z
+  double t0 = mysecond();
+  float *sp = s0, *sc = s1, *qp = q0, *qc = q1;
+  zeroField(s0); zeroField(s1); zeroField(q0); zeroField(q1);
+  #pragma omp target teams distribute parallel for thread_limit(256)
+  for (int i = 0; i < planeSize; i++) data[i] = 0;
+
+  for (int t = 0; t < steps; t++) {
+    waveStep(vsq_t, c, qc, qp, ricker(t));
+    waveStep(vsq_m, c, sc, sp, ricker(t));
+    float *tmp = sp; sp = sc; sc = tmp;
+    tmp = qp; qp = qc; qc = tmp;
+    float *plane = data + (size_t)(t + 1) * planeSize;
+    #pragma omp target teams distribute parallel for thread_limit(256)
+    for (int i = 0; i < planeSize; i++)
+      plane[i] = qc[REC_Z * planeSize + i] - sc[REC_Z * planeSize + i];
+  }
+  t_model = mysecond() - t0;
+
+  // migration: states 0 ... steps of the source wavefield in reverse
+  t0 = mysecond();
+  zeroField(s0); zeroField(s1); zeroField(q0); zeroField(q1); zeroField(image);
+  r.s_prev = s0; r.s_cur = s1;
+  r.q_prev = q0; r.q_cur = q1;
+  reverse(r, 0, steps + 1, snaps);
+  finishStore(r);
+  t_migrate = mysecond() - t0;
+}
+
+  double sum = 0, sum2 = 0;
+  for (int i = 0; i < ArraySize; i++) {
+    sum += fabsf(image[i]);
+    sum2 += (double)image[i] * image[i];
+  }
+
+  const double pts = (double)(nx-8)*(ny-8)*(nz-8);
+  printf("modeling time (s) = %f\n", t_model);
+  printf("migration time (s) = %f\n", t_migrate);
+  printf("  stencil (s) = %f\n", r.t_stencil);
+  printf("  snapshot pack/unpack (s) = %f\n", r.t_pack);
+  printf("  snapshot copy wait (s) = %f\n", r.t_wait);
+  printf("forward steps = %lld (recompute %.2f), backward steps = %lld\n",
+         r.advances, (double)r.advances / steps, r.adjoints);
+  printf("snapshots stored = %lld, restored = %lld\n", r.stores, r.restores);
+  printf("migration pt_rate (millions/sec) = %f\n",
+         pts * (r.advances + r.adjoints) / r.t_stencil / 1e6);
+  printf("image sum |I| = %e, sum I^2 = %e\n", sum, sum2);
+
+  free(vsq_m);
+  free(vsq_t);
+  free(s0);
+  free(s1);
+  free(q0);
+  free(q1);
+  free(image);
+  free(data);
+  free(pack0);
+  free(pack1);
+  free(store);
+  free(slotTime);
+  return 0;
+}
+
+
+int main(int argc, char* argv[]) {
+  if (argc > 1) {
+    if (argc < 3) {
+      printf("Usage: %s [steps memoryMB [bits]]\n", argv[0]);
+      printf("  without arguments: stencil benchmark\n");
+      printf("  steps:    time steps of a checkpointed reverse-time migration\n");
+      printf("  memoryMB: host memory for source wavefield snapshots\n");
+      printf("  bits:     bits per value of compressed snapshots, 0 = uncompressed\n");
+      return 1;
+    }
+    return rtm(atoi(argv[1]), atof(argv[2]), argc > 3 ? atoi(argv[3]) : 0);
+  }
+
   const int ArraySize = nx * ny * nz;
   float* next_s = (float*)malloc(ArraySize * sizeof(float));
   float* current_s = (float*)malloc(ArraySize * sizeof(float));
@@ -10,6 +10,18 @@ using namespace std;
 template <class real>
 void RunTest(string testName, OptionParser &op);
 
+template <class real>
+double RunFused(int n, unsigned int passes, const real *T, const real *P,
+    const real *Y, const real *molwt, real *WDOT,
+    real rateconv, real tconv, real pconv);
+
+#ifndef S3D_MECH
+template <class real>
+double RunUnfused(int n, unsigned int passes, const real *T, const real *P,
+    const real *Y, const real *molwt, real *WDOT,
+    real rateconv, real tconv, real pconv);
+#endif
+
 // ********************************************************
 // Function: toString
 //
@@ -52,7 +64,8 @@ template<class T> inline string toString(const T& t)
   void
 addBenchmarkSpecOptions(OptionParser &op)
 {
-  ; // No S3D specific options
+  op.addOption("fused", OPT_BOOL, "",
+      "evaluate the chemistry of a grid point in a single kernel", 'f');
 }
 
 void RunBenchmark(OptionParser &op)
@@ -80,12 +93,6 @@ void RunTest(string testName, OptionParser &op)
   real* host_y = (real*) malloc (Y_SIZE*n*sizeof(real));
   real* host_molwt = (real*) malloc (WDOT_SIZE*sizeof(real));
 
-  real* RF = (real*) malloc (RF_SIZE*n*sizeof(real));
-  real* RB = (real*) malloc (RB_SIZE*n*sizeof(real));
-  real* RKLOW = (real*) malloc (RKLOW_SIZE*n*sizeof(real));
-  real* C = (real*) malloc (C_SIZE*n*sizeof(real));
-  real* A = (real*) malloc (A_SIZE*n*sizeof(real));
-  real* EG = (real*) malloc (EG_SIZE*n*sizeof(real));
   real* WDOT = (real*) malloc (WDOT_SIZE*n*sizeof(real));
 
   // Initialize Test Problem
@@ -109,10 +116,16 @@ void RunTest(string testName, OptionParser &op)
   }
 
   // Initialize mass fractions
+#ifdef S3D_MECH
+  const real y_init[Y_SIZE] = MECH_Y_INIT;
+#endif
   for (int j=0; j<Y_SIZE; j++)
   {
     for (int i=0; i<n; i++)
     {
+#ifdef S3D_MECH
+      host_y[(j*n)+i] = y_init[j];
+#else
       host_y[(j*n)+i]= 0.0;
       if (j==14)
         host_y[(j*n)+i] = 0.064;
@@ -120,6 +133,7 @@ void RunTest(string testName, OptionParser &op)
         host_y[(j*n)+i] = 0.218;
       if (j==21)
         host_y[(j*n)+i] = 0.718;
+#endif
     }
   }
 
@@ -128,10 +142,105 @@ void RunTest(string testName, OptionParser &op)
   real *Y = host_y;
   real *molwt = host_molwt;
 
-  int thrds = BLOCK_SIZE;
+  unsigned int passes = op.getOptionInt("passes");
+  bool fused = op.getOptionBool("fused");
+
+  double time;
+#ifdef S3D_MECH
+  // a generated mechanism only provides the fused chain
+  fused = true;
+  time = RunFused<real>(n, passes, T, P, Y, molwt, WDOT, rateconv, tconv, pconv);
+#else
+  if (fused)
+    time = RunFused<real>(n, passes, T, P, Y, molwt, WDOT, rateconv, tconv, pconv);
+  else
+    time = RunUnfused<real>(n, passes, T, P, Y, molwt, WDOT, rateconv, tconv, pconv);
+#endif
+
+  printf("%s (%s): average kernel time per pass %f (ms)\n", testName.c_str(),
+         fused ? "fused" : "unfused", time * 1e3 / passes);
+
+  // Print out answers for verification
+  for (int i=0; i<WDOT_SIZE; i++) {
+      printf("% 23.16E ", WDOT[i*n]);
+      if (i % 3 == 2)
+          printf("\n");
+  }
+  printf("\n");
+
+  free(host_t);
+  free(host_p);
+  free(host_y);
+  free(host_molwt);
+  free(WDOT);
+}
+
+// ****************************************************************************
+// Function: RunFused
+//
+// Purpose:
+//   Evaluates the whole ratt -> ratx -> qssa -> rdwdot chain in a single
+//   kernel. Each thread keeps the intermediates of its grid point in
+//   private arrays (fused.h), so only the inputs and WDOT are streamed
+//   through device memory.
+//
+// Returns:  the kernel time of all passes in seconds
+//
+// ****************************************************************************
+  template <class real>
+double RunFused(int n, unsigned int passes, const real *T, const real *P,
+    const real *Y, const real *molwt, real *WDOT,
+    real rateconv, real tconv, real pconv)
+{
   int thrds2 = BLOCK_SIZE2;
+  double time = 0.0;
 
-  unsigned int passes = op.getOptionInt("passes");
+#pragma omp target data map(to: T[0:n], P[0:n], Y[0:Y_SIZE*n], molwt[0:WDOT_SIZE]) \
+                        map(from: WDOT[0:WDOT_SIZE*n])
+  {
+  double start = omp_get_wtime();
+
+  for (unsigned int pass = 0; pass < passes; pass++)
+  {
+#pragma omp target teams distribute parallel for thread_limit(thrds2)
+    for (int i = 0; i < n; i++) {
+#include "fused.h"
+    }
+  }
+
+  time = omp_get_wtime() - start;
+  }
+  return time;
+}
+
+#ifndef S3D_MECH
+// ****************************************************************************
+// Function: RunUnfused
+//
+// Purpose:
+//   Evaluates the chemistry with one kernel per stage header; the
+//   intermediates RF, RB, RKLOW, C, A and EG are kept in device memory
+//   between the kernels.
+//
+// Returns:  the kernel time of all passes in seconds
+//
+// ****************************************************************************
+  template <class real>
+double RunUnfused(int n, unsigned int passes, const real *T, const real *P,
+    const real *Y, const real *molwt, real *WDOT,
+    real rateconv, real tconv, real pconv)
+{
+  real* RF = (real*) malloc (RF_SIZE*n*sizeof(real));
+  real* RB = (real*) malloc (RB_SIZE*n*sizeof(real));
+  real* RKLOW = (real*) malloc (RKLOW_SIZE*n*sizeof(real));
+  real* C = (real*) malloc (C_SIZE*n*sizeof(real));
+  real* A = (real*) malloc (A_SIZE*n*sizeof(real));
+  real* EG = (real*) malloc (EG_SIZE*n*sizeof(real));
+  double time = 0.0;
+
+
+  int thrds = BLOCK_SIZE;
+  int thrds2 = BLOCK_SIZE2;
 
 #pragma omp target data map(to: T[0:n], P[0:n], Y[0:Y_SIZE*n], molwt[0:WDOT_SIZE]) \
                         map(alloc:RF[0:RF_SIZE*n], \
@@ -142,6 +251,7 @@ void RunTest(string testName, OptionParser &op)
                                   EG[0:EG_SIZE*n]) \
                         map(from: WDOT[0:WDOT_SIZE*n])
   {
+  double start = omp_get_wtime();
 
   for (unsigned int i = 0; i < passes; i++)
   {
@@ -232,7 +342,10 @@ void RunTest(string testName, OptionParser &op)
     {
 #pragma omp parallel
 	    {
+	      for (int i = omp_get_team_num() * thrds2 + omp_get_thread_num();
+	           i < (omp_get_team_num() + 1) * thrds2; i += omp_get_num_threads()) {
 #include "ratx2.h"
+	      }
 	    }
     }
 
@@ -241,7 +354,10 @@ void RunTest(string testName, OptionParser &op)
     {
 #pragma omp parallel
 	    {
+	      for (int i = omp_get_team_num() * thrds2 + omp_get_thread_num();
+	           i < (omp_get_team_num() + 1) * thrds2; i += omp_get_num_threads()) {
 #include "ratx4.h"
+	      }
 	    }
     }
 
@@ -250,7 +366,10 @@ void RunTest(string testName, OptionParser &op)
     {
 #pragma omp parallel
 	    {
+	      for (int i = omp_get_team_num() * thrds2 + omp_get_thread_num();
+	           i < (omp_get_team_num() + 1) * thrds2; i += omp_get_num_threads()) {
 #include "qssa.h"
+	      }
 	    }
     }
 
@@ -260,7 +379,10 @@ void RunTest(string testName, OptionParser &op)
     {
 #pragma omp parallel
 	    {
+	      for (int i = omp_get_team_num() * thrds2 + omp_get_thread_num();
+	           i < (omp_get_team_num() + 1) * thrds2; i += omp_get_num_threads()) {
 #include "qssab.h"
+	      }
 	    }
     }
     //qssa2_kernel <<< dim3(blks2), dim3(thrds2), 0, s1 >>> ( gpu_rf, gpu_rb, gpu_a);
@@ -268,7 +390,10 @@ void RunTest(string testName, OptionParser &op)
     {
 #pragma omp parallel
 	    {
+	      for (int i = omp_get_team_num() * thrds2 + omp_get_thread_num();
+	           i < (omp_get_team_num() + 1) * thrds2; i += omp_get_num_threads()) {
 #include "qssa2.h"
+	      }
 	    }
     }
 
@@ -277,7 +402,10 @@ void RunTest(string testName, OptionParser &op)
     {
 #pragma omp parallel
 	    {
+	      for (int i = omp_get_team_num() * thrds2 + omp_get_thread_num();
+	           i < (omp_get_team_num() + 1) * thrds2; i += omp_get_num_threads()) {
 #include "rdwdot.h"
+	      }
 	    }
     }
 
@@ -287,7 +415,10 @@ void RunTest(string testName, OptionParser &op)
     {
 #pragma omp parallel
 	    {
+	      for (int i = omp_get_team_num() * thrds2 + omp_get_thread_num();
+	           i < (omp_get_team_num() + 1) * thrds2; i += omp_get_num_threads()) {
 #include "rdwdot2.h"
+	      }
 	    }
     }
 
@@ -295,7 +426,10 @@ void RunTest(string testName, OptionParser &op)
     {
 #pragma omp parallel
 	    {
+	      for (int i = omp_get_team_num() * thrds2 + omp_get_thread_num();
+	           i < (omp_get_team_num() + 1) * thrds2; i += omp_get_num_threads()) {
 #include "rdwdot3.h"
+	      }
 	    }
     }
 
@@ -304,7 +438,10 @@ void RunTest(string testName, OptionParser &op)
     {
 #pragma omp parallel
 	    {
+	      for (int i = omp_get_team_num() * thrds2 + omp_get_thread_num();
+	           i < (omp_get_team_num() + 1) * thrds2; i += omp_get_num_threads()) {
 #include "rdwdot6.h"
+	      }
 	    }
     }
 
@@ -313,7 +450,10 @@ void RunTest(string testName, OptionParser &op)
     {
 #pragma omp parallel
 	    {
+	      for (int i = omp_get_team_num() * thrds2 + omp_get_thread_num();
+	           i < (omp_get_team_num() + 1) * thrds2; i += omp_get_num_threads()) {
 #include "rdwdot7.h"
+	      }
 	    }
     }
 
@@ -322,7 +462,10 @@ void RunTest(string testName, OptionParser &op)
     {
 #pragma omp parallel
 	    {
+	      for (int i = omp_get_team_num() * thrds2 + omp_get_thread_num();
+	           i < (omp_get_team_num() + 1) * thrds2; i += omp_get_num_threads()) {
 #include "rdwdot8.h"
+	      }
 	    }
     }
 
@@ -331,7 +474,10 @@ void RunTest(string testName, OptionParser &op)
     {
 #pragma omp parallel
 	    {
+	      for (int i = omp_get_team_num() * thrds2 + omp_get_thread_num();
+	           i < (omp_get_team_num() + 1) * thrds2; i += omp_get_num_threads()) {
 #include "rdwdot9.h"
+	      }
 	    }
     }
 
@@ -340,31 +486,23 @@ void RunTest(string testName, OptionParser &op)
     {
 #pragma omp parallel
 	    {
+	      for (int i = omp_get_team_num() * thrds2 + omp_get_thread_num();
+	           i < (omp_get_team_num() + 1) * thrds2; i += omp_get_num_threads()) {
 #include "rdwdot10.h"
+	      }
 	    }
     }
     // Approximately 10k flops per grid point (estimated by Ramanan)
   }
-
-  }
-
-  // Print out answers for verification
-  for (int i=0; i<WDOT_SIZE; i++) {
-      printf("% 23.16E ", WDOT[i*n]);
-      if (i % 3 == 2)
-          printf("\n");
+  time = omp_get_wtime() - start;
   }
-  printf("\n");
 
-  free(host_t);
-  free(host_p);
-  free(host_y);
-  free(host_molwt);
   free(RF);
   free(RB);
   free(RKLOW);
   free(C);
   free(A);
   free(EG);
-  free(WDOT);
+  return time;
 }
+#endif
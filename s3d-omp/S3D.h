@@ -189,14 +189,20 @@ t1 polyx(t1 x, t2 c0, t3 c1, t4 c2, t5 c3)
 // Size macros
 // This is the number of floats/doubles per thread for each var
 
+#define A_SIZE    (A_DIM * A_DIM)
+
+#ifdef S3D_MECH
+// Sizes and initial mass fractions of a mechanism generated by mkmech.py
+#include <mech.h>
+#else
 #define C_SIZE               (22)
 #define RF_SIZE             (206)
 #define RB_SIZE             (206)
 #define WDOT_SIZE            (22)
 #define RKLOW_SIZE           (21)
 #define Y_SIZE               (22)
-#define A_SIZE    (A_DIM * A_DIM)
 #define EG_SIZE              (32)
+#endif
 
 
 #endif
@@ -0,0 +1,131 @@
+// Body of the fused chemistry kernel for grid point i.
+//
+// The stage headers are included in the order of the separate kernels in
+// S3D.cpp, but RF, RB, RKLOW, C, A and EG are redirected to per-point
+// arrays, so the intermediates never leave the thread. Only T, P, Y,
+// molwt and WDOT are read from or written to global memory.
+//
+// With S3D_MECH defined the stages come from a directory generated by
+// mkmech.py (see Makefile), which provides mech_chain.h.
+
+    real rf_[RF_SIZE];
+    real rb_[RB_SIZE];
+    real rklow_[RKLOW_SIZE];
+    real c_[C_SIZE];
+    real eg_[EG_SIZE];
+
+#undef C
+#undef RF
+#undef RB
+#undef EG
+#undef RKLOW
+#define C(q)     idx(c_, q)
+#define RF(q)    idx(rf_, q)
+#define RB(q)    idx(rb_, q)
+#define EG(q)    idx(eg_, q)
+#define RKLOW(q) idx(rklow_, q)
+
+#ifdef S3D_MECH
+#include <mech_chain.h>
+#else
+    real a_[A_SIZE];
+#undef A
+#define A(b, c)  idx(a_, (((b)*A_DIM)+c))
+
+    {
+#include "ratt.h"
+    }
+    {
+#include "rdsmh.h"
+    }
+    {
+#include "gr_base.h"
+    }
+    {
+#include "ratt2.h"
+    }
+    {
+#include "ratt3.h"
+    }
+    {
+#include "ratt4.h"
+    }
+    {
+#include "ratt5.h"
+    }
+    {
+#include "ratt6.h"
+    }
+    {
+#include "ratt7.h"
+    }
+    {
+#include "ratt8.h"
+    }
+    {
+#include "ratt9.h"
+    }
+    {
+#include "ratt10.h"
+    }
+    {
+#include "ratx.h"
+    }
+    {
+#include "ratxb.h"
+    }
+    {
+#include "ratx2.h"
+    }
+    {
+#include "ratx4.h"
+    }
+    {
+#include "qssa.h"
+    }
+    {
+#include "qssab.h"
+    }
+    {
+#include "qssa2.h"
+    }
+    {
+#include "rdwdot.h"
+    }
+    {
+#include "rdwdot2.h"
+    }
+    {
+#include "rdwdot3.h"
+    }
+    {
+#include "rdwdot6.h"
+    }
+    {
+#include "rdwdot7.h"
+    }
+    {
+#include "rdwdot8.h"
+    }
+    {
+#include "rdwdot9.h"
+    }
+    {
+#include "rdwdot10.h"
+    }
+
+#undef A
+#define A(b, c)  idx2(A, (((b)*A_DIM)+c) )
+#endif
+
+// restore the global layouts of S3D.h
+#undef C
+#undef RF
+#undef RB
+#undef EG
+#undef RKLOW
+#define C(q)     idx2(C, q)
+#define RF(q)    idx2(RF, q)
+#define RB(q)    idx2(RB, q)
+#define EG(q)    idx2(EG, q)
+#define RKLOW(q) idx2(RKLOW, q)
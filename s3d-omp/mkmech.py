@@ -0,0 +1,454 @@
+#!/usr/bin/env python3
+#
+# Generates the stage headers of the fused S3D chemistry kernel from a
+# mechanism description, so that mechanisms other than the hard-coded one
+# can be evaluated with "make MECH=<file>".
+#
+# The description is a subset of the CHEMKIN-II input format:
+#
+#   SPECIES  <names> END
+#   THERMO   for each species: name molwt Tlow Tmid Thigh, followed by
+#            seven NASA coefficients above Tmid and seven below Tmid
+#            END
+#   REACTIONS [CAL/MOLE | KCAL/MOLE | JOULES/MOLE | KJOULES/MOLE | KELVINS]
+#            <equation> A b E, where the equation has no blanks and uses
+#            <=>, = (reversible) or => (irreversible), "+M" for third
+#            bodies and "(+M)" for fall-off reactions. Auxiliary lines:
+#            NAME/efficiency/ ..., LOW/A b E/, TROE/a T3 T1 [T2]/, DUPLICATE
+#            END
+#   INIT     NAME/mass fraction/ ... END   (optional, default is uniform)
+#
+# Comments start with "!". Units of A are mol, cm, s, as in CHEMKIN.
+#
+# Output (in the given directory):
+#   mech.h        sizes and initial mass fractions, included by S3D.h
+#   mech_chain.h  the stage headers in evaluation order, included by fused.h
+#   ratt.h rdsmh.h gr_base.h ratt2.h ratt10.h ratx.h ratx2.h ratx4.h rdwdot.h
+
+import math
+import os
+import re
+import sys
+
+GAS_CONSTANT = {
+    'CAL/MOLE': 1.98720425864083,
+    'KCAL/MOLE': 1.98720425864083e-3,
+    'JOULES/MOLE': 8.31446261815324,
+    'KJOULES/MOLE': 8.31446261815324e-3,
+    'KELVINS': 1.0,
+}
+
+class MechError(Exception):
+    pass
+
+class Reaction:
+    def __init__(self, equation):
+        self.equation = equation
+        self.reactants = {}
+        self.products = {}
+        self.reversible = True
+        self.third_body = False   # +M
+        self.falloff = None       # None, 'M' or the collider species
+        self.efficiencies = {}
+        self.low = None
+        self.troe = None
+
+def fmt(x):
+    return '%.9e' % x
+
+def strip_comment(line):
+    return line.split('!', 1)[0].strip()
+
+def parse_side(side, species, rxn):
+    stoich = {}
+    m = re.search(r'\(\+([A-Za-z0-9_*()-]*?)\)$', side)
+    if m:
+        rxn.falloff = m.group(1).upper()
+        side = side[:m.start()]
+    for term in side.split('+'):
+        if not term:
+            raise MechError('bad equation ' + rxn.equation)
+        if term.upper() == 'M':
+            rxn.third_body = True
+            continue
+        m = re.match(r'^(\d*)(.+)$', term)
+        nu = int(m.group(1)) if m.group(1) else 1
+        name = m.group(2).upper()
+        if name not in species:
+            raise MechError('unknown species %s in %s' % (name, rxn.equation))
+        stoich[name] = stoich.get(name, 0) + nu
+    return stoich
+
+def parse(fname):
+    species, thermo, reactions, init = [], {}, [], {}
+    units = 'CAL/MOLE'
+    section = None
+    tokens = []
+    with open(fname) as f:
+        lines = [strip_comment(l) for l in f]
+
+    for line in lines:
+        if not line:
+            continue
+        words = line.split()
+        key = words[0].upper()
+        if section is None:
+            if key in ('SPECIES', 'SPEC', 'THERMO', 'REACTIONS', 'REAC', 'INIT'):
+                section = key[:4]
+                if section == 'REAC':
+                    for w in words[1:]:
+                        if w.upper() not in GAS_CONSTANT:
+                            raise MechError('unsupported units ' + w)
+                        units = w.upper()
+                    continue
+                words = words[1:]
+            else:
+                raise MechError('unexpected line: ' + line)
+        if words and words[-1].upper() == 'END':
+            words = words[:-1]
+            done = True
+        else:
+            done = False
+
+        if section == 'SPEC':
+            species += [w.upper() for w in words]
+        elif section == 'THER':
+            tokens += words
+        elif section == 'INIT':
+            for name, value in re.findall(r'([^\s/]+)\s*/([^/]*)/', ' '.join(words)):
+                init[name.upper()] = float(value)
+        elif section == 'REAC' and words:
+            text = ' '.join(words)
+            if re.match(r'^[^\s/]+\s+[-+\d.]', text) and '/' not in words[0]:
+                if len(words) != 4:
+                    raise MechError('expected "equation A b E": ' + text)
+                rxn = Reaction(words[0])
+                m = re.match(r'^(.*?)(<=>|=>|=)(.*)$', words[0])
+                if not m:
+                    raise MechError('bad equation ' + words[0])
+                rxn.reversible = m.group(2) != '=>'
+                rxn.reactants = parse_side(m.group(1), species, rxn)
+                rxn.products = parse_side(m.group(3), species, rxn)
+                rxn.A, rxn.b, rxn.E = [float(w) for w in words[1:]]
+                rxn.E /= GAS_CONSTANT[units]
+                reactions.append(rxn)
+            else:
+                if not reactions:
+                    raise MechError('auxiliary data before first reaction')
+                rxn = reactions[-1]
+                for w in words:
+                    if w.upper() in ('DUPLICATE', 'DUP'):
+                        text = text.replace(w, '')
+                for name, value in re.findall(r'([^\s/]+)\s*/([^/]*)/', text):
+                    name = name.upper()
+                    vals = [float(v) for v in value.split()]
+                    if name == 'LOW':
+                        rxn.low = (vals[0], vals[1], vals[2] / GAS_CONSTANT[units])
+                    elif name == 'TROE':
+                        rxn.troe = vals
+                    elif name in species:
+                        rxn.efficiencies[name] = vals[0]
+                    else:
+                        raise MechError('unknown auxiliary data %s/%s/' % (name, value))
+        if done:
+            section = None
+
+    # thermo: name molwt Tlow Tmid Thigh + 14 coefficients
+    while tokens:
+        if len(tokens) < 19:
+            raise MechError('incomplete thermo data for ' + tokens[0])
+        name = tokens[0].upper()
+        vals = [float(t) for t in tokens[1:19]]
+        thermo[name] = (vals[0], vals[2], vals[4:11], vals[11:18])
+        tokens = tokens[19:]
+
+    for s in species:
+        if s not in thermo:
+            raise MechError('no thermo data for ' + s)
+    for r in reactions:
+        if r.falloff and r.low is None:
+            raise MechError('fall-off reaction without LOW: ' + r.equation)
+        if r.A <= 0.0:
+            raise MechError('non-positive pre-exponential factor: ' + r.equation)
+        if r.low and r.low[0] <= 0.0:
+            raise MechError('non-positive LOW pre-exponential factor: ' + r.equation)
+    return species, thermo, reactions, init
+
+def arrhenius(A, b, E_R):
+    # same shapes as the hand-written ratt.h
+    if E_R == 0.0 and b == 0.0:
+        return fmt(A)
+    if E_R == 0.0 and b == -1.0:
+        return fmt(A) + '*TI'
+    if E_R == 0.0 and b == -2.0:
+        return fmt(A) + '*TI2'
+    expr = fmt(math.log(A))
+    if b != 0.0:
+        expr += ' %+.9e*ALOGT' % b
+    if E_R != 0.0:
+        expr += ' %+.9e*TI' % -E_R
+    return 'EXP(%s)' % expr
+
+def conc_product(stoich, index, macro):
+    terms = []
+    for name, nu in stoich.items():
+        terms += ['%s(%d)' % (macro, index[name])] * nu
+    return terms
+
+def write(path, name, src, lines):
+    with open(os.path.join(path, name), 'w') as f:
+        f.write('// Generated by mkmech.py from %s; do not edit.\n\n' % src)
+        f.write('\n'.join(lines) + '\n')
+
+def generate(fname, out):
+    species, thermo, reactions, init = parse(fname)
+    src = os.path.basename(fname)
+    ns, nr = len(species), len(reactions)
+    index = dict((s, k + 1) for k, s in enumerate(species))
+    falloff = [j for j, r in enumerate(reactions) if r.falloff]
+    if not os.path.isdir(out):
+        os.makedirs(out)
+
+    # mech.h
+    y = [init.get(s, 0.0) for s in species] if init else [1.0 / ns] * ns
+    lines = ['#ifndef MECH_H', '#define MECH_H', '']
+    lines += ['// species: ' + ' '.join('%d %s' % (index[s], s) for s in species), '']
+    for macro, size in (('C_SIZE', ns), ('RF_SIZE', nr), ('RB_SIZE', nr),
+                        ('WDOT_SIZE', ns), ('RKLOW_SIZE', max(1, len(falloff))),
+                        ('Y_SIZE', ns), ('EG_SIZE', ns)):
+        lines.append('#define %-16s(%d)' % (macro, size))
+    lines += ['', '#define MECH_Y_INIT { %s }' % ', '.join(fmt(v) for v in y), '', '#endif']
+    write(out, 'mech.h', src, lines)
+
+    # ratt.h: forward rate coefficients
+    body = []
+    for j, r in enumerate(reactions):
+        body.append('    RF(%d) = %s;' % (j + 1, arrhenius(r.A, r.b, r.E)))
+    text = '\n'.join(body)
+    lines = ['    const real TEMP = T[i]*tconv;']
+    if 'ALOGT' in text:
+        lines.append('    const real ALOGT = LOG(TEMP);')
+    if 'TI' in text:
+        lines.append('    const real TI = 1.0e0/(TEMP);')
+    if 'TI2' in text:
+        lines.append('    const real TI2 = TI*TI;')
+    write(out, 'ratt.h', src, lines + [''] + body)
+
+    # rdsmh.h: exp(-G/RT) of every species from the NASA polynomials
+    lines = ['    const real TEMP = T[i]*tconv;',
+             '    const real TLOG = LOG((TEMP));',
+             '    const real TI = 1.0e0/(TEMP);',
+             '',
+             '    const real TN1 = TLOG - 1.0;']
+    def eg(k, a):
+        return ('        EG(%d) = EXP(%s %+.9e*TI\n'
+                '                    %+.9e*TN1 + polyx (TEMP,\n'
+                '                    %+.9e, %+.9e,\n'
+                '                    %+.9e, %+.9e));'
+                % (k, fmt(a[6]), -a[5], a[0], a[1] / 2, a[2] / 6, a[3] / 12, a[4] / 20))
+    for tmid in sorted(set(thermo[s][1] for s in species)):
+        group = [s for s in species if thermo[s][1] == tmid]
+        lines += ['', '    if ((TEMP) > %s)' % fmt(tmid), '    {']
+        lines += [eg(index[s], thermo[s][2]) for s in group]
+        lines += ['    }', '    else', '    {']
+        lines += [eg(index[s], thermo[s][3]) for s in group]
+        lines += ['    }']
+    write(out, 'rdsmh.h', src, lines)
+
+    # gr_base.h: molar concentrations
+    lines = ['    const real TEMP = T[i]*tconv;',
+             '    const real PRES = P[i]*pconv;',
+             '    const real SMALL = FLT_MIN;',
+             '',
+             '    real SUM, ctmp;',
+             '',
+             '    SUM = 0.0f;',
+             '']
+    for s in species:
+        lines += ['    C(%d) = ctmp = Y(%d)*%s;' % (index[s], index[s], fmt(1.0 / thermo[s][0])),
+                  '    SUM  += ctmp;']
+    lines += ['',
+              '    SUM = DIV (PRES, (SUM * (TEMP) * 8.314510e7));',
+              '',
+              '    for (unsigned k=1; k<=%d; k++) {' % ns,
+              '        C(k) = MAX(C(k), SMALL) * SUM;',
+              '    }']
+    write(out, 'gr_base.h', src, lines)
+
+    # ratt2.h: reverse rate coefficients from the equilibrium constants
+    body = []
+    for j, r in enumerate(reactions):
+        if not r.reversible:
+            body += ['    RB(%d) = 0.0;' % (j + 1), '']
+            continue
+        net = {}
+        for s, nu in r.reactants.items():
+            net[s] = net.get(s, 0) - nu
+        for s, nu in r.products.items():
+            net[s] = net.get(s, 0) + nu
+        num = conc_product(dict((s, -nu) for s, nu in net.items() if nu < 0), index, 'EG')
+        den = conc_product(dict((s, nu) for s, nu in net.items() if nu > 0), index, 'EG')
+        dn = sum(net.values())
+        if dn < 0:
+            num += ['PFAC'] * -dn
+        elif dn > 0:
+            den += ['PFAC'] * dn
+        num = '*'.join(num) if num else '1.0'
+        den = '*'.join(den) if den else '1.0'
+        body += ['    rtemp_inv = DIV ((%s), (%s));' % (num, den),
+                 '    RB(%d) = RF(%d) * MIN(rtemp_inv, SMALL_INV);' % (j + 1, j + 1), '']
+    text = '\n'.join(body)
+    lines = ['    const real TEMP = T[i]*tconv;']
+    if 'rtemp_inv' in text:
+        lines += ['    const real SMALL_INV = 1e37f;']
+    if 'PFAC' in text:
+        lines += ['    const real RU=8.31451e7;',
+                  '    const real PATM = 1.01325e6;',
+                  '    const real PFAC = DIV (PATM, (RU*(TEMP)));']
+    if 'rtemp_inv' in text:
+        lines += ['    real rtemp_inv;']
+    else:
+        lines = []
+    write(out, 'ratt2.h', src, lines + [''] + body)
+
+    chain = ['ratt.h', 'rdsmh.h', 'gr_base.h', 'ratt2.h']
+
+    # ratt10.h: low-pressure limits of the fall-off reactions
+    if falloff:
+        lines = ['    const real TEMP = T[i]*tconv;',
+                 '    const real ALOGT = LOG(TEMP);', '']
+        for m, j in enumerate(falloff):
+            A, b, E_R = reactions[j].low
+            lines.append('    RKLOW(%d) = EXP(%s %+.9e*ALOGT - DIV(%s,TEMP));'
+                         % (m + 1, fmt(math.log(A)), b, fmt(E_R)))
+        write(out, 'ratt10.h', src, lines)
+        chain.append('ratt10.h')
+
+    # ratx.h: third-body concentrations and fall-off corrections
+    ctb_names = {}
+    ctb_lines = []
+    def ctb(r, j):
+        if r.falloff and r.falloff != 'M':
+            return 'C(%d)' % index[r.falloff]
+        key = tuple(sorted(r.efficiencies.items(), key=lambda e: index[e[0]]))
+        if not key:
+            return 'CTOT'
+        if key not in ctb_names:
+            name = 'CTB_%d' % (j + 1)
+            ctb_names[key] = name
+            expr = 'CTOT'
+            for s, eff in key:
+                if eff - 1.0 == 1.0:
+                    expr += ' + C(%d)' % index[s]
+                elif eff - 1.0 == -1.0:
+                    expr += ' - C(%d)' % index[s]
+                elif eff != 1.0:
+                    expr += ' %+.9e*C(%d)' % (eff - 1.0, index[s])
+            ctb_lines.append('    real %s = %s;' % (name, expr))
+        return ctb_names[key]
+
+    body = []
+    troe = False
+    for j, r in enumerate(reactions):
+        if r.third_body:
+            name = ctb(r, j)
+            body += ['    RF(%d) = RF(%d)*%s;' % (j + 1, j + 1, name),
+                     '    RB(%d) = RB(%d)*%s;' % (j + 1, j + 1, name), '']
+        elif r.falloff:
+            name = ctb(r, j)
+            body += ['    PR = RKLOW(%d) * DIV(%s, RF(%d));' % (falloff.index(j) + 1, name, j + 1),
+                     '    PCOR = DIV(PR, (1.0 + PR));']
+            if r.troe:
+                troe = True
+                a, T3, T1 = r.troe[:3]
+                fcent = ('%s*EXP(DIV(-TEMP,%s)) + %s*EXP(DIV(-TEMP,%s))'
+                         % (fmt(1.0 - a), fmt(T3), fmt(a), fmt(T1)))
+                if len(r.troe) > 3:
+                    fcent += '\n    + EXP(DIV(%s,TEMP))' % fmt(-r.troe[3])
+                body += ['    PRLOG = LOG10(MAX(PR,SMALL));',
+                         '    FCENT = %s;' % fcent,
+                         '    FCLOG = LOG10(MAX(FCENT,SMALL));',
+                         '    XN    = 0.75 - 1.27*FCLOG;',
+                         '    CPRLOG= PRLOG - (0.4 + 0.67*FCLOG);',
+                         '    SQR = DIV(CPRLOG, (XN-0.14*CPRLOG));',
+                         '    FLOG = DIV(FCLOG, (1.0 + SQR*SQR));',
+                         '    FC = EXP10(FLOG);',
+                         '    PCOR = FC * PCOR;']
+            body += ['    RF(%d) = RF(%d) * PCOR;' % (j + 1, j + 1),
+                     '    RB(%d) = RB(%d) * PCOR;' % (j + 1, j + 1), '']
+    if body:
+        text = '\n'.join(body + ctb_lines)
+        lines = []
+        if troe:
+            lines.append('    const real TEMP = T[i]*tconv;')
+        if 'CTOT' in text:
+            lines += ['    real CTOT = 0.0;']
+        if falloff:
+            lines += ['    real PR, PCOR;']
+        if troe:
+            lines += ['    real PRLOG, FCENT, FCLOG, XN;',
+                      '    real CPRLOG, FLOG, FC, SQR;',
+                      '    const real SMALL = FLT_MIN;']
+        if 'CTOT' in text:
+            lines += ['',
+                      '    for (unsigned int k=1; k<=%d; k++) {' % ns,
+                      '        CTOT += C(k);',
+                      '    }']
+        write(out, 'ratx.h', src, lines + [''] + ctb_lines + [''] + body)
+        chain.append('ratx.h')
+
+    # ratx2.h / ratx4.h: multiply by the reactant / product concentrations
+    lines = []
+    for j, r in enumerate(reactions):
+        lines.append('    RF(%d) = RF(%d)*%s;' % (j + 1, j + 1,
+                     '*'.join(conc_product(r.reactants, index, 'C'))))
+    write(out, 'ratx2.h', src, lines)
+    lines = []
+    for j, r in enumerate(reactions):
+        if r.reversible:
+            lines.append('    RB(%d) = RB(%d)*%s;' % (j + 1, j + 1,
+                         '*'.join(conc_product(r.products, index, 'C'))))
+    write(out, 'ratx4.h', src, lines)
+    chain += ['ratx2.h', 'ratx4.h']
+
+    # rdwdot.h: net production rates
+    lines = []
+    for s in species:
+        terms = []
+        for j, r in enumerate(reactions):
+            nu = r.products.get(s, 0) - r.reactants.get(s, 0)
+            if nu > 0:
+                terms += ['+ROP2(%d)' % (j + 1)] * nu
+            elif nu < 0:
+                terms += ['-ROP2(%d)' % (j + 1)] * -nu
+        k = index[s]
+        if not terms:
+            lines += ['    WDOT(%d) = 0.0;' % k, '']
+            continue
+        rows = [' '.join(terms[n:n + 4]) for n in range(0, len(terms), 4)]
+        lines.append('    WDOT(%d) = (%s' % (k, '\n            '.join(rows))
+                     + ')*rateconv *molwt[%d];' % (k - 1))
+        lines.append('')
+    write(out, 'rdwdot.h', src, lines)
+    chain.append('rdwdot.h')
+
+    lines = []
+    for h in chain:
+        lines += ['    {', '#include "%s"' % h, '    }']
+    write(out, 'mech_chain.h', src, lines)
+    return ns, nr
+
+def main(argv):
+    if len(argv) != 3:
+        print('Usage: %s <mechanism file> <output directory>' % argv[0])
+        return 2
+    try:
+        ns, nr = generate(argv[1], argv[2])
+    except (MechError, IOError, ValueError) as e:
+        print('%s: %s' % (argv[1], e))
+        return 1
+    print('%s: %d species, %d reactions -> %s' % (argv[1], ns, nr, argv[2]))
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
@@ -44,6 +44,7 @@ typedef struct{
 	int egroups;
 	int nthreads;
 	int repeat;
+	int sorted; // Sweep FSR-sorted segments with segmented tally reductions
 	size_t nbytes;
 } Input;
 
@@ -86,6 +87,10 @@ SIMD_Vectors aligned_allocate_simd_vectors(Input * I);
 SIMD_Vectors allocate_simd_vectors(Input * I);
 double get_time(void);
 
+// main.c
+int sort_segments( Input * I, const int * QSR_id_arr, const int * FAI_id_arr,
+		int * QSR_sorted, int * FAI_sorted, int * run_start );
+
 // io.c
 void logo(int version);
 void center_print(const char *s, int width);
@@ -16,6 +16,7 @@ Input * set_default_input( void )
 #endif
   I->egroups = 128;
   I->repeat = 1;
+  I->sorted = 0;
   return I;
 }
 
@@ -76,6 +76,7 @@ void print_input_summary(Input * I)
 	printf("%-25s%d\n", "Number of Threads:", I->nthreads);
 	#endif
 	printf("%-25s%d\n", "Kernel execution times:", I->repeat);
+	printf("%-25s%s\n", "Segment Sweep:", I->sorted ? "FSR-sorted" : "unsorted");
 	printf("%-25s%d\n", "Energy Groups:", I->egroups);
 	printf("%-25s%d\n", "2D Source Regions:", I->source_2D_regions);
 	printf("%-25s%d\n", "Coarse Axial Intervals:", I->coarse_axial_intervals);
@@ -139,6 +140,18 @@ void read_CLI( int argc, char * argv[], Input * input )
 				input->repeat = 1;
 #else
 				input->repeat = atoi(argv[i]);
+#endif
+			else
+				print_CLI_error();
+		}
+		// sorted sweep (-m)
+		else if( strcmp(arg, "-m") == 0 )
+		{
+			if( ++i < argc )
+#ifdef VERIFY
+				input->sorted = 0;
+#else
+				input->sorted = atoi(argv[i]);
 #endif
 			else
 				print_CLI_error();
@@ -162,6 +175,8 @@ void print_CLI_error(void)
 	printf("  -s <segments>       Number of segments to process\n");
 	printf("  -e <energy groups>  Number of energy groups\n");
 	printf("  -n <kernel runs>    Number of kernel execution on a device (GPU)\n");
+	printf("  -m <mode>           0: unsorted segments (default)\n");
+	printf("                      1: FSR-sorted segments, segmented tally reduction\n");
 	exit(1);
 }
 
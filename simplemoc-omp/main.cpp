@@ -274,83 +274,119 @@ void attenuate_segment( Input * __restrict I, Source * __restrict S,
 }  
 
 
-int main( int argc, char * argv[] )
+// Counting sort of the segments by fine source region (QSR_id, FAI_id).
+// The sort is stable, so segments of a region keep their generation order.
+// run_start receives the first sorted segment of every non-empty region
+// followed by the total number of segments; the number of runs is returned.
+int sort_segments( Input * I, const int * QSR_id_arr, const int * FAI_id_arr,
+    int * QSR_sorted, int * FAI_sorted, int * run_start )
 {
-  unsigned int seed = 2;
-
-  srand(seed);
-
-  // Get Inputs
-  Input * I = set_default_input();
-  read_CLI( argc, argv, I );
-
-  // Calculate Number of 3D Source Regions
-  I->source_3D_regions = (int) ceil((double)I->source_2D_regions *
-      I->coarse_axial_intervals / I->decomp_assemblies_ax);
-
-  logo(4); // Based on the 4th version
-
-  // Build Source data (needed when verification is disabled)
-  Source *S = initialize_sources(I); 
-
-  // Build Device data from Source data
-  Source *S2 = copy_sources(I, S); 
+  const int fsr = I->source_3D_regions * I->fine_axial_intervals;
+  int * count = (int *) calloc( fsr + 1, sizeof(int) );
 
-  print_input_summary(I);
-
-  center_print("SIMULATION", 79);
-  border_print();
-  printf("Attentuating fluxes across segments...\n");
+  for( long i = 0; i < I->segments; i++ )
+    count[QSR_id_arr[i] * I->fine_axial_intervals + FAI_id_arr[i] + 1]++;
 
-  // Run Simulation Kernel Loop
+  int runs = 0;
+  for( int r = 0; r < fsr; r++ ) {
+    if( count[r+1] > 0 ) run_start[runs++] = count[r];
+    count[r+1] += count[r];
+  }
+  run_start[runs] = count[fsr];
 
-  // Host allocation
-  SIMD_Vectors simd_vecs = allocate_simd_vectors(I);
+  for( long i = 0; i < I->segments; i++ ) {
+    int pos = count[QSR_id_arr[i] * I->fine_axial_intervals + FAI_id_arr[i]]++;
+    QSR_sorted[pos] = QSR_id_arr[i];
+    FAI_sorted[pos] = FAI_id_arr[i];
+  }
 
-  float * state_flux = (float *) malloc(I->egroups * sizeof(float));
+  free(count);
+  return runs;
+}
 
-  // Device allocation
-  float * state_flux_device = NULL;
-  posix_memalign( (void**)&state_flux_device, 1024, I->egroups * sizeof(float));
+#pragma omp declare target
+// Attenuates the segments [first, last) of one fine source region in a
+// single energy group and returns the summed tally. All intermediate values
+// live in registers of the calling thread, and the angular flux is carried
+// from segment to segment in sorted order, so the result does not depend
+// on how the runs are scheduled.
+static inline float sweep_fsr_group( const float * fine_source,
+    const float * sigT_acc, const float * state_flux, int QSR_id, int FAI_id,
+    int first, int last, int fine_axial_intervals, int egroups, int g )
+{
+  const float dz = 0.1f;
+  const float zin = 0.3f; 
+  const float weight = 0.5f;
+  const float mu = 0.9f;
+  const float mu2 = 0.3f;
+  const float ds = 0.7f;
 
-  int* QSR_id_arr = NULL;
-  int* FAI_id_arr = NULL;
-  posix_memalign( (void**)&QSR_id_arr, 1024, sizeof(int) * I->segments );
-  posix_memalign( (void**)&FAI_id_arr, 1024, sizeof(int) * I->segments );
+  const float * f = fine_source + (QSR_id * fine_axial_intervals + FAI_id) * egroups + g;
 
-  // initialize the state flux 
-  for( int i = 0; i < I->egroups; i++ ) {
-    state_flux_device[i] = rand_r(&seed) / (float) RAND_MAX;
-    state_flux[i] = state_flux_device[i];
+  float q0, q1, q2;
+  if( FAI_id == 0 )
+  {
+    const float y2 = f[0];
+    const float y3 = f[egroups];
+    const float c1 = (y3 - y2) / dz;
+    q0 = y2 + c1*zin;
+    q1 = c1;
+    q2 = 0;
   }
-
-  // Verification is performed for one segment;
-  // Attentate segment is not run on CPU to reduce simulation time
-  for( long i = 0; i < I->segments; i++ )
+  else if ( FAI_id == fine_axial_intervals - 1 )
   {
-    // Pick Random QSR
-    int QSR_id = rand_r(&seed) % I->source_3D_regions;
-
-    // for device
-    QSR_id_arr[i] = QSR_id;
-
-    // Pick Random Fine Axial Interval
-    int FAI_id = rand_r(&seed) % I->fine_axial_intervals;
-
-    // for device
-    FAI_id_arr[i] = FAI_id;
-
-    // Attenuate Segment for one segment
-#ifdef VERIFY
-    attenuate_segment( I, S, QSR_id, FAI_id, state_flux, &simd_vecs);
-#endif
+    const float y1 = f[-egroups];
+    const float y2 = f[0];
+    const float c1 = (y2 - y1) / dz;
+    q0 = y2 + c1*zin;
+    q1 = c1;
+    q2 = 0;
+  }
+  else
+  {
+    const float y1 = f[-egroups];
+    const float y2 = f[0];
+    const float y3 = f[egroups];
+    const float c1 = (y1 - y3) / (2.f*dz);
+    const float c2 = (y1 - 2.f*y2 + y3) / (2.f*dz*dz);
+    q0 = y2 + c1*zin + c2*zin*zin;
+    q1 = c1 + 2.f*c2*zin;
+    q2 = c2;
   }
 
-  float* simd_vecs_debug = (float*) malloc (sizeof(float)*I->egroups*14);
+  // terms that only depend on the source region
+  const float sigT = sigT_acc[QSR_id * egroups + g];
+  const float tau = sigT * ds;
+  const float sigT2 = sigT * sigT;
+  const float expVal = 1.f - expf( -tau );
+  const float reuse = tau * (tau - 2.f) + 2.f * expVal / (sigT * sigT2); 
 
-  double start = get_time();
+  float psi = state_flux[g];
+  float sum = 0.f;
+  for( int s = first; s < last; s++ )
+  {
+    const float flux_integral = (q0 * tau + (sigT * psi - q0) * expVal) / sigT2
+      + q1 * mu * reuse + q2 * mu2 
+      * (tau * (tau * (tau - 3.f) + 6.f) - 6.f * expVal) 
+      / (3.f * sigT2 * sigT2);
+    sum += weight * flux_integral;
+
+    const float t1 = q0 * expVal / sigT;  
+    const float t2 = q1 * mu * (tau - expVal) / sigT2; 
+    const float t3 = q2 * mu2 * reuse;
+    const float t4 = psi * (1.f - expVal);
+    psi = t1 + t2 + t3 + t4;
+  }
+  return sum;
+}
+#pragma omp end declare target
 
 
+// Original sweep: every segment attenuates through the shared state flux
+// and scratch vectors, and tallies into its region without atomics
+static void unsorted_sweep( Input * I, Source * S2, float * state_flux_device,
+    int * QSR_id_arr, int * FAI_id_arr, float * simd_vecs_debug )
+{
   int fine_axial_intervals = I->fine_axial_intervals;
   int egroups = I->egroups;
   int segments = I->segments;
@@ -508,13 +544,214 @@ int main( int argc, char * argv[] )
     }
 #ifdef VERIFY
 #pragma omp target update from (v_acc[0:14*egroups])
+#endif
+  }
+}
+// Race-free sweep: segments are sorted by fine source region, one thread
+// handles one energy group of one region and reduces the tallies of the
+// region's segments in registers before a single update of the flux.
+// The state flux is read-only, every run starts from it.
+static void sorted_sweep( Input * I, Source * S2, float * state_flux_device,
+    int * QSR_sorted, int * FAI_sorted, int * run_start, int runs )
+{
+  int fine_axial_intervals = I->fine_axial_intervals;
+  int egroups = I->egroups;
+  int segments = I->segments;
+  int source_3D_regions = I->source_3D_regions;
+
+  int* FAI_id_acc = FAI_sorted;
+  int* QSR_id_acc = QSR_sorted;
+  int* run_start_acc = run_start;
+  float* fine_flux_acc = S2->fine_flux;
+  float* fine_source_acc = S2->fine_source;
+  float* sigT_acc = S2->sigT;
+  float* state_flux_acc = state_flux_device;
+
+#pragma omp target data map(to: QSR_id_acc[0:segments], \
+                                FAI_id_acc[0:segments], \
+                                run_start_acc[0:runs+1], \
+                                sigT_acc[0:source_3D_regions*egroups], \
+                                fine_source_acc[0:source_3D_regions*fine_axial_intervals*egroups], \
+                                state_flux_acc[0:egroups]) \
+                        map(tofrom: fine_flux_acc[0:source_3D_regions*fine_axial_intervals*egroups])
+  {
+    for (int n = 0; n < I->repeat; n++) {
+
+      #pragma omp target teams distribute parallel for collapse(2) thread_limit(128)
+      for (int r = 0; r < runs; r++) {
+        for (int g = 0; g < egroups; g++) {
+          const int first = run_start_acc[r];
+          const int last = run_start_acc[r+1];
+          const int QSR_id = QSR_id_acc[first];
+          const int FAI_id = FAI_id_acc[first];
+
+          const float sum = sweep_fsr_group(fine_source_acc, sigT_acc, state_flux_acc,
+              QSR_id, FAI_id, first, last, fine_axial_intervals, egroups, g);
+
+          fine_flux_acc[(QSR_id * fine_axial_intervals + FAI_id) * egroups + g] += sum;
+        }
+      }
+    }
+  }
+}
+
+// Serial reference of the sorted sweep built on the host attenuate_segment:
+// the segments of each region are attenuated one by one in sorted order,
+// starting from the initial state flux. The device flux after the sweep is
+// compared with the initial flux plus repeat times the reference tallies.
+static bool verify_sorted_sweep( Input * I, Source * S2, const float * init_flux,
+    const float * state_flux_init, const int * QSR_sorted, const int * FAI_sorted,
+    const int * run_start, int runs )
+{
+  const int fai = I->fine_axial_intervals;
+  const int egroups = I->egroups;
+  const long fsr_size = (long)I->source_3D_regions * fai * egroups;
+
+  float * ref_flux = (float *) calloc( fsr_size, sizeof(float) );
+  Source * R = (Source *) malloc( I->source_3D_regions * sizeof(Source) );
+  for( int i = 0; i < I->source_3D_regions; i++ ) {
+    R[i].fine_source = S2->fine_source + (long)i * fai * egroups;
+    R[i].fine_flux = ref_flux + (long)i * fai * egroups;
+    R[i].sigT = S2->sigT + (long)i * egroups;
+  }
+
+  SIMD_Vectors simd_vecs = allocate_simd_vectors(I);
+  float * psi = (float *) malloc( egroups * sizeof(float) );
+
+  for( int r = 0; r < runs; r++ ) {
+    memcpy( psi, state_flux_init, egroups * sizeof(float) );
+    for( int s = run_start[r]; s < run_start[r+1]; s++ )
+      attenuate_segment( I, R, QSR_sorted[s], FAI_sorted[s], psi, &simd_vecs );
+  }
+
+  bool ok = true;
+  double max_err = 0.0;
+  for( long i = 0; i < fsr_size; i++ ) {
+    const double expect = init_flux[i] + (double)I->repeat * ref_flux[i];
+    const double err = fabs( S2->fine_flux[i] - expect ) / fmax( 1.0, fabs(expect) );
+    if( err > max_err ) max_err = err;
+    if( err > 1e-3 ) ok = false;
+  }
+  printf("%-25s%.3e\n", "Max Relative Error:", max_err);
+
+  free(psi);
+  free(simd_vecs.q0);
+  free(R);
+  free(ref_flux);
+  return ok;
+}
+
+int main( int argc, char * argv[] )
+{
+  unsigned int seed = 2;
+
+  srand(seed);
+
+  // Get Inputs
+  Input * I = set_default_input();
+  read_CLI( argc, argv, I );
+
+  // Calculate Number of 3D Source Regions
+  I->source_3D_regions = (int) ceil((double)I->source_2D_regions *
+      I->coarse_axial_intervals / I->decomp_assemblies_ax);
+
+  logo(4); // Based on the 4th version
+
+  // Build Source data (needed when verification is disabled)
+  Source *S = initialize_sources(I); 
+
+  // Build Device data from Source data
+  Source *S2 = copy_sources(I, S); 
+
+  print_input_summary(I);
+
+  center_print("SIMULATION", 79);
+  border_print();
+  printf("Attentuating fluxes across segments...\n");
+
+  // Run Simulation Kernel Loop
+
+  // Host allocation
+  SIMD_Vectors simd_vecs = allocate_simd_vectors(I);
+
+  float * state_flux = (float *) malloc(I->egroups * sizeof(float));
+
+  // Device allocation
+  float * state_flux_device = NULL;
+  posix_memalign( (void**)&state_flux_device, 1024, I->egroups * sizeof(float));
+
+  int* QSR_id_arr = NULL;
+  int* FAI_id_arr = NULL;
+  posix_memalign( (void**)&QSR_id_arr, 1024, sizeof(int) * I->segments );
+  posix_memalign( (void**)&FAI_id_arr, 1024, sizeof(int) * I->segments );
+
+  // initialize the state flux 
+  for( int i = 0; i < I->egroups; i++ ) {
+    state_flux_device[i] = rand_r(&seed) / (float) RAND_MAX;
+    state_flux[i] = state_flux_device[i];
+  }
+
+  // Verification is performed for one segment;
+  // Attentate segment is not run on CPU to reduce simulation time
+  for( long i = 0; i < I->segments; i++ )
+  {
+    // Pick Random QSR
+    int QSR_id = rand_r(&seed) % I->source_3D_regions;
+
+    // for device
+    QSR_id_arr[i] = QSR_id;
+
+    // Pick Random Fine Axial Interval
+    int FAI_id = rand_r(&seed) % I->fine_axial_intervals;
+
+    // for device
+    FAI_id_arr[i] = FAI_id;
+
+    // Attenuate Segment for one segment
+#ifdef VERIFY
+    attenuate_segment( I, S, QSR_id, FAI_id, state_flux, &simd_vecs);
 #endif
   }
 
+
+  // Sorted segments and the first segment of every fine source region
+  int* QSR_sorted = NULL;
+  int* FAI_sorted = NULL;
+  int* run_start = NULL;
+  float* init_flux = NULL;
+  int runs = 0;
+  if( I->sorted ) {
+    const long fsr_size = (long)I->source_3D_regions * I->fine_axial_intervals * I->egroups;
+    posix_memalign( (void**)&QSR_sorted, 1024, sizeof(int) * I->segments );
+    posix_memalign( (void**)&FAI_sorted, 1024, sizeof(int) * I->segments );
+    run_start = (int*) malloc( sizeof(int) * ((long)I->source_3D_regions * I->fine_axial_intervals + 1) );
+    runs = sort_segments( I, QSR_id_arr, FAI_id_arr, QSR_sorted, FAI_sorted, run_start );
+    init_flux = (float*) malloc( sizeof(float) * fsr_size );
+    memcpy( init_flux, S2->fine_flux, sizeof(float) * fsr_size );
+  }
+
+  float* simd_vecs_debug = (float*) malloc (sizeof(float)*I->egroups*14);
+
+  double start = get_time();
+
+  if( I->sorted )
+    sorted_sweep( I, S2, state_flux_device, QSR_sorted, FAI_sorted, run_start, runs );
+  else
+    unsorted_sweep( I, S2, state_flux_device, QSR_id_arr, FAI_id_arr, simd_vecs_debug );
+
   printf("Simulation Complete.\n");
   double stop = get_time();
 
+  if( I->sorted ) {
+    if( verify_sorted_sweep( I, S2, init_flux, state_flux_device, QSR_sorted, FAI_sorted,
+          run_start, runs ) )
+      printf("Success\n");
+    else
+      printf("Fail\n");
+  }
+
 #ifdef VERIFY
+  const int egroups = I->egroups;
   const float* q0 = simd_vecs_debug;
   const float* q1 = simd_vecs_debug + egroups;
   const float* q2 = simd_vecs_debug + egroups * 2;
@@ -576,6 +813,10 @@ int main( int argc, char * argv[] )
   free(QSR_id_arr);
   free(FAI_id_arr);
   free(state_flux_device);
+  free(QSR_sorted);
+  free(FAI_sorted);
+  free(run_start);
+  free(init_flux);
 
   free(S2->fine_source);
   free(S2->fine_flux);
@@ -5,19 +5,32 @@
 #include <fstream>
 #include <vector>
 #include <chrono>
+#include <algorithm>
 #include <omp.h>
 
-typedef unsigned int T;
+// Payload type of the key-value sort
+typedef unsigned int V;
 
-template<typename T>
-struct vec4 {
-  T x;
-  T y;
-  T z;
-  T w;
-};
+// Key types
+enum { KEY_U32 = 0, KEY_U64 = 1, KEY_F32 = 2 };
 
-bool verifySort(const T *keys, const size_t size)
+// Map the bits of a float to an unsigned int whose order is the order
+// of the floats: flip all the bits of a negative number and only the
+// sign bit of a positive number.
+#pragma omp declare target
+inline unsigned int float_flip(unsigned int u)
+{
+  return u ^ ((u >> 31) ? 0xFFFFFFFFU : 0x80000000U);
+}
+
+inline unsigned int float_unflip(unsigned int u)
+{
+  return u ^ ((u >> 31) ? 0x80000000U : 0xFFFFFFFFU);
+}
+#pragma omp end declare target
+
+template <typename K>
+bool verifySort(const K *keys, const V *vals, const K *ref, const size_t size)
 {
   bool passed = true;
 
@@ -32,6 +45,24 @@ bool verifySort(const T *keys, const size_t size)
 #endif
     }
   }
+
+  // Each payload is the input index of its key, and the sort is stable
+  if (vals != NULL)
+  {
+    for (size_t i = 0; i < size; i++)
+    {
+      if (vals[i] >= size || !(ref[vals[i]] == keys[i]) ||
+          (i > 0 && keys[i - 1] == keys[i] && vals[i - 1] >= vals[i]))
+      {
+        passed = false;
+#ifdef VERBOSE_OUTPUT
+        std::cout << "Idx: " << i;
+        std::cout << " Value: " << vals[i] << "\n";
+#endif
+      }
+    }
+  }
+
   std::cout << "Test ";
   if (passed)
     std::cout << "Passed" << std::endl;
@@ -41,82 +72,74 @@ bool verifySort(const T *keys, const size_t size)
   return passed;
 }
 
-int main(int argc, char** argv) 
+// LSD radix sort of size keys of an unsigned integer type K, with an
+// optional payload (KV), radix_width bits per pass. The keys and values
+// are sorted in place; keys_tmp and vals_tmp are scratch buffers.
+template <typename K, int radix_width, bool KV>
+double radixSort(K *keys, V *vals, K *keys_tmp, V *vals_tmp,
+                 const size_t size, const int passes, const bool float_keys)
 {
+  // Number of possible digits
+  const int num_digits = 1 << radix_width;
+  const K digit_mask = (K)(num_digits - 1);
 
-  if (argc != 3) 
-  {
-    printf("Usage: %s <problem size> <number of passes>\n.", argv[0]);
-    return -1;
-  }
+  // The number of digit passes is even, so the sorted keys end up
+  // back in the input buffer
+  static_assert((sizeof(K) * 8 / radix_width) % 2 == 0, "odd number of digit passes");
 
-  int select = atoi(argv[1]);
-  int passes = atoi(argv[2]);
+  // Number of local work items per group. The bottom scan keeps a
+  // 16-bit count per digit and work item in local memory.
+  const int local_wsize = (num_digits > 16) ? 64 : 256;
+  const int items_per_thread = (num_digits > 16) ? 16 : 4;
 
-  // Problem Sizes
-  int probSizes[4] = { 1, 8, 32, 64 };
-  size_t size = probSizes[select];
-
-  // Convert to MiB
-  size = (size * 1024 * 1024) / sizeof(T);
+  // Number of work groups grows with the input, with at least
+  // 16 windows of the bottom scan per group
+  const size_t max_work_groups = 1024;
+  const size_t group_size = (size_t)local_wsize * items_per_thread * 16;
+  const size_t num_work_groups = std::min(max_work_groups,
+      std::max((size_t)1, (size + group_size - 1) / group_size));
 
-  // Create input data on CPU
-  unsigned int bytes = size * sizeof(T);
+  std::cout << "Radix width " << radix_width << ", " << sizeof(K) * 8
+            << "-bit keys" << (float_keys ? " (float)" : "")
+            << (KV ? " with payload" : "") << ", " << num_work_groups
+            << " work groups" << std::endl;
 
-  T* idata = (T*) malloc (bytes); 
-  T* odata = (T*) malloc (bytes); 
-
-  // Initialize host memory
-  std::cout << "Initializing host memory." << std::endl;
-  for (int i = 0; i < size; i++)
-  {
-    idata[i] = i % 16; // Fill with some pattern
-    odata[i] = -1;
-  }
-
-  std::cout << "Running benchmark with input array length " << size << std::endl;
+  unsigned int* isums = (unsigned int*) malloc (sizeof(unsigned int) * num_work_groups * num_digits);
 
   auto start = std::chrono::steady_clock::now();
 
-  // Number of local work items per group
-  const size_t local_wsize  = 256;
-  // Number of global work items
-  const size_t global_wsize = 16384; 
-  // 64 work groups
-  const size_t num_work_groups = global_wsize / local_wsize;
-
-  // The radix width in bits
-  const int radix_width = 4; // Changing this requires major kernel updates
-  //const int num_digits = (int)pow((double)2, radix_width); // n possible digits
-  const int num_digits = 16;
-
-  T* isums = (T*) malloc (sizeof(T) * num_work_groups * num_digits);
-
-#pragma omp target data map(to: idata[0:size]) \
-                        map(from: odata[0:size]) \
+#pragma omp target data map(tofrom: keys[0:size]) \
+                        map(alloc: keys_tmp[0:size]) \
                         map(alloc: isums[0:num_work_groups * num_digits])
   {
+#pragma omp target data map(tofrom: vals[0:KV ? size : 0]) \
+                        map(alloc: vals_tmp[0:KV ? size : 0])
+    {
+    if (float_keys)
+    {
+      #pragma omp target teams distribute parallel for thread_limit(256)
+      for (size_t i = 0; i < size; i++)
+        keys[i] = float_flip(keys[i]);
+    }
+
     for (int k = 0; k < passes; k++)
     {
-      // Assuming an 8 bit byte.
-      for (unsigned int shift = 0; shift < sizeof(T)*8; shift += radix_width)
+      for (int shift = 0; shift < (int)sizeof(K)*8; shift += radix_width)
       {
         // Like scan, we use a reduce-then-scan approach
 
-        // But before proceeding, update the shift appropriately
-        // for each kernel. This is how many bits to shift to the
-        // right used in binning.
-
-        // Also, the sort is not in place, so swap the input and output
+        // The sort is not in place, so swap the input and output
         // buffers on each pass.
         bool even = ((shift / radix_width) % 2 == 0) ? true : false;
 
-        T *in = even ? idata : odata;
-        T *out = even ? odata : idata;
+        K *in = even ? keys : keys_tmp;
+        K *out = even ? keys_tmp : keys;
+        V *vin = even ? vals : vals_tmp;
+        V *vout = even ? vals_tmp : vals;
 
 #pragma omp target teams num_teams(num_work_groups) thread_limit(local_wsize)
         {
-          T lmem[local_wsize];
+          unsigned int l_hist[num_digits];
 #pragma omp parallel
           {
 #include "sort_reduce.h"
@@ -125,14 +148,14 @@ int main(int argc, char** argv)
 
 #ifdef DEBUG
 #pragma omp target update from (isums[0:num_work_groups * num_digits])
-        for (int i = 0; i < num_work_groups * num_digits; i++)
+        for (size_t i = 0; i < num_work_groups * num_digits; i++)
           printf("reduce: %d: %d\n", shift, isums[i]);
 #endif
 
-#pragma omp target teams num_teams(num_work_groups) thread_limit(local_wsize)
+        // A single group scans the block counts of all digits
+#pragma omp target teams num_teams(1) thread_limit(256)
         {
-          T lmem[local_wsize*2];
-          T s_seed;
+          unsigned int l_totals[num_digits];
 #pragma omp parallel
           {
 #include "sort_top_scan.h"
@@ -141,15 +164,16 @@ int main(int argc, char** argv)
 
 #ifdef DEBUG
 #pragma omp target update from (isums[0:num_work_groups * num_digits])
-        for (int i = 0; i < num_work_groups * num_digits; i++)
+        for (size_t i = 0; i < num_work_groups * num_digits; i++)
           printf("top-scan: %d: %d\n", shift, isums[i]);
 #endif
 
 #pragma omp target teams num_teams(num_work_groups) thread_limit(local_wsize)
         {
-          T lmem[local_wsize*2];
-          T l_scanned_seeds[16];
-          T l_block_counts[16];
+          unsigned short l_counts[num_digits * local_wsize];
+          unsigned int l_scanned_seeds[num_digits];
+          unsigned int l_block_counts[num_digits];
+          unsigned int l_totals[num_digits];
 #pragma omp parallel
           {
 #include "sort_bottom_scan.h"
@@ -157,21 +181,121 @@ int main(int argc, char** argv)
         }
       }
     }  // passes
-  }
 
+    if (float_keys)
+    {
+      #pragma omp target teams distribute parallel for thread_limit(256)
+      for (size_t i = 0; i < size; i++)
+        keys[i] = float_unflip(keys[i]);
+    }
+    }
+  }
 
   auto end = std::chrono::steady_clock::now();
   auto t = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
-  double second = t / 1.e9; // Convert to seconds
+
+  free(isums);
+  return t / 1.e9; // Convert to seconds
+}
+
+template <typename K, int radix_width, bool KV>
+bool run(const size_t size, const int passes, const bool float_keys)
+{
+  K* keys = (K*) malloc (size * sizeof(K));
+  K* keys_tmp = (K*) malloc (size * sizeof(K));
+  K* ref = (K*) malloc (size * sizeof(K));
+  V* vals = KV ? (V*) malloc (size * sizeof(V)) : NULL;
+  V* vals_tmp = KV ? (V*) malloc (size * sizeof(V)) : NULL;
+
+  // Initialize host memory
+  std::cout << "Initializing host memory." << std::endl;
+  srand(123);
+  for (size_t i = 0; i < size; i++)
+  {
+    if (float_keys)
+    {
+      float f = (rand() / (float)RAND_MAX - 0.5f) * 2e6f;
+      memcpy(&keys[i], &f, sizeof(float));
+    }
+    else
+    {
+      // 16 random bits per digit group; fill the key from the top
+      K k = 0;
+      for (size_t b = 0; b < sizeof(K); b += 2)
+        k = (k << 16) | (K)(rand() & 0xFFFF);
+      keys[i] = k;
+    }
+    ref[i] = keys[i];
+    if (KV) vals[i] = i;
+  }
+
+  std::cout << "Running benchmark with input array length " << size << std::endl;
+
+  double second = radixSort<K, radix_width, KV>(keys, vals, keys_tmp, vals_tmp,
+                                                size, passes, float_keys);
   printf("Total elapsed time %.3f (s)\n", second);
+  printf("Throughput %.3f (Mkeys/s)\n", size * passes / second * 1e-6);
+
+  bool ok;
+  if (float_keys)
+    ok = verifySort((const float*)keys, vals, (const float*)ref, size);
+  else
+    ok = verifySort(keys, vals, ref, size);
+
+  free(keys);
+  free(keys_tmp);
+  free(ref);
+  free(vals);
+  free(vals_tmp);
+  return ok;
+}
+
+template <typename K, bool KV>
+bool run(const size_t size, const int passes, const int radix_width, const bool float_keys)
+{
+  return radix_width == 8 ? run<K, 8, KV>(size, passes, float_keys)
+                          : run<K, 4, KV>(size, passes, float_keys);
+}
+
+int main(int argc, char** argv)
+{
 
-  if (! verifySort(odata, size)) 
+  if (argc < 3 || argc > 6)
   {
+    printf("Usage: %s <problem size> <number of passes> [key type] [payload] [radix width]\n", argv[0]);
+    printf("  key type:    0 = 32-bit unsigned (default), 1 = 64-bit unsigned, 2 = float\n");
+    printf("  payload:     1 = sort 32-bit values along with the keys (default 0)\n");
+    printf("  radix width: 4 (default) or 8 bits per pass\n");
     return -1;
   }
 
-  free(idata);
-  free(isums);
-  free(odata);
-  return 0;
+  int select = atoi(argv[1]);
+  int passes = atoi(argv[2]);
+  int key_type = (argc > 3) ? atoi(argv[3]) : KEY_U32;
+  bool payload = (argc > 4) ? atoi(argv[4]) != 0 : false;
+  int radix_width = (argc > 5) ? atoi(argv[5]) : 4;
+
+  if (radix_width != 4 && radix_width != 8)
+  {
+    printf("Radix width must be 4 or 8\n");
+    return -1;
+  }
+
+  // Problem Sizes
+  int probSizes[4] = { 1, 8, 32, 64 };
+  size_t size = probSizes[select];
+
+  // Convert to MiB
+  size_t key_size = (key_type == KEY_U64) ? sizeof(unsigned long long) : sizeof(unsigned int);
+  size = (size * 1024 * 1024) / key_size;
+
+  bool ok;
+  if (key_type == KEY_U64)
+    ok = payload ? run<unsigned long long, true>(size, passes, radix_width, false)
+                 : run<unsigned long long, false>(size, passes, radix_width, false);
+  else
+    ok = payload ? run<unsigned int, true>(size, passes, radix_width, key_type == KEY_F32)
+                 : run<unsigned int, false>(size, passes, radix_width, key_type == KEY_F32);
+
+  return ok ? 0 : -1;
 }
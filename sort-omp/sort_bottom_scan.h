@@ -3,117 +3,75 @@ int group = omp_get_team_num();
 int local_range = omp_get_num_threads();
 int lid = omp_get_thread_num();
 
-// Use local memory to cache the scanned seeds
-
-// Keep a shared histogram of all instances seen by the current block
-
-// Keep a private histogram as well
-int histogram[16];
-
-// Prepare for reading 4-element vectors
-// Assume: divisible by 4
-
-int n4 = size / 4; //vector type is 4 wide
-
-int region_size = n4 / group_range;
-int block_start = group * region_size;
-// Give the last block any extra elements
-int block_stop  = (group == group_range - 1) ?  n4 : block_start + region_size;
-
-// Calculate starting index for this thread/work item
-int i = block_start + lid;
-int window = block_start;
-
-// Set the histogram in local memory to zero
-// and read in the scanned seeds from gmem
-if (lid < 16)
+// Same regions as in the reduction
+size_t region_size = (size + group_range - 1) / group_range;
+size_t block_start = group * region_size;
+size_t block_stop  = (block_start + region_size < size) ? block_start + region_size : size;
+
+// Use local memory to cache the scanned seeds, and keep
+// a shared histogram of all instances seen by the current block
+for (int d = lid; d < num_digits; d += local_range)
 {
-  l_block_counts[lid] = 0;
-  l_scanned_seeds[lid] = isums[(lid*group_range)+group];
+  l_block_counts[d] = 0;
+  l_scanned_seeds[d] = isums[(d * group_range) + group];
 }
 #pragma omp barrier
 
-// Scan multiple elements per thread
-while (window < block_stop)
-{
-  // Reset histogram
-  for (int q = 0; q < 16; q++) histogram[q] = 0;
-  vec4<T> val_4;
-  vec4<T> key_4;
-
-  if (i < block_stop) // Make sure we don't read out of bounds
-  {
-    val_4 = ((vec4<T>*)in)[i];
+// Each window holds items_per_thread consecutive keys per thread, so
+// the order of the keys within a digit is the order of the threads
+const size_t window_size = (size_t)local_range * items_per_thread;
 
-    // Mask the keys to get the appropriate digit
-    key_4.x = (val_4.x >> shift) & 0xFU;
-    key_4.y = (val_4.y >> shift) & 0xFU;
-    key_4.z = (val_4.z >> shift) & 0xFU;
-    key_4.w = (val_4.w >> shift) & 0xFU;
+for (size_t window = block_start; window < block_stop; window += window_size)
+{
+  size_t first = window + (size_t)lid * items_per_thread;
 
-    // Update the histogram
-    histogram[key_4.x]++;
-    histogram[key_4.y]++;
-    histogram[key_4.z]++;
-    histogram[key_4.w]++;
-  }
+  // Count the digits of this thread's keys in its column of l_counts
+  for (int d = 0; d < num_digits; d++)
+    l_counts[d * local_range + lid] = 0;
 
-  // Scan the digit counts in local memory
-  for (int digit = 0; digit < 16; digit++)
+  K key[items_per_thread];
+  unsigned int digit[items_per_thread];
+  for (int k = 0; k < items_per_thread; k++)
   {
-    int idx = lid;
-    lmem[idx] = 0;
-    idx += local_range;
-    lmem[idx] = histogram[digit];
-#pragma omp barrier
-    for (int i = 1; i < local_range; i *= 2)
+    if (first + k < block_stop) // Make sure we don't read out of bounds
     {
-      T t = lmem[idx -  i]; 
-#pragma omp barrier
-      lmem[idx] += t;     
-#pragma omp barrier
+      key[k] = in[first + k];
+      digit[k] = (unsigned int)((key[k] >> shift) & digit_mask);
+      l_counts[digit[k] * local_range + lid]++;
     }
-    histogram[digit] = lmem[idx-1];
-
-    //histogram[digit] = scanLocalMem(histogram[digit], lmem, 1);
-#pragma omp barrier
   }
+#pragma omp barrier
 
-  if (i < block_stop) // Make sure we don't write out of bounds
+  // Exclusive scan of each digit's row over the threads
+  for (int d = lid; d < num_digits; d += local_range)
   {
-    int address;
-    address = histogram[key_4.x] + l_scanned_seeds[key_4.x] + l_block_counts[key_4.x];
-    out[address] = val_4.x;
-    histogram[key_4.x]++;
-
-    address = histogram[key_4.y] + l_scanned_seeds[key_4.y] + l_block_counts[key_4.y];
-    out[address] = val_4.y;
-    histogram[key_4.y]++;
-
-    address = histogram[key_4.z] + l_scanned_seeds[key_4.z] + l_block_counts[key_4.z];
-    out[address] = val_4.z;
-    histogram[key_4.z]++;
-
-    address = histogram[key_4.w] + l_scanned_seeds[key_4.w] + l_block_counts[key_4.w];
-    out[address] = val_4.w;
-    histogram[key_4.w]++;
+    unsigned short seed = 0;
+    for (int t = 0; t < local_range; t++)
+    {
+      unsigned short c = l_counts[d * local_range + t];
+      l_counts[d * local_range + t] = seed;
+      seed += c;
+    }
+    l_totals[d] = seed;
   }
-
-  // Before proceeding, make sure everyone has finished their current
-  // indexing computations.
 #pragma omp barrier
-  // Now update the seed array.
-  if (lid == local_range-1)
+
+  for (int k = 0; k < items_per_thread; k++)
   {
-    for (int q = 0; q < 16; q++)
+    if (first + k < block_stop) // Make sure we don't write out of bounds
     {
-      l_block_counts[q] += histogram[q];
+      unsigned int d = digit[k];
+      unsigned int address = l_scanned_seeds[d] + l_block_counts[d] + 
+                             l_counts[d * local_range + lid]++;
+      out[address] = key[k];
+      if (KV) vout[address] = vin[first + k];
     }
   }
-#pragma omp barrier
 
-  // Advance window
-  window += local_range;
-  i += local_range;
+  // Before proceeding, make sure everyone has finished their current
+  // indexing computations. Then update the seed array.
+#pragma omp barrier
+  for (int d = lid; d < num_digits; d += local_range)
+    l_block_counts[d] += l_totals[d];
+#pragma omp barrier
 }
-
@@ -1,56 +1,30 @@
-
 int group_range = omp_get_num_teams();
 int group = omp_get_team_num();
 int local_range = omp_get_num_threads();
+int lid = omp_get_thread_num();
 
-int region_size = ((size / 4) / group_range) * 4;
-int block_start = group * region_size;
-
-// Give the last block any extra elements
-int block_stop  = (group == group_range - 1) ?  size : block_start + region_size;
-
-// Calculate starting index for this thread/work item
-int tid = omp_get_thread_num();
-int i = block_start + tid;
+// Each group owns one contiguous region of the input
+size_t region_size = (size + group_range - 1) / group_range;
+size_t block_start = group * region_size;
+size_t block_stop  = (block_start + region_size < size) ? block_start + region_size : size;
 
-// The per thread histogram, initially 0's.
-int digit_counts[16] = { 0, 0, 0, 0, 0, 0, 0, 0,
-  0, 0, 0, 0, 0, 0, 0, 0 };
+// The histogram of this group, initially 0's.
+for (int d = lid; d < num_digits; d += local_range)
+  l_hist[d] = 0;
+#pragma omp barrier
 
 // Reduce multiple elements per thread
-while (i < block_stop) 
+for (size_t i = block_start + lid; i < block_stop; i += local_range)
 {
-
-  // This statement
-  // 1) Loads the value in from global memory
-  // 2) Shifts to the right to have the 4 bits of interest
-  //    in the least significant places
-  // 3) Masks any more significant bits away. This leaves us
-  // with the relevant digit (which is also the index into the
-  // histogram). Next increment the histogram to count this occurrence.
-  digit_counts[(in[i] >> shift) & 0xFU]++;
-  i += local_range;
+  // Shift the digit of interest to the least significant places
+  // and mask any more significant bits away. This leaves us with
+  // the index into the histogram.
+  unsigned int digit = (unsigned int)((in[i] >> shift) & digit_mask);
+#pragma omp atomic update
+  l_hist[digit]++;
 }
-
-for (int d = 0; d < 16; d++)
-{
-  // Load this thread's sum into local/shared memory
-  lmem[tid] = digit_counts[d];
 #pragma omp barrier
 
-  // Reduce the contents of shared/local memory
-  for (unsigned int s = local_range / 2; s > 0; s >>= 1)
-  {
-    if (tid < s)
-    {
-      lmem[tid] += lmem[tid + s];
-    }
-#pragma omp barrier
-  }
-
-  // Write result for this block to global memory
-  if (tid == 0)
-  {
-    isums[(d * group_range) + group] = lmem[0];
-  }
-}
+// Write the counts of this block to global memory, digit-major
+for (int d = lid; d < num_digits; d += local_range)
+  isums[(d * group_range) + group] = l_hist[d];
@@ -1,51 +1,38 @@
-
 int local_range = omp_get_num_threads();
 int lid = omp_get_thread_num();
 
-if (lid == 0) s_seed = 0; 
-#pragma omp barrier
-
-
-// Decide if this is the last thread that needs to
-// propagate the seed value
-int last_thread = (lid < num_work_groups &&
-    (lid+1) == num_work_groups) ? 1 : 0;
-
-for (int d = 0; d < 16; d++)
+// Total count of each digit over all blocks
+for (int d = lid; d < num_digits; d += local_range)
 {
-  T val = 0;
-  // Load each block's count for digit d
-  if (lid < num_work_groups)
-  {
-    val = isums[(num_work_groups * d) + lid];
-  }
-  // Exclusive scan the counts in local memory
-  //FPTYPE res = scanLocalMem(val, lmem, 1);
-  int idx = lid;
-  lmem[idx] = 0;
-  idx += local_range;
-  lmem[idx] = val;
-#pragma omp barrier
-  for (int i = 1; i < local_range; i *= 2)
-  {
-    T t = lmem[idx -  i]; 
-#pragma omp barrier
-    lmem[idx] += t;     
+  unsigned int sum = 0;
+  for (size_t g = 0; g < num_work_groups; g++)
+    sum += isums[(num_work_groups * d) + g];
+  l_totals[d] = sum;
+}
 #pragma omp barrier
-  }
-  T res = lmem[idx-1];
 
-  // Write scanned value out to global
-  if (lid < num_work_groups)
+// Exclusive scan of the digit totals (at most 256 of them)
+if (lid == 0)
+{
+  unsigned int seed = 0;
+  for (int d = 0; d < num_digits; d++)
   {
-    isums[(num_work_groups * d) + lid] = res + s_seed;
+    unsigned int t = l_totals[d];
+    l_totals[d] = seed;
+    seed += t;
   }
+}
 #pragma omp barrier
 
-  if (last_thread)
+// Exclusive scan of the block counts of each digit, seeded with
+// the number of keys that have a smaller digit
+for (int d = lid; d < num_digits; d += local_range)
+{
+  unsigned int seed = l_totals[d];
+  for (size_t g = 0; g < num_work_groups; g++)
   {
-    s_seed += res + val;
+    unsigned int val = isums[(num_work_groups * d) + g];
+    isums[(num_work_groups * d) + g] = seed;
+    seed += val;
   }
-#pragma omp barrier
 }
-
@@ -0,0 +1,122 @@
+/*
+ * Copyright (c) 2016 University of Cordoba and University of Illinois
+ * All rights reserved.
+ *
+ * Developed by:    IMPACT Research Group
+ *                  University of Cordoba and University of Illinois
+ *                  http://impact.crhc.illinois.edu/
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * with the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *      > Redistributions of source code must retain the above copyright notice,
+ *        this list of conditions and the following disclaimers.
+ *      > Redistributions in binary form must reproduce the above copyright
+ *        notice, this list of conditions and the following disclaimers in the
+ *        documentation and/or other materials provided with the distribution.
+ *      > Neither the names of IMPACT Research Group, University of Cordoba, 
+ *        University of Illinois nor the names of its contributors may be used 
+ *        to endorse or promote products derived from this Software without 
+ *        specific prior written permission.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS WITH
+ * THE SOFTWARE.
+ *
+ */
+
+#include "kernel.h"
+#include <omp.h>
+#include <vector>
+#include <algorithm>
+
+bool atomic_minimum(std::atomic_int *minimum_value, int value) {
+    int prev_value = (minimum_value)->load();
+    while(value < prev_value)
+        if((minimum_value)->compare_exchange_weak(prev_value, value))
+            return true;
+    return false;
+}
+
+// Bucket queues of one thread. bins[b] holds the nodes this thread has
+// reached with a cost in [b * delta, (b + 1) * delta). While a bucket is
+// processed, the thread's part of it is moved to frontier, which the owner
+// and any idle thread consume in chunks through head.
+struct Bucket_queue {
+    std::vector<std::vector<int> > bins;
+    std::vector<int>               frontier;
+    std::atomic_int                head;
+    char                           pad[64]; // keep head of neighbouring threads apart
+};
+
+// Delta-stepping with per-thread bucket queues and work stealing -------------
+void run_delta_stepping(const Node *h_graph_nodes, const Edge *h_graph_edges, std::atomic_int *cost,
+    int source, int delta, int n_threads) {
+
+    std::vector<Bucket_queue> queues(n_threads);
+    std::vector<int>          next_bin(n_threads);
+    queues[0].bins.resize(1);
+    queues[0].bins[0].push_back(source);
+
+#pragma omp parallel num_threads(n_threads)
+    {
+        const int     tid = omp_get_thread_num();
+        Bucket_queue &own = queues[tid];
+        int           bin = 0;
+
+        while(bin != INF) {
+            own.frontier.clear();
+            if(bin < (int)own.bins.size())
+                own.frontier.swap(own.bins[bin]);
+            own.head.store(0);
+#pragma omp barrier
+
+            // Drain the own frontier first, then steal from the other threads
+            for(int k = 0; k < n_threads; k++) {
+                Bucket_queue &victim = queues[(tid + k) % n_threads];
+                const int     size   = (int)victim.frontier.size();
+                int           base;
+                while((base = victim.head.fetch_add(STEAL_CHUNK)) < size) {
+                    const int end = std::min(base + STEAL_CHUNK, size);
+                    for(int b = base; b < end; b++) {
+                        const int pid      = victim.frontier[b];
+                        const int cur_cost = cost[pid].load();
+                        if(cur_cost / delta != bin)
+                            continue; // settled in an earlier bucket
+                        //For each outgoing edge
+                        for(int i = h_graph_nodes[pid].x; i < (h_graph_nodes[pid].y + h_graph_nodes[pid].x); i++) {
+                            int id         = h_graph_edges[i].x;
+                            int cost_local = cur_cost + h_graph_edges[i].y;
+                            if(atomic_minimum(&cost[id], cost_local)) {
+                                const int b_new = cost_local / delta;
+                                if(b_new >= (int)own.bins.size())
+                                    own.bins.resize(b_new + 1);
+                                own.bins[b_new].push_back(id);
+                            }
+                        }
+                    }
+                }
+            }
+
+            // Next bucket: the smallest non-empty one over all threads. Light
+            // edges may have refilled the current one.
+            int local_bin = INF;
+            for(int b = bin; b < (int)own.bins.size(); b++)
+                if(!own.bins[b].empty()) {
+                    local_bin = b;
+                    break;
+                }
+            next_bin[tid] = local_bin;
+#pragma omp barrier
+            bin = *std::min_element(next_bin.begin(), next_bin.end());
+        }
+    }
+}
@@ -0,0 +1,223 @@
+/*
+ * Copyright (c) 2016 University of Cordoba and University of Illinois
+ * All rights reserved.
+ *
+ * Developed by:    IMPACT Research Group
+ *                  University of Cordoba and University of Illinois
+ *                  http://impact.crhc.illinois.edu/
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *      > Redistributions of source code must retain the above copyright notice,
+ *        this list of conditions and the following disclaimers.
+ *      > Redistributions in binary form must reproduce the above copyright
+ *        notice, this list of conditions and the following disclaimers in the
+ *        documentation and/or other materials provided with the distribution.
+ *      > Neither the names of IMPACT Research Group, University of Cordoba,
+ *        University of Illinois nor the names of its contributors may be used
+ *        to endorse or promote products derived from this Software without
+ *        specific prior written permission.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS WITH
+ * THE SOFTWARE.
+ *
+ */
+
+#include <unistd.h>
+#include <assert.h>
+#include <algorithm>
+#include <omp.h>
+#include "kernel.h"
+#include "support/common.h"
+#include "support/timer.h"
+#include "support/verify.h"
+
+
+// Params ---------------------------------------------------------------------
+struct Params {
+
+  int         n_threads;
+  int         n_warmup;
+  int         n_reps;
+  const char *file_name;
+  const char *comparison_file;
+  int         delta;
+
+  Params(int argc, char **argv) {
+    n_threads       = omp_get_max_threads();
+    n_warmup        = 1;
+    n_reps          = 1;
+    file_name       = "input/NYR_input.dat";
+    comparison_file = "output/NYR_bfs.out";
+    delta           = 0;
+    int opt;
+    while((opt = getopt(argc, argv, "ht:w:r:f:c:d:")) >= 0) {
+      switch(opt) {
+        case 'h':
+          usage();
+          exit(0);
+          break;
+        case 't': n_threads       = atoi(optarg); break;
+        case 'w': n_warmup        = atoi(optarg); break;
+        case 'r': n_reps          = atoi(optarg); break;
+        case 'f': file_name       = optarg; break;
+        case 'c': comparison_file = optarg; break;
+        case 'd': delta           = atoi(optarg); break;
+        default:
+            fprintf(stderr, "\nUnrecognized option!\n");
+            usage();
+            exit(0);
+      }
+    }
+    assert(n_threads > 0 && "Invalid # of host threads!");
+    assert(n_reps > 0 && "Invalid # of repetitions!");
+    assert(delta >= 0 && "Invalid bucket width!");
+  }
+
+  void usage() {
+    fprintf(stderr,
+        "\nUsage:  ./sssp [options]"
+        "\n"
+        "\nGeneral options:"
+        "\n    -h        help"
+        "\n    -t <T>    maximum # of host threads; runs 1, 2, 4, ..., T (default=all)"
+        "\n    -w <W>    # of untimed warmup iterations (default=1)"
+        "\n    -r <R>    # of timed repetition iterations (default=1)"
+        "\n"
+        "\nBenchmark-specific options:"
+        "\n    -f <F>    name of input file with control points (default=input/NYR_input.dat)"
+        "\n    -c <C>    comparison file (default=output/NYR_bfs_BFS.out)"
+        "\n    -d <D>    delta-stepping bucket width (default=average edge cost)"
+        "\n");
+  }
+};
+
+// Input Data -----------------------------------------------------------------
+void read_input_size(int &n_nodes, int &n_edges, const Params &p) {
+  FILE *fp = fopen(p.file_name, "r");
+  if(!fp) {
+    printf("Error Reading graph file\n");
+    exit(EXIT_FAILURE);
+  }
+  fscanf(fp, "%d", &n_nodes);
+  fscanf(fp, "%d", &n_edges);
+  fclose(fp);
+}
+
+void read_input(int &source, Node *&h_nodes, Edge *&h_edges, const Params &p) {
+
+  int   start, edgeno;
+  int   n_nodes, n_edges;
+  int   id, cost;
+  FILE *fp = fopen(p.file_name, "r");
+
+  fscanf(fp, "%d", &n_nodes);
+  fscanf(fp, "%d", &n_edges);
+  fscanf(fp, "%d", &source);
+  printf("Number of nodes = %d\t", n_nodes);
+  printf("Number of edges = %d\t", n_edges);
+
+  // initalize the memory: Nodes
+  for(int i = 0; i < n_nodes; i++) {
+    fscanf(fp, "%d %d", &start, &edgeno);
+    h_nodes[i].x = start;
+    h_nodes[i].y = edgeno;
+  }
+#if PRINT_ALL
+  for(int i = 0; i < n_nodes; i++) {
+    printf("%d, %d\n", h_nodes[i].x, h_nodes[i].y);
+  }
+#endif
+
+  // initalize the memory: Edges
+  for(int i = 0; i < n_edges; i++) {
+    fscanf(fp, "%d", &id);
+    fscanf(fp, "%d", &cost);
+    h_edges[i].x = id;
+    h_edges[i].y = cost;
+  }
+  fclose(fp);
+}
+
+// Main ------------------------------------------------------------------------------------------
+int main(int argc, char **argv) {
+
+  const Params p(argc, argv);
+  Timer        timer;
+
+  // Allocate
+  int n_nodes, n_edges;
+  read_input_size(n_nodes, n_edges, p);
+  timer.start("Allocation");
+  Node *           h_nodes = (Node *)malloc(sizeof(Node) * n_nodes);
+  Edge *           h_edges = (Edge *)malloc(sizeof(Edge) * n_edges);
+  std::atomic_int *h_cost  = (std::atomic_int *)malloc(sizeof(std::atomic_int) * n_nodes);
+  timer.stop("Allocation");
+
+  // Initialize
+  timer.start("Initialization");
+  int source;
+  read_input(source, h_nodes, h_edges, p);
+  long long total_cost = 0;
+  for(int i = 0; i < n_edges; i++)
+    total_cost += h_edges[i].y;
+  const int delta = p.delta > 0 ? p.delta : std::max(1LL, n_edges > 0 ? total_cost / n_edges : 1);
+  printf("Bucket width = %d\n", delta);
+  timer.stop("Initialization");
+  timer.print("Initialization", 1);
+
+  // Strong scaling over 1, 2, 4, ..., n_threads threads
+  for(int n_threads = 1;; n_threads = std::min(2 * n_threads, p.n_threads)) {
+    const string name = "Kernel (" + std::to_string(n_threads) + " threads)";
+    for(int rep = 0; rep < p.n_reps + p.n_warmup; rep++) {
+      // Reset
+      for(int i = 0; i < n_nodes; i++) {
+        h_cost[i].store(INF);
+      }
+      h_cost[source].store(0);
+
+      if(rep >= p.n_warmup)
+        timer.start(name);
+      run_delta_stepping(h_nodes, h_edges, h_cost, source, delta, n_threads);
+      if(rep >= p.n_warmup)
+        timer.stop(name);
+    }
+    timer.print(name, p.n_reps);
+
+    // Verify answer
+    verify(h_cost, n_nodes, p.comparison_file);
+
+    // Edges leaving the nodes reached from the source
+    long long n_traversed = 0;
+    for(int i = 0; i < n_nodes; i++)
+      if(h_cost[i].load() != INF)
+        n_traversed += h_nodes[i].y;
+    printf("%d threads: %.3f million edges/s\n", n_threads,
+        n_traversed / (timer.time[name] / p.n_reps) * 1e-3);
+
+    if(n_threads == p.n_threads)
+      break;
+  }
+  timer.print("Allocation", 1);
+
+  // Free memory
+  timer.start("Deallocation");
+  free(h_nodes);
+  free(h_edges);
+  free(h_cost);
+  timer.stop("Deallocation");
+  timer.print("Deallocation", 1);
+
+  printf("Test Passed\n");
+  return 0;
+}
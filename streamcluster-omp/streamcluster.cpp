@@ -881,7 +881,7 @@ int main(int argc, char **argv)
 #endif
 
   if (argc<9) {
-    fprintf(stderr,"usage: %s k1 k2 d n chunksize clustersize infile outfile nproc\n",
+    fprintf(stderr,"usage: %s k1 k2 d n chunksize clustersize infile outfile nproc [prefetch]\n",
         argv[0]);
     fprintf(stderr,"  k1:          Min. number of centers allowed\n");
     fprintf(stderr,"  k2:          Max. number of centers allowed\n");
@@ -892,8 +892,11 @@ int main(int argc, char **argv)
     fprintf(stderr,"  infile:      Input file (if n<=0)\n");
     fprintf(stderr,"  outfile:     Output file\n");
     fprintf(stderr,"  nproc:       Number of threads to use\n");
+    fprintf(stderr,"  prefetch:    Read the next chunk of infile in the background (default 1)\n");
     fprintf(stderr,"\n");
     fprintf(stderr, "if n > 0, points will be randomly generated instead of reading from infile.\n");
+    fprintf(stderr, "infile holds d floats per point, optionally after a 16-byte header\n");
+    fprintf(stderr, "(\"%s\", the dimension as an int, 4 bytes of padding); it is memory-mapped.\n", POINTS_MAGIC);
     exit(1);
   }
   kmin = atoi(argv[1]);
@@ -907,13 +910,29 @@ int main(int argc, char **argv)
   nproc = atoi(argv[9]);
 
 
+  // reading of the next chunk overlaps with clustering unless prefetch is 0
+  int prefetch = (argc > 10) ? atoi(argv[10]) : 1;
+
   srand48(SEED);
   PStream* stream;
+  PrefetchStream* prefetcher = NULL;
   if( n > 0 ) {
+    // the generator shares lrand48 with the clustering, so it is not prefetched
     stream = new SimStream(n);
   }
   else {
-    stream = new FileStream(infilename);
+    MappedStream* mapped = new MappedStream(infilename, dim);
+    if( mapped->mapped() ) {
+      stream = mapped;
+    }
+    else {
+      delete mapped;
+      stream = new FileStream(infilename);
+    }
+    if( prefetch ) {
+      prefetcher = new PrefetchStream(stream, dim, chunksize);
+      stream = prefetcher;
+    }
   }
 #ifdef PROFILE_TMP
   double t1 = gettime();
@@ -934,6 +953,8 @@ int main(int argc, char **argv)
   streamCluster(stream, kmin, kmax, dim, chunksize, clustersize, outfilename );
   double sc_end = gettime();
   printf("Streamcluster time = %lf (s)\n", sc_end-sc_start);
+  if( prefetcher != NULL ) 
+    printf("Time waiting for input = %lf (s)\n", prefetcher->waitTime());
 
 #ifdef ENABLE_PARSEC_HOOKS
   __parsec_roi_end();
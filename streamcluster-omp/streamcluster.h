@@ -32,6 +32,11 @@
 #include <math.h>
 #include <sys/resource.h>
 #include <limits.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 
 #ifdef ENABLE_PARSEC_HOOKS
@@ -130,6 +135,184 @@ private:
   FILE* fp;
 };
 
+/* memory-mapped point file */
+/* the file holds dim*n floats, optionally preceded by a 16-byte header: */
+/* the magic "SCPOINTS", the dimension as an int, and 4 bytes of padding */
+#define POINTS_MAGIC "SCPOINTS"
+#define POINTS_HEADER 16
+
+class MappedStream : public PStream {
+public:
+  MappedStream(char* filename, int dim) {
+    base = (char*)MAP_FAILED;
+    size = pos = 0;
+    int fd = open(filename, O_RDONLY);
+    if( fd < 0 ) {
+      fprintf(stderr,"error opening file %s\n.",filename);
+      exit(1);
+    }
+    struct stat st;
+    if( fstat(fd, &st) == 0 && st.st_size > 0 ) {
+      size = st.st_size;
+      base = (char*)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if( base == (char*)MAP_FAILED ) {
+      size = 0;
+      return;
+    }
+    madvise(base, size, MADV_SEQUENTIAL);
+    if( size >= POINTS_HEADER && memcmp(base, POINTS_MAGIC, 8) == 0 ) {
+      int file_dim;
+      memcpy(&file_dim, base + 8, sizeof(int));
+      if( file_dim != dim ) {
+        fprintf(stderr,"file %s holds %d-dimensional points, expected %d\n", filename, file_dim, dim);
+        exit(1);
+      }
+      pos = POINTS_HEADER;
+    }
+  }
+  // false if the file could not be mapped (e.g. it is empty or a pipe)
+  bool mapped() {
+    return base != (char*)MAP_FAILED;
+  }
+  size_t read( float* dest, int dim, int num ) {
+    size_t point = sizeof(float)*dim;
+    size_t count = (size - pos) / point;
+    if( count > (size_t)num ) count = num;
+    memcpy(dest, base + pos, count*point);
+    pos += count*point;
+    // start paging in the next chunk while this one is clustered
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t next = pos & ~(page - 1);
+    size_t ahead = (size_t)num*point + (pos - next);
+    if( next < size ) {
+      if( next + ahead > size ) ahead = size - next;
+      madvise(base + next, ahead, MADV_WILLNEED);
+    }
+    return count;
+  }
+  int ferror() {
+    return 0;
+  }
+  int feof() {
+    return pos >= size;
+  }
+  ~MappedStream() {
+    if( mapped() ) munmap(base, size);
+  }
+private:
+  char* base;
+  size_t size;
+  size_t pos;
+};
+
+/* reads the next chunk of another stream on a background thread */
+/* while the caller works on the current one */
+class PrefetchStream : public PStream {
+public:
+  PrefetchStream(PStream* stream_, int dim_, int num_) {
+    stream = stream_;
+    dim = dim_;
+    num = num_;
+    buffer = (float*)malloc((size_t)dim*num*sizeof(float));
+    pending = done = quit = false;
+    count = 0;
+    error = eof = 0;
+    chunk_error = chunk_eof = 0;
+    wait_time = 0.0;
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&cond, NULL);
+    pthread_create(&thread, NULL, worker, this);
+    request();
+  }
+  size_t read( float* dest, int dim_, int num_ ) {
+    if( dim_ != dim || num_ > num ) {
+      fprintf(stderr,"prefetch stream was set up for %d points of dimension %d\n", num, dim);
+      exit(1);
+    }
+    struct timeval t1, t2;
+    gettimeofday(&t1, NULL);
+    pthread_mutex_lock(&mutex);
+    while( !done ) pthread_cond_wait(&cond, &mutex);
+    // state of the chunk handed out, the worker overwrites eof/error
+    // as soon as the next chunk is requested
+    size_t n = count;
+    chunk_error = error;
+    chunk_eof = eof;
+    pthread_mutex_unlock(&mutex);
+    gettimeofday(&t2, NULL);
+    wait_time += (t2.tv_sec - t1.tv_sec) + (t2.tv_usec - t1.tv_usec)*1e-6;
+
+    memcpy(dest, buffer, n*dim*sizeof(float));
+    if( !chunk_error && !chunk_eof ) request();
+    return n;
+  }
+  int ferror() {
+    return chunk_error;
+  }
+  int feof() {
+    return chunk_eof;
+  }
+  // time the consumer was blocked on I/O
+  double waitTime() {
+    return wait_time;
+  }
+  ~PrefetchStream() {
+    pthread_mutex_lock(&mutex);
+    while( pending && !done ) pthread_cond_wait(&cond, &mutex);
+    quit = true;
+    pthread_cond_broadcast(&cond);
+    pthread_mutex_unlock(&mutex);
+    pthread_join(thread, NULL);
+    pthread_cond_destroy(&cond);
+    pthread_mutex_destroy(&mutex);
+    free(buffer);
+    delete stream;
+  }
+private:
+  void request() {
+    pthread_mutex_lock(&mutex);
+    pending = true;
+    done = false;
+    pthread_cond_broadcast(&cond);
+    pthread_mutex_unlock(&mutex);
+  }
+  static void* worker(void* arg) {
+    PrefetchStream* s = (PrefetchStream*)arg;
+    pthread_mutex_lock(&s->mutex);
+    while( 1 ) {
+      while( !s->pending && !s->quit ) pthread_cond_wait(&s->cond, &s->mutex);
+      if( s->quit ) break;
+      pthread_mutex_unlock(&s->mutex);
+      size_t n = s->stream->read(s->buffer, s->dim, s->num);
+      int error = s->stream->ferror();
+      int eof = s->stream->feof();
+      pthread_mutex_lock(&s->mutex);
+      s->count = n;
+      s->error = error;
+      s->eof = eof;
+      s->pending = false;
+      s->done = true;
+      pthread_cond_broadcast(&s->cond);
+    }
+    pthread_mutex_unlock(&s->mutex);
+    return NULL;
+  }
+  PStream* stream;
+  int dim;
+  int num;
+  float* buffer;
+  bool pending, done, quit;
+  size_t count;
+  int error, eof;
+  int chunk_error, chunk_eof;
+  double wait_time;
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+};
+
 /* function prototypes */
 double gettime();
 int isIdentical(float*, float*, int);